@@ -0,0 +1,483 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+#include "CQueue.h"
+#include "ClientManager.h"
+#include "Command.h"
+#include "Packet.h"
+
+// Microbenchmarks for the server's hot-path primitives.
+//
+//   bench [--filter TEXT] [--min-time-ms N] [--repeat N] [--out FILE]
+//         [--baseline FILE] [--threshold PCT]
+//
+// Every benchmark is calibrated to run for at least --min-time-ms, then measured --repeat
+// times; the median and the fastest repeat are reported. --out writes the results as JSON (the
+// same format --baseline reads). With --baseline, each benchmark present in both is compared on
+// its fastest repeat, which other load on the machine disturbs least, and the run exits 1 when
+// any is slower than the baseline by more than --threshold percent.
+// Baselines are only comparable on the machine and build they were recorded with:
+// regenerate bench/baseline.json (bench --out bench/baseline.json) when either changes.
+
+struct Options {
+    std::string filter;
+    uint64_t minTimeMs = 200;
+    int repeat = 5;
+    std::string out;
+    std::string baseline;
+    double threshold = 10;      // Percent slower than the baseline that counts as a regression
+};
+
+struct Benchmark {
+    std::string name;
+    std::function<void(uint64_t iterations)> run;
+};
+
+struct Result {
+    std::string name;
+    double nsPerOp = 0;         // Median of the repeats
+    double minNsPerOp = 0;      // Fastest repeat, used for the baseline comparison
+    uint64_t iterations = 0;    // Per repeat
+};
+
+// Keeps the compiler from discarding a value that is otherwise unused
+template <typename T>
+static void keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Swallows the per-call logging of the code under test
+class CNullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+class CQuiet {
+public:
+    CQuiet() : m_out(std::cout.rdbuf(&m_null)), m_err(std::cerr.rdbuf(&m_null)) {}
+    ~CQuiet() {
+        std::cout.rdbuf(m_out);
+        std::cerr.rdbuf(m_err);
+    }
+private:
+    CNullBuffer m_null;
+    std::streambuf* m_out;
+    std::streambuf* m_err;
+};
+
+static uint64_t nowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static uint64_t timeRun(const Benchmark& benchmark, uint64_t iterations) {
+    uint64_t start = nowNs();
+    benchmark.run(iterations);
+    return nowNs() - start;
+}
+
+static Result measure(const Benchmark& benchmark, const Options& options) {
+    // Grow the iteration count until one run takes a tenth of the target, then scale up
+    uint64_t target = options.minTimeMs * 1000000;
+    uint64_t iterations = 1;
+    uint64_t elapsed = timeRun(benchmark, iterations);
+    while (elapsed < target / 10 && iterations < (1ULL << 40)) {
+        uint64_t factor = elapsed > 0 ? std::min<uint64_t>(100, std::max<uint64_t>(2, target / 10 / elapsed)) : 100;
+        iterations *= factor;
+        elapsed = timeRun(benchmark, iterations);
+    }
+    if (elapsed < target) {
+        iterations = std::max<uint64_t>(1, static_cast<uint64_t>(static_cast<double>(iterations) * target / std::max<uint64_t>(elapsed, 1)));
+    }
+
+    std::vector<double> samples;
+    for (int i = 0; i < options.repeat; i++) {
+        samples.push_back(static_cast<double>(timeRun(benchmark, iterations)) / iterations);
+    }
+    std::sort(samples.begin(), samples.end());
+    Result result;
+    result.name = benchmark.name;
+    result.nsPerOp = samples[samples.size() / 2];
+    result.minNsPerOp = samples.front();
+    result.iterations = iterations;
+    return result;
+}
+
+// ---- CPacket ----
+
+static const size_t PAYLOAD_SIZES[] = { 16, 256, 4096, 65536 };
+
+static std::string payload(size_t size) {
+    std::string data(size, '\0');
+    std::mt19937 random(static_cast<uint32_t>(size));
+    for (auto& byte : data) {
+        byte = static_cast<char>(random());
+    }
+    return data;
+}
+
+static void addPacketBenchmarks(std::vector<Benchmark>& benchmarks) {
+    for (size_t size : PAYLOAD_SIZES) {
+        auto data = std::make_shared<std::string>(payload(size));
+        std::string suffix = "/" + std::to_string(size);
+
+        benchmarks.push_back({ "packet/construct" + suffix, [data](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; i++) {
+                CPacket packet(1, reinterpret_cast<const uint8_t*>(data->data()), data->size());
+                keep(packet);
+            }
+        } });
+
+        auto wire = std::make_shared<std::string>(CPacket(1, reinterpret_cast<const uint8_t*>(data->data()), data->size()).Serialize());
+        benchmarks.push_back({ "packet/parse" + suffix, [wire](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; i++) {
+                size_t consumed = wire->size();
+                CPacket packet(reinterpret_cast<const uint8_t*>(wire->data()), consumed);
+                keep(consumed);
+            }
+        } });
+
+        auto packet = std::make_shared<CPacket>(1, reinterpret_cast<const uint8_t*>(data->data()), data->size());
+        benchmarks.push_back({ "packet/data" + suffix, [packet](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; i++) {
+                const char* bytes = packet->Data();
+                keep(bytes);
+            }
+        } });
+
+        benchmarks.push_back({ "packet/checksum" + suffix, [data](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; i++) {
+                keep(data);
+                uint16_t sum = CPacket::checksum(reinterpret_cast<const uint8_t*>(data->data()), data->size());
+                keep(sum);
+            }
+        } });
+    }
+}
+
+// ---- CQueue<CPacket> ----
+
+// producers threads push iterations items in total, one consumer takes them with pop() or popBatch()
+static void runQueue(uint64_t iterations, int producers, size_t batch) {
+    static const std::string data(64, 'q');
+    CPacket packet(1, reinterpret_cast<const uint8_t*>(data.data()), data.size());
+    PacketQueue queue;
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        uint64_t count = iterations / producers + (static_cast<uint64_t>(p) < iterations % producers ? 1 : 0);
+        threads.emplace_back([&queue, &packet, count] {
+            for (uint64_t i = 0; i < count; i++) {
+                queue.push(1, packet);
+            }
+        });
+    }
+    uint64_t received = 0;
+    PacketQueueItem item;
+    while (received < iterations) {
+        if (batch > 1) {
+            std::vector<PacketQueueItem> items = queue.popBatch(batch);
+            received += items.size();
+            if (items.empty()) {
+                std::this_thread::yield();
+            }
+        }
+        else if (queue.pop(item)) {
+            received++;
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+static void addQueueBenchmarks(std::vector<Benchmark>& benchmarks) {
+    benchmarks.push_back({ "queue/push-pop/single-thread", [](uint64_t iterations) {
+        static const std::string data(64, 'q');
+        CPacket packet(1, reinterpret_cast<const uint8_t*>(data.data()), data.size());
+        PacketQueue queue;
+        PacketQueueItem item;
+        for (uint64_t i = 0; i < iterations; i++) {
+            queue.push(1, packet);
+            queue.pop(item);
+        }
+        keep(item);
+    } });
+    for (int producers : { 1, 2, 4 }) {
+        std::string suffix = "/" + std::to_string(producers) + "p1c";
+        benchmarks.push_back({ "queue/pop" + suffix, [producers](uint64_t iterations) {
+            runQueue(iterations, producers, 1);
+        } });
+        benchmarks.push_back({ "queue/pop-batch-64" + suffix, [producers](uint64_t iterations) {
+            runQueue(iterations, producers, 64);
+        } });
+    }
+}
+
+// ---- ClientManager ----
+
+static void addClientBenchmarks(std::vector<Benchmark>& benchmarks) {
+    for (int clients : { 10, 1000, 100000 }) {
+        // Built once per size; sockets and ids are deliberately not equal
+        auto manager = std::make_shared<ClientManager>();
+        {
+            CQuiet quiet;
+            for (int i = 0; i < clients; i++) {
+                manager->addClient(1000 + i * 3, i + 1, "127.0.0.1", 40000 + i % 20000);
+            }
+        }
+        auto order = std::make_shared<std::vector<int>>(4096);
+        std::mt19937 random(static_cast<uint32_t>(clients));
+        for (auto& index : *order) {
+            index = static_cast<int>(random() % clients);
+        }
+        std::string suffix = "/" + std::to_string(clients);
+
+        benchmarks.push_back({ "clients/by-socket" + suffix, [manager, order](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; i++) {
+                int id = manager->getClientIdBySocket(1000 + (*order)[i & 4095] * 3);
+                keep(id);
+            }
+        } });
+        benchmarks.push_back({ "clients/by-id" + suffix, [manager, order](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; i++) {
+                int socket = manager->getSocketByClientId((*order)[i & 4095] + 1);
+                keep(socket);
+            }
+        } });
+        benchmarks.push_back({ "clients/connected-ids" + suffix, [manager](uint64_t iterations) {
+            for (uint64_t i = 0; i < iterations; i++) {
+                std::vector<int> ids = manager->getConnectedClientIds();
+                keep(ids.data());
+            }
+        } });
+    }
+}
+
+// ---- CCommand::ExecuteCommand ----
+
+// Dispatch through the command table into the handler, including the handler's own logging
+// (sent to a null stream here); there is no server, so nothing is sent or recorded
+static void addDispatchBenchmarks(std::vector<Benchmark>& benchmarks) {
+    auto command = std::make_shared<CCommand>();
+    {
+        CQuiet quiet;
+        command->getClientManager().addClient(1000, 1, "127.0.0.1", 40000);
+    }
+    auto dispatch = [command](uint16_t cmd, const std::string& data) {
+        auto packet = std::make_shared<CPacket>(cmd, reinterpret_cast<const uint8_t*>(data.data()), data.size());
+        return [command, packet, cmd](uint64_t iterations) {
+            CQuiet quiet;
+            std::list<CPacket> lstPacket;
+            PacketQueue packetQueue;
+            for (uint64_t i = 0; i < iterations; i++) {
+                int result = command->ExecuteCommand(cmd, lstPacket, packetQueue, *packet, 1);
+                keep(result);
+                lstPacket.clear();
+                if ((i & 255) == 255) {
+                    packetQueue.clear();
+                }
+            }
+        };
+    };
+    benchmarks.push_back({ "dispatch/text-message", dispatch(static_cast<uint16_t>(CCommand::Type::TEXT_MESSAGE), std::string(64, 'm')) });
+    benchmarks.push_back({ "dispatch/test-connect", dispatch(static_cast<uint16_t>(CCommand::Type::TEST_CONNECT), "probe") });
+    benchmarks.push_back({ "dispatch/unknown", dispatch(999, "x") });
+}
+
+// ---- Output and baseline ----
+
+static std::string jsonString(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out + "\"";
+}
+
+static bool writeJson(const std::string& path, const std::vector<Result>& results, const Options& options) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Error: Cannot write " << path << std::endl;
+        return false;
+    }
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    out << "{\n";
+    out << "  \"context\": {\n";
+    out << "    \"date\": " << jsonString(date) << ",\n";
+    out << "    \"host\": " << jsonString(host) << ",\n";
+    out << "    \"cpus\": " << std::thread::hardware_concurrency() << ",\n";
+    out << "    \"compiler\": " << jsonString(__VERSION__) << ",\n";
+    out << "    \"min_time_ms\": " << options.minTimeMs << ",\n";
+    out << "    \"repeat\": " << options.repeat << "\n";
+    out << "  },\n";
+    out << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& result = results[i];
+        out << "    {\"name\": " << jsonString(result.name)
+            << ", \"ns_per_op\": " << std::fixed << std::setprecision(2) << result.nsPerOp
+            << ", \"min_ns_per_op\": " << result.minNsPerOp
+            << ", \"iterations\": " << result.iterations << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+    return true;
+}
+
+// Reads name -> min_ns_per_op from a file written by writeJson
+static bool readBaseline(const std::string& path, std::map<std::string, double>& baseline) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Error: Cannot read baseline " << path << std::endl;
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    std::string text = buffer.str();
+    size_t position = 0;
+    while ((position = text.find("\"name\": \"", position)) != std::string::npos) {
+        position += 9;
+        size_t end = text.find('"', position);
+        size_t value = text.find("\"min_ns_per_op\": ", end);
+        if (end == std::string::npos || value == std::string::npos) {
+            break;
+        }
+        baseline[text.substr(position, end - position)] = std::strtod(text.c_str() + value + 17, nullptr);
+        position = value;
+    }
+    if (baseline.empty()) {
+        std::cerr << "Error: No benchmarks in baseline " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Prints the comparison, returns the number of regressions
+static int compare(const std::vector<Result>& results, const std::map<std::string, double>& baseline, double threshold) {
+    int regressions = 0;
+    std::cout << std::endl << "=== Against baseline, fastest repeat (threshold " << std::defaultfloat << threshold
+        << "%) ===" << std::endl;
+    for (const auto& result : results) {
+        auto it = baseline.find(result.name);
+        if (it == baseline.end()) {
+            std::cout << std::left << std::setw(36) << result.name << "new" << std::endl;
+            continue;
+        }
+        double change = it->second > 0 ? (result.minNsPerOp - it->second) * 100 / it->second : 0;
+        bool regressed = change > threshold;
+        regressions += regressed ? 1 : 0;
+        std::cout << std::left << std::setw(36) << result.name << std::right << std::fixed << std::setprecision(2)
+            << std::setw(12) << it->second << " -> " << std::setw(12) << result.minNsPerOp << " ns  "
+            << std::showpos << std::setprecision(1) << change << "%" << std::noshowpos
+            << (regressed ? "  REGRESSION" : (change < -threshold ? "  improved" : "")) << std::endl;
+    }
+    std::cout << (regressions > 0 ? std::to_string(regressions) + " regression(s)" : std::string("No regressions")) << std::endl;
+    return regressions;
+}
+
+static void usage(const char* program) {
+    std::cerr << "Usage: " << program << " [--filter TEXT] [--min-time-ms N] [--repeat N] [--out FILE]"
+        << " [--baseline FILE] [--threshold PCT]" << std::endl;
+}
+
+static bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--filter") {
+            options.filter = value;
+        }
+        else if (arg == "--min-time-ms") {
+            options.minTimeMs = std::max<uint64_t>(1, std::strtoull(value.c_str(), nullptr, 10));
+        }
+        else if (arg == "--repeat") {
+            options.repeat = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (arg == "--out") {
+            options.out = value;
+        }
+        else if (arg == "--baseline") {
+            options.baseline = value;
+        }
+        else if (arg == "--threshold") {
+            options.threshold = std::atof(value.c_str());
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+    std::map<std::string, double> baseline;
+    if (!options.baseline.empty() && !readBaseline(options.baseline, baseline)) {
+        return 2;
+    }
+
+    std::vector<Benchmark> benchmarks;
+    addPacketBenchmarks(benchmarks);
+    addQueueBenchmarks(benchmarks);
+    addClientBenchmarks(benchmarks);
+    addDispatchBenchmarks(benchmarks);
+
+    std::vector<Result> results;
+    std::cout << std::left << std::setw(36) << "benchmark" << std::right << std::setw(14) << "ns/op"
+        << std::setw(14) << "min ns/op" << std::setw(14) << "iterations" << std::endl;
+    for (const auto& benchmark : benchmarks) {
+        if (!options.filter.empty() && benchmark.name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+        Result result = measure(benchmark, options);
+        std::cout << std::left << std::setw(36) << result.name << std::right << std::fixed << std::setprecision(2)
+            << std::setw(14) << result.nsPerOp << std::setw(14) << result.minNsPerOp
+            << std::setw(14) << result.iterations << std::endl;
+        results.push_back(result);
+    }
+
+    if (!options.out.empty()) {
+        if (!writeJson(options.out, results, options)) {
+            return 2;
+        }
+        std::cout << "Results written to " << options.out << std::endl;
+    }
+    if (!baseline.empty() && compare(results, baseline, options.threshold) > 0) {
+        return 1;
+    }
+    return 0;
+}
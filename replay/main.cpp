@@ -0,0 +1,732 @@
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "Capture.h"
+#include "Listener.h"
+#include "Packet.h"
+
+#ifdef SERVEQT_WITH_OPENSSL
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#else
+typedef struct ssl_st SSL;
+typedef struct ssl_ctx_st SSL_CTX;
+#endif
+
+// Replays a traffic capture (serveqt --capture FILE) against a local server.
+// Every captured client gets its own connection and its frames are sent in
+// the recorded order; a separate probe connection measures round-trip latency
+// with TEST_CONNECT while the replay is running. Each connection ends with a
+// TEST_CONNECT barrier (at its captured disconnect or at the end of the capture)
+// and the run ends once all of them are answered, so the elapsed time covers
+// the server's processing and not just the kernel accepting the bytes.
+// Around the run the server's own wake-up latency statistics are reset and
+// read back with the admin command "latency" (local targets only).
+// Targets prefixed with "tls:" are reached over TLS (build with SERVEQT_WITH_OPENSSL).
+// With --compare the capture is replayed a second time against another endpoint,
+// e.g. the server's plaintext listener, and the throughput gap is reported.
+
+static const uint16_t TEST_CONNECT = 1981;
+static const uint16_t ADMIN = 14;
+static const int ADMIN_TIMEOUT_MS = 2000;
+static const size_t MAX_CONNECTION_PENDING = 8 * 1024 * 1024;  // Stop reading the capture above this
+static const int BARRIER_TIMEOUT_MS = 30000;  // Give up waiting for the server after this
+
+struct Connection {
+    int fd = -1;
+    SSL* ssl = nullptr;   // TLS targets
+    std::string pending;  // Frames not yet accepted by the kernel
+    size_t sent = 0;      // Bytes of pending already written
+    bool closing = false; // Captured client disconnected, close once the barrier is answered
+    std::string inbound;  // Unparsed responses, scanned for the barrier reply
+    bool barrier = false; // Waiting for the reply to the final TEST_CONNECT
+};
+
+struct ReplayResult {
+    double seconds = 0;
+    double framesPerSecond = 0;
+    double bytesPerSecond = 0;
+};
+
+struct Options {
+    std::string capturePath;
+    ListenEndpoint target;
+    ListenEndpoint compare;
+    bool haveCompare = false;
+    double speed = 1.0;   // 0 = as fast as possible
+    int probeMs = 10;     // Probe interval (0 disables the probe)
+};
+
+static uint64_t nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// send()/recv() over a plain or TLS connection, with the same return values and errno
+static ssize_t sendData(int fd, [[maybe_unused]] SSL* ssl, const char* data, size_t size) {
+#ifdef SERVEQT_WITH_OPENSSL
+    if (ssl) {
+        int count = SSL_write(ssl, data, static_cast<int>(std::min<size_t>(size, 1 << 30)));
+        if (count > 0) {
+            return count;
+        }
+        int error = SSL_get_error(ssl, count);
+        errno = (error == SSL_ERROR_WANT_WRITE || error == SSL_ERROR_WANT_READ) ? EAGAIN : EPIPE;
+        return -1;
+    }
+#endif
+    return send(fd, data, size, MSG_NOSIGNAL);
+}
+
+static ssize_t recvData(int fd, [[maybe_unused]] SSL* ssl, char* buffer, size_t size) {
+#ifdef SERVEQT_WITH_OPENSSL
+    if (ssl) {
+        int count = SSL_read(ssl, buffer, static_cast<int>(size));
+        if (count > 0) {
+            return count;
+        }
+        int error = SSL_get_error(ssl, count);
+        if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+            errno = EAGAIN;
+            return -1;
+        }
+        if (error == SSL_ERROR_ZERO_RETURN || (error == SSL_ERROR_SYSCALL && ERR_peek_error() == 0)) {
+            return 0;
+        }
+        errno = EIO;
+        return -1;
+    }
+#endif
+    return recv(fd, buffer, size, 0);
+}
+
+static void closeTarget(int fd, [[maybe_unused]] SSL* ssl) {
+#ifdef SERVEQT_WITH_OPENSSL
+    SSL_free(ssl);
+#endif
+    close(fd);
+}
+
+// Client TLS context for "tls:" targets; the server certificate is not verified (benchmark use)
+static SSL_CTX* createTlsContext() {
+#ifdef SERVEQT_WITH_OPENSSL
+    SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+    if (ctx) {
+        SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+    }
+    return ctx;
+#else
+    std::cerr << "TLS targets need a build with SERVEQT_WITH_OPENSSL" << std::endl;
+    return nullptr;
+#endif
+}
+
+static int connectTarget(const ListenEndpoint& target, [[maybe_unused]] SSL_CTX* tls, SSL** ssl) {
+    int fd = -1;
+    int result = -1;
+    if (target.family == ListenEndpoint::UNIX) {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, target.address.c_str(), sizeof(address.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd != -1) {
+            result = connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+        }
+    }
+    else if (target.family == ListenEndpoint::IPV6) {
+        struct sockaddr_in6 address;
+        memset(&address, 0, sizeof(address));
+        address.sin6_family = AF_INET6;
+        address.sin6_port = htons(target.port);
+        inet_pton(AF_INET6, target.address.c_str(), &address.sin6_addr);
+        fd = socket(AF_INET6, SOCK_STREAM, 0);
+        if (fd != -1) {
+            result = connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+        }
+    }
+    else {
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(target.port);
+        inet_pton(AF_INET, target.address.c_str(), &address.sin_addr);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd != -1) {
+            result = connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+        }
+    }
+    if (result == -1) {
+        std::cerr << "Failed to connect to " << target.toString() << ": " << strerror(errno) << std::endl;
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+    if (target.family != ListenEndpoint::UNIX) {
+        int flag = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    }
+    *ssl = nullptr;
+    if (target.tls) {
+        // Blocking handshake, then the connection is used non-blocking like a plain one
+#ifdef SERVEQT_WITH_OPENSSL
+        *ssl = tls ? SSL_new(tls) : nullptr;
+        if (!*ssl || SSL_set_fd(*ssl, fd) != 1 || SSL_connect(*ssl) != 1) {
+            std::cerr << "TLS handshake with " << target.toString() << " failed" << std::endl;
+            SSL_free(*ssl);
+            *ssl = nullptr;
+            close(fd);
+            return -1;
+        }
+#else
+        close(fd);
+        return -1;
+#endif
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+// Write as much pending data as the socket accepts; false if the connection failed
+static bool flushConnection(Connection& connection) {
+    while (connection.sent < connection.pending.size()) {
+        ssize_t written = sendData(connection.fd, connection.ssl, connection.pending.data() + connection.sent,
+            connection.pending.size() - connection.sent);
+        if (written > 0) {
+            connection.sent += written;
+            continue;
+        }
+        if (written == -1 && errno == EINTR) {
+            continue;
+        }
+        return written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+    connection.pending.clear();
+    connection.sent = 0;
+    return true;
+}
+
+// Read everything available; false once the server closed the connection
+static bool drainSocket(int fd, SSL* ssl, uint64_t& bytesRead, std::string* keep = nullptr) {
+    char buffer[65536];
+    while (true) {
+        ssize_t count = recvData(fd, ssl, buffer, sizeof(buffer));
+        if (count > 0) {
+            bytesRead += count;
+            if (keep) {
+                keep->append(buffer, count);
+            }
+            continue;
+        }
+        if (count == -1 && errno == EINTR) {
+            continue;
+        }
+        return count == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+}
+
+// Count the TEST_CONNECT replies in the probe's receive buffer and drop the parsed frames.
+// The probe also receives every broadcast, so other commands are skipped.
+static int takeProbeReplies(std::string& buffer) {
+    int replies = 0;
+    size_t offset = 0;
+    while (buffer.size() - offset >= 10) {
+        size_t head = buffer.find("\xFF\xFE", offset, 2);
+        if (head == std::string::npos) {
+            offset = buffer.size() - 1;
+            break;
+        }
+        if (buffer.size() - head < 8) {
+            offset = head;
+            break;
+        }
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(buffer.data() + head);
+        size_t length = (static_cast<size_t>(bytes[2]) << 24) | (bytes[3] << 16) | (bytes[4] << 8) | bytes[5];
+        if (length < 4) {
+            offset = head + 1;
+            continue;
+        }
+        if (buffer.size() - head < 6 + length) {
+            offset = head;
+            break;
+        }
+        uint16_t cmd = static_cast<uint16_t>((bytes[6] << 8) | bytes[7]) & ~CPacket::CMD_COMPRESSED;
+        if (cmd == TEST_CONNECT) {
+            replies++;
+        }
+        offset = head + 6 + length;
+    }
+    buffer.erase(0, offset);
+    return replies;
+}
+
+// Send one admin command on a short-lived connection and wait for its reply.
+// Returns an empty string if the server does not answer (remote target, old server).
+static std::string adminQuery(const ListenEndpoint& target, SSL_CTX* tls, const std::string& request) {
+    SSL* ssl = nullptr;
+    int fd = connectTarget(target, tls, &ssl);
+    if (fd == -1) {
+        return "";
+    }
+    CPacket packet(ADMIN, reinterpret_cast<const uint8_t*>(request.data()), request.size());
+    std::string frame = packet.Serialize();
+    std::string buffer;
+    std::string reply;
+    size_t sent = 0;
+    uint64_t deadline = nowUs() + static_cast<uint64_t>(ADMIN_TIMEOUT_MS) * 1000;
+    while (reply.empty() && nowUs() < deadline) {
+        struct pollfd pfd = { fd, static_cast<short>(POLLIN | (sent < frame.size() ? POLLOUT : 0)), 0 };
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        if (sent < frame.size() && (pfd.revents & POLLOUT)) {
+            ssize_t count = sendData(fd, ssl, frame.data() + sent, frame.size() - sent);
+            if (count > 0) {
+                sent += static_cast<size_t>(count);
+            }
+        }
+        char chunk[65536];
+        ssize_t count = recvData(fd, ssl, chunk, sizeof(chunk));
+        if (count == 0 || (count == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            break;
+        }
+        if (count > 0) {
+            buffer.append(chunk, static_cast<size_t>(count));
+        }
+        // Skip broadcasts and presence updates until the admin reply
+        size_t offset = 0;
+        while (reply.empty() && buffer.size() - offset >= 10) {
+            size_t head = buffer.find("\xFF\xFE", offset, 2);
+            if (head == std::string::npos || buffer.size() - head < 8) {
+                break;
+            }
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(buffer.data() + head);
+            size_t length = (static_cast<size_t>(bytes[2]) << 24) | (bytes[3] << 16) | (bytes[4] << 8) | bytes[5];
+            if (length < 4) {
+                offset = head + 1;
+                continue;
+            }
+            if (buffer.size() - head < 6 + length) {
+                break;
+            }
+            uint16_t cmd = static_cast<uint16_t>((bytes[6] << 8) | bytes[7]);
+            if (cmd == ADMIN) {
+                reply.assign(buffer, head + 8, length - 4);
+            }
+            offset = head + 6 + length;
+        }
+        buffer.erase(0, offset);
+    }
+    closeTarget(fd, ssl);
+    return reply;
+}
+
+static uint64_t percentile(const std::vector<uint64_t>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static void usage(const char* program) {
+    std::cerr << "Usage: " << program << " CAPTURE [--target host:port|[ipv6]:port|unix:/path|tls:host:port]"
+        << " [--compare ENDPOINT] [--speed 1|N|max] [--probe-ms N]" << std::endl;
+}
+
+static bool parseOptions(int argc, char* argv[], Options& options) {
+    ListenEndpoint::parse("127.0.0.1:8080", options.target);
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--target" && i + 1 < argc) {
+            if (!ListenEndpoint::parse(argv[++i], options.target)) {
+                std::cerr << "Error: Invalid target " << argv[i] << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--compare" && i + 1 < argc) {
+            if (!ListenEndpoint::parse(argv[++i], options.compare)) {
+                std::cerr << "Error: Invalid compare target " << argv[i] << std::endl;
+                return false;
+            }
+            options.haveCompare = true;
+        }
+        else if (arg == "--speed" && i + 1 < argc) {
+            std::string speed = argv[++i];
+            options.speed = speed == "max" ? 0.0 : std::atof(speed.c_str());
+            if (speed != "max" && options.speed <= 0) {
+                std::cerr << "Error: --speed must be positive or \"max\"." << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--probe-ms" && i + 1 < argc) {
+            options.probeMs = std::atoi(argv[++i]);
+            if (options.probeMs < 0) {
+                std::cerr << "Error: --probe-ms must not be negative." << std::endl;
+                return false;
+            }
+        }
+        else if (options.capturePath.empty() && arg.compare(0, 2, "--") != 0) {
+            options.capturePath = arg;
+        }
+        else {
+            return false;
+        }
+    }
+    return !options.capturePath.empty();
+}
+
+// One replay of the whole capture against target; prints the report and fills in the throughput
+static bool runReplay(const Options& options, const ListenEndpoint& target, SSL_CTX* tls, ReplayResult& result) {
+    CCaptureReader reader;
+    if (!reader.open(options.capturePath)) {
+        return false;
+    }
+    int epollFd = epoll_create1(0);
+    if (epollFd == -1) {
+        std::cerr << "Failed to create epoll: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Probe connection: one TEST_CONNECT in flight at a time
+    std::string probeFrame;
+    {
+        const std::string ping = "ping";
+        CPacket probePacket(TEST_CONNECT, reinterpret_cast<const uint8_t*>(ping.data()), ping.size());
+        probeFrame.assign(probePacket.Data(), probePacket.Size());
+    }
+    int probeFd = -1;
+    SSL* probeSsl = nullptr;
+    if (options.probeMs > 0) {
+        probeFd = connectTarget(target, tls, &probeSsl);
+        if (probeFd == -1) {
+            close(epollFd);
+            return false;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLET;
+        event.data.fd = probeFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, probeFd, &event);
+    }
+    std::string probeBuffer;
+    std::vector<uint64_t> latencies;
+    uint64_t probeSentAt = 0;      // 0 = no probe in flight
+    uint64_t nextProbeAt = 0;
+
+    std::map<int, std::unique_ptr<Connection>> connections;  // captured client id -> connection
+    std::map<int, Connection*> bySocket;
+    uint64_t framesSent = 0;
+    uint64_t bytesSent = 0;
+    uint64_t bytesReceived = 0;
+    uint64_t connectionsOpened = 0;
+    uint64_t connectionsLost = 0;
+    uint64_t maxLagUs = 0;         // Worst delay behind the capture schedule (paced mode)
+
+    auto closeConnection = [&](int clientId) {
+        auto it = connections.find(clientId);
+        if (it == connections.end()) {
+            return;
+        }
+        bySocket.erase(it->second->fd);
+        closeTarget(it->second->fd, it->second->ssl);
+        connections.erase(it);
+    };
+    auto openConnection = [&](int clientId) -> Connection* {
+        closeConnection(clientId);
+        SSL* ssl = nullptr;
+        int fd = connectTarget(target, tls, &ssl);
+        if (fd == -1) {
+            return nullptr;
+        }
+        std::unique_ptr<Connection> connection(new Connection());
+        connection->fd = fd;
+        connection->ssl = ssl;
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        Connection* raw = connection.get();
+        bySocket[fd] = raw;
+        connections[clientId] = std::move(connection);
+        connectionsOpened++;
+        return raw;
+    };
+    auto clientIdOf = [&](Connection* connection) {
+        for (const auto& pair : connections) {
+            if (pair.second.get() == connection) {
+                return pair.first;
+            }
+        }
+        return -1;
+    };
+
+    adminQuery(target, tls, "latency-reset");
+
+    CaptureRecord record;
+    bool haveRecord = reader.next(record);
+    Connection* blocked = nullptr;  // Connection whose backlog holds up the capture
+    uint64_t startUs = nowUs();
+    uint64_t finishUs = 0;         // All frames processed by the server
+    uint64_t barrierDeadline = 0;  // 0 = barrier not sent yet
+
+    while (true) {
+        uint64_t now = nowUs();
+
+        // Issue every record that is due, in capture order
+        while (haveRecord && !blocked) {
+            if (options.speed > 0) {
+                uint64_t dueUs = startUs + static_cast<uint64_t>(record.timeUs / options.speed);
+                if (now < dueUs) {
+                    break;
+                }
+                maxLagUs = std::max(maxLagUs, now - dueUs);
+            }
+            auto it = connections.find(record.clientId);
+            Connection* connection = it == connections.end() ? nullptr : it->second.get();
+            if (record.type == CaptureRecord::CONNECT) {
+                openConnection(record.clientId);
+            }
+            else if (record.type == CaptureRecord::DISCONNECT) {
+                if (connection) {
+                    connection->pending += probeFrame;
+                    connection->barrier = true;
+                    connection->closing = true;
+                    if (!flushConnection(*connection)) {
+                        closeConnection(record.clientId);
+                    }
+                }
+            }
+            else {
+                // Clients connected before the capture started have no CONNECT record
+                if (!connection) {
+                    connection = openConnection(record.clientId);
+                }
+                if (connection) {
+                    connection->pending += record.data;
+                    framesSent++;
+                    bytesSent += record.data.size();
+                    if (!flushConnection(*connection)) {
+                        connectionsLost++;
+                        closeConnection(record.clientId);
+                        connection = nullptr;
+                    }
+                    else if (connection->pending.size() > MAX_CONNECTION_PENDING) {
+                        blocked = connection;
+                    }
+                }
+            }
+            haveRecord = reader.next(record);
+        }
+
+        // Latency probe
+        if (probeFd != -1 && probeSentAt == 0 && now >= nextProbeAt) {
+            if (sendData(probeFd, probeSsl, probeFrame.data(), probeFrame.size()) == static_cast<ssize_t>(probeFrame.size())) {
+                probeSentAt = now;
+            }
+            nextProbeAt = now + static_cast<uint64_t>(options.probeMs) * 1000;
+        }
+
+        // Capture exhausted: a TEST_CONNECT behind the last frame of every connection
+        if (!haveRecord && barrierDeadline == 0) {
+            barrierDeadline = now + BARRIER_TIMEOUT_MS * 1000;
+            for (auto& pair : connections) {
+                if (!pair.second->closing) {
+                    pair.second->pending += probeFrame;
+                    pair.second->barrier = true;
+                    flushConnection(*pair.second);
+                }
+            }
+        }
+        if (barrierDeadline != 0) {
+            bool waiting = false;
+            for (const auto& pair : connections) {
+                waiting = waiting || pair.second->barrier || !pair.second->pending.empty();
+            }
+            if (!waiting || now >= barrierDeadline) {
+                if (waiting) {
+                    std::cerr << "Timed out waiting for the server to process the replay" << std::endl;
+                }
+                finishUs = now;
+                break;
+            }
+        }
+
+        // Sleep until the next record is due, the next probe, or socket activity
+        int timeoutMs = 100;
+        if (haveRecord && !blocked && options.speed > 0) {
+            uint64_t dueUs = startUs + static_cast<uint64_t>(record.timeUs / options.speed);
+            timeoutMs = dueUs > now ? static_cast<int>(std::min<uint64_t>((dueUs - now + 999) / 1000, 100)) : 0;
+        }
+        else if (haveRecord && !blocked) {
+            timeoutMs = 0;
+        }
+        if (probeFd != -1 && probeSentAt == 0) {
+            timeoutMs = std::min(timeoutMs, static_cast<int>(nextProbeAt > now ? (nextProbeAt - now + 999) / 1000 : 0));
+        }
+
+        struct epoll_event events[64];
+        int count = epoll_wait(epollFd, events, 64, timeoutMs);
+        if (count == -1 && errno != EINTR) {
+            std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == probeFd) {
+                if (!drainSocket(probeFd, probeSsl, bytesReceived, &probeBuffer)) {
+                    std::cerr << "Probe connection closed by server" << std::endl;
+                    epoll_ctl(epollFd, EPOLL_CTL_DEL, probeFd, nullptr);
+                    closeTarget(probeFd, probeSsl);
+                    probeFd = -1;
+                    probeSsl = nullptr;
+                    continue;
+                }
+                int replies = takeProbeReplies(probeBuffer);
+                if (replies > 0 && probeSentAt != 0) {
+                    latencies.push_back(nowUs() - probeSentAt);
+                    probeSentAt = 0;
+                }
+                continue;
+            }
+            auto it = bySocket.find(fd);
+            if (it == bySocket.end()) {
+                continue;
+            }
+            Connection* connection = it->second;
+            bool alive = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                alive = drainSocket(fd, connection->ssl, bytesReceived, &connection->inbound);
+                if (takeProbeReplies(connection->inbound) > 0) {
+                    connection->barrier = false;
+                }
+            }
+            if (alive && (events[i].events & EPOLLOUT)) {
+                alive = flushConnection(*connection);
+            }
+            if (!alive) {
+                if (!connection->pending.empty()) {
+                    connectionsLost++;
+                }
+                if (blocked == connection) {
+                    blocked = nullptr;
+                }
+                closeConnection(clientIdOf(connection));
+                continue;
+            }
+            if (blocked == connection && connection->pending.size() <= MAX_CONNECTION_PENDING / 2) {
+                blocked = nullptr;
+            }
+            if (connection->closing && !connection->barrier && connection->pending.empty()) {
+                closeConnection(clientIdOf(connection));
+            }
+        }
+    }
+
+    double seconds = std::max<uint64_t>((finishUs ? finishUs : nowUs()) - startUs, 1) / 1000000.0;
+    std::ostringstream speed;
+    speed << options.speed << "x";
+    std::cout << "=== Replay: " << options.capturePath << " -> " << target.toString() << " ===" << std::endl;
+    std::cout << "Speed: " << (options.speed > 0 ? speed.str() : std::string("max")) << std::endl;
+    std::cout << "Connections: " << connectionsOpened << " opened, " << connectionsLost << " lost" << std::endl;
+    std::cout << "Sent: " << framesSent << " frames, " << bytesSent << " bytes in " << seconds << " s" << std::endl;
+    std::cout << "Throughput: " << static_cast<uint64_t>(framesSent / seconds) << " frames/s, "
+        << bytesSent / seconds / (1024 * 1024) << " MB/s" << std::endl;
+    std::cout << "Received: " << bytesReceived << " bytes" << std::endl;
+    if (options.speed > 0) {
+        std::cout << "Max schedule lag: " << maxLagUs << " us" << std::endl;
+    }
+    if (!latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        std::cout << "Probe latency (" << latencies.size() << " samples): p50 " << percentile(latencies, 0.50)
+            << " us, p90 " << percentile(latencies, 0.90) << " us, p99 " << percentile(latencies, 0.99)
+            << " us, max " << latencies.back() << " us" << std::endl;
+    }
+    std::string serverLatency = adminQuery(target, tls, "latency");
+    if (!serverLatency.empty() && serverLatency.compare(0, 6, "error:") != 0) {
+        std::cout << "Server wake-up: " << serverLatency << std::endl;
+    }
+
+    result.seconds = seconds;
+    result.framesPerSecond = framesSent / seconds;
+    result.bytesPerSecond = bytesSent / seconds;
+
+    for (const auto& pair : connections) {
+        closeTarget(pair.second->fd, pair.second->ssl);
+    }
+    if (probeFd != -1) {
+        closeTarget(probeFd, probeSsl);
+    }
+    close(epollFd);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    SSL_CTX* tls = nullptr;
+    if (options.target.tls || (options.haveCompare && options.compare.tls)) {
+        tls = createTlsContext();
+        if (!tls) {
+            return 1;
+        }
+    }
+
+    ReplayResult targetResult;
+    if (!runReplay(options, options.target, tls, targetResult)) {
+        return 1;
+    }
+    if (options.haveCompare) {
+        ReplayResult compareResult;
+        std::cout << std::endl;
+        if (!runReplay(options, options.compare, tls, compareResult)) {
+            return 1;
+        }
+        // Express the gap as the cost of the slower transport, e.g. TLS against plaintext
+        bool targetFirst = options.target.tls == options.compare.tls || !options.target.tls;
+        const ReplayResult& base = targetFirst ? targetResult : compareResult;
+        const ReplayResult& other = targetFirst ? compareResult : targetResult;
+        const ListenEndpoint& baseTarget = targetFirst ? options.target : options.compare;
+        const ListenEndpoint& otherTarget = targetFirst ? options.compare : options.target;
+        std::cout << std::endl << "=== " << otherTarget.toString() << " vs " << baseTarget.toString() << " ===" << std::endl;
+        std::cout << "Throughput: " << static_cast<uint64_t>(other.framesPerSecond) << " vs "
+            << static_cast<uint64_t>(base.framesPerSecond) << " frames/s, "
+            << other.bytesPerSecond / (1024 * 1024) << " vs " << base.bytesPerSecond / (1024 * 1024) << " MB/s" << std::endl;
+        if (base.bytesPerSecond > 0) {
+            std::cout << "Gap: " << (other.bytesPerSecond - base.bytesPerSecond) * 100.0 / base.bytesPerSecond << "%" << std::endl;
+        }
+        if (options.speed > 0) {
+            std::cout << "Note: paced replay (--speed " << options.speed << "); use --speed max to measure capacity" << std::endl;
+        }
+    }
+#ifdef SERVEQT_WITH_OPENSSL
+    SSL_CTX_free(tls);
+#endif
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include "CQueue.h"
+#include <functional>
 
 template<typename T>
 void CQueue<T>::push(const QueueItem<T>& item) {
@@ -86,3 +87,4 @@ void CQueue<T>::waitForData() {
 
 // 显式实例化模板
 template class CQueue<CPacket>;
+template class CQueue<std::function<void()>>;   // 线程池完成队列
@@ -0,0 +1,188 @@
+#include "Capture.h"
+#include <iostream>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char CAPTURE_MAGIC[8] = { 'S', 'Q', 'C', 'A', 'P', '0', '0', '1' };
+static const size_t MAX_RECORD_SIZE = 64 * 1024 * 1024 + 16;
+
+static void putLittle(std::string& out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<char>(value >> (i * 8)));
+    }
+}
+
+static uint64_t getLittle(const unsigned char* in, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; --i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+static uint64_t clockUs(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+CCaptureWriter::CCaptureWriter()
+    : m_file(nullptr), m_stopping(false), m_startUs(0), m_dropped(0)
+{
+}
+
+CCaptureWriter::~CCaptureWriter()
+{
+    close();
+}
+
+bool CCaptureWriter::open(const std::string& path, bool keepExisting)
+{
+    // 每个文件只有一个文件头，不能接在旧进程的记录后面追加，也不能截断旧进程正在写的文件
+    if (keepExisting && access(path.c_str(), F_OK) == 0) {
+        std::string rotated = path + "." + std::to_string(clockUs(CLOCK_REALTIME) / 1000000);
+        if (rename(path.c_str(), rotated.c_str()) == 0) {
+            std::cout << "[Capture] Previous capture kept as " << rotated << std::endl;
+        }
+        else {
+            std::cerr << "[Capture] Failed to rotate " << path << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    // 不让热重启启动的新进程继承
+    m_file = fopen(path.c_str(), "wbe");
+    if (!m_file) {
+        std::cerr << "[Capture] Failed to open " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::string header(CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    putLittle(header, clockUs(CLOCK_REALTIME), 8);
+    fwrite(header.data(), 1, header.size(), m_file);
+
+    m_startUs = clockUs(CLOCK_MONOTONIC);
+    m_stopping = false;
+    m_thread = std::thread(&CCaptureWriter::writerLoop, this);
+    std::cout << "[Capture] Recording inbound traffic to " << path << std::endl;
+    return true;
+}
+
+void CCaptureWriter::close()
+{
+    if (!m_file) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_condition.notify_one();
+    m_thread.join();
+    fclose(m_file);
+    m_file = nullptr;
+    if (m_dropped > 0) {
+        std::cerr << "[Capture] " << m_dropped << " records dropped (writer fell behind)" << std::endl;
+    }
+}
+
+void CCaptureWriter::record(CaptureRecord::Type type, int clientId, const char* data, size_t size)
+{
+    if (!m_file) {
+        return;
+    }
+    uint64_t timeUs = clockUs(CLOCK_MONOTONIC) - m_startUs;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_pending.size() + CaptureRecord::HEADER_SIZE + size > MAX_PENDING) {
+        m_dropped++;
+        return;
+    }
+    m_pending.push_back(static_cast<char>(type));
+    putLittle(m_pending, static_cast<uint32_t>(clientId), 4);
+    putLittle(m_pending, timeUs, 8);
+    putLittle(m_pending, size, 4);
+    m_pending.append(data ? data : "", size);
+}
+
+uint64_t CCaptureWriter::droppedRecords() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+void CCaptureWriter::writerLoop()
+{
+    std::string batch;
+    while (true) {
+        bool stopping;
+        {
+            // 每100ms取走一次缓冲区，写盘不持有锁
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait_for(lock, std::chrono::milliseconds(100), [this] { return m_stopping; });
+            batch.swap(m_pending);
+            stopping = m_stopping;
+        }
+        if (!batch.empty()) {
+            if (fwrite(batch.data(), 1, batch.size(), m_file) != batch.size()) {
+                std::cerr << "[Capture] Write failed: " << strerror(errno) << std::endl;
+            }
+            fflush(m_file);
+            batch.clear();
+        }
+        if (stopping) {
+            break;
+        }
+    }
+}
+
+CCaptureReader::CCaptureReader()
+    : m_file(nullptr), m_startTimeUs(0)
+{
+}
+
+CCaptureReader::~CCaptureReader()
+{
+    if (m_file) {
+        fclose(m_file);
+    }
+}
+
+bool CCaptureReader::open(const std::string& path)
+{
+    m_file = fopen(path.c_str(), "rb");
+    if (!m_file) {
+        std::cerr << "[Capture] Failed to open " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    unsigned char header[16];
+    if (fread(header, 1, sizeof(header), m_file) != sizeof(header) ||
+        memcmp(header, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0) {
+        std::cerr << "[Capture] Not a capture file: " << path << std::endl;
+        return false;
+    }
+    m_startTimeUs = getLittle(header + 8, 8);
+    return true;
+}
+
+bool CCaptureReader::next(CaptureRecord& record)
+{
+    unsigned char header[CaptureRecord::HEADER_SIZE];
+    if (!m_file || fread(header, 1, sizeof(header), m_file) != sizeof(header)) {
+        return false;
+    }
+    record.type = static_cast<CaptureRecord::Type>(header[0]);
+    record.clientId = static_cast<int>(getLittle(header + 1, 4));
+    record.timeUs = getLittle(header + 5, 8);
+    size_t size = static_cast<size_t>(getLittle(header + 13, 4));
+    if (record.type < CaptureRecord::CONNECT || record.type > CaptureRecord::DISCONNECT || size > MAX_RECORD_SIZE) {
+        std::cerr << "[Capture] Corrupt record" << std::endl;
+        return false;
+    }
+    record.data.resize(size);
+    return size == 0 || fread(&record.data[0], 1, size, m_file) == size;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// 流量捕获文件格式(小端)
+//   文件头：魔数"SQCAP001"(8) + 开始时间(微秒，Unix时间)(8)
+//   记录：  类型(1) + 客户端ID(4) + 相对开始的时间(微秒)(8) + 长度(4) + 数据
+// 帧记录的数据是客户端发来的完整原始帧(含包头和校验和)，回放时原样发送
+struct CaptureRecord {
+    enum Type : uint8_t {
+        CONNECT = 1,
+        FRAME = 2,
+        DISCONNECT = 3
+    };
+
+    static const size_t HEADER_SIZE = 17;
+
+    Type type = FRAME;
+    int clientId = 0;
+    uint64_t timeUs = 0;
+    std::string data;
+};
+
+// 捕获写入 - epoll线程只把记录追加到内存缓冲区，后台线程批量写盘
+// 后台来不及写时丢弃新记录并计数，不阻塞收包
+class CCaptureWriter
+{
+public:
+    static const size_t MAX_PENDING = 64 * 1024 * 1024;
+
+    CCaptureWriter();
+    ~CCaptureWriter();
+
+    // keepExisting为true时(热重启接管)已有的文件改名为 path.开始时间 保留，旧进程继续写入改名后的文件
+    bool open(const std::string& path, bool keepExisting = false);
+    void close();
+    bool isOpen() const { return m_file != nullptr; }
+
+    void record(CaptureRecord::Type type, int clientId, const char* data = nullptr, size_t size = 0);
+
+    uint64_t droppedRecords() const;
+
+private:
+    FILE* m_file;
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::string m_pending;                 // 等待写盘的记录
+    bool m_stopping;
+    uint64_t m_startUs;                    // 单调时钟起点
+    uint64_t m_dropped;
+
+    void writerLoop();
+};
+
+// 捕获读取 - 回放工具使用
+class CCaptureReader
+{
+public:
+    CCaptureReader();
+    ~CCaptureReader();
+
+    bool open(const std::string& path);
+    // 读取下一条记录，文件结束或记录损坏时返回false
+    bool next(CaptureRecord& record);
+
+    uint64_t startTimeUs() const { return m_startTimeUs; }
+
+private:
+    FILE* m_file;
+    uint64_t m_startTimeUs;
+};
@@ -0,0 +1,283 @@
+#include "ChunkStore.h"
+#include "Sha256.h"
+#include "Schema.h"
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+uint64_t FileManifest::totalSize() const
+{
+    uint64_t total = 0;
+    for (const auto& chunk : chunks) {
+        total += chunk.size;
+    }
+    return total;
+}
+
+std::string FileManifest::encode() const
+{
+    std::string out;
+    out.reserve(10 + name.size() + chunks.size() * (CSha256::DIGEST_SIZE + 4));
+    schema::Writer writer(out);
+    writer.writeInt(transferId);
+    writer.writeInt(static_cast<uint16_t>(name.size()));
+    writer.writeBytes(name);
+    writer.writeInt(static_cast<uint32_t>(chunks.size()));
+    for (const auto& chunk : chunks) {
+        writer.writeBytes(chunk.hash);
+        writer.writeInt(chunk.size);
+    }
+    return out;
+}
+
+bool FileManifest::decode(const std::string& data, FileManifest& manifest)
+{
+    schema::Reader reader(data);
+    uint16_t nameLength = 0;
+    std::string_view name;
+    uint32_t count = 0;
+    if (!reader.readInt(manifest.transferId) || !reader.readInt(nameLength) || nameLength == 0 ||
+        !reader.readBytes(nameLength, name) || !reader.readInt(count)) {
+        return false;
+    }
+    const size_t entrySize = CSha256::DIGEST_SIZE + 4;
+    if (count == 0 || count > MAX_CHUNKS || reader.remaining() != count * entrySize) {
+        return false;
+    }
+    manifest.name.assign(name);
+    manifest.chunks.resize(count);
+    for (auto& chunk : manifest.chunks) {
+        std::string_view hash;
+        reader.readBytes(CSha256::DIGEST_SIZE, hash);
+        reader.readInt(chunk.size);
+        chunk.hash.assign(hash);
+        if (chunk.size == 0 || chunk.size > MAX_CHUNK_SIZE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+CChunkStore::CChunkStore()
+    : m_memoryLimit(DEFAULT_MEMORY_LIMIT), m_diskLimit(DEFAULT_DISK_LIMIT), m_memoryBytes(0), m_diskBytes(0)
+{
+}
+
+bool CChunkStore::open(const std::string& spillDirectory, size_t memoryLimit, uint64_t diskLimit)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_memoryLimit = memoryLimit;
+    m_diskLimit = diskLimit;
+    if (spillDirectory.empty()) {
+        return true;
+    }
+
+    if (mkdir(spillDirectory.c_str(), 0755) == -1 && errno != EEXIST) {
+        std::cerr << "[ChunkStore] Failed to create " << spillDirectory << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    DIR* dir = opendir(spillDirectory.c_str());
+    if (!dir) {
+        std::cerr << "[ChunkStore] Failed to open " << spillDirectory << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    m_directory = spillDirectory;
+
+    // 按修改时间恢复磁盘LRU顺序
+    std::vector<std::pair<time_t, std::string>> files;
+    while (struct dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() != CSha256::DIGEST_SIZE * 2 ||
+            name.find_first_not_of("0123456789abcdef") != std::string::npos) {
+            continue;
+        }
+        struct stat st;
+        if (stat((m_directory + "/" + name).c_str(), &st) == 0) {
+            files.emplace_back(st.st_mtime, name);
+        }
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+
+    for (const auto& file : files) {
+        std::string hash;
+        for (size_t i = 0; i < file.second.size(); i += 2) {
+            hash.push_back(static_cast<char>(std::stoi(file.second.substr(i, 2), nullptr, 16)));
+        }
+        struct stat st;
+        stat(pathOf(hash).c_str(), &st);
+        m_diskLru.push_front(hash);
+        m_disk[hash] = { static_cast<uint64_t>(st.st_size), m_diskLru.begin() };
+        m_diskBytes += st.st_size;
+    }
+    std::cout << "[ChunkStore] Loaded " << m_disk.size() << " chunks (" << m_diskBytes
+        << " bytes) from " << m_directory << std::endl;
+    return true;
+}
+
+std::string CChunkStore::pathOf(const std::string& hash) const
+{
+    return m_directory + "/" + CSha256::toHex(hash);
+}
+
+void CChunkStore::put(const std::string& hash, const Chunk& data)
+{
+    std::vector<std::pair<std::string, Chunk>> evicted;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_memory.count(hash) != 0) {
+            return;
+        }
+        insertLocked(hash, data, evicted);
+    }
+    // 写盘不持有锁，期间读取从 m_spilling 命中
+    spill(evicted);
+}
+
+void CChunkStore::insertLocked(const std::string& hash, const Chunk& data, std::vector<std::pair<std::string, Chunk>>& evicted)
+{
+    m_memoryLru.push_front(hash);
+    m_memory[hash] = { data, m_memoryLru.begin() };
+    m_memoryBytes += data->size();
+
+    while (m_memoryBytes > m_memoryLimit && m_memoryLru.size() > 1) {
+        std::string victim = m_memoryLru.back();
+        m_memoryLru.pop_back();
+        auto it = m_memory.find(victim);
+        m_memoryBytes -= it->second.data->size();
+        if (!m_directory.empty() && m_disk.count(victim) == 0) {
+            m_spilling[victim] = it->second.data;
+            evicted.emplace_back(victim, it->second.data);
+        }
+        m_memory.erase(it);
+    }
+}
+
+void CChunkStore::spill(const std::vector<std::pair<std::string, Chunk>>& evicted)
+{
+    for (const auto& item : evicted) {
+        std::string path = pathOf(item.first);
+        std::string temp = path + ".tmp";
+        bool written = false;
+        int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd != -1) {
+            const std::string& data = *item.second;
+            written = write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+            close(fd);
+            written = written && rename(temp.c_str(), path.c_str()) == 0;
+        }
+        if (!written) {
+            std::cerr << "[ChunkStore] Failed to spill chunk " << CSha256::toHex(item.first) << std::endl;
+            unlink(temp.c_str());
+        }
+
+        std::vector<std::string> removed;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_spilling.erase(item.first);
+            if (written && m_disk.count(item.first) == 0) {
+                m_diskLru.push_front(item.first);
+                m_disk[item.first] = { item.second->size(), m_diskLru.begin() };
+                m_diskBytes += item.second->size();
+            }
+            while (m_diskBytes > m_diskLimit && !m_diskLru.empty()) {
+                std::string victim = m_diskLru.back();
+                m_diskLru.pop_back();
+                m_diskBytes -= m_disk[victim].size;
+                m_disk.erase(victim);
+                removed.push_back(victim);
+            }
+        }
+        for (const auto& hash : removed) {
+            unlink(pathOf(hash).c_str());
+        }
+    }
+}
+
+CChunkStore::Chunk CChunkStore::find(const std::string& hash)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_memory.find(hash);
+    if (it != m_memory.end()) {
+        m_memoryLru.splice(m_memoryLru.begin(), m_memoryLru, it->second.lru);
+        return it->second.data;
+    }
+    auto spilling = m_spilling.find(hash);
+    return spilling != m_spilling.end() ? spilling->second : nullptr;
+}
+
+CChunkStore::Chunk CChunkStore::get(const std::string& hash)
+{
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_memory.find(hash);
+        if (it != m_memory.end()) {
+            m_memoryLru.splice(m_memoryLru.begin(), m_memoryLru, it->second.lru);
+            return it->second.data;
+        }
+        auto spilling = m_spilling.find(hash);
+        if (spilling != m_spilling.end()) {
+            return spilling->second;
+        }
+        auto disk = m_disk.find(hash);
+        if (disk == m_disk.end()) {
+            return nullptr;
+        }
+        m_diskLru.splice(m_diskLru.begin(), m_diskLru, disk->second.lru);
+        path = pathOf(hash);
+    }
+
+    // 从磁盘读回并放回内存
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat st;
+    std::string data;
+    if (fstat(fd, &st) == 0) {
+        data.resize(st.st_size);
+        if (read(fd, &data[0], data.size()) != static_cast<ssize_t>(data.size())) {
+            data.clear();
+        }
+    }
+    close(fd);
+    if (data.empty() || CSha256::digest(data.data(), data.size()) != hash) {
+        std::cerr << "[ChunkStore] Corrupt chunk on disk: " << path << std::endl;
+        return nullptr;
+    }
+
+    Chunk chunk = std::make_shared<const std::string>(std::move(data));
+    std::vector<std::pair<std::string, Chunk>> evicted;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_memory.count(hash) == 0) {
+            insertLocked(hash, chunk, evicted);
+        }
+    }
+    spill(evicted);
+    return chunk;
+}
+
+bool CChunkStore::contains(const std::string& hash) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_memory.count(hash) != 0 || m_spilling.count(hash) != 0 || m_disk.count(hash) != 0;
+}
+
+size_t CChunkStore::memoryBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_memoryBytes;
+}
+
+uint64_t CChunkStore::diskBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_diskBytes;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 文件清单 - 文件名 + 按顺序排列的分块(SHA-256摘要 + 长度)
+// 编码(网络字节序)：
+//   传输ID(4) + 文件名长度(2) + 文件名 + 分块数(4) + [摘要(32) 长度(4)]...
+struct FileManifest {
+    struct Entry {
+        std::string hash;          // 32字节二进制摘要
+        uint32_t size;
+    };
+
+    static const size_t MAX_CHUNKS = 65536;
+    static const size_t MAX_CHUNK_SIZE = 1024 * 1024;     // 分块帧不可拆分，过大会拉长聊天等待
+
+    uint32_t transferId = 0;
+    std::string name;
+    std::vector<Entry> chunks;
+
+    uint64_t totalSize() const;
+    std::string encode() const;
+    static bool decode(const std::string& data, FileManifest& manifest);
+};
+
+// 内容寻址的分块存储 - 以SHA-256摘要为键
+// 内存中按LRU保留最近使用的分块，超过上限时淘汰到磁盘目录(文件名为摘要的十六进制)，
+// 磁盘也超过上限时删除最久未用的文件；未设置目录时只使用内存
+// 所有接口线程安全：校验、写入和磁盘读回(get)在工作线程，epoll线程只用find取内存中的分块
+class CChunkStore
+{
+public:
+    using Chunk = std::shared_ptr<const std::string>;
+
+    static const size_t DEFAULT_MEMORY_LIMIT = 256 * 1024 * 1024;
+    static const uint64_t DEFAULT_DISK_LIMIT = 4ULL * 1024 * 1024 * 1024;
+
+    CChunkStore();
+
+    // 设置淘汰目录并加载已有的分块索引
+    bool open(const std::string& spillDirectory, size_t memoryLimit = DEFAULT_MEMORY_LIMIT,
+        uint64_t diskLimit = DEFAULT_DISK_LIMIT);
+
+    void put(const std::string& hash, const Chunk& data);
+    Chunk get(const std::string& hash);                // 内存未命中时从磁盘读回并校验，只在工作线程调用
+    Chunk find(const std::string& hash);               // 只查内存，已淘汰到磁盘时返回nullptr
+    bool contains(const std::string& hash) const;
+
+    size_t memoryBytes() const;
+    uint64_t diskBytes() const;
+
+private:
+    struct MemoryEntry {
+        Chunk data;
+        std::list<std::string>::iterator lru;
+    };
+    struct DiskEntry {
+        uint64_t size;
+        std::list<std::string>::iterator lru;
+    };
+
+    mutable std::mutex m_mutex;
+    size_t m_memoryLimit;
+    uint64_t m_diskLimit;
+    std::string m_directory;
+
+    std::unordered_map<std::string, MemoryEntry> m_memory;
+    std::list<std::string> m_memoryLru;                // 头部为最近使用
+    size_t m_memoryBytes;
+
+    std::unordered_map<std::string, Chunk> m_spilling; // 已移出内存、正在写盘
+    std::unordered_map<std::string, DiskEntry> m_disk;
+    std::list<std::string> m_diskLru;
+    uint64_t m_diskBytes;
+
+    void insertLocked(const std::string& hash, const Chunk& data, std::vector<std::pair<std::string, Chunk>>& evicted);
+    void spill(const std::vector<std::pair<std::string, Chunk>>& evicted);
+    std::string pathOf(const std::string& hash) const;
+};
@@ -2,16 +2,17 @@
 #include <iostream>
 #include <algorithm>
 
-ClientManager::ClientManager() {
+ClientManager::ClientManager() : m_generation(0) {
     // 构造函数，初始化客户端管理器
 }
 
 void ClientManager::addClient(int clientSocket, int clientId, const std::string& ip, int port) {
     m_clients[clientId] = ClientInfo(clientSocket, clientId, ip, port);
     m_socketToClientId[clientSocket] = clientId;
+    m_generation++;
     std::cout << "[ClientManager] Client added: Socket=" << clientSocket
         << ", ID=" << clientId << ", IP=" << ip << ", Port=" << port << std::endl;
-    updateUserList();
+    m_presence.join(clientId, "");
 }
 
 void ClientManager::removeClient(int clientId) {
@@ -20,9 +21,10 @@ void ClientManager::removeClient(int clientId) {
         int socket = it->second.socket;
         m_socketToClientId.erase(socket);
         m_clients.erase(it);
+        m_generation++;
         std::cout << "[ClientManager] Client removed: ID=" << clientId
             << ", Socket=" << socket << std::endl;
-        updateUserList();
+        m_presence.leave(clientId);
     }
 }
 
@@ -38,6 +40,7 @@ void ClientManager::updateClientUsername(int clientId, const std::string& userna
     auto it = m_clients.find(clientId);
     if (it != m_clients.end()) {
         it->second.username = username;
+        m_presence.rename(clientId, username);
         std::cout << "[ClientManager] Username updated for client "
             << clientId << ": " << username << std::endl;
     }
@@ -47,11 +50,31 @@ void ClientManager::updateClientConnectionStatus(int clientId, bool connected) {
     auto it = m_clients.find(clientId);
     if (it != m_clients.end()) {
         it->second.isConnected = connected;
+        m_generation++;
         std::cout << "[ClientManager] Client " << clientId
             << " connection status: " << (connected ? "connected" : "disconnected") << std::endl;
     }
 }
 
+void ClientManager::updateClientCodec(int clientId, uint8_t codec) {
+    auto it = m_clients.find(clientId);
+    if (it != m_clients.end()) {
+        it->second.codec = codec;
+        m_generation++;
+        std::cout << "[ClientManager] Client " << clientId
+            << " codec: " << static_cast<int>(codec) << std::endl;
+    }
+}
+
+void ClientManager::updateClientFeatures(int clientId, uint8_t features) {
+    auto it = m_clients.find(clientId);
+    if (it != m_clients.end()) {
+        it->second.features = features;
+        std::cout << "[ClientManager] Client " << clientId
+            << " features: " << static_cast<int>(features) << std::endl;
+    }
+}
+
 bool ClientManager::hasClient(int clientId) const {
     return m_clients.find(clientId) != m_clients.end();
 }
@@ -80,16 +103,6 @@ int ClientManager::getSocketByClientId(int clientId) const {
     return (it != m_clients.end()) ? it->second.socket : -1;
 }
 
-std::vector<std::string> ClientManager::getUserList() const {
-    std::vector<std::string> userList;
-    for (const auto& pair : m_clients) {
-        if (!pair.second.username.empty()) {
-            userList.push_back(pair.second.username);
-        }
-    }
-    return userList;
-}
-
 std::vector<int> ClientManager::getConnectedClientIds() const {
     std::vector<int> connectedIds;
     for (const auto& pair : m_clients) {
@@ -107,6 +120,39 @@ void ClientManager::appendToBuffer(int clientId, const std::string& data) {
     }
 }
 
+void ClientManager::appendToBuffer(int clientId, const char* data, size_t size) {
+    auto it = m_clients.find(clientId);
+    if (it != m_clients.end()) {
+        it->second.receiverBuffer.append(data, size);
+    }
+}
+
+void ClientManager::swapBuffer(int clientId, std::string& buffer) {
+    auto it = m_clients.find(clientId);
+    if (it != m_clients.end()) {
+        it->second.receiverBuffer.swap(buffer);
+    }
+}
+
+size_t ClientManager::bufferCapacity(int clientId) const {
+    auto it = m_clients.find(clientId);
+    return (it != m_clients.end()) ? it->second.receiverBuffer.capacity() : 0;
+}
+
+size_t ClientManager::shrinkBuffer(int clientId) {
+    auto it = m_clients.find(clientId);
+    if (it == m_clients.end()) {
+        return 0;
+    }
+    std::string& buffer = it->second.receiverBuffer;
+    size_t before = buffer.capacity();
+    if (before == buffer.size()) {
+        return 0;
+    }
+    buffer.shrink_to_fit();
+    return before > buffer.capacity() ? before - buffer.capacity() : 0;
+}
+
 std::string ClientManager::getBuffer(int clientId) const {
     auto it = m_clients.find(clientId);
     return (it != m_clients.end()) ? it->second.receiverBuffer : "";
@@ -125,9 +171,3 @@ void ClientManager::removeFromBuffer(int clientId, size_t bytes) {
         it->second.receiverBuffer.erase(0, bytes);
     }
 }
-
-void ClientManager::updateUserList() {
-    // 更新用户列表的逻辑可以在这里实现
-    // 目前只是占位符
-    //
-}
\ No newline at end of file
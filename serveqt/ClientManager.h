@@ -1,8 +1,11 @@
 #pragma once
+#include <cstdint>
 #include <map>
 #include <string>
 #include <vector>
 #include <memory>
+#include "Presence.h"
+#include "OutboundQueue.h"
 
 struct ClientInfo {
     int socket;                   
@@ -12,17 +15,22 @@ struct ClientInfo {
     std::string username;          
     bool isConnected;              
     std::string receiverBuffer;    
+    uint8_t codec;                 // 协商的压缩编码(CCompressor::Codec)
+    uint8_t features;              // 客户端声明支持的功能(CCommand::FEATURE_*)
+    std::shared_ptr<COutboundQueue> outbound;  // 发送队列
 
-    ClientInfo() : socket(-1), id(-1), ip(""), port(0), isConnected(false) {}
+    ClientInfo() : socket(-1), id(-1), ip(""), port(0), isConnected(false), codec(0), features(0) {}
 
     ClientInfo(int clientSocket, int clientId, const std::string& clientIp, int clientPort)
-        : socket(clientSocket), id(clientId), ip(clientIp), port(clientPort), isConnected(true) {
+        : socket(clientSocket), id(clientId), ip(clientIp), port(clientPort), isConnected(true), codec(0),
+        features(0), outbound(std::make_shared<COutboundQueue>()) {
     }
 
     ClientInfo(const ClientInfo& other)
         : socket(other.socket), id(other.id), ip(other.ip), port(other.port),
         username(other.username), isConnected(other.isConnected),
-        receiverBuffer(other.receiverBuffer) {
+        receiverBuffer(other.receiverBuffer), codec(other.codec),
+        features(other.features), outbound(other.outbound) {
     }
 
     ClientInfo& operator=(const ClientInfo& other) {
@@ -34,6 +42,9 @@ struct ClientInfo {
             username = other.username;
             isConnected = other.isConnected;
             receiverBuffer = other.receiverBuffer;
+            codec = other.codec;
+            features = other.features;
+            outbound = other.outbound;
         }
         return *this;
     }
@@ -50,6 +61,8 @@ public:
     void removeClientBySocket(int clientSocket);
     void updateClientUsername(int clientId, const std::string& username);
     void updateClientConnectionStatus(int clientId, bool connected);
+    void updateClientCodec(int clientId, uint8_t codec);
+    void updateClientFeatures(int clientId, uint8_t features);
 
     // 客户端查询
     bool hasClient(int clientId) const;
@@ -61,18 +74,30 @@ public:
 
     // 批量查询接口
     const std::map<int, ClientInfo>& getAllClients() const { return m_clients; }
-    std::vector<std::string> getUserList() const;
+    const std::vector<std::string>& getUserList() const { return m_presence.getUserNames(); }
     std::vector<int> getConnectedClientIds() const;
 
     // 统计信息
     size_t getClientCount() const { return m_clients.size(); }
+    // 增删客户端、连接状态或编码变化时递增，缓存按客户端划分结果的模块据此判断是否过期
+    uint64_t getGeneration() const { return m_generation; }
 
     // 网络缓冲区管理
     void appendToBuffer(int clientId, const std::string& data);
+    void appendToBuffer(int clientId, const char* data, size_t size);
+    // 与调用方交换缓冲区，处理期间客户端可能被移除，换出后处理不会访问失效的引用
+    void swapBuffer(int clientId, std::string& buffer);
+    size_t bufferCapacity(int clientId) const;
+    // 释放多余的容量，返回释放的字节数
+    size_t shrinkBuffer(int clientId);
     std::string getBuffer(int clientId) const;
     void clearBuffer(int clientId);
     void removeFromBuffer(int clientId, size_t bytes);
 
+    // 在线状态(带版本号的用户列表)
+    const CPresence& getPresence() const { return m_presence; }
+    CPresence& getPresence() { return m_presence; }
+
     // Socket映射管理
     int getClientIdBySocket(int clientSocket) const;
     int getSocketByClientId(int clientId) const;
@@ -80,7 +105,6 @@ public:
 private:
     std::map<int, ClientInfo> m_clients;           // clientId -> ClientInfo
     std::map<int, int> m_socketToClientId;         // socket -> clientId 映射
-
-    // 辅助方法
-    void updateUserList();
+    CPresence m_presence;                          // 在线用户列表，随增删改增量更新
+    uint64_t m_generation;                         // 成员版本号
 };
\ No newline at end of file
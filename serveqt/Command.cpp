@@ -2,53 +2,249 @@
 #include "Packet.h"
 #include <iostream>
 #include "ServerSocket.h"
+#include "Compressor.h"
+#include "CommandMessages.h"
+#include "Trace.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+
+// 编译期生成的命令分发表
+// 小于 DENSE_LIMIT 的命令ID通过 denseIndex 直接索引到处理函数，
+// 其余稀疏ID(如 TEST_CONNECT)在常量数组中顺序比较
+template<typename... Msgs>
+struct CommandTable {
+	using Invoker = int (*)(CCommand&, CommandContext&);
+
+	static constexpr size_t DENSE_LIMIT = 64;
+	static constexpr uint8_t NO_HANDLER = 0xFF;
+	static constexpr size_t COUNT = sizeof...(Msgs);
+
+	static constexpr uint16_t ids[] = { static_cast<uint16_t>(Msgs::type)... };
+
+	// 解码后调用对应的 handle 重载
+	template<typename Msg>
+	static int invoke(CCommand& command, CommandContext& ctx) {
+		Msg msg;
+		{
+			CTraceSpan span("decode", ctx.inPacket.getCmd());
+			if (!Msg::decode(ctx.inPacket, msg)) {
+				std::cerr << "Command.cpp: failed to decode command " << ctx.inPacket.getCmd() << std::endl;
+				return -1;
+			}
+		}
+		CTraceSpan span(Msg::label, ctx.clientId);
+		if constexpr (requires { command.handle(ctx.clientId, std::move(msg)); }) {
+			// 协程处理函数：此时还未开始执行，由连接的协程 co_await
+			if (!ctx.continuation) {
+				std::cerr << "Command.cpp: command " << Msg::label << " needs a connection coroutine" << std::endl;
+				return -1;
+			}
+			*ctx.continuation = command.handle(ctx.clientId, std::move(msg));
+			return 0;
+		}
+		else {
+			return command.handle(ctx, msg);
+		}
+	}
 
-CCommand::CCommand() : m_serverSocket(nullptr) {
-	struct { int nCmd; CMDFUNC func; }
-	data[] = {
-		{static_cast<int>(Type::TEXT_MESSAGE), &CCommand::handleTextMessage },
-		{static_cast<int>(Type::FILE_START), &CCommand::handleFileStart },
-		{static_cast<int>(Type::FILE_DATA), &CCommand::handleFileData },
-		{static_cast<int>(Type::FILE_COMPLETE), &CCommand::handleFileComplete },
-		{static_cast<int>(Type::TEST_CONNECT), &CCommand::handleTestConnect },
-		{-1, nullptr}
-	};
-	for (int i = 0; data[i].nCmd != -1; ++i) {
-		m_mapFunction.emplace(data[i].nCmd, data[i].func);
+	static constexpr Invoker invokers[] = { &invoke<Msgs>... };
+	static constexpr bool offloads[] = { Msgs::offload... };
+
+	static constexpr std::array<uint8_t, DENSE_LIMIT> buildDenseIndex() {
+		std::array<uint8_t, DENSE_LIMIT> index{};
+		for (size_t i = 0; i < DENSE_LIMIT; ++i) {
+			index[i] = NO_HANDLER;
+		}
+		for (size_t i = 0; i < COUNT; ++i) {
+			if (ids[i] < DENSE_LIMIT) {
+				index[ids[i]] = static_cast<uint8_t>(i);
+			}
+		}
+		return index;
 	}
-}
 
-int CCommand::ExecuteCommand(int nCmd, std::list<CPacket>& lstPacket, PacketQueue& packetQueue, CPacket& inPacket, int clientId) {
-	auto it = m_mapFunction.find(nCmd);
-	if (it == m_mapFunction.end()) {
+	static constexpr bool hasUniqueIds() {
+		for (size_t i = 0; i < COUNT; ++i) {
+			for (size_t j = i + 1; j < COUNT; ++j) {
+				if (ids[i] == ids[j]) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	static constexpr std::array<uint8_t, DENSE_LIMIT> denseIndex = buildDenseIndex();
+
+	static int indexOf(int nCmd) {
+		if (nCmd >= 0 && static_cast<size_t>(nCmd) < DENSE_LIMIT) {
+			uint8_t i = denseIndex[nCmd];
+			return i == NO_HANDLER ? -1 : i;
+		}
+		for (size_t i = 0; i < COUNT; ++i) {
+			if (ids[i] == nCmd) {
+				return static_cast<int>(i);
+			}
+		}
 		return -1;
 	}
-	return(this->*(it->second))(lstPacket, packetQueue, inPacket, clientId);
+
+	static int dispatch(CCommand& command, int nCmd, CommandContext& ctx) {
+		int i = indexOf(nCmd);
+		return i < 0 ? -1 : invokers[i](command, ctx);
+	}
+
+	static bool isOffloaded(int nCmd) {
+		int i = indexOf(nCmd);
+		return i >= 0 && offloads[i];
+	}
+};
+
+// 已注册的命令列表
+using Commands = CommandTable<
+	TextMessageMsg,
+	FileStartMsg,
+	FileDataMsg,
+	FileCompleteMsg,
+	CapabilityMsg,
+	HistoryRequestMsg,
+	PresenceSyncMsg,
+	SetUsernameMsg,
+	FileManifestMsg,
+	ChunkRequestMsg,
+	ChunkDataMsg,
+	AdminMsg,
+	SessionMsg,
+	SessionAckMsg,
+	TestConnectMsg
+>;
+
+static_assert(Commands::hasUniqueIds(), "duplicate command id in Commands");
+static_assert(Commands::COUNT < Commands::NO_HANDLER, "too many commands for dense index");
+
+CCommand::CCommand() : m_serverSocket(nullptr), m_nextTransferId(1), m_presenceDeferred(false), m_presenceDeferredFrom(0) {
+}
+
+bool CCommand::isOffloaded(int nCmd) {
+	return Commands::isOffloaded(nCmd);
+}
+
+int CCommand::ExecuteCommand(int nCmd, std::list<CPacket>& lstPacket, PacketQueue& packetQueue, CPacket& inPacket, int clientId,
+	CTask<int>* continuation) {
+	CommandContext ctx{ lstPacket, packetQueue, inPacket, clientId, continuation };
+	return Commands::dispatch(*this, nCmd, ctx);
 }
 
 // 客户端管理方法
 void CCommand::addClient(int clientSocket, int clientId, const std::string& ip, int port) {
+	uint64_t version = m_clientManager.getPresence().getVersion();
 	m_clientManager.addClient(clientSocket, clientId, ip, port);
+	publishPresence(version);
 }
 
 void CCommand::removeClient(int clientId) {
+	dropTransfers(clientId);
+	uint64_t version = m_clientManager.getPresence().getVersion();
 	m_clientManager.removeClient(clientId);
+	publishPresence(version);
 }
 
 void CCommand::updateClientUsername(int clientId, const std::string& username) {
+	uint64_t version = m_clientManager.getPresence().getVersion();
 	m_clientManager.updateClientUsername(clientId, username);
+	publishPresence(version);
+}
+
+void CCommand::updateRemoteClient(int clientId, const std::string& username) {
+	uint64_t version = m_clientManager.getPresence().getVersion();
+	m_clientManager.getPresence().join(clientId, username);
+	publishPresence(version);
+}
+
+void CCommand::removeRemoteClient(int clientId) {
+	uint64_t version = m_clientManager.getPresence().getVersion();
+	m_clientManager.getPresence().leave(clientId);
+	publishPresence(version);
+}
+
+// 把 previousVersion 之后的在线状态变更只发给订阅者，每种编码只序列化一次
+// 本节点客户端的变更同时同步给集群中的其他节点
+void CCommand::publishPresence(uint64_t previousVersion) {
+	const CPresence& presence = m_clientManager.getPresence();
+	std::vector<const PresenceDelta*> deltas;
+	if (!m_serverSocket || presence.getVersion() == previousVersion ||
+		!presence.deltasSince(previousVersion, deltas)) {
+		return;
+	}
+
+	CFederation& federation = m_serverSocket->getFederation();
+	for (const PresenceDelta* delta : deltas) {
+		if (delta->op == PresenceDelta::LEAVE) {
+			federation.announceLeave(delta->clientId);
+		}
+		else {
+			federation.announceMember(delta->clientId, delta->name);
+		}
+	}
+
+	std::vector<int> subscribers = presence.getSubscribers();
+	if (subscribers.empty()) {
+		return;
+	}
+
+	// 过载时只记下起始版本，由 flushPresence() 把这段时间的变更合并成一个包
+	COverloadController& overload = m_serverSocket->getOverload();
+	if (overload.coalescePresence()) {
+		if (!m_presenceDeferred) {
+			m_presenceDeferred = true;
+			m_presenceDeferredFrom = previousVersion;
+		}
+		overload.count(COverloadController::PRESENCE_COALESCED);
+		return;
+	}
+	if (m_presenceDeferred) {
+		// 还有合并中的变更，从更早的版本一起发出，保持版本连续
+		flushPresence();
+		return;
+	}
+
+	std::string payload = CPresence::encodeDeltas(deltas);
+	CPacket deltaPacket(static_cast<int>(Type::PRESENCE_DELTA), reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+	m_serverSocket->multicastPacket(deltaPacket, subscribers);
+}
+
+void CCommand::flushPresence() {
+	if (!m_presenceDeferred || !m_serverSocket) {
+		return;
+	}
+	m_presenceDeferred = false;
+	const CPresence& presence = m_clientManager.getPresence();
+	std::vector<int> subscribers = presence.getSubscribers();
+	if (subscribers.empty() || presence.getVersion() == m_presenceDeferredFrom) {
+		return;
+	}
+
+	// 变更太多、增量已被淘汰时改发快照
+	std::vector<const PresenceDelta*> deltas;
+	if (presence.deltasSince(m_presenceDeferredFrom, deltas)) {
+		std::string payload = CPresence::encodeDeltas(deltas);
+		CPacket deltaPacket(static_cast<int>(Type::PRESENCE_DELTA), reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+		m_serverSocket->multicastPacket(deltaPacket, subscribers);
+	}
+	else {
+		const std::string& snapshot = presence.encodeSnapshot();
+		CPacket snapshotPacket(static_cast<int>(Type::PRESENCE_SNAPSHOT), reinterpret_cast<const uint8_t*>(snapshot.data()), snapshot.size());
+		m_serverSocket->multicastPacket(snapshotPacket, subscribers);
+	}
 }
 
 // 数据包路由方法
 void CCommand::broadcastPacket(const CPacket& packet, int excludeClientId) {
 	if (!m_serverSocket) return;
 
-	auto connectedIds = m_clientManager.getConnectedClientIds();
-	for (int clientId : connectedIds) {
-		if (clientId != excludeClientId) {
-			m_serverSocket->sendPacketToClient(clientId, packet);
-		}
-	}
+	// 由ServerSocket按编码分组，每种编码只压缩一次
+	m_serverSocket->broadcastPacket(packet, excludeClientId);
 }
 
 void CCommand::sendPacketToClient(int clientId, const CPacket& packet) {
@@ -66,123 +262,626 @@ void CCommand::sendSystemMessage(const std::string& message, int excludeClientId
 }
 
 // 处理聊天消息 - 支持同步和异步双重处理
-int CCommand::handleTextMessage(std::list<CPacket>& lstPacket, PacketQueue& packetQueue, CPacket& inPacket, int clientId) {
-	std::string rawData = inPacket.getData();
+int CCommand::handle(CommandContext& ctx, const TextMessageMsg& msg) {
+	const std::string_view rawData = msg.text;
 	if (rawData.empty()) {
 		std::cerr << "chat message content is empty" << std::endl;
 		return -1;
 	}
 
 	// 添加发送者信息到消息中
-	const ClientInfo* client = m_clientManager.getClient(clientId);
+	const ClientInfo* client = m_clientManager.getClient(ctx.clientId);
 	if (client) {
-		std::string senderInfo = "[" + std::to_string(clientId) + "] ";
-		std::string fullMessage = senderInfo + rawData;
+		std::string senderInfo = "[" + std::to_string(ctx.clientId) + "] ";
+		std::string fullMessage = senderInfo + std::string(rawData);
 
 		// 创建新的消息包
 		CPacket newPacket(static_cast<int>(Type::TEXT_MESSAGE), reinterpret_cast<const uint8_t*>(fullMessage.c_str()), fullMessage.size());
 
+		// 记录到消息历史，供后加入的客户端回放
+		if (m_serverSocket) {
+			m_serverSocket->appendHistory(newPacket, ctx.clientId);
+		}
+
 		// 同步处理：添加到lstPacket用于立即发送
-		lstPacket.push_back(newPacket);
+		ctx.lstPacket.push_back(newPacket);
 
 		// 异步处理：添加到packetQueue用于高并发场景
-		packetQueue.push(static_cast<size_t>(Type::TEXT_MESSAGE), newPacket);
+		ctx.packetQueue.push(static_cast<size_t>(Type::TEXT_MESSAGE), newPacket);
 	}
 	else {
 		// 如果没有找到客户端信息，直接转发原包
-		lstPacket.push_back(inPacket);
-		packetQueue.push(static_cast<size_t>(Type::TEXT_MESSAGE), inPacket);
+		ctx.lstPacket.push_back(ctx.inPacket);
+		ctx.packetQueue.push(static_cast<size_t>(Type::TEXT_MESSAGE), ctx.inPacket);
 	}
 
-	std::cout << "Forward chat messages from client " << clientId << ": " << rawData << std::endl;
+	std::cout << "Forward chat messages from client " << ctx.clientId << ": " << rawData << std::endl;
 	return 0;
 }
 
-// 文件首包 仅含filename - 支持同步和异步双重处理
-int CCommand::handleFileStart(std::list<CPacket>& lstPacket, PacketQueue& packetQueue, CPacket& inPacket, int clientId) {
-	const std::string filename = inPacket.getData();
+// 文件首包 - 支持同步和异步双重处理
+// 版本格式的首包转发前降为旧格式(只有文件名)，接收方不需要识别版本
+int CCommand::handle(CommandContext& ctx, const FileStartMsg& msg) {
+	const std::string_view filename = msg.filename;
 	if (filename.empty()) {
 		std::cerr << "Command.cpp: " << "The file name is empty" << std::endl;
 		return -1;
 	}
+	CPacket startPacket = ctx.inPacket;
+	if (msg.version != 0) {
+		FileStartMsg legacy;
+		legacy.filename = filename;
+		if (!encodePacket(legacy, startPacket)) {
+			return -1;
+		}
+	}
 
 	// 添加发送者信息
-	const ClientInfo* client = m_clientManager.getClient(clientId);
+	const ClientInfo* client = m_clientManager.getClient(ctx.clientId);
 	if (client) {
-		std::string senderInfo = "[" + std::to_string(clientId) + "] ";
-		std::string fullMessage = senderInfo + "started file transfer: " + filename;
+		std::string senderInfo = "[" + std::to_string(ctx.clientId) + "] ";
+		std::string fullMessage = senderInfo + "started file transfer: " + std::string(filename);
 
 		CPacket newPacket(static_cast<int>(Type::TEXT_MESSAGE), reinterpret_cast<const uint8_t*>(fullMessage.c_str()), fullMessage.size());
 
 		// 同步处理：通知消息立即发送
-		lstPacket.push_back(newPacket);
+		ctx.lstPacket.push_back(newPacket);
 
 		// 异步处理：添加到packetQueue用于高并发场景
-		packetQueue.push(static_cast<size_t>(Type::TEXT_MESSAGE), newPacket);
+		ctx.packetQueue.push(static_cast<size_t>(Type::TEXT_MESSAGE), newPacket);
 	}
 
-	std::cout << "Client " << clientId << " started file transfer: " << filename << std::endl;
+	std::cout << "Client " << ctx.clientId << " started file transfer: " << filename;
+	if (msg.size != 0) {
+		std::cout << " (" << msg.size << " bytes)";
+	}
+	std::cout << std::endl;
 
 	// 同步处理：文件开始包立即发送
-	lstPacket.push_back(inPacket);
+	ctx.lstPacket.push_back(startPacket);
 
 	// 异步处理：添加到packetQueue用于高并发场景
-	packetQueue.push(static_cast<size_t>(Type::FILE_START), inPacket);
+	ctx.packetQueue.push(static_cast<size_t>(Type::FILE_START), startPacket);
 	return 0;
 }
 
 // 中间数据 - 支持同步和异步双重处理
-int CCommand::handleFileData(std::list<CPacket>& lstPacket, PacketQueue& packetQueue, CPacket& inPacket, int clientId) {
-	const std::string& chunk = inPacket.getData();
-	std::cout << "Client " << clientId << " file data chunk size: " << chunk.size() << std::endl;
+int CCommand::handle(CommandContext& ctx, const FileDataMsg& msg) {
+	std::cout << "Client " << ctx.clientId << " file data chunk size: " << msg.chunk.size() << std::endl;
 
 	// 同步处理：文件数据包立即发送
-	lstPacket.push_back(inPacket);
+	ctx.lstPacket.push_back(ctx.inPacket);
 
 	// 异步处理：添加到packetQueue用于高并发场景
-	packetQueue.push(static_cast<size_t>(Type::FILE_DATA), inPacket);
+	ctx.packetQueue.push(static_cast<size_t>(Type::FILE_DATA), ctx.inPacket);
 	return 0;
 }
 
-int CCommand::handleFileComplete(std::list<CPacket>& lstPacket, PacketQueue& packetQueue, CPacket& inPacket, int clientId) {
-	const ClientInfo* client = m_clientManager.getClient(clientId);
+int CCommand::handle(CommandContext& ctx, const FileCompleteMsg&) {
+	const ClientInfo* client = m_clientManager.getClient(ctx.clientId);
 	if (client) {
-		std::string senderInfo = "[" + std::to_string(clientId) + "] ";
+		std::string senderInfo = "[" + std::to_string(ctx.clientId) + "] ";
 		std::string fullMessage = senderInfo + " file transfer completed";
 
 		CPacket newPacket(static_cast<int>(Type::TEXT_MESSAGE), reinterpret_cast<const uint8_t*>(fullMessage.c_str()), fullMessage.size());
 
 		// 同步处理：通知消息立即发送
-		lstPacket.push_back(newPacket);
+		ctx.lstPacket.push_back(newPacket);
 
 		// 异步处理：添加到packetQueue用于高并发场景
-		packetQueue.push(static_cast<size_t>(Type::TEXT_MESSAGE), newPacket);
+		ctx.packetQueue.push(static_cast<size_t>(Type::TEXT_MESSAGE), newPacket);
 	}
 
-	std::cout << "Client " << clientId << " file transfer completed" << std::endl;
+	std::cout << "Client " << ctx.clientId << " file transfer completed" << std::endl;
 
 	// 同步处理：文件完成包立即发送
-	lstPacket.push_back(inPacket);
+	ctx.lstPacket.push_back(ctx.inPacket);
 
 	// 异步处理：添加到packetQueue用于高并发场景
-	packetQueue.push(static_cast<size_t>(Type::FILE_COMPLETE), inPacket);
+	ctx.packetQueue.push(static_cast<size_t>(Type::FILE_COMPLETE), ctx.inPacket);
 	return 0;
 }
 
 // 处理测试连接 - 支持同步和异步双重处理
-int CCommand::handleTestConnect(std::list<CPacket>& lstPacket, PacketQueue& packetQueue, CPacket& inPacket, int clientId) {
+int CCommand::handle(CommandContext& ctx, const TestConnectMsg& msg) {
+	// 客户端回送的服务器探测，计入连接统计，不再回复
+	std::string payload(msg.payload);
+	if (CTelemetry::isPing(payload)) {
+		if (m_serverSocket) {
+			m_serverSocket->getTelemetry().recordPong(ctx.clientId, payload, CScheduler::nowUs());
+		}
+		return 0;
+	}
+
 	// 返回简单的OK消息
-	std::string okMsg = "OK";
-	CPacket okPacket(static_cast<int>(Type::TEST_CONNECT),
-		reinterpret_cast<const uint8_t*>(okMsg.data()), okMsg.size());
+	TestConnectMsg ok;
+	ok.payload = "OK";
+	CPacket okPacket;
+	encodePacket(ok, okPacket);
 
 	// 同步处理：测试连接响应立即发送
-	lstPacket.push_back(okPacket);
+	ctx.lstPacket.push_back(okPacket);
 
 	// 异步处理：添加到packetQueue用于高并发场景
-	packetQueue.push(static_cast<size_t>(Type::TEST_CONNECT), okPacket);
+	ctx.packetQueue.push(static_cast<size_t>(Type::TEST_CONNECT), okPacket);
+
+	std::cout << "Test connect successfully from client " << ctx.clientId << std::endl;
+	return 0;
+}
+
+// 能力协商 - 负载为客户端支持的编码ID列表(每字节一个，按偏好排序)
+// 回复只发给请求方，负载为选定的编码ID，0表示不压缩
+int CCommand::handle(CommandContext& ctx, const CapabilityMsg& msg) {
+	if (!m_clientManager.hasClient(ctx.clientId)) {
+		return -1;
+	}
+
+	CCompressor::Codec codec = CCompressor::negotiate(msg.codecs);
+	m_clientManager.updateClientCodec(ctx.clientId, static_cast<uint8_t>(codec));
+
+	// 功能位：回复中带上服务器接受的功能，只声明编码的客户端仍然只收到1字节
+	uint8_t features = 0;
+	for (uint8_t feature : { FEATURE_CHUNKS, FEATURE_PING }) {
+		if (msg.codecs.find(static_cast<char>(feature)) != std::string_view::npos) {
+			features |= feature;
+		}
+	}
+	m_clientManager.updateClientFeatures(ctx.clientId, features);
+
+	CapabilityReplyMsg reply;
+	reply.codec = static_cast<uint8_t>(codec);
+	reply.features = features;
+	CPacket replyPacket;
+	encodePacket(reply, replyPacket);
+	sendPacketToClient(ctx.clientId, replyPacket);
+
+	std::cout << "Client " << ctx.clientId << " negotiated codec: " << CCompressor::name(codec) << std::endl;
+	return 0;
+}
+
+// 历史回放 - 只发给请求方，单次最多回放 MAX_HISTORY_REPLAY 条
+int CCommand::handle(CommandContext& ctx, const HistoryRequestMsg& msg) {
+	static const size_t MAX_HISTORY_REPLAY = 1000;
+	if (!m_serverSocket || !m_clientManager.hasClient(ctx.clientId)) {
+		return -1;
+	}
+
+	size_t replayed = 0;
+	if (msg.mode == HistoryRequestMsg::LAST) {
+		replayed = m_serverSocket->replayHistoryLast(ctx.clientId, std::min<uint64_t>(msg.value, MAX_HISTORY_REPLAY));
+	}
+	else {
+		replayed = m_serverSocket->replayHistorySince(ctx.clientId, msg.value, MAX_HISTORY_REPLAY);
+	}
+
+	std::cout << "Client " << ctx.clientId << " history replay: " << replayed << " messages" << std::endl;
+	return 0;
+}
+
+// 在线状态同步 - 请求方成为订阅者；版本落后不多时补发增量，否则发送完整快照
+int CCommand::handle(CommandContext& ctx, const PresenceSyncMsg& msg) {
+	if (!m_clientManager.hasClient(ctx.clientId)) {
+		return -1;
+	}
+
+	CPresence& presence = m_clientManager.getPresence();
+	presence.subscribe(ctx.clientId);
+
+	// 版本0表示客户端没有本地列表；增量比快照还多时也直接发快照
+	std::vector<const PresenceDelta*> deltas;
+	if (msg.version != 0 && presence.deltasSince(msg.version, deltas) &&
+		deltas.size() <= presence.getUserCount() + 1) {
+		std::string payload = CPresence::encodeDeltas(deltas);
+		CPacket deltaPacket(static_cast<int>(Type::PRESENCE_DELTA), reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+		sendPacketToClient(ctx.clientId, deltaPacket);
+		std::cout << "Client " << ctx.clientId << " presence sync: " << deltas.size() << " deltas" << std::endl;
+	}
+	else {
+		const std::string& payload = presence.encodeSnapshot();
+		CPacket snapshotPacket(static_cast<int>(Type::PRESENCE_SNAPSHOT), reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+		sendPacketToClient(ctx.clientId, snapshotPacket);
+		std::cout << "Client " << ctx.clientId << " presence sync: snapshot of " << presence.getUserCount() << " users" << std::endl;
+	}
+	return 0;
+}
+
+// 设置用户名 - 通过在线状态增量通知订阅者
+int CCommand::handle(CommandContext& ctx, const SetUsernameMsg& msg) {
+	if (!m_clientManager.hasClient(ctx.clientId)) {
+		return -1;
+	}
+	updateClientUsername(ctx.clientId, std::string(msg.name));
+	return 0;
+}
+
+// 文件清单 - 存储中已有的分块不再上传，每个缺少的摘要只请求一次
+int CCommand::handle(CommandContext& ctx, const FileManifestMsg& msg) {
+	if (!m_serverSocket || !m_clientManager.hasClient(ctx.clientId)) {
+		return -1;
+	}
+
+	CChunkStore& store = m_serverSocket->getChunkStore();
+	PendingUpload upload;
+	upload.manifest = msg.manifest;
+	std::vector<uint32_t> request;
+	for (size_t i = 0; i < msg.manifest.chunks.size(); ++i) {
+		const std::string& hash = msg.manifest.chunks[i].hash;
+		if (!store.contains(hash) && upload.missing.insert(hash).second) {
+			request.push_back(static_cast<uint32_t>(i));
+		}
+	}
+
+	ChunkRequestMsg reply;
+	reply.transferId = msg.manifest.transferId;
+	reply.indices = schema::U32List::host(request);
+	CPacket requestPacket;
+	encodePacket(reply, requestPacket);
+	sendPacketToClient(ctx.clientId, requestPacket);
+
+	std::cout << "Client " << ctx.clientId << " manifest " << msg.manifest.name << ": "
+		<< msg.manifest.chunks.size() << " chunks, " << request.size() << " missing" << std::endl;
+
+	if (upload.missing.empty()) {
+		distributeFile(ctx.clientId, upload.manifest);
+	}
+	else {
+		m_uploads[{ ctx.clientId, msg.manifest.transferId }] = std::move(upload);
+	}
+	return 0;
+}
+
+// 分块数据 - 在工作线程中校验摘要并写入存储，完成后回到epoll线程更新上传进度
+// 只接受该连接待上传清单中缺少的分块，否则客户端不发清单也能填满分块缓存
+int CCommand::handle(CommandContext& ctx, const ChunkDataMsg& msg) {
+	if (!m_serverSocket || !m_clientManager.hasClient(ctx.clientId)) {
+		return -1;
+	}
+
+	std::string hash(msg.hash);
+	bool expected = false;
+	for (auto it = m_uploads.lower_bound({ ctx.clientId, 0 }); it != m_uploads.end() && it->first.first == ctx.clientId; ++it) {
+		if (it->second.missing.count(hash) != 0) {
+			expected = true;
+			break;
+		}
+	}
+	if (!expected) {
+		std::cerr << "Client " << ctx.clientId << " sent unrequested chunk " << CSha256::toHex(hash) << std::endl;
+		return -1;
+	}
+	auto data = std::make_shared<const std::string>(msg.data);
+	auto valid = std::make_shared<bool>(false);
+	CChunkStore* store = &m_serverSocket->getChunkStore();
+	int clientId = ctx.clientId;
+	m_serverSocket->runOffloaded(clientId,
+		[store, hash, data, valid] {
+			*valid = CSha256::digest(data->data(), data->size()) == hash;
+			if (*valid) {
+				store->put(hash, data);
+			}
+		},
+		[this, clientId, hash, valid] {
+			onChunkStored(clientId, hash, *valid);
+		});
+	return 0;
+}
+
+// 分块请求 - 接收方只请求本地没有的分块
+// 解码出的序号指向数据包，协程开始执行时数据包已经释放，先复制再进入协程
+CTask<int> CCommand::handle(int clientId, ChunkRequestMsg msg) {
+	return sendChunks(clientId, msg.transferId, msg.indices.toVector());
+}
+
+CTask<int> CCommand::sendChunks(int clientId, uint32_t transferId, std::vector<uint32_t> indices) {
+	auto it = m_downloads.find(transferId);
+	if (!m_serverSocket || it == m_downloads.end() || it->second.recipients.count(clientId) == 0) {
+		std::cerr << "Client " << clientId << " requested chunks of unknown transfer " << transferId << std::endl;
+		co_return -1;
+	}
+
+	// 挂起期间传输记录可能被删除(例如发送方断开)，使用清单的副本
+	const FileManifest manifest = it->second.manifest;
+	size_t sent = 0;
+	for (uint32_t index : indices) {
+		if (index >= manifest.chunks.size()) {
+			continue;
+		}
+		const std::string& hash = manifest.chunks[index].hash;
+		CChunkStore::Chunk chunk = co_await loadChunk(clientId, hash);
+		if (!chunk) {
+			std::cerr << "Chunk " << CSha256::toHex(hash) << " no longer in store" << std::endl;
+			continue;
+		}
+		ChunkDataMsg data;
+		data.hash = hash;
+		data.data = *chunk;
+		CPacket chunkPacket;
+		if (!encodePacket(data, chunkPacket)) {
+			continue;
+		}
+		// 接收方的发送队列超过高水位时在这里挂起，整个文件不会一次进入发送队列
+		if (!co_await m_serverSocket->send(clientId, chunkPacket)) {
+			break;
+		}
+		sent++;
+	}
+
+	std::cout << "Client " << clientId << " fetched " << sent << "/" << manifest.chunks.size()
+		<< " chunks of " << manifest.name << std::endl;
+	it = m_downloads.find(transferId);
+	if (it != m_downloads.end()) {
+		it->second.recipients.erase(clientId);
+		if (it->second.recipients.empty()) {
+			m_downloads.erase(it);
+		}
+	}
+	co_return 0;
+}
+
+void CCommand::onChunkStored(int clientId, const std::string& hash, bool valid) {
+	if (!valid) {
+		std::cerr << "Client " << clientId << " sent chunk with mismatched hash " << CSha256::toHex(hash) << std::endl;
+		return;
+	}
+
+	// 该客户端所有等待这个分块的上传
+	for (auto it = m_uploads.lower_bound({ clientId, 0 }); it != m_uploads.end() && it->first.first == clientId;) {
+		PendingUpload& upload = it->second;
+		if (upload.missing.erase(hash) != 0 && upload.missing.empty()) {
+			FileManifest manifest = std::move(upload.manifest);
+			it = m_uploads.erase(it);
+			distributeFile(clientId, manifest);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+// 分块全部到齐后分发：支持清单的客户端只收到清单，由它们请求本地没有的分块；
+// 其他客户端(以及集群中的其他节点)按原有的 FILE_START/FILE_DATA/FILE_COMPLETE 接收
+void CCommand::distributeFile(int senderId, const FileManifest& manifest) {
+	std::vector<int> manifestClients;
+	std::vector<int> legacyClients;
+	for (const auto& pair : m_clientManager.getAllClients()) {
+		if (pair.first == senderId) {
+			continue;
+		}
+		if (pair.second.features & FEATURE_CHUNKS) {
+			manifestClients.push_back(pair.first);
+		}
+		else {
+			legacyClients.push_back(pair.first);
+		}
+	}
+
+	if (!manifestClients.empty()) {
+		PendingDownload& download = m_downloads[m_nextTransferId];
+		download.manifest = manifest;
+		download.manifest.transferId = m_nextTransferId++;
+		download.recipients.insert(manifestClients.begin(), manifestClients.end());
+
+		std::string payload = download.manifest.encode();
+		CPacket manifestPacket(static_cast<int>(Type::FILE_MANIFEST), reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+		m_serverSocket->multicastPacket(manifestPacket, manifestClients);
+	}
+
+	std::cout << "Distributing " << manifest.name << " (" << manifest.totalSize() << " bytes) from client " << senderId
+		<< ": " << manifestClients.size() << " by manifest, " << legacyClients.size() << " legacy" << std::endl;
+
+	// 旧客户端和其他节点需要全部数据，在后台逐块发送，完成后再发通知
+	bool forwardToPeers = m_serverSocket->getFederation().connectedPeers() > 0;
+	if (!legacyClients.empty() || forwardToPeers) {
+		streamLegacyFile(senderId, manifest, std::move(legacyClients), forwardToPeers).start();
+	}
+	else {
+		announceFile(senderId);
+	}
+}
+
+CTask<> CCommand::streamLegacyFile(int senderId, FileManifest manifest, std::vector<int> recipients, bool forwardToPeers) {
+	CFederation& federation = m_serverSocket->getFederation();
+	CScheduler& scheduler = m_serverSocket->getScheduler();
+	auto sendAll = [&](const CPacket& packet) {
+		m_serverSocket->multicastPacket(packet, recipients);
+		if (forwardToPeers) {
+			federation.forwardBroadcast(packet, senderId);
+		}
+	};
 
-	std::cout << "Test connect successfully from client " << clientId << std::endl;
+	CPacket startPacket;
+	FileStartMsg start;
+	start.filename = manifest.name;
+	if (!encodePacket(start, startPacket)) {
+		co_return;
+	}
+	sendAll(startPacket);
+
+	size_t sent = 0;
+	for (const auto& entry : manifest.chunks) {
+		// 按最慢的接收方推进：发送队列高于低水位时等待，停滞超过时限的接收方退出本次传输
+		uint64_t waitStart = CScheduler::nowMs();
+		while (true) {
+			bool stalled = CScheduler::nowMs() - waitStart > CConnection::SEND_STALL_TIMEOUT_MS;
+			bool backlog = false;
+			for (auto it = recipients.begin(); it != recipients.end();) {
+				const ClientInfo* client = m_clientManager.getClient(*it);
+				bool pending = client && client->outbound->bytes() > CConnection::SEND_LOW_WATER;
+				if (!client || (pending && stalled)) {
+					if (client) {
+						std::cerr << "Client " << *it << " stalled, leaving legacy transfer of " << manifest.name << std::endl;
+					}
+					it = recipients.erase(it);
+					continue;
+				}
+				backlog = backlog || pending;
+				++it;
+			}
+			if (forwardToPeers && federation.pendingBytes() > CConnection::SEND_LOW_WATER) {
+				if (stalled) {
+					std::cerr << "Peer links stalled, stop forwarding " << manifest.name << std::endl;
+					forwardToPeers = false;
+				}
+				else {
+					backlog = true;
+				}
+			}
+			if (!backlog) {
+				break;
+			}
+			co_await scheduler.sleepFor(LEGACY_PACE_MS);
+		}
+		if (recipients.empty() && !forwardToPeers) {
+			break;
+		}
+
+		CChunkStore::Chunk chunk = co_await loadChunk(senderId, entry.hash);
+		if (!chunk) {
+			std::cerr << "Chunk " << CSha256::toHex(entry.hash) << " missing, legacy transfer of " << manifest.name << " aborted" << std::endl;
+			co_return;
+		}
+		std::vector<CPacket> packets;
+		CServerSocket::appendSplitPacket(packets, CPacket(static_cast<int>(Type::FILE_DATA),
+			reinterpret_cast<const uint8_t*>(chunk->data()), chunk->size()));
+		for (const auto& packet : packets) {
+			sendAll(packet);
+		}
+		sent++;
+	}
+
+	if (sent == manifest.chunks.size()) {
+		CPacket completePacket;
+		FileCompleteMsg complete;
+		complete.filename = manifest.name;
+		if (encodePacket(complete, completePacket)) {
+			sendAll(completePacket);
+		}
+	}
+	std::cout << "Legacy transfer of " << manifest.name << ": " << sent << "/" << manifest.chunks.size()
+		<< " chunks to " << recipients.size() << " clients" << std::endl;
+	announceFile(senderId);
+}
+
+// 与原有文件传输一样通知所有客户端
+void CCommand::announceFile(int senderId) {
+	std::string notice = "[" + std::to_string(senderId) + "]  file transfer completed";
+	CPacket noticePacket(static_cast<int>(Type::TEXT_MESSAGE), reinterpret_cast<const uint8_t*>(notice.c_str()), notice.size());
+	m_serverSocket->broadcastPacket(noticePacket);
+	m_serverSocket->getFederation().forwardBroadcast(noticePacket, senderId);
+}
+
+CTask<CChunkStore::Chunk> CCommand::loadChunk(int clientId, std::string hash) {
+	CChunkStore* store = &m_serverSocket->getChunkStore();
+	CChunkStore::Chunk chunk = store->find(hash);
+	if (chunk || !store->contains(hash)) {
+		co_return chunk;
+	}
+	auto loaded = std::make_shared<CChunkStore::Chunk>();
+	co_await m_serverSocket->offload(clientId, [store, hash, loaded] {
+		*loaded = store->get(hash);
+	});
+	co_return *loaded;
+}
+
+void CCommand::dropTransfers(int clientId) {
+	for (auto it = m_uploads.lower_bound({ clientId, 0 }); it != m_uploads.end() && it->first.first == clientId;) {
+		it = m_uploads.erase(it);
+	}
+	for (auto it = m_downloads.begin(); it != m_downloads.end();) {
+		it->second.recipients.erase(clientId);
+		if (it->second.recipients.empty()) {
+			it = m_downloads.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+// 管理命令 - 只接受本机(回环地址、本用户的Unix域socket、共享内存)客户端
+// 其他用户连到Unix域socket时地址为"unix-uid-N"(见 CListener::accept)
+int CCommand::handle(CommandContext& ctx, const AdminMsg& msg) {
+	const ClientInfo* client = m_clientManager.getClient(ctx.clientId);
+	if (!client || (client->ip != "127.0.0.1" && client->ip != "::1" && client->ip != "unix" && client->ip != "local")) {
+		std::cerr << "Rejected admin command from client " << ctx.clientId << std::endl;
+		return -1;
+	}
+
+	std::string request(msg.request);
+	std::string reply;
+	if (request == "trace-dump") {
+		std::string path = CTrace::dump();
+		reply = path.empty() ? "error: trace dump failed" : path;
+	}
+	else if (request.compare(0, 11, "trace-rate ") == 0) {
+		uint32_t rate = static_cast<uint32_t>(std::strtoul(request.c_str() + 11, nullptr, 10));
+		CTrace::configure(rate, "");
+		reply = "trace sample rate " + std::to_string(rate);
+	}
+	else if (request == "overload") {
+		reply = m_serverSocket ? m_serverSocket->getOverload().describe() : "error: no server";
+	}
+	else if (request == "memory") {
+		reply = m_serverSocket ? m_serverSocket->getMemoryBudget().describe() : "error: no server";
+	}
+	else if (request == "stats") {
+		reply = m_serverSocket ? m_serverSocket->getTelemetry().describe() : "error: no server";
+	}
+	else if (request.compare(0, 6, "stats ") == 0) {
+		int clientId = std::atoi(request.c_str() + 6);
+		reply = m_serverSocket ? m_serverSocket->getTelemetry().describe(clientId) : "error: no server";
+	}
+	else if (request == "fanout") {
+		reply = m_serverSocket ? m_serverSocket->getFanOut().describe() : "error: no server";
+	}
+	else if (request == "tls") {
+		reply = m_serverSocket ? m_serverSocket->describeTls() : "error: no server";
+	}
+	else if (request == "sessions") {
+		reply = m_serverSocket ? m_serverSocket->getSessions().describe() : "error: no server";
+	}
+	else if (request == "config") {
+		reply = m_serverSocket ? m_serverSocket->describeConfig() : "error: no server";
+	}
+	else if (request == "config-reload") {
+		reply = m_serverSocket ? m_serverSocket->reloadConfig() : "error: no server";
+	}
+	else if (request == "latency") {
+		reply = m_serverSocket ? m_serverSocket->describeLatency() : "error: no server";
+	}
+	else if (request == "latency-reset") {
+		if (m_serverSocket) {
+			m_serverSocket->resetLatency();
+		}
+		reply = "latency statistics reset";
+	}
+	else {
+		reply = "error: unknown admin command";
+	}
+
+	std::cout << "Admin command from client " << ctx.clientId << ": " << request << " -> " << reply << std::endl;
+	CPacket replyPacket(static_cast<int>(Type::ADMIN), reinterpret_cast<const uint8_t*>(reply.data()), reply.size());
+	sendPacketToClient(ctx.clientId, replyPacket);
 	return 0;
 }
 
+// 可靠会话 - 新建或按令牌恢复，回复和重发由 CServerSocket 放入发送队列
+int CCommand::handle(CommandContext& ctx, const SessionMsg& msg) {
+	if (!m_serverSocket || !m_clientManager.hasClient(ctx.clientId)) {
+		return -1;
+	}
+	return m_serverSocket->openSession(ctx.clientId, std::string(msg.token), msg.ack) ? 0 : -1;
+}
+
+// 会话确认 - 丢弃窗口中已确认的帧
+int CCommand::handle(CommandContext& ctx, const SessionAckMsg& msg) {
+	std::shared_ptr<CSession> session = m_serverSocket ? m_serverSocket->getSessions().find(ctx.clientId) : nullptr;
+	if (!session) {
+		return -1;
+	}
+	if (!session->ack(msg.seq)) {
+		std::cerr << "Client " << ctx.clientId << " acknowledged unsent frame " << msg.seq << std::endl;
+		return -1;
+	}
+	return 0;
+}
@@ -1,15 +1,44 @@
 #pragma once
 #include <list>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 #include "ClientManager.h"
 #include "CQueue.h"
+#include "ChunkStore.h"
+#include "Coroutine.h"
 
 
 class CPacket;
 class CServerSocket;
 
+// 解码后的消息结构，定义见 CommandMessages.h
+struct TextMessageMsg;
+struct FileStartMsg;
+struct FileDataMsg;
+struct FileCompleteMsg;
+struct TestConnectMsg;
+struct CapabilityMsg;
+struct HistoryRequestMsg;
+struct PresenceSyncMsg;
+struct SetUsernameMsg;
+struct FileManifestMsg;
+struct ChunkRequestMsg;
+struct ChunkDataMsg;
+struct AdminMsg;
+struct SessionMsg;
+struct SessionAckMsg;
+
+// 命令处理上下文 - 取代原先的四个输出参数
+struct CommandContext {
+	std::list<CPacket>& lstPacket;     // 同步处理结果
+	PacketQueue& packetQueue;          // 异步处理队列
+	const CPacket& inPacket;           // 原始数据包，用于原样转发
+	int clientId;                      // 发送方客户端ID
+	CTask<int>* continuation;          // 协程处理函数的任务，由连接的协程等待；为空时不支持协程处理函数
+};
+
 class CCommand {
 public:
 	enum class Type : uint16_t {
@@ -17,24 +46,48 @@ public:
 		FILE_START = 2,        // 文件首包
 		FILE_DATA = 3,         // 文件数据
 		FILE_COMPLETE = 4,     // 文件传输完成
+		CAPABILITY = 5,        // 能力协商(压缩编码)
+		HISTORY_REQUEST = 6,   // 请求历史消息回放
+		PRESENCE_DELTA = 7,    // 在线状态增量(服务器下发)
+		PRESENCE_SNAPSHOT = 8, // 在线状态快照(服务器下发)
+		PRESENCE_SYNC = 9,     // 在线状态同步请求(携带客户端版本号)
+		SET_USERNAME = 10,     // 设置用户名
+		FILE_MANIFEST = 11,    // 文件清单(分块摘要)，双向
+		CHUNK_REQUEST = 12,    // 请求缺少的分块，双向
+		CHUNK_DATA = 13,       // 分块数据，双向
+		ADMIN = 14,            // 管理命令(文本)，只接受本机客户端
+		SESSION = 15,          // 建立或恢复可靠会话
+		SESSION_ACK = 16,      // 会话累计确认
+		SESSION_MOVED = 17,    // 会话恢复后客户端ID变更(服务器下发)
 		TEST_CONNECT = 1981    // 测试连接
 	};
 
-	// 命令处理函数类型 - 支持同步(lstPacket)和异步(packetQueue)双重处理
-	using CMDFUNC = int (CCommand::*)(std::list<CPacket>&, PacketQueue&, CPacket&, int);
+	// 能力协商负载中编码ID之外的功能位，旧版本服务器会把它当作未知编码忽略
+	static constexpr uint8_t FEATURE_CHUNKS = 0x80;    // 支持接收文件清单
+	static constexpr uint8_t FEATURE_PING = 0x40;      // 原样回送服务器发出的TEST_CONNECT探测
 
 	CCommand();
 	~CCommand() = default;
 
 	// 执行命令：根据命令ID处理具体业务逻辑
 	// 支持同步(lstPacket)和异步(packetQueue)两种处理方式
-	int ExecuteCommand(int nCmd, std::list<CPacket>& lstPacket, PacketQueue& packetQueue, CPacket& inPacket, int clientId = -1);
+	// 分发表在编译期生成(见 Command.cpp 中的 CommandTable)，命令ID直接索引到处理函数
+	// 协程处理函数不在这里执行完，而是把任务放入continuation，由调用方 co_await
+	int ExecuteCommand(int nCmd, std::list<CPacket>& lstPacket, PacketQueue& packetQueue, CPacket& inPacket, int clientId = -1,
+		CTask<int>* continuation = nullptr);
+
+	// 该命令的后续工作(压缩、落盘等)是否应交给工作线程，而不在epoll线程执行
+	static bool isOffloaded(int nCmd);
 
 	// 客户端管理
 	void addClient(int clientSocket, int clientId, const std::string& ip, int port);
 	void removeClient(int clientId);
 	void updateClientUsername(int clientId, const std::string& username);
 
+	// 集群中其他节点的客户端，只出现在在线用户列表中
+	void updateRemoteClient(int clientId, const std::string& username);
+	void removeRemoteClient(int clientId);
+
 	// 获取客户端信息
 	const ClientManager& getClientManager() const { return m_clientManager; }
 	ClientManager& getClientManager() { return m_clientManager; }
@@ -42,21 +95,66 @@ public:
 	// 数据包路由
 	void setServerSocket(class CServerSocket* serverSocket) { m_serverSocket = serverSocket; }
 
+	// 过载时合并的在线状态增量，每个采样周期发送一次
+	void flushPresence();
+
 private:
-	std::map<int, CMDFUNC> m_mapFunction;
+	template<typename... Msgs> friend struct CommandTable;
+
 	ClientManager m_clientManager;                    // 客户端管理器
 	class CServerSocket* m_serverSocket;
 
-	// 命令处理器 - 支持同步和异步双重处理
-	int handleTextMessage(std::list<CPacket>& lstPacket, PacketQueue& packetQueue, CPacket& inPacket, int clientId);
-	int handleFileStart(std::list<CPacket>& lstPacket, PacketQueue& packetQueue, CPacket& inPacket, int clientId);
-	int handleFileData(std::list<CPacket>& lstPacket, PacketQueue& packetQueue, CPacket& inPacket, int clientId);
-	int handleFileComplete(std::list<CPacket>& lstPacket, PacketQueue& packetQueue, CPacket& inPacket, int clientId);
-	int handleTestConnect(std::list<CPacket>& lstPacket, PacketQueue& packetQueue, CPacket& inPacket, int clientId);
+	// 命令处理器 - 按消息类型重载，由分发表在解码后调用
+	// 需要挂起的处理函数写成协程：参数为(客户端ID, 消息)且按值传递，挂起期间上下文已不存在
+	int handle(CommandContext& ctx, const TextMessageMsg& msg);
+	int handle(CommandContext& ctx, const FileStartMsg& msg);
+	int handle(CommandContext& ctx, const FileDataMsg& msg);
+	int handle(CommandContext& ctx, const FileCompleteMsg& msg);
+	int handle(CommandContext& ctx, const TestConnectMsg& msg);
+	int handle(CommandContext& ctx, const CapabilityMsg& msg);
+	int handle(CommandContext& ctx, const HistoryRequestMsg& msg);
+	int handle(CommandContext& ctx, const PresenceSyncMsg& msg);
+	int handle(CommandContext& ctx, const SetUsernameMsg& msg);
+	int handle(CommandContext& ctx, const FileManifestMsg& msg);
+	CTask<int> handle(int clientId, ChunkRequestMsg msg);
+	int handle(CommandContext& ctx, const ChunkDataMsg& msg);
+	int handle(CommandContext& ctx, const AdminMsg& msg);
+	int handle(CommandContext& ctx, const SessionMsg& msg);
+	int handle(CommandContext& ctx, const SessionAckMsg& msg);
+
+	// 分块文件分发
+	// 上传：发送方的清单中还有分块未收到
+	struct PendingUpload {
+		FileManifest manifest;
+		std::set<std::string> missing;
+	};
+	// 下发：已发出清单、等待接收方请求分块
+	struct PendingDownload {
+		FileManifest manifest;
+		std::set<int> recipients;
+	};
+	std::map<std::pair<int, uint32_t>, PendingUpload> m_uploads;   // (clientId, 传输ID)
+	std::map<uint32_t, PendingDownload> m_downloads;               // 服务器分配的传输ID
+	uint32_t m_nextTransferId;
+	bool m_presenceDeferred;                          // 有合并中尚未发送的在线状态增量
+	uint64_t m_presenceDeferredFrom;                  // 合并开始前的版本号
+
+	static const uint64_t LEGACY_PACE_MS = 10;        // 旧方式发送文件时检查接收方发送队列的间隔
+
+	CTask<int> sendChunks(int clientId, uint32_t transferId, std::vector<uint32_t> indices);
+	void onChunkStored(int clientId, const std::string& hash, bool valid);
+	void distributeFile(int senderId, const FileManifest& manifest);
+	// 逐块发给旧客户端和集群其他节点，每块之前等接收方的发送队列排空到低水位
+	CTask<> streamLegacyFile(int senderId, FileManifest manifest, std::vector<int> recipients, bool forwardToPeers);
+	void announceFile(int senderId);
+	// 取出分块，已淘汰到磁盘的在工作线程中读回，不阻塞epoll线程
+	CTask<CChunkStore::Chunk> loadChunk(int clientId, std::string hash);
+	void dropTransfers(int clientId);
 
 	// 辅助方法
 	void broadcastPacket(const CPacket& packet, int excludeClientId = -1);
 	void sendPacketToClient(int clientId, const CPacket& packet);
 	void sendSystemMessage(const std::string& message, int excludeClientId = -1);
+	void publishPresence(uint64_t previousVersion);
 };
 
@@ -0,0 +1,315 @@
+#pragma once
+#include <string_view>
+#include "Command.h"
+#include "Packet.h"
+#include "ChunkStore.h"
+#include "Sha256.h"
+#include "Session.h"
+#include "Schema.h"
+
+// 每个命令对应一个解码后的消息结构
+// type   : 对应的 CCommand::Type，分发表据此生成索引
+// Schema : 负载的字段布局(见 Schema.h)，编码和解码由它生成
+// decode : 从数据包解码，视图直接指向包内数据，不做拷贝；字段之外的取值检查也在这里
+// offload: 为true时后续的编码/发送准备在工作线程中完成，不阻塞epoll线程
+// 新增命令：在 CCommand::Type 中添加枚举值，定义消息结构，
+//          声明 CCommand::handle 重载，并加入 Command.cpp 的 Commands 列表
+// 只由服务器发出的消息(如 CapabilityReplyMsg)只需要 type 和 Schema，用 encodePacket 生成数据包
+
+// 聊天消息 - 负载为文本
+struct TextMessageMsg {
+	static constexpr CCommand::Type type = CCommand::Type::TEXT_MESSAGE;
+	static constexpr const char* label = "TEXT_MESSAGE";
+	static constexpr bool offload = false;
+	std::string_view text;
+
+	using Schema = schema::Message<schema::Rest<&TextMessageMsg::text>>;
+
+	static bool decode(const CPacket& packet, TextMessageMsg& msg) {
+		return Schema::decode(packet.getData(), msg);
+	}
+};
+
+// 文件首包
+//   旧格式  : 负载只有文件名
+//   版本格式: 0x00 + 版本号(1) + 文件名长度(2) + 文件名 + [版本1] 文件大小(8)
+// 文件名不会以0字节开头，据此区分两种格式；版本号高于 VERSION 时忽略末尾不认识的字段
+struct FileStartMsg {
+	static constexpr CCommand::Type type = CCommand::Type::FILE_START;
+	static constexpr const char* label = "FILE_START";
+	static constexpr bool offload = false;
+	static constexpr uint8_t VERSION = 1;
+	uint8_t version = 0;               // 0为旧格式
+	std::string_view filename;
+	uint64_t size = 0;                 // 0表示发送方没有给出
+
+	using LegacySchema = schema::Message<schema::Rest<&FileStartMsg::filename>>;
+	using Schema = schema::Message<
+		schema::Magic<0>,
+		schema::Version<&FileStartMsg::version, VERSION>,
+		schema::Blob<&FileStartMsg::filename, uint16_t>,
+		schema::Since<1, schema::Int<&FileStartMsg::size>>>;
+
+	static bool decode(const CPacket& packet, FileStartMsg& msg) {
+		std::string_view payload = packet.getData();
+		bool ok = !payload.empty() && payload[0] == '\0' ? Schema::decode(payload, msg) : LegacySchema::decode(payload, msg);
+		return ok && !msg.filename.empty();
+	}
+
+	static bool encode(const FileStartMsg& msg, std::string& out) {
+		return msg.version == 0 ? LegacySchema::encode(msg, out) : Schema::encode(msg, out);
+	}
+};
+
+// 文件数据 - 负载为数据块
+struct FileDataMsg {
+	static constexpr CCommand::Type type = CCommand::Type::FILE_DATA;
+	static constexpr const char* label = "FILE_DATA";
+	static constexpr bool offload = true;
+	std::string_view chunk;
+
+	using Schema = schema::Message<schema::Rest<&FileDataMsg::chunk>>;
+
+	static bool decode(const CPacket& packet, FileDataMsg& msg) {
+		return Schema::decode(packet.getData(), msg);
+	}
+};
+
+// 文件传输完成 - 负载内容不关心(服务器分发时带上文件名)
+struct FileCompleteMsg {
+	static constexpr CCommand::Type type = CCommand::Type::FILE_COMPLETE;
+	static constexpr const char* label = "FILE_COMPLETE";
+	static constexpr bool offload = false;
+	std::string_view filename;
+
+	using Schema = schema::Message<schema::Rest<&FileCompleteMsg::filename>>;
+
+	static bool decode(const CPacket& packet, FileCompleteMsg& msg) {
+		return Schema::decode(packet.getData(), msg);
+	}
+};
+
+// 测试连接 - 负载内容不关心
+struct TestConnectMsg {
+	static constexpr CCommand::Type type = CCommand::Type::TEST_CONNECT;
+	static constexpr const char* label = "TEST_CONNECT";
+	static constexpr bool offload = false;
+	std::string_view payload;
+
+	using Schema = schema::Message<schema::Rest<&TestConnectMsg::payload>>;
+
+	static bool decode(const CPacket& packet, TestConnectMsg& msg) {
+		return Schema::decode(packet.getData(), msg);
+	}
+};
+
+// 能力协商 - 负载为客户端支持的编码ID列表
+struct CapabilityMsg {
+	static constexpr CCommand::Type type = CCommand::Type::CAPABILITY;
+	static constexpr const char* label = "CAPABILITY";
+	static constexpr bool offload = false;
+	std::string_view codecs;
+
+	using Schema = schema::Message<schema::Rest<&CapabilityMsg::codecs>>;
+
+	static bool decode(const CPacket& packet, CapabilityMsg& msg) {
+		return Schema::decode(packet.getData(), msg);
+	}
+};
+
+// 能力协商回复(服务器发出) - 选定的编码ID(1) + [接受的功能位(1)]，没有功能位时省略，旧客户端只收到1字节
+struct CapabilityReplyMsg {
+	static constexpr CCommand::Type type = CCommand::Type::CAPABILITY;
+	uint8_t codec = 0;
+	uint8_t features = 0;
+
+	using Schema = schema::Message<
+		schema::Int<&CapabilityReplyMsg::codec>,
+		schema::Trailing<schema::Int<&CapabilityReplyMsg::features>>>;
+};
+
+// 历史回放请求 - 模式(1字节) + 参数(8字节,网络字节序)
+// 模式 LAST : 参数为条数；模式 SINCE : 参数为起始时间戳(毫秒)
+struct HistoryRequestMsg {
+	static constexpr CCommand::Type type = CCommand::Type::HISTORY_REQUEST;
+	static constexpr const char* label = "HISTORY_REQUEST";
+	static constexpr bool offload = false;
+	enum Mode : uint8_t { LAST = 0, SINCE = 1 };
+	uint8_t mode = LAST;
+	uint64_t value = 0;
+
+	using Schema = schema::Message<schema::Int<&HistoryRequestMsg::mode>, schema::Int<&HistoryRequestMsg::value>>;
+
+	static bool decode(const CPacket& packet, HistoryRequestMsg& msg) {
+		return Schema::decode(packet.getData(), msg) && (msg.mode == LAST || msg.mode == SINCE);
+	}
+};
+
+// 在线状态同步 - 客户端已知的版本号(8字节,网络字节序)，0表示没有本地列表
+struct PresenceSyncMsg {
+	static constexpr CCommand::Type type = CCommand::Type::PRESENCE_SYNC;
+	static constexpr const char* label = "PRESENCE_SYNC";
+	static constexpr bool offload = false;
+	uint64_t version = 0;
+
+	using Schema = schema::Message<schema::Int<&PresenceSyncMsg::version>>;
+
+	static bool decode(const CPacket& packet, PresenceSyncMsg& msg) {
+		return Schema::decode(packet.getData(), msg);
+	}
+};
+
+// 设置用户名 - 负载为用户名，最长 MAX_NAME 字节
+struct SetUsernameMsg {
+	static constexpr CCommand::Type type = CCommand::Type::SET_USERNAME;
+	static constexpr const char* label = "SET_USERNAME";
+	static constexpr bool offload = false;
+	static constexpr size_t MAX_NAME = 64;
+	std::string_view name;
+
+	using Schema = schema::Message<schema::Rest<&SetUsernameMsg::name>>;
+
+	static bool decode(const CPacket& packet, SetUsernameMsg& msg) {
+		return Schema::decode(packet.getData(), msg) && !msg.name.empty() && msg.name.size() <= MAX_NAME;
+	}
+};
+
+// 文件清单 - 条目列表的编码见 FileManifest(用 schema::Reader/Writer 逐条读写)；服务器回复 CHUNK_REQUEST 列出需要上传的分块
+struct FileManifestMsg {
+	static constexpr CCommand::Type type = CCommand::Type::FILE_MANIFEST;
+	static constexpr const char* label = "FILE_MANIFEST";
+	static constexpr bool offload = false;
+	FileManifest manifest;
+
+	static bool decode(const CPacket& packet, FileManifestMsg& msg) {
+		return FileManifest::decode(packet.getData(), msg.manifest);
+	}
+};
+
+// 分块请求 - 传输ID(4) + 个数(4) + [分块序号(4)]...，网络字节序，双向使用
+// 解码出的序号列表指向包内数据，服务器发出时指向本地数组
+struct ChunkRequestMsg {
+	static constexpr CCommand::Type type = CCommand::Type::CHUNK_REQUEST;
+	static constexpr const char* label = "CHUNK_REQUEST";
+	static constexpr bool offload = false;
+	uint32_t transferId = 0;
+	schema::U32List indices;
+
+	using Schema = schema::Message<schema::Int<&ChunkRequestMsg::transferId>, schema::List<&ChunkRequestMsg::indices, uint32_t>>;
+
+	static bool decode(const CPacket& packet, ChunkRequestMsg& msg) {
+		return Schema::decode(packet.getData(), msg) && msg.indices.size() <= FileManifest::MAX_CHUNKS;
+	}
+};
+
+// 分块数据 - SHA-256摘要(32) + 数据；摘要校验和写入存储在工作线程中完成
+struct ChunkDataMsg {
+	static constexpr CCommand::Type type = CCommand::Type::CHUNK_DATA;
+	static constexpr const char* label = "CHUNK_DATA";
+	static constexpr bool offload = true;
+	std::string_view hash;
+	std::string_view data;
+
+	using Schema = schema::Message<schema::Bytes<&ChunkDataMsg::hash, CSha256::DIGEST_SIZE>, schema::Rest<&ChunkDataMsg::data>>;
+
+	static bool decode(const CPacket& packet, ChunkDataMsg& msg) {
+		return Schema::decode(packet.getData(), msg) && !msg.data.empty() && msg.data.size() <= FileManifest::MAX_CHUNK_SIZE;
+	}
+};
+
+// 管理命令 - 负载为文本命令，如 "trace-dump"、"trace-rate 100"；回复同一命令字的文本结果
+struct AdminMsg {
+	static constexpr CCommand::Type type = CCommand::Type::ADMIN;
+	static constexpr const char* label = "ADMIN";
+	static constexpr bool offload = false;
+	static constexpr size_t MAX_REQUEST = 256;
+	std::string_view request;
+
+	using Schema = schema::Message<schema::Rest<&AdminMsg::request>>;
+
+	static bool decode(const CPacket& packet, AdminMsg& msg) {
+		return Schema::decode(packet.getData(), msg) && !msg.request.empty() && msg.request.size() <= MAX_REQUEST;
+	}
+};
+
+// 可靠会话请求 - 令牌长度(1) + 令牌 + 已按顺序收到的最后一帧的序号(8)
+// 令牌为空表示新建会话；令牌有效且确认号之后的帧都还在重传窗口中时恢复会话，否则新建(回复中标记未恢复)
+struct SessionMsg {
+	static constexpr CCommand::Type type = CCommand::Type::SESSION;
+	static constexpr const char* label = "SESSION";
+	static constexpr bool offload = false;
+	std::string_view token;
+	uint64_t ack = 0;
+
+	using Schema = schema::Message<schema::Blob<&SessionMsg::token, uint8_t>, schema::Int<&SessionMsg::ack>>;
+
+	static bool decode(const CPacket& packet, SessionMsg& msg) {
+		return Schema::decode(packet.getData(), msg) && (msg.token.empty() || msg.token.size() == CSession::TOKEN_SIZE);
+	}
+};
+
+// 会话回复(服务器发出) - 令牌(16) + 第一个编号帧的序号(8) + 是否恢复(1) + 编码ID(1) + 客户端ID(4)
+// 回复之后发给该客户端的帧依次编号；恢复时先重发确认号之后的帧，编码恢复为会话建立时协商的编码
+struct SessionReplyMsg {
+	static constexpr CCommand::Type type = CCommand::Type::SESSION;
+	std::string_view token;
+	uint64_t firstSeq = 0;
+	uint8_t resumed = 0;
+	uint8_t codec = 0;
+	uint32_t clientId = 0;
+
+	using Schema = schema::Message<
+		schema::Bytes<&SessionReplyMsg::token, CSession::TOKEN_SIZE>,
+		schema::Int<&SessionReplyMsg::firstSeq>,
+		schema::Int<&SessionReplyMsg::resumed>,
+		schema::Int<&SessionReplyMsg::codec>,
+		schema::Int<&SessionReplyMsg::clientId>>;
+};
+
+// 会话累计确认 - 已按顺序收到的最后一帧的序号(8)
+struct SessionAckMsg {
+	static constexpr CCommand::Type type = CCommand::Type::SESSION_ACK;
+	static constexpr const char* label = "SESSION_ACK";
+	static constexpr bool offload = false;
+	uint64_t seq = 0;
+
+	using Schema = schema::Message<schema::Int<&SessionAckMsg::seq>>;
+
+	static bool decode(const CPacket& packet, SessionAckMsg& msg) {
+		return Schema::decode(packet.getData(), msg);
+	}
+};
+
+// 会话恢复通知(服务器发出，广播给其他客户端和集群节点) - 上一个ID(4) + 新ID(4) + 创建会话时的ID(4)
+// 恢复的连接使用新分配的ID，其他客户端据此把上一个ID的在线状态和消息归到同一用户
+struct SessionMovedMsg {
+	static constexpr CCommand::Type type = CCommand::Type::SESSION_MOVED;
+	uint32_t previousId = 0;
+	uint32_t clientId = 0;
+	uint32_t originalId = 0;
+
+	using Schema = schema::Message<
+		schema::Int<&SessionMovedMsg::previousId>,
+		schema::Int<&SessionMovedMsg::clientId>,
+		schema::Int<&SessionMovedMsg::originalId>>;
+};
+
+// 按消息模式编码为数据包；消息自己定义了 encode(如有多种格式)时使用它
+// 变长字段超出长度前缀的范围时返回false
+template<typename Msg>
+bool encodePacket(const Msg& msg, CPacket& packet) {
+	std::string payload;
+	bool ok = false;
+	if constexpr (requires { Msg::encode(msg, payload); }) {
+		ok = Msg::encode(msg, payload);
+	}
+	else {
+		ok = Msg::Schema::encode(msg, payload);
+	}
+	if (!ok) {
+		std::cerr << "failed to encode command " << static_cast<int>(Msg::type) << std::endl;
+		return false;
+	}
+	packet = CPacket(static_cast<uint16_t>(Msg::type), reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+	return true;
+}
@@ -0,0 +1,204 @@
+#include "Compressor.h"
+#include "Command.h"
+#include <arpa/inet.h>
+#include <iostream>
+
+#ifdef SERVEQT_WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef SERVEQT_WITH_ZSTD
+#include <zstd.h>
+#endif
+#ifdef SERVEQT_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+bool CCompressor::isSupported(Codec codec)
+{
+    switch (codec) {
+    case Codec::NONE:
+        return true;
+#ifdef SERVEQT_WITH_LZ4
+    case Codec::LZ4:
+        return true;
+#endif
+#ifdef SERVEQT_WITH_ZSTD
+    case Codec::ZSTD:
+        return true;
+#endif
+#ifdef SERVEQT_WITH_ZLIB
+    case Codec::DEFLATE:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+CCompressor::Codec CCompressor::negotiate(std::string_view clientCodecs)
+{
+    // 每个字节是一个编码ID，按客户端偏好排列
+    for (unsigned char id : clientCodecs) {
+        Codec codec = static_cast<Codec>(id);
+        if (codec != Codec::NONE && isSupported(codec)) {
+            return codec;
+        }
+    }
+    return Codec::NONE;
+}
+
+bool CCompressor::isCompressible(uint16_t cmd)
+{
+    switch (static_cast<CCommand::Type>(cmd)) {
+    case CCommand::Type::TEXT_MESSAGE:
+    case CCommand::Type::FILE_DATA:
+    case CCommand::Type::CHUNK_DATA:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool CCompressor::compress(Codec codec, const std::string& in, std::string& out)
+{
+    if (in.size() > MAX_DECOMPRESSED_SIZE) {
+        return false;
+    }
+
+    // 前4字节记录原始长度
+    uint32_t rawSize = htonl(static_cast<uint32_t>(in.size()));
+    out.assign(reinterpret_cast<const char*>(&rawSize), 4);
+
+    switch (codec) {
+#ifdef SERVEQT_WITH_LZ4
+    case Codec::LZ4: {
+        int bound = LZ4_compressBound(static_cast<int>(in.size()));
+        out.resize(4 + bound);
+        int n = LZ4_compress_default(in.data(), &out[4], static_cast<int>(in.size()), bound);
+        if (n <= 0) {
+            return false;
+        }
+        out.resize(4 + n);
+        return true;
+    }
+#endif
+#ifdef SERVEQT_WITH_ZSTD
+    case Codec::ZSTD: {
+        size_t bound = ZSTD_compressBound(in.size());
+        out.resize(4 + bound);
+        size_t n = ZSTD_compress(&out[4], bound, in.data(), in.size(), 1);
+        if (ZSTD_isError(n)) {
+            return false;
+        }
+        out.resize(4 + n);
+        return true;
+    }
+#endif
+#ifdef SERVEQT_WITH_ZLIB
+    case Codec::DEFLATE: {
+        uLongf n = compressBound(in.size());
+        out.resize(4 + n);
+        if (compress2(reinterpret_cast<Bytef*>(&out[4]), &n,
+            reinterpret_cast<const Bytef*>(in.data()), in.size(), Z_BEST_SPEED) != Z_OK) {
+            return false;
+        }
+        out.resize(4 + n);
+        return true;
+    }
+#endif
+    default:
+        return false;
+    }
+}
+
+bool CCompressor::decompress(Codec codec, const std::string& in, std::string& out)
+{
+    if (in.size() < 4) {
+        return false;
+    }
+    uint32_t rawSize = 0;
+    memcpy(&rawSize, in.data(), 4);
+    rawSize = ntohl(rawSize);
+    if (rawSize > MAX_DECOMPRESSED_SIZE) {
+        std::cerr << "Compressor: decompressed size too large: " << rawSize << std::endl;
+        return false;
+    }
+
+    out.resize(rawSize);
+    [[maybe_unused]] const char* src = in.data() + 4;
+    [[maybe_unused]] size_t srcSize = in.size() - 4;
+
+    switch (codec) {
+#ifdef SERVEQT_WITH_LZ4
+    case Codec::LZ4: {
+        int n = LZ4_decompress_safe(src, &out[0], static_cast<int>(srcSize), static_cast<int>(rawSize));
+        return n >= 0 && static_cast<uint32_t>(n) == rawSize;
+    }
+#endif
+#ifdef SERVEQT_WITH_ZSTD
+    case Codec::ZSTD: {
+        size_t n = ZSTD_decompress(&out[0], rawSize, src, srcSize);
+        return !ZSTD_isError(n) && n == rawSize;
+    }
+#endif
+#ifdef SERVEQT_WITH_ZLIB
+    case Codec::DEFLATE: {
+        uLongf n = rawSize;
+        if (uncompress(reinterpret_cast<Bytef*>(&out[0]), &n,
+            reinterpret_cast<const Bytef*>(src), srcSize) != Z_OK) {
+            return false;
+        }
+        return n == rawSize;
+    }
+#endif
+    default:
+        return false;
+    }
+}
+
+bool CCompressor::compressPacket(const CPacket& in, Codec codec, CPacket& out)
+{
+    if (codec == Codec::NONE || in.isCompressed() || !isCompressible(in.getCmd())) {
+        return false;
+    }
+    const std::string& raw = in.getData();
+    if (raw.size() < MIN_COMPRESS_SIZE) {
+        return false;
+    }
+
+    std::string packed;
+    if (!compress(codec, raw, packed) || packed.size() >= raw.size()) {
+        return false; // 没有收益，发送原包
+    }
+
+    out = CPacket(in.getCmd(), reinterpret_cast<const uint8_t*>(packed.data()), packed.size());
+    out.setCompressed(true);
+    return true;
+}
+
+bool CCompressor::decompressPacket(const CPacket& in, Codec codec, CPacket& out)
+{
+    if (!in.isCompressed()) {
+        return false;
+    }
+
+    std::string raw;
+    if (!decompress(codec, in.getData(), raw) || raw.empty()) {
+        std::cerr << "Compressor: failed to decompress packet with codec " << name(codec) << std::endl;
+        return false;
+    }
+
+    out = CPacket(in.getCmd(), reinterpret_cast<const uint8_t*>(raw.data()), raw.size());
+    return true;
+}
+
+const char* CCompressor::name(Codec codec)
+{
+    switch (codec) {
+    case Codec::NONE: return "none";
+    case Codec::LZ4: return "lz4";
+    case Codec::ZSTD: return "zstd";
+    case Codec::DEFLATE: return "deflate";
+    default: return "unknown";
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Packet.h"
+
+// 负载压缩 - 每个连接通过 CAPABILITY 命令协商一种编码
+// 压缩后的负载格式：原始长度(4字节,网络字节序) + 编码数据
+// 可用的编码由编译宏决定：SERVEQT_WITH_LZ4 / SERVEQT_WITH_ZSTD / SERVEQT_WITH_ZLIB
+class CCompressor
+{
+public:
+    enum class Codec : uint8_t {
+        NONE = 0,       // 不压缩
+        LZ4 = 1,        // LZ4 - 速度优先
+        ZSTD = 2,       // zstd - 压缩率优先
+        DEFLATE = 3     // zlib deflate - 兼容后备
+    };
+
+    // 小于该长度的负载不值得压缩
+    static const size_t MIN_COMPRESS_SIZE = 128;
+    // 解压后允许的最大长度，防止解压炸弹
+    static const size_t MAX_DECOMPRESSED_SIZE = 64 * 1024 * 1024;
+
+    // 当前构建是否支持该编码
+    static bool isSupported(Codec codec);
+
+    // 按客户端偏好顺序选择第一个支持的编码，没有则返回 NONE
+    static Codec negotiate(std::string_view clientCodecs);
+
+    // 只对文本和文件数据压缩
+    static bool isCompressible(uint16_t cmd);
+
+    // 压缩/解压原始负载
+    static bool compress(Codec codec, const std::string& in, std::string& out);
+    static bool decompress(Codec codec, const std::string& in, std::string& out);
+
+    // 数据包级别的封装：压缩失败或没有收益时返回 false，调用方发送原包
+    static bool compressPacket(const CPacket& in, Codec codec, CPacket& out);
+    static bool decompressPacket(const CPacket& in, Codec codec, CPacket& out);
+
+    static const char* name(Codec codec);
+};
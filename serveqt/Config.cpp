@@ -0,0 +1,440 @@
+#include "Config.h"
+#include "Federation.h"
+#include "Listener.h"
+#include <climits>
+#include <cstdlib>
+#include <errno.h>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+namespace {
+
+// 一个参数：set把文本转换后写入(不合法时返回false)，get给出文本形式(比较、显示、重载时写回)
+struct Option {
+    enum Kind {
+        VALUE,
+        FLAG,          // 命令行中不带值
+        LIST           // 可以出现多次
+    };
+
+    // set/get/clear 由各 xxxOption 函数在构造后设置
+    Option(const std::string& name, Kind kind, bool reloadable, const std::string& expected, const std::string& help)
+        : name(name), kind(kind), reloadable(reloadable), expected(expected), help(help) {
+    }
+
+    std::string name;
+    Kind kind;
+    bool reloadable;
+    std::string expected;                                      // 出错时提示的取值范围
+    std::string help;
+    std::function<bool(ServerConfig&, const std::string&)> set;
+    std::function<std::string(const ServerConfig&)> get;
+    std::function<void(ServerConfig&)> clear;                  // 只有LIST使用
+};
+
+std::string trim(const std::string& text)
+{
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string::npos) {
+        return "";
+    }
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+bool parseInt(const std::string& text, long min, long max, long& value)
+{
+    if (text.empty()) {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if (*end != '\0' || errno == ERANGE || parsed < min || parsed > max) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+bool parseFlag(const std::string& text, bool& value)
+{
+    if (text == "on" || text == "true" || text == "yes" || text == "1") {
+        value = true;
+        return true;
+    }
+    if (text == "off" || text == "false" || text == "no" || text == "0") {
+        value = false;
+        return true;
+    }
+    return false;
+}
+
+Option intOption(const char* name, int ServerConfig::* field, long min, long max, bool reloadable, const char* help)
+{
+    Option option{ name, Option::VALUE, reloadable, std::to_string(min) + ".." + std::to_string(max), help };
+    option.set = [field, min, max](ServerConfig& config, const std::string& text) {
+        long value = 0;
+        if (!parseInt(text, min, max, value)) {
+            return false;
+        }
+        config.*field = static_cast<int>(value);
+        return true;
+    };
+    option.get = [field](const ServerConfig& config) { return std::to_string(config.*field); };
+    return option;
+}
+
+Option textOption(const char* name, std::string ServerConfig::* field, const char* help)
+{
+    Option option{ name, Option::VALUE, false, "a string", help };
+    option.set = [field](ServerConfig& config, const std::string& text) {
+        config.*field = text;
+        return true;
+    };
+    option.get = [field](const ServerConfig& config) { return config.*field; };
+    return option;
+}
+
+Option flagOption(const char* name, bool ServerConfig::* field, bool reloadable, const char* help)
+{
+    Option option{ name, Option::FLAG, reloadable, "on/off", help };
+    option.set = [field](ServerConfig& config, const std::string& text) { return parseFlag(text, config.*field); };
+    option.get = [field](const ServerConfig& config) { return std::string(config.*field ? "on" : "off"); };
+    return option;
+}
+
+Option listOption(const char* name, std::vector<std::string> ServerConfig::* field, const char* help)
+{
+    Option option{ name, Option::LIST, false, "a non-empty string", help };
+    option.set = [field](ServerConfig& config, const std::string& text) {
+        if (text.empty()) {
+            return false;
+        }
+        (config.*field).push_back(text);
+        return true;
+    };
+    option.get = [field](const ServerConfig& config) {
+        std::string joined;
+        for (const auto& item : config.*field) {
+            joined += (joined.empty() ? "" : ",") + item;
+        }
+        return joined;
+    };
+    option.clear = [field](ServerConfig& config) { (config.*field).clear(); };
+    return option;
+}
+
+Option microsecondOption(const char* name, uint32_t LatencyOptions::* field, bool reloadable, const char* help)
+{
+    Option option{ name, Option::VALUE, reloadable, "0..1000000", help };
+    option.set = [field](ServerConfig& config, const std::string& text) {
+        long value = 0;
+        if (!parseInt(text, 0, 1000000, value)) {
+            return false;
+        }
+        config.latency.*field = static_cast<uint32_t>(value);
+        return true;
+    };
+    option.get = [field](const ServerConfig& config) { return std::to_string(config.latency.*field); };
+    return option;
+}
+
+const std::vector<Option>& options()
+{
+    static const std::vector<Option> table = [] {
+        std::vector<Option> list;
+        // 监听
+        list.push_back(textOption("ip", &ServerConfig::ip, "Address to listen on when no listen is given"));
+        list.push_back(intOption("port", &ServerConfig::port, 1, 65535, false, "Port to listen on when no listen is given"));
+        list.push_back(listOption("listen", &ServerConfig::listeners, "Listen address: ip:port, [ipv6]:port, unix:/path, tls:ip:port (repeatable)"));
+
+        // 连接和socket
+        list.push_back(intOption("max-clients", &ServerConfig::maxClients, 0, 1000000, true, "Refuse new connections beyond this many clients (0 = unlimited)"));
+        list.push_back(intOption("max-events", &ServerConfig::maxEvents, 1, 65536, false, "Events taken per epoll_wait"));
+        list.push_back(intOption("read-size", &ServerConfig::readSize, 1024, 16 * 1024 * 1024, true, "Bytes read from a client socket per recv"));
+        list.push_back(intOption("send-buffer-kb", &ServerConfig::sendBufferKb, 0, 1024 * 1024, true, "SO_SNDBUF of new client sockets (0 = kernel default)"));
+        list.push_back(intOption("receive-buffer-kb", &ServerConfig::receiveBufferKb, 0, 1024 * 1024, true, "SO_RCVBUF of new client sockets (0 = kernel default)"));
+        list.push_back(flagOption("tcp-nodelay", &ServerConfig::noDelay, true, "TCP_NODELAY on new client sockets"));
+        list.push_back(intOption("notsent-lowat-kb", &ServerConfig::notSentLowatKb, 0, 1024 * 1024, true, "TCP_NOTSENT_LOWAT of new client sockets (0 = not set)"));
+        list.push_back(intOption("write-batch-kb", &ServerConfig::writeBatchKb, 1, 16 * 1024, true, "Largest batch taken from a send queue per writev"));
+        list.push_back(intOption("worker-threads", &ServerConfig::workerThreads, 0, 1024, false, "Worker threads (0 = one less than the CPU count)"));
+
+        // 历史、热重启、集群
+        list.push_back(textOption("history", &ServerConfig::historyDir, "Message history directory (disabled if empty)"));
+        list.push_back(intOption("replay-on-join", &ServerConfig::joinReplay, 0, INT_MAX, true, "History messages replayed to each new client"));
+        list.push_back(textOption("handoff", &ServerConfig::handoffPath, "Hot restart handoff socket (disabled if empty)"));
+        list.push_back(intOption("node-id", &ServerConfig::nodeId, 1, CFederation::MAX_NODE_ID, false, "Federation node id"));
+        list.push_back(intOption("federation-port", &ServerConfig::federationPort, 0, 65535, false, "Port other nodes connect to"));
+        list.push_back(listOption("peer", &ServerConfig::peers, "Other federation node, host:port (repeatable)"));
+
+        // 传输
+        list.push_back(textOption("shm", &ServerConfig::shmPath, "Shared memory transport handshake socket (disabled if empty)"));
+        list.push_back(textOption("tls-cert", &ServerConfig::tlsCert, "Certificate chain for tls: listeners (PEM)"));
+        list.push_back(textOption("tls-key", &ServerConfig::tlsKey, "Private key for tls: listeners (PEM)"));
+        list.push_back(flagOption("ktls", &ServerConfig::ktls, false, "Hand TLS keys to the kernel after the handshake"));
+
+        // 诊断
+        list.push_back(intOption("trace-sample", &ServerConfig::traceSample, 0, INT_MAX, true, "Trace one in N events (0 = off)"));
+        list.push_back(textOption("trace-dir", &ServerConfig::traceDir, "Where trace dumps are written"));
+        list.push_back(textOption("capture", &ServerConfig::capturePath, "Inbound traffic capture file (disabled if empty)"));
+
+        // 存储和内存
+        list.push_back(textOption("chunk-cache", &ServerConfig::chunkDir, "Chunk cache spill directory (memory only if empty)"));
+        list.push_back(intOption("chunk-cache-mb", &ServerConfig::chunkCacheMb, 1, INT_MAX, false, "Chunk cache memory limit"));
+        list.push_back(intOption("overload-rss-mb", &ServerConfig::overloadRssMb, 0, INT_MAX, true, "Shed load as resident memory approaches this (0 = off)"));
+        list.push_back(intOption("mem-budget-mb", &ServerConfig::memBudgetMb, 0, INT_MAX, true, "All connection buffers (0 = unlimited)"));
+        list.push_back(intOption("conn-mem-mb", &ServerConfig::connMemMb, 0, INT_MAX, true, "Buffers of one connection (0 = unlimited)"));
+
+        // 低延迟
+        Option pinCpus{ "pin-cpus", Option::VALUE, false, "a list like 2,3 or 2-5", "Pin the event loop to the first CPU and workers to the rest" };
+        pinCpus.set = [](ServerConfig& config, const std::string& text) {
+            std::vector<int> cpus;
+            if (!LatencyOptions::parseCpuList(text, cpus)) {
+                return false;
+            }
+            config.latency.cpus = cpus;
+            return true;
+        };
+        pinCpus.get = [](const ServerConfig& config) {
+            std::string cpus;
+            for (int cpu : config.latency.cpus) {
+                cpus += (cpus.empty() ? "" : ",") + std::to_string(cpu);
+            }
+            return cpus;
+        };
+        list.push_back(pinCpus);
+        list.push_back(microsecondOption("spin-us", &LatencyOptions::spinUs, true, "Poll this long before blocking in epoll_wait"));
+        list.push_back(microsecondOption("busy-poll-us", &LatencyOptions::busyPollUs, false, "SO_BUSY_POLL of client sockets"));
+
+        // 并行扇出
+        Option partitions{ "fanout-partitions", Option::VALUE, false, "auto or 0..1024", "Parallel broadcast partitions (auto = one per worker, 0 = off)" };
+        partitions.set = [](ServerConfig& config, const std::string& text) {
+            long value = -1;
+            if (text != "auto" && !parseInt(text, 0, 1024, value)) {
+                return false;
+            }
+            config.fanOutPartitions = static_cast<int>(value);
+            return true;
+        };
+        partitions.get = [](const ServerConfig& config) {
+            return config.fanOutPartitions < 0 ? std::string("auto") : std::to_string(config.fanOutPartitions);
+        };
+        list.push_back(partitions);
+        list.push_back(intOption("fanout-threshold", &ServerConfig::fanOutThreshold, 1, INT_MAX, true, "Recipients needed to go parallel"));
+
+        // 会话
+        list.push_back(intOption("session-window-kb", &ServerConfig::sessionWindowKb, 0, 1024 * 1024, false, "Retransmit window per session (0 = sessions off)"));
+        list.push_back(intOption("session-timeout", &ServerConfig::sessionTimeoutS, 1, 86400, true, "Seconds a detached session waits for a resume"));
+        return list;
+    }();
+    return table;
+}
+
+const Option* findOption(const std::string& name)
+{
+    for (const auto& option : options()) {
+        if (option.name == name) {
+            return &option;
+        }
+    }
+    return nullptr;
+}
+
+bool applyOption(ServerConfig& config, const std::string& name, const std::string& value, std::string& error)
+{
+    const Option* option = findOption(name);
+    if (!option) {
+        error = "unknown option " + name;
+        return false;
+    }
+    if (!option->set(config, value)) {
+        error = "invalid value \"" + value + "\" for " + name + " (expected " + option->expected + ")";
+        return false;
+    }
+    return true;
+}
+
+}
+
+CConfig::CConfig()
+{
+}
+
+bool CConfig::load(int argc, char* argv[])
+{
+    m_path.clear();
+    m_commandLine.clear();
+    size_t positional = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--config") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --config requires a file." << std::endl;
+                return false;
+            }
+            m_path = argv[++i];
+            continue;
+        }
+        if (arg.compare(0, 2, "--") != 0) {
+            // 位置参数：ip、port
+            if (positional >= 2) {
+                std::cerr << "Error: unexpected argument " << arg << "." << std::endl;
+                return false;
+            }
+            m_commandLine.emplace_back(positional++ == 0 ? "ip" : "port", arg);
+            continue;
+        }
+
+        std::string name = arg.substr(2);
+        const Option* option = findOption(name);
+        if (!option && name.compare(0, 3, "no-") == 0) {
+            const Option* negated = findOption(name.substr(3));
+            if (negated && negated->kind == Option::FLAG) {
+                m_commandLine.emplace_back(negated->name, "off");
+                continue;
+            }
+        }
+        if (!option) {
+            std::cerr << "Error: unknown option " << arg << " (see --help)." << std::endl;
+            return false;
+        }
+        if (option->kind == Option::FLAG) {
+            m_commandLine.emplace_back(name, "on");
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Error: " << arg << " requires a value." << std::endl;
+            return false;
+        }
+        m_commandLine.emplace_back(name, argv[++i]);
+    }
+
+    std::string error;
+    if (!build(m_values, error)) {
+        std::cerr << "Error: " << error << "." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool CConfig::build(ServerConfig& values, std::string& error) const
+{
+    values = ServerConfig();
+
+    if (!m_path.empty()) {
+        std::ifstream file(m_path);
+        if (!file) {
+            error = "cannot open config file " + m_path;
+            return false;
+        }
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(file, line)) {
+            lineNumber++;
+            line = trim(line);
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            std::string where = m_path + ":" + std::to_string(lineNumber) + ": ";
+            size_t equals = line.find('=');
+            if (equals == std::string::npos) {
+                error = where + "expected \"name = value\"";
+                return false;
+            }
+            if (!applyOption(values, trim(line.substr(0, equals)), trim(line.substr(equals + 1)), error)) {
+                error = where + error;
+                return false;
+            }
+        }
+    }
+
+    // 命令行中出现的列表参数替换文件中的全部值
+    std::set<std::string> replaced;
+    for (const auto& pair : m_commandLine) {
+        const Option* option = findOption(pair.first);
+        if (option && option->kind == Option::LIST && replaced.insert(pair.first).second) {
+            option->clear(values);
+        }
+        if (!applyOption(values, pair.first, pair.second, error)) {
+            error = "command line: " + error;
+            return false;
+        }
+    }
+
+    // 参数之间的检查
+    if ((values.federationPort > 0 || !values.peers.empty()) && values.nodeId == 0) {
+        error = "node-id is required with federation-port/peer";
+        return false;
+    }
+    bool tls = false;
+    for (const auto& spec : values.listeners) {
+        ListenEndpoint endpoint;
+        if (!ListenEndpoint::parse(spec, endpoint)) {
+            error = "invalid listen address " + spec;
+            return false;
+        }
+        tls = tls || endpoint.tls;
+    }
+    if (tls && (values.tlsCert.empty() || values.tlsKey.empty())) {
+        error = "tls: listeners need both tls-cert and tls-key";
+        return false;
+    }
+    return true;
+}
+
+bool CConfig::reload(std::vector<std::string>& applied, std::vector<std::string>& restartOnly)
+{
+    ServerConfig next;
+    std::string error;
+    if (!build(next, error)) {
+        std::cerr << "[Config] Reload failed, keeping the current configuration: " << error << std::endl;
+        return false;
+    }
+
+    // 只取可重载参数的新值，其余参数保持启动时的值
+    ServerConfig merged = m_values;
+    for (const auto& option : options()) {
+        std::string before = option.get(m_values);
+        std::string after = option.get(next);
+        if (before == after) {
+            continue;
+        }
+        std::string change = option.name + " " + before + " -> " + after;
+        if (option.reloadable) {
+            option.set(merged, after);
+            applied.push_back(change);
+        }
+        else {
+            restartOnly.push_back(change);
+        }
+    }
+    m_values = merged;
+    return true;
+}
+
+std::string CConfig::describe() const
+{
+    std::ostringstream out;
+    out << "config: " << (m_path.empty() ? std::string("command line only") : m_path)
+        << " (* applied on reload: SIGHUP or admin \"config-reload\")";
+    for (const auto& option : options()) {
+        out << "\n" << option.name << " = " << option.get(m_values) << (option.reloadable ? " *" : "");
+    }
+    return out.str();
+}
+
+void CConfig::usage(std::ostream& out)
+{
+    out << "Usage: serveqt [ip] [port] [--config FILE] [--option value ...]" << std::endl;
+    out << "Options are also accepted as \"option = value\" lines in the config file;" << std::endl;
+    out << "the command line overrides the file. * = applied on reload (SIGHUP)." << std::endl;
+    for (const auto& option : options()) {
+        std::string flag = "--" + option.name + (option.kind == Option::FLAG ? "" : " VALUE");
+        out << "  " << std::left << std::setw(28) << flag << option.help << (option.reloadable ? " *" : "") << std::endl;
+    }
+}
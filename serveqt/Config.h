@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Latency.h"
+#include "MemoryBudget.h"
+#include "FanOut.h"
+#include "Session.h"
+#include "OutboundQueue.h"
+
+// 服务器运行参数 - 取代原来的编译期宏和交互式端口输入，每个部署用配置文件调整，不需要重新编译
+// 默认值与原来的宏/常量相同；字段后标注(可重载)的参数运行中修改配置文件后发送SIGHUP即生效
+struct ServerConfig {
+    // 监听
+    std::string ip = "127.0.0.1";
+    int port = 8080;
+    std::vector<std::string> listeners;            // ip:port、[ipv6]:port、unix:/path、tls:ip:port，为空时监听ip:port
+
+    // 连接和socket
+    int maxClients = 0;                            // 客户端数上限，0不限制(可重载)
+    int maxEvents = 1024;                          // 每次epoll_wait取出的事件数
+    int readSize = 64 * 1024;                      // 每次recv的字节数(可重载)
+    int sendBufferKb = 0;                          // 客户端socket的SO_SNDBUF，0使用内核默认(可重载，对新连接生效)
+    int receiveBufferKb = 0;                       // SO_RCVBUF(可重载，对新连接生效)
+    bool noDelay = false;                          // TCP_NODELAY(可重载，对新连接生效)
+    int notSentLowatKb = 128;                      // TCP_NOTSENT_LOWAT(可重载，对新连接生效)
+    int writeBatchKb = static_cast<int>(COutboundQueue::DEFAULT_BATCH_BYTES >> 10); // 单次writev最多取出的数据(可重载)
+    int workerThreads = 0;                         // 工作线程数，0按CPU核数
+
+    // 历史、热重启、集群
+    std::string historyDir;                        // 为空时不记录
+    int joinReplay = 0;                            // 新连接自动回放的历史条数(可重载)
+    std::string handoffPath;                       // 为空时不启用热重启
+    int nodeId = 0;                                // 0时不启用集群
+    int federationPort = 0;
+    std::vector<std::string> peers;                // host:port
+
+    // 传输
+    std::string shmPath;                           // 为空时不启用共享内存传输
+    std::string tlsCert;
+    std::string tlsKey;
+    bool ktls = true;
+
+    // 诊断
+    int traceSample = 0;                           // 每N个事件采样一个，0不采样(可重载)
+    std::string traceDir = "/tmp";
+    std::string capturePath;                       // 为空时不捕获
+
+    // 存储和内存
+    std::string chunkDir;                          // 为空时只使用内存
+    int chunkCacheMb = 256;
+    int overloadRssMb = 0;                         // 0不限制(可重载)
+    int memBudgetMb = static_cast<int>(CMemoryBudget::DEFAULT_TOTAL_LIMIT >> 20);       // 0不限制(可重载)
+    int connMemMb = static_cast<int>(CMemoryBudget::DEFAULT_CONNECTION_LIMIT >> 20);    // 0不限制(可重载)
+
+    // 低延迟、并行扇出、会话
+    LatencyOptions latency;                        // spinUs可重载
+    int fanOutPartitions = -1;                     // -1每个工作线程一个分区，0不启用
+    int fanOutThreshold = static_cast<int>(CFanOut::DEFAULT_THRESHOLD);                 // (可重载)
+    int sessionWindowKb = static_cast<int>(CSessionTable::DEFAULT_WINDOW >> 10);        // 0不启用会话
+    int sessionTimeoutS = static_cast<int>(CSessionTable::DEFAULT_TIMEOUT_MS / 1000);   // (可重载)
+};
+
+// 配置加载 - 参数名在配置文件和命令行中相同
+//   配置文件  每行 "名称 = 值"，#开始的行是注释；listen、peer可以出现多次；开关写 on/off
+//   命令行    --名称 值；开关写 --名称 或 --no-名称；--config 指定配置文件；另外两个位置参数依次是ip、port
+// 命令行的值覆盖配置文件(listen、peer在命令行中出现时替换文件中的全部地址)，全部参数检查通过才生效
+// 重新加载(SIGHUP、管理命令 "config-reload")重读配置文件再叠加启动时的命令行：
+// 可重载的参数立即应用，其余参数的变化只记录日志，重启(或热重启)后生效；检查失败时保持原配置
+// 只在epoll线程中使用
+class CConfig
+{
+public:
+    CConfig();
+
+    // 解析命令行和配置文件，出错时输出原因并返回false
+    bool load(int argc, char* argv[]);
+    // 重新加载：applied为已应用的变化，restartOnly为需要重启的变化
+    bool reload(std::vector<std::string>& applied, std::vector<std::string>& restartOnly);
+
+    const ServerConfig& values() const { return m_values; }
+    const std::string& path() const { return m_path; }
+
+    // 管理命令 "config"：全部参数的当前值，可重载的参数带*
+    std::string describe() const;
+    static void usage(std::ostream& out);
+
+private:
+    std::string m_path;                                            // 配置文件，为空时只使用命令行
+    std::vector<std::pair<std::string, std::string>> m_commandLine; // 命令行给出的参数(名称, 值)
+    ServerConfig m_values;
+
+    // 默认值 -> 配置文件 -> 命令行，再做参数之间的检查；error为第一个错误
+    bool build(ServerConfig& values, std::string& error) const;
+};
@@ -0,0 +1,131 @@
+#include "Connection.h"
+#include "ServerSocket.h"
+#include <algorithm>
+#include <iostream>
+
+CConnection::CConnection(CServerSocket& server, CScheduler& scheduler, int socket, int clientId,
+    std::shared_ptr<COutboundQueue> outbound)
+    : m_server(server), m_scheduler(scheduler), m_socket(socket), m_clientId(clientId),
+    m_outbound(std::move(outbound)), m_inboxBytes(0), m_holding(false), m_closed(false) {
+}
+
+bool CConnection::deliver(const CPacket& packet) {
+    if (m_closed) {
+        return false;
+    }
+    // 上限只约束积压：收件队列为空(包括协程正在等待)时任何解析器接受的帧(最大 MAX_PACKET_SIZE)都能放入
+    if (!m_inbox.empty() && m_inboxBytes + packet.Size() > MAX_INBOX_BYTES) {
+        return false;
+    }
+    m_inbox.push_back(packet);
+    m_inboxBytes += packet.Size();
+
+    // 协程在等待下一帧：在epoll线程的调用栈上直接处理，与原先的同步处理时机相同
+    if (m_reader) {
+        std::coroutine_handle<> reader = std::exchange(m_reader, {});
+        reader.resume();
+    }
+    return true;
+}
+
+bool CConnection::ReadAwaiter::await_resume() {
+    if (connection.m_closed || connection.m_inbox.empty()) {
+        return false;
+    }
+    packet = std::move(connection.m_inbox.front());
+    connection.m_inbox.pop_front();
+    connection.m_inboxBytes -= packet.Size();
+    return true;
+}
+
+void CConnection::onWritable() {
+    if (!m_senders.empty() && m_outbound->bytes() < SEND_LOW_WATER) {
+        wakeSenders();
+    }
+}
+
+void CConnection::close() {
+    if (m_closed) {
+        return;
+    }
+    m_closed = true;
+    wakeSenders();
+    // 客户端已经移除，socket号可能被新连接复用，未处理的帧直接丢弃
+    m_inbox.clear();
+    m_inboxBytes = 0;
+    m_holding = false;
+    if (m_reader) {
+        m_scheduler.post(std::exchange(m_reader, {}));
+    }
+}
+
+std::string CConnection::takeInbox() {
+    std::string data;
+    // 推迟的帧在队列中的帧之前收到
+    if (m_holding) {
+        data.append(m_held.Serialize());
+        m_holding = false;
+    }
+    for (const CPacket& packet : m_inbox) {
+        data.append(packet.Serialize());
+    }
+    m_inbox.clear();
+    m_inboxBytes = 0;
+    return data;
+}
+
+void CConnection::holdFrame(const CPacket& packet) {
+    m_held = packet;
+    m_holding = true;
+}
+
+bool CConnection::releaseFrame() {
+    bool holding = m_holding;
+    m_holding = false;
+    m_held = CPacket();
+    return holding;
+}
+
+void CConnection::wakeSenders() {
+    // 可能在其他协程的发送过程中调用，放入就绪队列，不在这里嵌套恢复
+    std::vector<SendAwaiter*> senders;
+    senders.swap(m_senders);
+    for (SendAwaiter* sender : senders) {
+        m_scheduler.cancelTimer(sender->timerId);
+        m_scheduler.post(sender->handle);
+    }
+}
+
+CConnection::SendAwaiter CConnection::send(std::shared_ptr<CConnection> connection, const CPacket& packet) {
+    return SendAwaiter{ std::move(connection), packet, 0, false, {} };
+}
+
+bool CConnection::SendAwaiter::await_ready() const noexcept {
+    return !connection || connection->m_closed || connection->m_outbound->bytes() < SEND_HIGH_WATER;
+}
+
+void CConnection::SendAwaiter::await_suspend(std::coroutine_handle<> awaiting) {
+    handle = awaiting;
+    CConnection* owner = connection.get();
+    owner->m_senders.push_back(this);
+    timerId = owner->m_scheduler.addTimer(SEND_STALL_TIMEOUT_MS, [owner, this] {
+        auto it = std::find(owner->m_senders.begin(), owner->m_senders.end(), this);
+        if (it != owner->m_senders.end()) {
+            owner->m_senders.erase(it);
+            timedOut = true;
+            owner->m_scheduler.post(handle);
+        }
+    });
+}
+
+bool CConnection::SendAwaiter::await_resume() {
+    if (!connection || connection->m_closed) {
+        return false;
+    }
+    if (timedOut) {
+        std::cerr << "[Connection] Client " << connection->m_clientId << " did not drain its queue in "
+            << SEND_STALL_TIMEOUT_MS << " ms" << std::endl;
+        return false;
+    }
+    return connection->m_server.sendPacketToClient(connection->m_clientId, packet);
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Coroutine.h"
+#include "OutboundQueue.h"
+#include "Packet.h"
+
+class CServerSocket;
+
+// 客户端连接的协程接口
+// 每个连接由一个协程顺序处理收到的帧：co_await readFrame() 取下一帧，处理函数可以挂起(等待发送额度、定时器)，
+// 挂起期间收到的帧留在收件队列中，处理完成后按顺序继续，同一连接的命令顺序不变
+// 所有方法只在epoll线程中调用
+class CConnection
+{
+public:
+    static const size_t SEND_HIGH_WATER = 4 * 1024 * 1024;    // 发送队列超过该值时 send() 挂起
+    static const size_t SEND_LOW_WATER = 1024 * 1024;         // 降到该值以下时恢复
+    static const size_t MAX_INBOX_BYTES = 16 * 1024 * 1024;   // 挂起期间积压的未处理帧上限，队列为空时单帧不受限
+    static const uint64_t SEND_STALL_TIMEOUT_MS = 30000;      // 等待发送额度的最长时间
+
+    CConnection(CServerSocket& server, CScheduler& scheduler, int socket, int clientId,
+        std::shared_ptr<COutboundQueue> outbound);
+
+    int socket() const { return m_socket; }
+    int clientId() const { return m_clientId; }
+    bool closed() const { return m_closed; }
+    size_t inboxBytes() const { return m_inboxBytes; }
+
+    // 收到一个完整的帧；协程正在等待时直接恢复。已有积压且超过上限时返回false
+    bool deliver(const CPacket& packet);
+    // 发送队列写出后调用，低于低水位时唤醒等待发送的协程
+    void onWritable();
+    // 连接断开，唤醒所有等待者(readFrame/send 返回false)
+    void close();
+    // 热重启交接：取出尚未处理的帧(原始字节，包括推迟中的帧)，由新进程重新解析
+    std::string takeInbox();
+    // 已从收件队列取出、但推迟处理的帧(过载时的文件数据)，处理之前仍由 takeInbox 交出
+    void holdFrame(const CPacket& packet);
+    // 开始处理推迟的帧；期间已被 takeInbox 交出或连接已关闭时返回false
+    bool releaseFrame();
+
+    struct ReadAwaiter {
+        CConnection& connection;
+        CPacket& packet;
+        bool await_ready() const noexcept { return !connection.m_inbox.empty() || connection.m_closed; }
+        void await_suspend(std::coroutine_handle<> handle) noexcept { connection.m_reader = handle; }
+        bool await_resume();
+    };
+    // 取下一帧，连接断开后返回false
+    ReadAwaiter readFrame(CPacket& packet) { return ReadAwaiter{ *this, packet }; }
+
+    struct SendAwaiter {
+        std::shared_ptr<CConnection> connection;      // 挂起期间保持连接对象有效
+        CPacket packet;
+        uint64_t timerId = 0;
+        bool timedOut = false;
+        std::coroutine_handle<> handle;
+
+        bool await_ready() const noexcept;
+        void await_suspend(std::coroutine_handle<> awaiting);
+        bool await_resume();
+    };
+    // 放入发送队列；队列超过高水位时先挂起，等对方读走数据。连接断开或等待超时返回false
+    static SendAwaiter send(std::shared_ptr<CConnection> connection, const CPacket& packet);
+
+private:
+    CServerSocket& m_server;
+    CScheduler& m_scheduler;
+    int m_socket;
+    int m_clientId;
+    std::shared_ptr<COutboundQueue> m_outbound;
+    std::deque<CPacket> m_inbox;                       // 处理函数挂起期间收到的帧
+    size_t m_inboxBytes;
+    CPacket m_held;                                    // 推迟处理的帧
+    bool m_holding;
+    std::coroutine_handle<> m_reader;                  // 等待下一帧的协程
+    std::vector<SendAwaiter*> m_senders;               // 等待发送额度的协程
+    bool m_closed;
+
+    void wakeSenders();
+};
@@ -0,0 +1,182 @@
+#include "Coroutine.h"
+#include <algorithm>
+#include <iostream>
+#include <new>
+#include <vector>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+namespace {
+
+// 每个分级一条空闲链表，空闲块的前8字节存放下一个空闲块
+struct FreeLists {
+    std::vector<void*> heads;
+
+    FreeLists() : heads(CFramePool::MAX_POOLED / CFramePool::GRANULE, nullptr) {}
+    ~FreeLists() {
+        for (void* head : heads) {
+            while (head) {
+                void* next = *static_cast<void**>(head);
+                ::operator delete(head);
+                head = next;
+            }
+        }
+    }
+};
+
+thread_local FreeLists t_freeLists;
+
+size_t sizeClass(size_t size) {
+    return (size + CFramePool::GRANULE - 1) / CFramePool::GRANULE - 1;
+}
+
+} // namespace
+
+void* CFramePool::allocate(size_t size) {
+    if (size > MAX_POOLED) {
+        return ::operator new(size);
+    }
+    void*& head = t_freeLists.heads[sizeClass(size)];
+    if (head) {
+        void* block = head;
+        head = *static_cast<void**>(block);
+        return block;
+    }
+    return ::operator new((sizeClass(size) + 1) * GRANULE);
+}
+
+void CFramePool::deallocate(void* pointer, size_t size) {
+    if (size > MAX_POOLED) {
+        ::operator delete(pointer);
+        return;
+    }
+    void*& head = t_freeLists.heads[sizeClass(size)];
+    *static_cast<void**>(pointer) = head;
+    head = pointer;
+}
+
+CScheduler::CScheduler() : m_timerFd(-1), m_nextTimerId(1) {
+}
+
+CScheduler::~CScheduler() {
+    close();
+}
+
+bool CScheduler::open() {
+    m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_timerFd == -1) {
+        std::cerr << "[Scheduler] timerfd_create failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    rearm();
+    return true;
+}
+
+void CScheduler::close() {
+    if (m_timerFd != -1) {
+        ::close(m_timerFd);
+        m_timerFd = -1;
+    }
+}
+
+void CScheduler::post(std::coroutine_handle<> handle) {
+    m_ready.push_back(handle);
+}
+
+void CScheduler::runReady() {
+    // 恢复的协程可能继续唤醒其他协程，一直处理到队列为空
+    while (!m_ready.empty()) {
+        std::coroutine_handle<> handle = m_ready.front();
+        m_ready.pop_front();
+        handle.resume();
+    }
+}
+
+uint64_t CScheduler::nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint64_t CScheduler::nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t CScheduler::addTimer(uint64_t delayMs, std::function<void()> callback) {
+    uint64_t id = m_nextTimerId++;
+    uint64_t deadline = nowUs() + delayMs * 1000;
+    bool earliest = m_timers.empty() || deadline < m_timers.begin()->first.first;
+    m_timers.emplace(std::make_pair(deadline, id), std::move(callback));
+    m_timerDeadlines[id] = deadline;
+    if (earliest) {
+        rearm();
+    }
+    return id;
+}
+
+void CScheduler::cancelTimer(uint64_t id) {
+    auto it = m_timerDeadlines.find(id);
+    if (it == m_timerDeadlines.end()) {
+        return;
+    }
+    m_timers.erase(std::make_pair(it->second, id));
+    m_timerDeadlines.erase(it);
+}
+
+void CScheduler::expireTimers() {
+    uint64_t expirations;
+    while (read(m_timerFd, &expirations, sizeof(expirations)) > 0) {
+    }
+
+    // 回调中可能添加或取消定时器，每次取出一个再执行
+    uint64_t now = nowUs();
+    while (!m_timers.empty() && m_timers.begin()->first.first <= now) {
+        auto it = m_timers.begin();
+        m_lateness.record(now - it->first.first);
+        std::function<void()> callback = std::move(it->second);
+        m_timerDeadlines.erase(it->first.second);
+        m_timers.erase(it);
+        callback();
+    }
+    rearm();
+}
+
+bool CScheduler::timerDue() const {
+    return !m_timers.empty() && m_timers.begin()->first.first <= nowUs();
+}
+
+int CScheduler::timeoutMs() const {
+    if (m_timers.empty()) {
+        return -1;
+    }
+    uint64_t deadline = m_timers.begin()->first.first;
+    uint64_t now = nowUs();
+    if (deadline <= now) {
+        return 0;
+    }
+    uint64_t ms = (deadline - now + 999) / 1000;
+    return static_cast<int>(std::min<uint64_t>(ms, INT32_MAX));
+}
+
+void CScheduler::rearm() {
+    if (m_timerFd == -1) {
+        return;
+    }
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (!m_timers.empty()) {
+        // 绝对时间，已经到期的设为1纳秒之后，立即触发
+        uint64_t deadline = m_timers.begin()->first.first;
+        spec.it_value.tv_sec = deadline / 1000000;
+        spec.it_value.tv_nsec = (deadline % 1000000) * 1000;
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+            spec.it_value.tv_nsec = 1;
+        }
+    }
+    timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
@@ -0,0 +1,199 @@
+#pragma once
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <utility>
+#include "Latency.h"
+
+// 协程帧内存池 - 协程帧按 GRANULE 字节分级，释放后留在本线程的空闲链表中复用
+// 连接和命令处理的协程只在epoll线程中创建和销毁，热路径上不再调用malloc
+class CFramePool
+{
+public:
+    static const size_t GRANULE = 64;
+    static const size_t MAX_POOLED = 4096;             // 更大的帧直接使用operator new
+
+    static void* allocate(size_t size);
+    static void deallocate(void* pointer, size_t size);
+};
+
+template<typename T = void>
+class CTask;
+
+namespace coroutine_detail {
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;              // co_await 该任务的协程
+    bool detached = false;                             // start() 启动，结束时自行销毁
+
+    static void* operator new(size_t size) { return CFramePool::allocate(size); }
+    static void operator delete(void* pointer, size_t size) { CFramePool::deallocate(pointer, size); }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // 结束时直接切换回等待者(对称转移)，不占用调用栈
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            PromiseBase& promise = handle.promise();
+            if (promise.continuation) {
+                return promise.continuation;
+            }
+            if (promise.detached) {
+                handle.destroy();
+            }
+            return std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    // 项目中不使用异常
+    void unhandled_exception() noexcept { std::terminate(); }
+};
+
+template<typename T>
+struct Promise : PromiseBase {
+    T value{};
+    CTask<T> get_return_object();
+    void return_value(T result) { value = std::move(result); }
+    T take() { return std::move(value); }
+};
+
+template<>
+struct Promise<void> : PromiseBase {
+    CTask<void> get_return_object();
+    void return_void() {}
+    void take() {}
+};
+
+} // namespace coroutine_detail
+
+// 惰性启动的协程任务：被 co_await 时才开始执行，或用 start() 作为独立协程运行
+template<typename T>
+class CTask
+{
+public:
+    using promise_type = coroutine_detail::Promise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    CTask() = default;
+    explicit CTask(Handle handle) : m_handle(handle) {}
+    CTask(CTask&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+    CTask& operator=(CTask&& other) noexcept {
+        if (this != &other) {
+            reset();
+            m_handle = std::exchange(other.m_handle, {});
+        }
+        return *this;
+    }
+    ~CTask() { reset(); }
+
+    CTask(const CTask&) = delete;
+    CTask& operator=(const CTask&) = delete;
+
+    explicit operator bool() const { return static_cast<bool>(m_handle); }
+
+    // 不再持有，运行到第一个挂起点；结束后协程帧自行释放
+    void start() {
+        Handle handle = std::exchange(m_handle, {});
+        handle.promise().detached = true;
+        handle.resume();
+    }
+
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            Handle handle;
+            bool await_ready() const noexcept { return !handle || handle.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+            T await_resume() { return handle.promise().take(); }
+        };
+        return Awaiter{ m_handle };
+    }
+
+private:
+    Handle m_handle;
+
+    void reset() {
+        if (m_handle) {
+            m_handle.destroy();
+            m_handle = {};
+        }
+    }
+};
+
+namespace coroutine_detail {
+
+template<typename T>
+CTask<T> Promise<T>::get_return_object() {
+    return CTask<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline CTask<void> Promise<void>::get_return_object() {
+    return CTask<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+} // namespace coroutine_detail
+
+// 协程调度 - 就绪队列和定时器，都在epoll线程中执行
+// 从其他协程内部唤醒的协程先放入就绪队列，由事件循环在当前事件处理完后恢复，避免嵌套执行
+// 定时器使用一个timerfd，始终按最早的到期时间设置；到期时间以微秒保存，并记录回调相对到期时间的延迟
+class CScheduler
+{
+public:
+    CScheduler();
+    ~CScheduler();
+
+    bool open();
+    void close();
+    int timerFd() const { return m_timerFd; }
+
+    void post(std::coroutine_handle<> handle);
+    void runReady();
+
+    // 定时器：delayMs后在epoll线程执行callback，返回的ID可用于取消
+    uint64_t addTimer(uint64_t delayMs, std::function<void()> callback);
+    void cancelTimer(uint64_t id);
+    void expireTimers();                               // timerfd可读时调用
+    bool timerDue() const;                             // 自旋轮询时检查，不经过timerfd
+    int timeoutMs() const;                             // 距最早到期的毫秒数(向上取整)，没有定时器时为-1
+
+    // 定时器回调的唤醒延迟
+    CLatencyHistogram& timerLateness() { return m_lateness; }
+
+    // co_await scheduler.sleepFor(ms)
+    auto sleepFor(uint64_t delayMs) {
+        struct Awaiter {
+            CScheduler& scheduler;
+            uint64_t delayMs;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) {
+                CScheduler* owner = &scheduler;
+                scheduler.addTimer(delayMs, [owner, handle] { owner->post(handle); });
+            }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{ *this, delayMs };
+    }
+
+    static uint64_t nowMs();
+    static uint64_t nowUs();
+
+private:
+    int m_timerFd;
+    std::deque<std::coroutine_handle<>> m_ready;
+    std::map<std::pair<uint64_t, uint64_t>, std::function<void()>> m_timers;  // (到期时间us, ID) -> 回调
+    std::map<uint64_t, uint64_t> m_timerDeadlines;     // ID -> 到期时间us
+    uint64_t m_nextTimerId;
+    CLatencyHistogram m_lateness;
+
+    void rearm();
+};
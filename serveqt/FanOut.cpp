@@ -0,0 +1,63 @@
+#include "FanOut.h"
+#include <algorithm>
+#include <sstream>
+
+CFanOut::CFanOut()
+    : m_partitions(AUTO_PARTITIONS), m_threshold(DEFAULT_THRESHOLD), m_built(false), m_generation(0), m_inflight(0),
+    m_broadcasts(0), m_recipients(0), m_tasks(0), m_routed(0), m_failures(0)
+{
+}
+
+void CFanOut::configure(size_t partitions, size_t threshold)
+{
+    m_partitions = partitions;
+    m_threshold = threshold;
+    m_built = false;
+}
+
+void CFanOut::rebuild(uint64_t generation, std::vector<std::vector<Member>>& members)
+{
+    m_snapshot.clear();
+    m_codecs.clear();
+    for (auto& partition : members) {
+        for (const auto& member : partition) {
+            if (std::find(m_codecs.begin(), m_codecs.end(), member.codec) == m_codecs.end()) {
+                m_codecs.push_back(member.codec);
+            }
+        }
+        // 进行中的任务仍持有旧快照，这里只替换指针
+        m_snapshot.push_back(std::make_shared<const std::vector<Member>>(std::move(partition)));
+    }
+    m_generation = generation;
+    m_built = true;
+}
+
+bool CFanOut::finish()
+{
+    if (m_inflight > 0) {
+        m_inflight--;
+    }
+    return m_inflight == 0;
+}
+
+void CFanOut::recordBroadcast(size_t recipients, size_t partitions)
+{
+    m_broadcasts++;
+    m_recipients += recipients;
+    m_tasks += partitions;
+}
+
+std::string CFanOut::describe() const
+{
+    std::ostringstream out;
+    if (!enabled()) {
+        out << "fan-out: disabled";
+        return out.str();
+    }
+    out << "fan-out: " << m_partitions << " partitions, threshold " << m_threshold << " recipients, "
+        << m_inflight << " tasks in flight\n"
+        << "parallel broadcasts " << m_broadcasts << " (" << m_recipients << " recipients, " << m_tasks << " tasks)"
+        << ", routed sends " << m_routed << ", failures " << m_failures << "\n"
+        << "completion " << m_completion.describe();
+    return out.str();
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "OutboundQueue.h"
+#include "Latency.h"
+
+// 大规模广播的分区并行扇出
+// 接收方按客户端ID分到若干分区，每个分区对应线程池中的一个串行队列；
+// 接收方达到阈值时epoll线程只按编码生成帧，给每个分区提交一个任务就返回，
+// 由工作线程把共享的帧放入本分区各连接的发送队列并写出
+// 顺序：并行扇出进行期间，发给TCP客户端的所有帧(包括单独发送)都经所在分区的串行队列，
+//       同一接收方的帧按提交顺序写出，同一发送方的消息顺序不变；全部完成后恢复在epoll线程直接发送
+// 共享内存客户端的通道和用户态加密的TLS连接只在epoll线程使用，始终直接发送，不进入分区；内核加密(kTLS)的连接照常进入分区
+// 这里只保存分区快照、进行中的任务数和统计，提交和收尾由 CServerSocket 执行；只在epoll线程中使用
+class CFanOut
+{
+public:
+    // 工作线程需要的连接信息，快照期间客户端断开时fd由 CServerSocket 延迟关闭
+    struct Member {
+        int clientId;
+        int fd;
+        uint8_t codec;
+        std::shared_ptr<COutboundQueue> outbound;
+    };
+    using Partition = std::shared_ptr<const std::vector<Member>>;
+
+    static const size_t DEFAULT_THRESHOLD = 256;       // 接收方少于该数时在epoll线程直接发送
+    static const size_t AUTO_PARTITIONS = SIZE_MAX;    // 每个工作线程一个分区，线程池启动后确定
+    static const uint64_t STRAND_BASE = 1ULL << 62;    // 分区串行队列的key，不与客户端ID和历史队列冲突
+
+    CFanOut();
+
+    // partitions为0时不启用
+    void configure(size_t partitions, size_t threshold);
+    bool enabled() const { return m_partitions > 0 && m_partitions != AUTO_PARTITIONS; }
+    size_t partitionCount() const { return m_partitions; }
+    size_t threshold() const { return m_threshold; }
+    void setThreshold(size_t threshold) { m_threshold = threshold; }
+
+    // 是否走并行路径：接收方足够多，或已有并行扇出进行中(保证顺序)
+    bool shouldSplit(size_t recipients) const { return enabled() && (busy() || recipients >= m_threshold); }
+
+    size_t partitionOf(int clientId) const { return static_cast<size_t>(clientId) % m_partitions; }
+    uint64_t strandOf(size_t partition) const { return STRAND_BASE + partition; }
+
+    // 全体客户端的分区快照，按 ClientManager 的版本号缓存
+    bool stale(uint64_t generation) const { return !m_built || generation != m_generation; }
+    void rebuild(uint64_t generation, std::vector<std::vector<Member>>& members);
+    const Partition& partition(size_t index) const { return m_snapshot[index]; }
+    const std::vector<uint8_t>& codecs() const { return m_codecs; }   // 快照中出现的编码
+
+    // 进行中的分区任务
+    void begin() { m_inflight++; }
+    bool finish();                                     // 返回是否已全部完成
+    bool busy() const { return m_inflight > 0; }
+
+    // 统计
+    void recordBroadcast(size_t recipients, size_t partitions);
+    void recordCompletion(uint64_t elapsedUs) { m_completion.record(elapsedUs); }
+    void recordRouted() { m_routed++; }
+    void recordFailures(size_t count) { m_failures += count; }
+
+    // 管理命令 "fanout"
+    std::string describe() const;
+
+private:
+    size_t m_partitions;
+    size_t m_threshold;
+    bool m_built;
+    uint64_t m_generation;
+    std::vector<Partition> m_snapshot;
+    std::vector<uint8_t> m_codecs;
+    size_t m_inflight;
+
+    uint64_t m_broadcasts;                             // 并行扇出的次数
+    uint64_t m_recipients;                             // 并行扇出的接收方总数
+    uint64_t m_tasks;                                  // 提交的分区任务
+    uint64_t m_routed;                                 // 进行期间经分区队列的单独发送
+    uint64_t m_failures;                               // 工作线程中入队或写出失败、被断开的连接
+    CLatencyHistogram m_completion;                    // 提交到最后一个分区完成的时间
+};
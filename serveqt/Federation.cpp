@@ -0,0 +1,562 @@
+#include "Federation.h"
+#include "ServerSocket.h"
+#include "Command.h"
+#include "HistoryLog.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+
+static void putU16(std::string& out, uint16_t value)
+{
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+}
+
+static void putU32(std::string& out, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<char>(value >> shift));
+    }
+}
+
+static void putU64(std::string& out, uint64_t value)
+{
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<char>(value >> shift));
+    }
+}
+
+static uint64_t getBE(const std::string& in, size_t pos, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | static_cast<uint8_t>(in[pos + i]);
+    }
+    return value;
+}
+
+CFederation::CFederation()
+    : m_server(nullptr), m_nodeId(0), m_listenPort(0), m_listenFd(-1), m_epollFd(-1),
+    m_epoch(0), m_nextSeq(0)
+{
+}
+
+CFederation::~CFederation()
+{
+    stop();
+}
+
+void CFederation::configure(int nodeId, int listenPort, const std::vector<std::string>& peers)
+{
+    m_nodeId = nodeId;
+    m_listenPort = listenPort;
+    m_outLinks.clear();
+    for (const auto& peer : peers) {
+        size_t colon = peer.rfind(':');
+        if (colon == std::string::npos) {
+            log("Ignoring peer without port: " + peer);
+            continue;
+        }
+        OutLink link;
+        link.host = peer.substr(0, colon);
+        link.port = std::atoi(peer.c_str() + colon + 1);
+        m_outLinks.push_back(link);
+    }
+}
+
+bool CFederation::start(int epollFd)
+{
+    if (!isEnabled()) {
+        return true;
+    }
+    m_epollFd = epollFd;
+    // epoch区分本节点的不同进程，对端据此重置序号
+    m_epoch = CHistoryLog::nowMs();
+    m_nextSeq = 0;
+
+    // 热重启时旧进程可能还占着端口，失败后在tick中重试
+    if (m_listenPort > 0 && !openListener()) {
+        log("Federation port busy, will retry");
+    }
+    for (auto& link : m_outLinks) {
+        connectPeer(link);
+    }
+    log("Node " + std::to_string(m_nodeId) + " federating with " + std::to_string(m_outLinks.size()) + " peers");
+    return true;
+}
+
+void CFederation::stop()
+{
+    for (auto& link : m_outLinks) {
+        if (link.fd != -1) {
+            close(link.fd);
+            link.fd = -1;
+        }
+        link.connected = false;
+        link.outBuffer.clear();
+    }
+    for (const auto& pair : m_inLinks) {
+        close(pair.first);
+    }
+    m_inLinks.clear();
+    if (m_listenFd != -1) {
+        close(m_listenFd);
+        m_listenFd = -1;
+    }
+    m_epollFd = -1;
+}
+
+bool CFederation::ownsFd(int fd) const
+{
+    if (fd == m_listenFd || m_inLinks.count(fd) != 0) {
+        return true;
+    }
+    for (const auto& link : m_outLinks) {
+        if (link.fd == fd) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CFederation::handleEvent(int fd, uint32_t events)
+{
+    if (fd == m_listenFd) {
+        acceptPeer();
+        return;
+    }
+    if (m_inLinks.count(fd) != 0) {
+        readInLink(fd);
+        return;
+    }
+
+    OutLink* link = findOutLink(fd);
+    if (!link) {
+        return;
+    }
+    if (!link->connected) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+        if (error != 0) {
+            closeOutLink(*link, strerror(error));
+            return;
+        }
+        link->connected = true;
+        log("Connected to peer " + link->host + ":" + std::to_string(link->port));
+        sendHello(*link);
+    }
+    if (events & (EPOLLHUP | EPOLLERR)) {
+        closeOutLink(*link, "connection closed");
+        return;
+    }
+    flushOutLink(*link);
+}
+
+void CFederation::tick()
+{
+    if (!isEnabled() || m_epollFd == -1) {
+        return;
+    }
+    if (m_listenPort > 0 && m_listenFd == -1) {
+        openListener();
+    }
+    uint64_t now = CHistoryLog::nowMs();
+    for (auto& link : m_outLinks) {
+        if (link.fd == -1 && now >= link.nextAttemptMs) {
+            connectPeer(link);
+        }
+    }
+}
+
+bool CFederation::openListener()
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return false;
+    }
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(m_listenPort);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1) {
+        close(fd);
+        return false;
+    }
+
+    m_listenFd = fd;
+    updateEpoll(fd, EPOLLIN, true);
+    log("Listening for peers on port " + std::to_string(m_listenPort));
+    return true;
+}
+
+void CFederation::acceptPeer()
+{
+    while (true) {
+        int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                log("Failed to accept peer: " + std::string(strerror(errno)));
+            }
+            return;
+        }
+        m_inLinks[fd] = InLink();
+        updateEpoll(fd, EPOLLIN | EPOLLET, true);
+    }
+}
+
+void CFederation::connectPeer(OutLink& link)
+{
+    link.nextAttemptMs = CHistoryLog::nowMs() + RECONNECT_INTERVAL_MS;
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = nullptr;
+    if (getaddrinfo(link.host.c_str(), std::to_string(link.port).c_str(), &hints, &result) != 0 || !result) {
+        log("Failed to resolve peer " + link.host);
+        return;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        freeaddrinfo(result);
+        return;
+    }
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    int ret = connect(fd, result->ai_addr, result->ai_addrlen);
+    freeaddrinfo(result);
+    if (ret == -1 && errno != EINPROGRESS) {
+        close(fd);
+        return;
+    }
+
+    link.fd = fd;
+    link.connected = false;
+    link.outBuffer.clear();
+    // 连接完成时触发EPOLLOUT
+    updateEpoll(fd, EPOLLOUT | EPOLLET, true);
+}
+
+void CFederation::closeOutLink(OutLink& link, const std::string& reason)
+{
+    if (link.fd == -1) {
+        return;
+    }
+    if (link.connected) {
+        log("Lost peer " + link.host + ":" + std::to_string(link.port) + " (" + reason + ")");
+    }
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, link.fd, nullptr);
+    close(link.fd);
+    link.fd = -1;
+    link.connected = false;
+    link.outBuffer.clear();
+}
+
+void CFederation::closeInLink(int fd, const std::string& reason)
+{
+    auto it = m_inLinks.find(fd);
+    if (it == m_inLinks.end()) {
+        return;
+    }
+    // 该节点的客户端全部下线
+    std::set<int> members = std::move(it->second.members);
+    if (it->second.remoteNode != 0) {
+        log("Peer node " + std::to_string(it->second.remoteNode) + " disconnected (" + reason + "), removing " +
+            std::to_string(members.size()) + " remote clients");
+    }
+    m_inLinks.erase(it);
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+
+    for (int clientId : members) {
+        m_server->getCommand()->removeRemoteClient(clientId);
+    }
+}
+
+void CFederation::flushOutLink(OutLink& link)
+{
+    while (!link.outBuffer.empty()) {
+        ssize_t n = send(link.fd, link.outBuffer.data(), link.outBuffer.size(), MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            closeOutLink(link, strerror(errno));
+            return;
+        }
+        link.outBuffer.erase(0, n);
+    }
+}
+
+void CFederation::readInLink(int fd)
+{
+    char buffer[65536];
+    while (true) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n == 0) {
+            closeInLink(fd, "connection closed");
+            return;
+        }
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            closeInLink(fd, strerror(errno));
+            return;
+        }
+        m_inLinks[fd].inBuffer.append(buffer, n);
+    }
+
+    // 对端的帧总是紧接着上一帧：包头、长度或校验和不对说明链路已经错位，
+    // 无法像客户端数据那样逐字节找回，断开后由对端重新连接并发送HELLO
+    std::string& inBuffer = m_inLinks[fd].inBuffer;
+    while (inBuffer.size() >= 8) {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(inBuffer.data());
+        uint32_t length = (static_cast<uint32_t>(data[2]) << 24) | (static_cast<uint32_t>(data[3]) << 16) |
+            (static_cast<uint32_t>(data[4]) << 8) | static_cast<uint32_t>(data[5]);
+        if (data[0] != 0xFF || data[1] != 0xFE || length < 4 || length > MAX_PACKET_SIZE) {
+            closeInLink(fd, "malformed frame");
+            return;
+        }
+        if (inBuffer.size() < 6 + static_cast<size_t>(length)) {
+            break;
+        }
+        size_t consumed = 6 + static_cast<size_t>(length);
+        CPacket packet(data, consumed);
+        if (consumed == 0) {
+            closeInLink(fd, "checksum mismatch");
+            return;
+        }
+        inBuffer.erase(0, consumed);
+        if (!handlePeerPacket(fd, m_inLinks[fd], packet)) {
+            closeInLink(fd, "protocol error");
+            return;
+        }
+    }
+}
+
+bool CFederation::handlePeerPacket(int fd, InLink& link, const CPacket& packet)
+{
+    const std::string& data = packet.getData();
+    uint16_t cmd = packet.getCmd();
+    if (link.remoteNode == 0 && cmd != PEER_HELLO) {
+        return false;
+    }
+
+    switch (cmd) {
+    case PEER_HELLO: {
+        if (data.size() != 12) {
+            return false;
+        }
+        int remoteNode = static_cast<int>(getBE(data, 0, 4));
+        uint64_t epoch = getBE(data, 4, 8);
+        if (remoteNode <= 0 || remoteNode > MAX_NODE_ID || remoteNode == m_nodeId) {
+            log("Rejecting peer with node id " + std::to_string(remoteNode));
+            return false;
+        }
+        // 同一节点重连时旧链路作废
+        for (auto it = m_inLinks.begin(); it != m_inLinks.end(); ++it) {
+            if (it->first != fd && it->second.remoteNode == remoteNode) {
+                closeInLink(it->first, "replaced");
+                break;
+            }
+        }
+        Origin& origin = m_origins[remoteNode];
+        if (origin.epoch != epoch) {
+            origin.epoch = epoch;
+            origin.lastSeq = 0;
+        }
+        m_inLinks[fd].remoteNode = remoteNode;
+        log("Peer node " + std::to_string(remoteNode) + " connected");
+        return true;
+    }
+    case PEER_MEMBER:
+    case PEER_LEAVE: {
+        if (data.size() < 4) {
+            return false;
+        }
+        int clientId = static_cast<int>(getBE(data, 0, 4));
+        // 只接受对端自己的客户端
+        if (nodeOf(clientId) != link.remoteNode) {
+            return false;
+        }
+        if (cmd == PEER_MEMBER) {
+            link.members.insert(clientId);
+            m_server->getCommand()->updateRemoteClient(clientId, data.substr(4));
+        }
+        else {
+            link.members.erase(clientId);
+            m_server->getCommand()->removeRemoteClient(clientId);
+        }
+        return true;
+    }
+    case PEER_BROADCAST:
+    case PEER_HISTORY: {
+        if (data.size() < 14) {
+            return false;
+        }
+        uint64_t value = getBE(data, 0, 8);
+        int originClientId = static_cast<int>(getBE(data, 8, 4));
+        uint16_t innerCmd = static_cast<uint16_t>(getBE(data, 12, 2));
+        CPacket inner(innerCmd, reinterpret_cast<const uint8_t*>(data.data() + 14), data.size() - 14);
+        if (cmd == PEER_HISTORY) {
+            m_server->recordRemoteHistory(inner, originClientId, value);
+            return true;
+        }
+
+        Origin& origin = m_origins[link.remoteNode];
+        if (value <= origin.lastSeq) {
+            return true;
+        }
+        origin.lastSeq = value;
+        m_server->deliverRemoteBroadcast(inner);
+        return true;
+    }
+    default:
+        log("Unknown peer command " + std::to_string(cmd));
+        return true;
+    }
+}
+
+void CFederation::sendToPeers(uint16_t cmd, const std::string& payload)
+{
+    // 帧只序列化一次，每条链路各发送一份
+    CPacket packet(cmd, reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+    std::string frame = packet.Serialize();
+    size_t size = frame.size();
+
+    for (auto& link : m_outLinks) {
+        if (link.fd == -1 || !link.connected) {
+            continue;
+        }
+        if (link.outBuffer.size() + size > MAX_PEER_BUFFER) {
+            closeOutLink(link, "peer too slow");
+            continue;
+        }
+        bool idle = link.outBuffer.empty();
+        link.outBuffer.append(frame);
+        if (idle) {
+            flushOutLink(link);
+        }
+    }
+}
+
+void CFederation::sendHello(OutLink& link)
+{
+    std::string hello;
+    putU32(hello, static_cast<uint32_t>(m_nodeId));
+    putU64(hello, m_epoch);
+    CPacket packet(PEER_HELLO, reinterpret_cast<const uint8_t*>(hello.data()), hello.size());
+    link.outBuffer.append(packet.Data(), packet.Size());
+
+    // 随后是本节点当前在线的客户端
+    for (const auto& pair : m_server->getCommand()->getClientManager().getAllClients()) {
+        std::string member;
+        putU32(member, static_cast<uint32_t>(pair.first));
+        member.append(pair.second.username);
+        CPacket memberPacket(PEER_MEMBER, reinterpret_cast<const uint8_t*>(member.data()), member.size());
+        link.outBuffer.append(memberPacket.Data(), memberPacket.Size());
+    }
+}
+
+void CFederation::forwardBroadcast(const CPacket& packet, int originClientId)
+{
+    if (!isEnabled() || !isLocalClient(originClientId)) {
+        return;
+    }
+    std::string payload;
+    putU64(payload, ++m_nextSeq);
+    putU32(payload, static_cast<uint32_t>(originClientId));
+    putU16(payload, packet.getCmd());
+    payload.append(packet.getData());
+    sendToPeers(PEER_BROADCAST, payload);
+}
+
+void CFederation::forwardHistory(const CPacket& packet, int originClientId, uint64_t timestampMs)
+{
+    if (!isEnabled() || !isLocalClient(originClientId)) {
+        return;
+    }
+    std::string payload;
+    putU64(payload, timestampMs);
+    putU32(payload, static_cast<uint32_t>(originClientId));
+    putU16(payload, packet.getCmd());
+    payload.append(packet.getData());
+    sendToPeers(PEER_HISTORY, payload);
+}
+
+void CFederation::announceMember(int clientId, const std::string& name)
+{
+    if (!isEnabled() || !isLocalClient(clientId)) {
+        return;
+    }
+    std::string payload;
+    putU32(payload, static_cast<uint32_t>(clientId));
+    payload.append(name);
+    sendToPeers(PEER_MEMBER, payload);
+}
+
+void CFederation::announceLeave(int clientId)
+{
+    if (!isEnabled() || !isLocalClient(clientId)) {
+        return;
+    }
+    std::string payload;
+    putU32(payload, static_cast<uint32_t>(clientId));
+    sendToPeers(PEER_LEAVE, payload);
+}
+
+size_t CFederation::connectedPeers() const
+{
+    size_t count = 0;
+    for (const auto& link : m_outLinks) {
+        if (link.connected) {
+            count++;
+        }
+    }
+    return count;
+}
+
+size_t CFederation::pendingBytes() const
+{
+    size_t pending = 0;
+    for (const auto& link : m_outLinks) {
+        pending = std::max(pending, link.outBuffer.size());
+    }
+    return pending;
+}
+
+void CFederation::updateEpoll(int fd, uint32_t events, bool add)
+{
+    struct epoll_event event;
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(m_epollFd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &event) == -1) {
+        log("Failed to register peer socket in epoll: " + std::string(strerror(errno)));
+    }
+}
+
+CFederation::OutLink* CFederation::findOutLink(int fd)
+{
+    for (auto& link : m_outLinks) {
+        if (link.fd == fd) {
+            return &link;
+        }
+    }
+    return nullptr;
+}
+
+void CFederation::log(const std::string& message) const
+{
+    std::cout << "[Federation] " << message << std::endl;
+}
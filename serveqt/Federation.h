@@ -0,0 +1,120 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "Packet.h"
+
+class CServerSocket;
+
+// 集群 - 多个serveqt节点通过TCP互联，转发广播消息和在线用户
+// 每个节点主动连接配置的所有对端，只在自己发起的连接上发送、只从对端发起的连接接收，
+// 所以每对节点之间是两条单向链路，不需要判断重复连接
+// 防环：只转发本节点客户端产生的广播和在线状态，收到的转发只在本地投递
+// 顺序：每个源节点的广播带递增序号，接收方丢弃不大于已收序号的帧；源节点重启后epoch变化，序号重新计算
+// 客户端ID在集群内唯一：高位是节点ID
+//
+// 对端协议复用CPacket帧格式(网络字节序)：
+//   HELLO     : 节点ID(4) + epoch(8)
+//   MEMBER    : 客户端ID(4) + 用户名            上线或改名
+//   LEAVE     : 客户端ID(4)
+//   BROADCAST : 序号(8) + 源客户端ID(4) + 命令(2) + 数据
+//   HISTORY   : 时间戳(8) + 源客户端ID(4) + 命令(2) + 数据
+class CFederation
+{
+public:
+    static const int NODE_ID_SHIFT = 20;               // 客户端ID = 节点ID << 20 | 节点内序号
+    static const int MAX_NODE_ID = 1023;
+    static const size_t MAX_PEER_BUFFER = 64 * 1024 * 1024;   // 单条链路未发出数据上限
+    static const uint64_t RECONNECT_INTERVAL_MS = 1000;
+    static const uint64_t TICK_MS = 100;               // tick() 的调用周期
+
+    CFederation();
+    ~CFederation();
+
+    void setServerSocket(CServerSocket* server) { m_server = server; }
+
+    // peers 为 host:port 列表
+    void configure(int nodeId, int listenPort, const std::vector<std::string>& peers);
+    bool isEnabled() const { return m_nodeId > 0; }
+    int getNodeId() const { return m_nodeId; }
+    int firstClientId() const { return (m_nodeId << NODE_ID_SHIFT) + 1; }
+    int lastClientId() const { return (m_nodeId << NODE_ID_SHIFT) + (1 << NODE_ID_SHIFT) - 1; }
+    bool isLocalClient(int clientId) const { return !isEnabled() || nodeOf(clientId) == m_nodeId; }
+    static int nodeOf(int clientId) { return clientId >> NODE_ID_SHIFT; }
+
+    // 在epoll线程中运行
+    bool start(int epollFd);
+    void stop();
+    bool ownsFd(int fd) const;
+    void handleEvent(int fd, uint32_t events);
+    void tick();                                       // 重连对端、重试监听
+
+    // 本节点的事件发给所有对端，每条链路只发送一帧
+    void forwardBroadcast(const CPacket& packet, int originClientId);
+    void forwardHistory(const CPacket& packet, int originClientId, uint64_t timestampMs);
+    void announceMember(int clientId, const std::string& name);
+    void announceLeave(int clientId);
+
+    size_t connectedPeers() const;
+    size_t pendingBytes() const;                       // 各链路未发出数据的最大值
+
+private:
+    enum PeerCmd : uint16_t {
+        PEER_HELLO = 1,
+        PEER_MEMBER = 2,
+        PEER_LEAVE = 3,
+        PEER_BROADCAST = 4,
+        PEER_HISTORY = 5
+    };
+
+    // 本节点发起的链路，只用于发送
+    struct OutLink {
+        std::string host;
+        int port = 0;
+        int fd = -1;
+        bool connected = false;                        // 非阻塞connect是否完成
+        uint64_t nextAttemptMs = 0;
+        std::string outBuffer;
+    };
+
+    // 对端发起的链路，只用于接收
+    struct InLink {
+        int remoteNode = 0;                            // 收到HELLO之前为0
+        std::string inBuffer;
+        std::set<int> members;                         // 该节点上报的在线客户端
+    };
+
+    // 每个源节点的广播序号
+    struct Origin {
+        uint64_t epoch = 0;
+        uint64_t lastSeq = 0;
+    };
+
+    CServerSocket* m_server;
+    int m_nodeId;
+    int m_listenPort;
+    int m_listenFd;
+    int m_epollFd;
+    uint64_t m_epoch;
+    uint64_t m_nextSeq;
+    std::vector<OutLink> m_outLinks;
+    std::map<int, InLink> m_inLinks;                   // fd -> 链路
+    std::map<int, Origin> m_origins;                   // 节点ID -> 序号
+
+    bool openListener();
+    void acceptPeer();
+    void connectPeer(OutLink& link);
+    void closeOutLink(OutLink& link, const std::string& reason);
+    void closeInLink(int fd, const std::string& reason);
+    void flushOutLink(OutLink& link);
+    void readInLink(int fd);
+    bool handlePeerPacket(int fd, InLink& link, const CPacket& packet);
+    void sendToPeers(uint16_t cmd, const std::string& payload);
+    void sendHello(OutLink& link);
+    void updateEpoll(int fd, uint32_t events, bool add);
+    OutLink* findOutLink(int fd);
+
+    void log(const std::string& message) const;
+};
@@ -0,0 +1,335 @@
+#include "Handoff.h"
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static const char HANDOFF_REQUEST[8] = { 'T', 'A', 'K', 'E', 'O', 'V', 'E', 'R' };
+static const char HANDOFF_ACK[4] = { 'D', 'O', 'N', 'E' };
+
+// 序列化辅助：同一台机器上的进程之间交接，直接使用本机字节序
+static void putU32(std::string& out, uint32_t value)
+{
+    out.append(reinterpret_cast<const char*>(&value), 4);
+}
+
+static void putString(std::string& out, const std::string& value)
+{
+    putU32(out, static_cast<uint32_t>(value.size()));
+    out.append(value);
+}
+
+static bool getU32(const std::string& in, size_t& pos, uint32_t& value)
+{
+    if (pos + 4 > in.size()) {
+        return false;
+    }
+    memcpy(&value, in.data() + pos, 4);
+    pos += 4;
+    return true;
+}
+
+static bool getString(const std::string& in, size_t& pos, std::string& value)
+{
+    uint32_t length = 0;
+    if (!getU32(in, pos, length) || pos + length > in.size()) {
+        return false;
+    }
+    value.assign(in, pos, length);
+    pos += length;
+    return true;
+}
+
+static bool makeAddress(const std::string& path, struct sockaddr_un& addr)
+{
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "[Handoff] Socket path too long: " << path << std::endl;
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+int CHandoff::listen(const std::string& path)
+{
+    struct sockaddr_un addr;
+    if (!makeAddress(path, addr)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd == -1) {
+        std::cerr << "[Handoff] Failed to create socket: " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    // 旧进程已经交出路径，直接替换
+    unlink(path.c_str());
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || ::listen(fd, 1) == -1) {
+        std::cerr << "[Handoff] Failed to listen on " << path << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int CHandoff::takeOver(const std::string& path, HandoffState& state)
+{
+    struct sockaddr_un addr;
+    if (!makeAddress(path, addr)) {
+        return -1;
+    }
+
+    int conn = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (conn == -1) {
+        return -1;
+    }
+    if (connect(conn, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        // 没有正在运行的旧进程，正常冷启动
+        close(conn);
+        return -1;
+    }
+
+    std::cout << "[Handoff] Found running server at " << path << ", requesting takeover" << std::endl;
+    if (!writeAll(conn, HANDOFF_REQUEST, sizeof(HANDOFF_REQUEST))) {
+        close(conn);
+        return -1;
+    }
+
+    // 状态长度 + 状态 + 描述符
+    uint32_t length = 0;
+    std::string data;
+    if (!readAll(conn, reinterpret_cast<char*>(&length), 4)) {
+        std::cerr << "[Handoff] Old server closed the connection" << std::endl;
+        close(conn);
+        return -1;
+    }
+    data.resize(length);
+    if (!readAll(conn, &data[0], length) || !deserialize(data, state)) {
+        std::cerr << "[Handoff] Invalid handoff state" << std::endl;
+        close(conn);
+        return -1;
+    }
+
+    std::vector<int> fds;
+    if (!recvFds(conn, state.listeners.size() + state.clients.size(), fds)) {
+        std::cerr << "[Handoff] Failed to receive file descriptors" << std::endl;
+        for (int fd : fds) {
+            close(fd);
+        }
+        close(conn);
+        return -1;
+    }
+
+    size_t index = 0;
+    for (auto& listener : state.listeners) {
+        listener.fd = fds[index++];
+    }
+    for (auto& client : state.clients) {
+        client.fd = fds[index++];
+    }
+    std::cout << "[Handoff] Received " << state.listeners.size() << " listen sockets and "
+        << state.clients.size() << " clients" << std::endl;
+    return conn;
+}
+
+bool CHandoff::readRequest(int conn)
+{
+    char request[sizeof(HANDOFF_REQUEST)];
+    return readAll(conn, request, sizeof(request)) &&
+        memcmp(request, HANDOFF_REQUEST, sizeof(request)) == 0;
+}
+
+bool CHandoff::sendState(int conn, const HandoffState& state)
+{
+    std::string data = serialize(state);
+    uint32_t length = static_cast<uint32_t>(data.size());
+    if (!writeAll(conn, reinterpret_cast<const char*>(&length), 4) ||
+        !writeAll(conn, data.data(), data.size())) {
+        return false;
+    }
+
+    std::vector<int> fds;
+    for (const auto& listener : state.listeners) {
+        fds.push_back(listener.fd);
+    }
+    for (const auto& client : state.clients) {
+        fds.push_back(client.fd);
+    }
+    return sendFds(conn, fds);
+}
+
+bool CHandoff::sendAck(int conn)
+{
+    return writeAll(conn, HANDOFF_ACK, sizeof(HANDOFF_ACK));
+}
+
+bool CHandoff::waitAck(int conn, int timeoutMs)
+{
+    struct pollfd pfd = { conn, POLLIN, 0 };
+    if (poll(&pfd, 1, timeoutMs) <= 0) {
+        return false;
+    }
+    char ack[sizeof(HANDOFF_ACK)];
+    return readAll(conn, ack, sizeof(ack)) && memcmp(ack, HANDOFF_ACK, sizeof(ack)) == 0;
+}
+
+std::string CHandoff::serialize(const HandoffState& state)
+{
+    std::string out;
+    putU32(out, MAGIC);
+    putU32(out, static_cast<uint32_t>(state.nextClientId));
+    putU32(out, static_cast<uint32_t>(state.listeners.size()));
+    for (const auto& listener : state.listeners) {
+        putString(out, listener.endpoint);
+    }
+    putU32(out, static_cast<uint32_t>(state.clients.size()));
+    for (const auto& client : state.clients) {
+        putU32(out, static_cast<uint32_t>(client.id));
+        putString(out, client.ip);
+        putU32(out, static_cast<uint32_t>(client.port));
+        putString(out, client.username);
+        putU32(out, client.codec);
+        putU32(out, client.features);
+        putU32(out, client.presenceSubscribed ? 1 : 0);
+        putString(out, client.receiverBuffer);
+        putString(out, client.pendingOutput);
+    }
+    return out;
+}
+
+bool CHandoff::deserialize(const std::string& data, HandoffState& state)
+{
+    size_t pos = 0;
+    uint32_t magic = 0, nextClientId = 0, listenerCount = 0, count = 0;
+    if (!getU32(data, pos, magic) || magic != MAGIC ||
+        !getU32(data, pos, nextClientId) || !getU32(data, pos, listenerCount)) {
+        return false;
+    }
+    state.nextClientId = static_cast<int>(nextClientId);
+    state.listeners.clear();
+    for (uint32_t i = 0; i < listenerCount; ++i) {
+        HandoffListener listener;
+        if (!getString(data, pos, listener.endpoint)) {
+            return false;
+        }
+        state.listeners.push_back(listener);
+    }
+    if (!getU32(data, pos, count)) {
+        return false;
+    }
+    state.clients.clear();
+
+    for (uint32_t i = 0; i < count; ++i) {
+        HandoffClient client;
+        uint32_t id = 0, port = 0, codec = 0, features = 0, subscribed = 0;
+        if (!getU32(data, pos, id) || !getString(data, pos, client.ip) ||
+            !getU32(data, pos, port) || !getString(data, pos, client.username) ||
+            !getU32(data, pos, codec) || !getU32(data, pos, features) || !getU32(data, pos, subscribed) ||
+            !getString(data, pos, client.receiverBuffer) || !getString(data, pos, client.pendingOutput)) {
+            return false;
+        }
+        client.id = static_cast<int>(id);
+        client.port = static_cast<int>(port);
+        client.codec = static_cast<uint8_t>(codec);
+        client.features = static_cast<uint8_t>(features);
+        client.presenceSubscribed = subscribed != 0;
+        state.clients.push_back(client);
+    }
+    return pos == data.size();
+}
+
+bool CHandoff::sendFds(int conn, const std::vector<int>& fds)
+{
+    // 每条消息携带1字节数据和最多 FDS_PER_MESSAGE 个描述符
+    for (size_t sent = 0; sent < fds.size(); sent += FDS_PER_MESSAGE) {
+        size_t n = std::min(FDS_PER_MESSAGE, fds.size() - sent);
+        std::vector<char> control(CMSG_SPACE(n * sizeof(int)));
+        char byte = 'F';
+        struct iovec iov = { &byte, 1 };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(n * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds.data() + sent, n * sizeof(int));
+
+        if (sendmsg(conn, &msg, MSG_NOSIGNAL) != 1) {
+            std::cerr << "[Handoff] sendmsg failed: " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CHandoff::recvFds(int conn, size_t count, std::vector<int>& fds)
+{
+    while (fds.size() < count) {
+        size_t n = std::min(FDS_PER_MESSAGE, count - fds.size());
+        std::vector<char> control(CMSG_SPACE(n * sizeof(int)));
+        char byte = 0;
+        struct iovec iov = { &byte, 1 };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+
+        if (recvmsg(conn, &msg, MSG_CMSG_CLOEXEC) != 1 || (msg.msg_flags & MSG_CTRUNC)) {
+            return false;
+        }
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            return false;
+        }
+        size_t received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int* data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+        fds.insert(fds.end(), data, data + received);
+    }
+    return fds.size() == count;
+}
+
+bool CHandoff::writeAll(int conn, const char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = send(conn, data, size, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool CHandoff::readAll(int conn, char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = recv(conn, data, size, 0);
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
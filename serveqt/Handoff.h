@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 热重启时交接给新进程的单个客户端状态
+struct HandoffClient {
+    int fd;                        // 客户端socket(通过SCM_RIGHTS传递)
+    int id;
+    std::string ip;
+    int port;
+    std::string username;
+    uint8_t codec;
+    uint8_t features;
+    bool presenceSubscribed;
+    std::string receiverBuffer;    // 尚未组成完整包的接收数据
+    std::string pendingOutput;     // 尚未发出的数据
+
+    HandoffClient() : fd(-1), id(-1), port(0), codec(0), features(0), presenceSubscribed(false) {}
+};
+
+// 交接的监听socket，新进程按监听地址匹配自己的配置
+struct HandoffListener {
+    int fd;
+    std::string endpoint;      // ListenEndpoint::toString()
+
+    HandoffListener() : fd(-1) {}
+};
+
+// 热重启交接的完整状态
+struct HandoffState {
+    std::vector<HandoffListener> listeners;
+    int nextClientId;
+    std::vector<HandoffClient> clients;
+
+    HandoffState() : nextClientId(1) {}
+};
+
+// 热重启 - 通过Unix域socket在新旧进程之间交接监听socket、客户端socket和状态
+// 流程：
+//   1. 新进程连接交接路径并发送请求
+//   2. 旧进程停止读取、等待后台任务完成，序列化状态后分批用SCM_RIGHTS发送描述符
+//   3. 新进程接管后回复确认，旧进程退出；未收到确认时旧进程恢复服务
+class CHandoff
+{
+public:
+    // 旧进程：在交接路径上监听
+    static int listen(const std::string& path);
+
+    // 新进程：连接旧进程并接收状态，成功时返回交接连接(用于之后发送确认)，否则返回-1
+    static int takeOver(const std::string& path, HandoffState& state);
+
+    // 旧进程：在接受的交接连接上读取请求
+    static bool readRequest(int conn);
+
+    // 旧进程：发送状态和描述符
+    static bool sendState(int conn, const HandoffState& state);
+
+    // 确认
+    static bool sendAck(int conn);
+    static bool waitAck(int conn, int timeoutMs);
+
+private:
+    static const uint32_t MAGIC = 0x53514833;      // "SQH3"，状态格式变化时修改
+    static constexpr size_t FDS_PER_MESSAGE = 250;      // 小于SCM_MAX_FD
+
+    static std::string serialize(const HandoffState& state);
+    static bool deserialize(const std::string& data, HandoffState& state);
+    static bool sendFds(int conn, const std::vector<int>& fds);
+    static bool recvFds(int conn, size_t count, std::vector<int>& fds);
+    static bool writeAll(int conn, const char* data, size_t size);
+    static bool readAll(int conn, char* data, size_t size);
+};
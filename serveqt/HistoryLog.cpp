@@ -0,0 +1,432 @@
+#include "HistoryLog.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char HISTORY_MAGIC[4] = { 'S', 'Q', 'H', 'L' };
+static const uint32_t HISTORY_VERSION = 2;      // 版本1的段仍可读取，新记录只写入版本2的段
+
+CHistoryLog::Segment::~Segment()
+{
+    if (base) {
+        munmap(base, capacity);
+    }
+    if (fd != -1) {
+        ::close(fd);
+    }
+    if (removeOnClose) {
+        unlink(path.c_str());
+    }
+}
+
+CHistoryLog::CHistoryLog()
+    : m_segmentSize(DEFAULT_SEGMENT_SIZE), m_maxSegments(DEFAULT_MAX_SEGMENTS), m_nextSeq(0)
+{
+}
+
+CHistoryLog::~CHistoryLog()
+{
+    close();
+}
+
+uint64_t CHistoryLog::nowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+size_t CHistoryLog::recordHeaderSize(const Segment& segment)
+{
+    return segment.version == 1 ? V1_RECORD_HEADER_SIZE : RECORD_HEADER_SIZE;
+}
+
+// CRC-32(IEEE)，覆盖记录中长度和CRC字段以外的部分
+uint32_t CHistoryLog::recordCrc(const char* record, size_t length)
+{
+    static const struct Table {
+        uint32_t entries[256];
+        Table() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; bit++) {
+                    value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+                }
+                entries[i] = value;
+            }
+        }
+    } table;
+
+    uint32_t crc = 0xFFFFFFFFu;
+    auto update = [&crc](const char* data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            crc = table.entries[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+        }
+    };
+    update(record + 4, 12);
+    update(record + RECORD_HEADER_SIZE, length - RECORD_HEADER_SIZE);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+std::string CHistoryLog::segmentPath(uint64_t firstSeq) const
+{
+    char name[64];
+    snprintf(name, sizeof(name), "history-%020llu.log", static_cast<unsigned long long>(firstSeq));
+    return m_directory + "/" + name;
+}
+
+bool CHistoryLog::open(const std::string& directory, size_t segmentSize, size_t maxSegments)
+{
+    close();
+
+    if (mkdir(directory.c_str(), 0755) == -1 && errno != EEXIST) {
+        std::cerr << "[HistoryLog] Failed to create directory " << directory << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    m_directory = directory;
+    m_segmentSize = std::max(segmentSize, HEADER_SIZE + 4096);
+    m_maxSegments = std::max<size_t>(maxSegments, 1);
+    m_nextSeq = 0;
+
+    // 按文件名(首条序号)排序恢复已有段
+    std::vector<std::string> names;
+    DIR* dir = opendir(directory.c_str());
+    if (dir) {
+        while (struct dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.compare(0, 8, "history-") == 0 && name.size() > 4 &&
+                name.compare(name.size() - 4, 4, ".log") == 0) {
+                names.push_back(name);
+            }
+        }
+        closedir(dir);
+    }
+    std::sort(names.begin(), names.end());
+
+    for (const auto& name : names) {
+        SegmentPtr segment = openSegment(m_directory + "/" + name, 0, false);
+        if (!segment) {
+            continue;
+        }
+        m_nextSeq = segment->firstSeq + segment->count;
+        m_segments.push_back(segment);
+    }
+
+    // 旧版本的段只读，新记录写入新段
+    if (!m_segments.empty() && m_segments.back()->version != HISTORY_VERSION && m_segments.back()->count == 0) {
+        unlink(m_segments.back()->path.c_str());
+        m_segments.pop_back();
+    }
+    if ((m_segments.empty() || m_segments.back()->version != HISTORY_VERSION) && !rotate()) {
+        m_directory.clear();
+        return false;
+    }
+    while (m_segments.size() > m_maxSegments) {
+        m_segments.front()->removeOnClose = true;
+        m_segments.erase(m_segments.begin());
+    }
+
+    std::cout << "[HistoryLog] Opened " << directory << ": " << m_segments.size()
+        << " segments, " << m_nextSeq << " records" << std::endl;
+    return true;
+}
+
+void CHistoryLog::close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& segment : m_segments) {
+        msync(segment->base, segment->committed, MS_ASYNC);
+    }
+    m_segments.clear();
+    m_directory.clear();
+}
+
+CHistoryLog::SegmentPtr CHistoryLog::openSegment(const std::string& path, uint64_t firstSeq, bool create)
+{
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0), 0644);
+    if (fd == -1) {
+        std::cerr << "[HistoryLog] Failed to open " << path << ": " << strerror(errno) << std::endl;
+        return nullptr;
+    }
+
+    size_t capacity = m_segmentSize;
+    if (create) {
+        // 预分配为稀疏文件，写入时才真正占用磁盘
+        if (ftruncate(fd, capacity) == -1) {
+            std::cerr << "[HistoryLog] Failed to size " << path << ": " << strerror(errno) << std::endl;
+            ::close(fd);
+            return nullptr;
+        }
+    }
+    else {
+        struct stat st;
+        if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < HEADER_SIZE) {
+            ::close(fd);
+            return nullptr;
+        }
+        capacity = st.st_size;
+    }
+
+    void* base = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        std::cerr << "[HistoryLog] Failed to mmap " << path << ": " << strerror(errno) << std::endl;
+        ::close(fd);
+        return nullptr;
+    }
+
+    SegmentPtr segment = std::make_shared<Segment>();
+    segment->path = path;
+    segment->fd = fd;
+    segment->base = static_cast<char*>(base);
+    segment->capacity = capacity;
+
+    if (create) {
+        memcpy(segment->base, HISTORY_MAGIC, 4);
+        memcpy(segment->base + 4, &HISTORY_VERSION, 4);
+        memcpy(segment->base + 8, &firstSeq, 8);
+        segment->firstSeq = firstSeq;
+        segment->version = HISTORY_VERSION;
+        segment->committed = HEADER_SIZE;
+        return segment;
+    }
+
+    if (!recoverSegment(*segment)) {
+        std::cerr << "[HistoryLog] Ignoring invalid segment " << path << std::endl;
+        return nullptr;
+    }
+    return segment;
+}
+
+bool CHistoryLog::recoverSegment(Segment& segment)
+{
+    memcpy(&segment.version, segment.base + 4, 4);
+    if (memcmp(segment.base, HISTORY_MAGIC, 4) != 0 || segment.version < 1 || segment.version > HISTORY_VERSION) {
+        return false;
+    }
+    memcpy(&segment.firstSeq, segment.base + 8, 8);
+
+    // 顺序扫描记录直到遇到空白、不完整或校验失败的记录
+    size_t headerSize = recordHeaderSize(segment);
+    size_t offset = HEADER_SIZE;
+    bool torn = false;
+    while (offset + headerSize <= segment.capacity) {
+        uint32_t length = 0;
+        uint64_t timestamp = 0;
+        memcpy(&length, segment.base + offset, 4);
+        memcpy(&timestamp, segment.base + offset + 4, 8);
+        if (length < headerSize || offset + length > segment.capacity) {
+            torn = length != 0;
+            break;
+        }
+        if (segment.version >= 2) {
+            uint32_t crc = 0;
+            memcpy(&crc, segment.base + offset + 16, 4);
+            if (crc != recordCrc(segment.base + offset, length)) {
+                torn = true;
+                break;
+            }
+        }
+
+        if (segment.count % INDEX_INTERVAL == 0) {
+            segment.index.push_back({ segment.firstSeq + segment.count, timestamp, offset });
+        }
+        if (segment.count == 0) {
+            segment.firstTimestamp = timestamp;
+        }
+        segment.lastTimestamp = timestamp;
+        segment.count++;
+        offset += length;
+    }
+    segment.committed = offset;
+
+    if (torn) {
+        // 清除截断点之后的残留内容，避免之后追加的记录与旧数据拼成看似有效的记录
+        std::cerr << "[HistoryLog] Truncating " << segment.path << " at offset " << offset
+            << " after " << segment.count << " records" << std::endl;
+        if (fallocate(segment.fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, segment.capacity - offset) == -1) {
+            memset(segment.base + offset, 0, segment.capacity - offset);
+        }
+    }
+    return true;
+}
+
+bool CHistoryLog::rotate()
+{
+    if (!m_segments.empty()) {
+        msync(m_segments.back()->base, m_segments.back()->committed, MS_ASYNC);
+    }
+
+    SegmentPtr segment = openSegment(segmentPath(m_nextSeq), m_nextSeq, true);
+    if (!segment) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_segments.push_back(segment);
+    // 超出保留数量时丢弃最旧的段，正在回放的读者释放后才删除文件
+    while (m_segments.size() > m_maxSegments) {
+        m_segments.front()->removeOnClose = true;
+        m_segments.erase(m_segments.begin());
+    }
+    return true;
+}
+
+bool CHistoryLog::append(uint64_t timestampMs, int clientId, const char* frame, size_t size)
+{
+    if (!isOpen()) {
+        return false;
+    }
+
+    size_t length = RECORD_HEADER_SIZE + size;
+    if (length > m_segmentSize - HEADER_SIZE) {
+        std::cerr << "[HistoryLog] Record too large: " << size << " bytes" << std::endl;
+        return false;
+    }
+
+    SegmentPtr segment;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        segment = m_segments.back();
+    }
+    if (segment->committed + length > segment->capacity) {
+        if (!rotate()) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        segment = m_segments.back();
+    }
+
+    // 已提交位置之后的内存只有写线程访问，无需加锁
+    char* p = segment->base + segment->committed;
+    uint32_t length32 = static_cast<uint32_t>(length);
+    int32_t id = clientId;
+    memcpy(p + 4, &timestampMs, 8);
+    memcpy(p + 12, &id, 4);
+    memcpy(p + RECORD_HEADER_SIZE, frame, size);
+    uint32_t crc = recordCrc(p, length);
+    memcpy(p + 16, &crc, 4);
+    memcpy(p, &length32, 4);
+
+    // 发布：更新已提交位置和稀疏索引
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (segment->count % INDEX_INTERVAL == 0) {
+        segment->index.push_back({ m_nextSeq, timestampMs, segment->committed });
+    }
+    if (segment->count == 0) {
+        segment->firstTimestamp = timestampMs;
+    }
+    segment->lastTimestamp = timestampMs;
+    segment->count++;
+    segment->committed += length;
+    m_nextSeq++;
+    return true;
+}
+
+uint64_t CHistoryLog::recordCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_nextSeq;
+}
+
+size_t CHistoryLog::visit(const Segment& segment, size_t offset, size_t limit, uint64_t seq,
+    uint64_t minSeq, uint64_t minTimestamp, size_t maxCount, const Visitor& visitor, bool& stop) const
+{
+    size_t headerSize = recordHeaderSize(segment);
+    size_t visited = 0;
+    while (offset + headerSize <= limit && visited < maxCount) {
+        uint32_t length = 0;
+        uint64_t timestamp = 0;
+        memcpy(&length, segment.base + offset, 4);
+        memcpy(&timestamp, segment.base + offset + 4, 8);
+
+        if (seq >= minSeq && timestamp >= minTimestamp) {
+            // 帧数据直接指向映射内存
+            if (!visitor(segment.base + offset + headerSize, length - headerSize)) {
+                stop = true;
+                break;
+            }
+            visited++;
+        }
+        offset += length;
+        seq++;
+    }
+    return visited;
+}
+
+size_t CHistoryLog::replayLast(size_t n, const Visitor& visitor) const
+{
+    struct View { SegmentPtr segment; size_t offset; size_t limit; uint64_t seq; };
+    std::vector<View> views;
+    uint64_t startSeq = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        startSeq = m_nextSeq > n ? m_nextSeq - n : 0;
+        for (const auto& segment : m_segments) {
+            if (segment->firstSeq + segment->count <= startSeq) {
+                continue;
+            }
+            // 找到不超过起始序号的最后一个索引点
+            View view{ segment, HEADER_SIZE, segment->committed, segment->firstSeq };
+            for (const auto& entry : segment->index) {
+                if (entry.seq > startSeq) {
+                    break;
+                }
+                view.offset = entry.offset;
+                view.seq = entry.seq;
+            }
+            views.push_back(view);
+        }
+    }
+
+    size_t total = 0;
+    bool stop = false;
+    for (const auto& view : views) {
+        total += visit(*view.segment, view.offset, view.limit, view.seq, startSeq, 0, n - total, visitor, stop);
+        if (stop || total >= n) {
+            break;
+        }
+    }
+    return total;
+}
+
+size_t CHistoryLog::replaySince(uint64_t timestampMs, size_t maxCount, const Visitor& visitor) const
+{
+    struct View { SegmentPtr segment; size_t offset; size_t limit; uint64_t seq; };
+    std::vector<View> views;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& segment : m_segments) {
+            if (segment->count == 0 || segment->lastTimestamp < timestampMs) {
+                continue;
+            }
+            // 找到时间戳早于目标的最后一个索引点
+            View view{ segment, HEADER_SIZE, segment->committed, segment->firstSeq };
+            for (const auto& entry : segment->index) {
+                if (entry.timestamp >= timestampMs) {
+                    break;
+                }
+                view.offset = entry.offset;
+                view.seq = entry.seq;
+            }
+            views.push_back(view);
+        }
+    }
+
+    size_t total = 0;
+    bool stop = false;
+    for (const auto& view : views) {
+        total += visit(*view.segment, view.offset, view.limit, view.seq, 0, timestampMs, maxCount - total, visitor, stop);
+        if (stop || total >= maxCount) {
+            break;
+        }
+    }
+    return total;
+}
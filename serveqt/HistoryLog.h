@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 消息历史日志 - 分段、mmap映射、只追加
+// 目录下每个段文件预分配固定大小并整体映射，记录格式：
+//   长度(4字节) + 时间戳毫秒(8字节) + 客户端ID(4字节) + CRC32(4字节) + 序列化后的数据包帧
+// CRC覆盖时间戳、客户端ID和帧，恢复时截断到第一条校验失败的记录(崩溃时写了一半的尾部)
+// 每隔 INDEX_INTERVAL 条记录保存一个稀疏索引(序号/时间戳/偏移)，启动时扫描段文件重建
+// 写入只由一个线程(线程池中的历史串行队列)执行；读取可在任意线程，
+// 回放时直接把映射内存中的帧交给回调发送，不做拷贝
+class CHistoryLog
+{
+public:
+    // 回放回调：返回false停止回放
+    using Visitor = std::function<bool(const char* frame, size_t size)>;
+
+    static const size_t DEFAULT_SEGMENT_SIZE = 64 * 1024 * 1024;
+    static const size_t DEFAULT_MAX_SEGMENTS = 16;
+    static const size_t INDEX_INTERVAL = 64;
+
+    CHistoryLog();
+    ~CHistoryLog();
+
+    // 打开目录，恢复已有的段文件
+    bool open(const std::string& directory,
+        size_t segmentSize = DEFAULT_SEGMENT_SIZE, size_t maxSegments = DEFAULT_MAX_SEGMENTS);
+    void close();
+    bool isOpen() const { return !m_directory.empty(); }
+
+    // 追加一条记录，只能在写线程调用
+    bool append(uint64_t timestampMs, int clientId, const char* frame, size_t size);
+
+    // 回放最近n条
+    size_t replayLast(size_t n, const Visitor& visitor) const;
+
+    // 回放某时间点(含)之后的记录，最多maxCount条
+    size_t replaySince(uint64_t timestampMs, size_t maxCount, const Visitor& visitor) const;
+
+    uint64_t recordCount() const;
+
+    static uint64_t nowMs();
+
+private:
+    struct IndexEntry {
+        uint64_t seq;          // 全局序号
+        uint64_t timestamp;    // 时间戳(毫秒)
+        size_t offset;         // 段内偏移
+    };
+
+    struct Segment {
+        std::string path;
+        int fd = -1;
+        char* base = nullptr;
+        size_t capacity = 0;
+        size_t committed = 0;          // 已提交的字节数，以下内容不再变化
+        uint64_t firstSeq = 0;
+        uint64_t count = 0;
+        uint64_t firstTimestamp = 0;
+        uint64_t lastTimestamp = 0;
+        std::vector<IndexEntry> index;
+        uint32_t version = 0;
+        bool removeOnClose = false;    // 超出保留数量后删除文件
+
+        ~Segment();
+    };
+    using SegmentPtr = std::shared_ptr<Segment>;
+
+    static const size_t HEADER_SIZE = 16;           // 段文件头
+    static const size_t RECORD_HEADER_SIZE = 20;    // 记录头
+    static const size_t V1_RECORD_HEADER_SIZE = 16; // 版本1的记录头，没有CRC
+
+    static size_t recordHeaderSize(const Segment& segment);
+    static uint32_t recordCrc(const char* record, size_t length);
+
+    std::string m_directory;
+    size_t m_segmentSize;
+    size_t m_maxSegments;
+    uint64_t m_nextSeq;
+
+    mutable std::mutex m_mutex;                     // 保护段列表和已提交位置
+    std::vector<SegmentPtr> m_segments;
+
+    SegmentPtr openSegment(const std::string& path, uint64_t firstSeq, bool create);
+    bool recoverSegment(Segment& segment);
+    bool rotate();
+    std::string segmentPath(uint64_t firstSeq) const;
+
+    // 从段内指定位置开始遍历记录，直到limit偏移
+    size_t visit(const Segment& segment, size_t offset, size_t limit, uint64_t seq,
+        uint64_t minSeq, uint64_t minTimestamp, size_t maxCount, const Visitor& visitor, bool& stop) const;
+};
@@ -0,0 +1,98 @@
+#include "Latency.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+bool LatencyOptions::parseCpuList(const std::string& text, std::vector<int>& cpus) {
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (item.empty()) {
+            return false;
+        }
+        char* end = nullptr;
+        long first = std::strtol(item.c_str(), &end, 10);
+        long last = first;
+        if (*end == '-') {
+            last = std::strtol(end + 1, &end, 10);
+        }
+        if (*end != '\0' || first < 0 || last < first || last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    return !cpus.empty();
+}
+
+bool LatencyOptions::pinCurrentThread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (result != 0) {
+        std::cerr << "[Latency] Failed to pin thread to CPU " << cpu << ": " << strerror(result) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+CLatencyHistogram::CLatencyHistogram() {
+    reset();
+}
+
+size_t CLatencyHistogram::bucketOf(uint64_t us) {
+    if (us < 16) {
+        return static_cast<size_t>(us);
+    }
+    int msb = 63 - __builtin_clzll(us);               // >= 4
+    return 16 + static_cast<size_t>(msb - 4) * 8 + static_cast<size_t>((us >> (msb - 3)) & 7);
+}
+
+uint64_t CLatencyHistogram::bucketValue(size_t bucket) {
+    if (bucket < 16) {
+        return bucket;
+    }
+    size_t msb = (bucket - 16) / 8 + 4;
+    uint64_t sub = (bucket - 16) % 8;
+    return (8 + sub) << (msb - 3);
+}
+
+void CLatencyHistogram::record(uint64_t us) {
+    m_buckets[bucketOf(us)]++;
+    m_count++;
+    m_max = std::max(m_max, us);
+}
+
+void CLatencyHistogram::reset() {
+    memset(m_buckets, 0, sizeof(m_buckets));
+    m_count = 0;
+    m_max = 0;
+}
+
+uint64_t CLatencyHistogram::percentile(double p) const {
+    if (m_count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(m_count - 1));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+        seen += m_buckets[bucket];
+        if (seen > rank) {
+            return std::min(bucketValue(bucket), m_max);
+        }
+    }
+    return m_max;
+}
+
+std::string CLatencyHistogram::describe() const {
+    std::ostringstream out;
+    out << "n=" << m_count << " p50=" << percentile(50) << "us p90=" << percentile(90)
+        << "us p99=" << percentile(99) << "us max=" << m_max << "us";
+    return out.str();
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 低延迟模式的配置
+//   cpus        第一个核绑定epoll线程，其余的核轮流绑定工作线程(只给一个核时工作线程不绑定)
+//   spinUs      阻塞前非阻塞轮询的时间预算，0为直接阻塞
+//   busyPollUs  客户端TCP socket的SO_BUSY_POLL，超过 net.core.busy_poll 需要CAP_NET_ADMIN
+struct LatencyOptions {
+    std::vector<int> cpus;
+    uint32_t spinUs = 0;
+    uint32_t busyPollUs = 0;
+
+    bool enabled() const { return !cpus.empty() || spinUs > 0 || busyPollUs > 0; }
+
+    // "2,3,6-8" 形式的核列表
+    static bool parseCpuList(const std::string& text, std::vector<int>& cpus);
+    // 绑定当前线程
+    static bool pinCurrentThread(int cpu);
+};
+
+// 延迟直方图(微秒) - 16以下精确，之后每个2的幂分8档，误差不超过12.5%
+// 只在一个线程中记录和读取
+class CLatencyHistogram
+{
+public:
+    CLatencyHistogram();
+
+    void record(uint64_t us);
+    void reset();
+
+    uint64_t count() const { return m_count; }
+    uint64_t max() const { return m_max; }
+    // p为0~100，返回该档的下限
+    uint64_t percentile(double p) const;
+
+    // "n=.. p50=..us p90=..us p99=..us max=..us"
+    std::string describe() const;
+
+private:
+    static const size_t BUCKETS = 16 + 60 * 8;
+
+    uint64_t m_buckets[BUCKETS];
+    uint64_t m_count;
+    uint64_t m_max;
+
+    static size_t bucketOf(uint64_t us);
+    static uint64_t bucketValue(size_t bucket);
+};
@@ -0,0 +1,178 @@
+#include "Listener.h"
+#include <cstdlib>
+#include <iostream>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static const char UNIX_PREFIX[] = "unix:";
+static const char TLS_PREFIX[] = "tls:";
+
+bool ListenEndpoint::parse(const std::string& spec, ListenEndpoint& endpoint)
+{
+    if (spec.compare(0, sizeof(TLS_PREFIX) - 1, TLS_PREFIX) == 0) {
+        // Unix域socket只在本机，不需要加密
+        if (!parse(spec.substr(sizeof(TLS_PREFIX) - 1), endpoint) || endpoint.family == UNIX || endpoint.tls) {
+            return false;
+        }
+        endpoint.tls = true;
+        return true;
+    }
+    endpoint.tls = false;
+    if (spec.compare(0, sizeof(UNIX_PREFIX) - 1, UNIX_PREFIX) == 0) {
+        endpoint.family = UNIX;
+        endpoint.address = spec.substr(sizeof(UNIX_PREFIX) - 1);
+        endpoint.port = 0;
+        return !endpoint.address.empty() && endpoint.address.size() < sizeof(sockaddr_un::sun_path);
+    }
+
+    size_t colon = spec.rfind(':');
+    if (colon == std::string::npos || colon + 1 >= spec.size()) {
+        return false;
+    }
+    std::string host = spec.substr(0, colon);
+    endpoint.port = std::atoi(spec.c_str() + colon + 1);
+    if (endpoint.port <= 0 || endpoint.port > 65535) {
+        return false;
+    }
+
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+        endpoint.family = IPV6;
+        endpoint.address = host.substr(1, host.size() - 2);
+        struct in6_addr addr;
+        return inet_pton(AF_INET6, endpoint.address.c_str(), &addr) == 1;
+    }
+    endpoint.family = IPV4;
+    endpoint.address = host;
+    struct in_addr addr;
+    return inet_pton(AF_INET, endpoint.address.c_str(), &addr) == 1;
+}
+
+std::string ListenEndpoint::toString() const
+{
+    std::string prefix = tls ? TLS_PREFIX : "";
+    switch (family) {
+    case UNIX:
+        return UNIX_PREFIX + address;
+    case IPV6:
+        return prefix + "[" + address + "]:" + std::to_string(port);
+    default:
+        return prefix + address + ":" + std::to_string(port);
+    }
+}
+
+CListener::CListener(const ListenEndpoint& endpoint)
+    : m_endpoint(endpoint), m_fd(-1), m_adopted(false)
+{
+}
+
+bool CListener::open()
+{
+    struct sockaddr_storage storage;
+    memset(&storage, 0, sizeof(storage));
+    socklen_t length = 0;
+    int domain = AF_INET;
+
+    if (m_endpoint.family == ListenEndpoint::UNIX) {
+        struct sockaddr_un* addr = reinterpret_cast<struct sockaddr_un*>(&storage);
+        addr->sun_family = AF_UNIX;
+        memcpy(addr->sun_path, m_endpoint.address.c_str(), m_endpoint.address.size());
+        length = sizeof(struct sockaddr_un);
+        domain = AF_UNIX;
+        // 上次运行留下的socket文件
+        unlink(m_endpoint.address.c_str());
+    }
+    else if (m_endpoint.family == ListenEndpoint::IPV6) {
+        struct sockaddr_in6* addr = reinterpret_cast<struct sockaddr_in6*>(&storage);
+        addr->sin6_family = AF_INET6;
+        addr->sin6_port = htons(m_endpoint.port);
+        inet_pton(AF_INET6, m_endpoint.address.c_str(), &addr->sin6_addr);
+        length = sizeof(struct sockaddr_in6);
+        domain = AF_INET6;
+    }
+    else {
+        struct sockaddr_in* addr = reinterpret_cast<struct sockaddr_in*>(&storage);
+        addr->sin_family = AF_INET;
+        addr->sin_port = htons(m_endpoint.port);
+        inet_pton(AF_INET, m_endpoint.address.c_str(), &addr->sin_addr);
+        length = sizeof(struct sockaddr_in);
+    }
+
+    m_fd = socket(domain, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_fd == -1) {
+        std::cerr << "[Listener] Failed to create socket for " << m_endpoint.toString() << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // 端口复用；IPv6监听只接受IPv6，IPv4需要单独的监听地址
+    int opt = 1;
+    if (domain != AF_UNIX) {
+        setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    }
+    if (domain == AF_INET6) {
+        setsockopt(m_fd, IPPROTO_IPV6, IPV6_V6ONLY, &opt, sizeof(opt));
+    }
+
+    if (bind(m_fd, reinterpret_cast<struct sockaddr*>(&storage), length) == -1 ||
+        listen(m_fd, SOMAXCONN) == -1) {
+        std::cerr << "[Listener] Failed to listen on " << m_endpoint.toString() << ": " << strerror(errno) << std::endl;
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void CListener::close(bool removePath)
+{
+    if (m_fd == -1) {
+        return;
+    }
+    ::close(m_fd);
+    m_fd = -1;
+    if (removePath && m_endpoint.family == ListenEndpoint::UNIX) {
+        unlink(m_endpoint.address.c_str());
+    }
+}
+
+int CListener::accept(std::string& ip, int& port)
+{
+    struct sockaddr_storage storage;
+    socklen_t length = sizeof(storage);
+    int clientSocket = ::accept(m_fd, reinterpret_cast<struct sockaddr*>(&storage), &length);
+    if (clientSocket == -1) {
+        return -1;
+    }
+
+    char text[INET6_ADDRSTRLEN] = "";
+    if (storage.ss_family == AF_INET6) {
+        const struct sockaddr_in6* addr = reinterpret_cast<const struct sockaddr_in6*>(&storage);
+        inet_ntop(AF_INET6, &addr->sin6_addr, text, sizeof(text));
+        port = ntohs(addr->sin6_port);
+        ip = text;
+    }
+    else if (storage.ss_family == AF_INET) {
+        const struct sockaddr_in* addr = reinterpret_cast<const struct sockaddr_in*>(&storage);
+        inet_ntop(AF_INET, &addr->sin_addr, text, sizeof(text));
+        port = ntohs(addr->sin_port);
+        ip = text;
+    }
+    else {
+        // Unix域socket的客户端没有地址，按对端用户区分：只有本用户(或root)记为"unix"，可以使用管理命令
+        struct ucred peer = {};
+        socklen_t peerLength = sizeof(peer);
+        if (getsockopt(clientSocket, SOL_SOCKET, SO_PEERCRED, &peer, &peerLength) == 0 &&
+            (peer.uid == geteuid() || peer.uid == 0)) {
+            ip = "unix";
+        }
+        else {
+            ip = "unix-uid-" + std::to_string(peer.uid);
+        }
+        port = 0;
+    }
+    return clientSocket;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// 监听地址
+//   "host:port"      IPv4，如 127.0.0.1:8080、0.0.0.0:8080
+//   "[addr]:port"    IPv6，如 [::1]:8080、[::]:8080(只接受IPv6)
+//   "unix:/path"     Unix域socket，同一台机器上的进程绕过TCP/IP协议栈
+//   "tls:..."        前两种TCP地址加前缀，连接先完成TLS握手(见 Tls.h)
+struct ListenEndpoint {
+    enum Family : uint8_t {
+        IPV4,
+        IPV6,
+        UNIX
+    };
+
+    Family family = IPV4;
+    std::string address;       // IP地址或socket路径
+    int port = 0;
+    bool tls = false;
+
+    static bool parse(const std::string& spec, ListenEndpoint& endpoint);
+    std::string toString() const;
+};
+
+// 监听socket - 多个监听地址同时接受连接，客户端进入同一张客户端表
+class CListener
+{
+public:
+    explicit CListener(const ListenEndpoint& endpoint);
+
+    // 创建、绑定并开始监听(非阻塞)
+    bool open();
+    // 使用热重启时从旧进程接管的socket
+    void adopt(int fd) { m_fd = fd; m_adopted = true; }
+    bool adopted() const { return m_adopted; }
+    // 关闭socket；removePath为true时删除Unix域socket文件
+    void close(bool removePath);
+
+    // 接受一个连接，返回客户端socket并填写对端地址；失败返回-1
+    // Unix域socket的对端地址为"unix"(本用户或root)或"unix-uid-N"(其他用户)
+    int accept(std::string& ip, int& port);
+
+    int fd() const { return m_fd; }
+    const ListenEndpoint& endpoint() const { return m_endpoint; }
+
+private:
+    ListenEndpoint m_endpoint;
+    int m_fd;
+    bool m_adopted;            // 从旧进程接管，Unix域socket文件仍由旧进程使用
+};
@@ -0,0 +1,99 @@
+#include "MemoryBudget.h"
+#include <algorithm>
+#include <sstream>
+
+CMemoryBudget::CMemoryBudget()
+    : m_totalLimit(DEFAULT_TOTAL_LIMIT), m_connectionLimit(DEFAULT_CONNECTION_LIMIT), m_total(0),
+    m_kindTotals(), m_peak(0), m_counters() {
+}
+
+void CMemoryBudget::setLimits(size_t total, size_t perConnection) {
+    m_totalLimit = total;
+    m_connectionLimit = perConnection;
+}
+
+void CMemoryBudget::set(int clientId, Kind kind, size_t bytes) {
+    size_t& current = m_accounts[clientId].bytes[kind];
+    m_total = m_total - current + bytes;
+    m_kindTotals[kind] = m_kindTotals[kind] - current + bytes;
+    current = bytes;
+    m_peak = std::max(m_peak, m_total);
+}
+
+void CMemoryBudget::removeClient(int clientId) {
+    auto it = m_accounts.find(clientId);
+    if (it == m_accounts.end()) {
+        return;
+    }
+    for (int kind = 0; kind < KIND_COUNT; ++kind) {
+        m_total -= it->second.bytes[kind];
+        m_kindTotals[kind] -= it->second.bytes[kind];
+    }
+    m_accounts.erase(it);
+}
+
+size_t CMemoryBudget::connectionBytes(int clientId) const {
+    auto it = m_accounts.find(clientId);
+    if (it == m_accounts.end()) {
+        return 0;
+    }
+    size_t bytes = 0;
+    for (int kind = 0; kind < KIND_COUNT; ++kind) {
+        bytes += it->second.bytes[kind];
+    }
+    return bytes;
+}
+
+bool CMemoryBudget::canGrow(int clientId, size_t bytes) const {
+    if (m_connectionLimit > 0 && connectionBytes(clientId) + bytes > m_connectionLimit) {
+        return false;
+    }
+    // 发送队列中广播共享的帧在每个接收方各计一次，全局预算只按接收缓冲区和积压帧判断，
+    // 否则大量广播会让正常大小的入站帧也被拒绝
+    size_t inbound = m_kindTotals[RECEIVE] + m_kindTotals[INBOX];
+    return m_totalLimit == 0 || inbound + bytes <= m_totalLimit;
+}
+
+bool CMemoryBudget::overConnectionLimit(int clientId) const {
+    return m_connectionLimit > 0 && connectionBytes(clientId) > m_connectionLimit;
+}
+
+std::vector<int> CMemoryBudget::idleClients(uint64_t nowMs, uint64_t idleMs) const {
+    std::vector<int> idle;
+    for (const auto& pair : m_accounts) {
+        if (nowMs - pair.second.lastActiveMs >= idleMs) {
+            idle.push_back(pair.first);
+        }
+    }
+    return idle;
+}
+
+std::string CMemoryBudget::describe() const {
+    // 按连接用量取前几个，便于定位占用内存的客户端
+    std::vector<std::pair<size_t, int>> largest;
+    for (const auto& pair : m_accounts) {
+        largest.push_back({ connectionBytes(pair.first), pair.first });
+    }
+    size_t top = std::min<size_t>(largest.size(), 5);
+    std::partial_sort(largest.begin(), largest.begin() + top, largest.end(),
+        [](const std::pair<size_t, int>& a, const std::pair<size_t, int>& b) { return a.first > b.first; });
+
+    std::ostringstream out;
+    out << "total " << m_total << " bytes";
+    if (m_totalLimit > 0) {
+        out << " of " << m_totalLimit << " (" << usagePercent() << "%)";
+    }
+    out << ", peak " << m_peak
+        << "; receive " << m_kindTotals[RECEIVE]
+        << ", outbound " << m_kindTotals[OUTBOUND]
+        << ", inbox " << m_kindTotals[INBOX]
+        << "; " << m_accounts.size() << " connections, limit " << m_connectionLimit << " each; largest:";
+    for (size_t i = 0; i < top; ++i) {
+        out << " " << largest[i].second << "=" << largest[i].first;
+    }
+    out << "; frames refused " << m_counters[FRAMES_REFUSED]
+        << ", cap disconnects " << m_counters[CAP_DISCONNECTS]
+        << ", buffers shrunk " << m_counters[BUFFERS_SHRUNK]
+        << ", bytes released " << m_counters[BYTES_RELEASED];
+    return out.str();
+}
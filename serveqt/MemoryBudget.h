@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// 内存记账 - 每个连接的接收缓冲区、发送队列和挂起期间积压的帧计入该连接和全局总量
+// 接收缓冲区按容量(实际占用)计算，发送队列按未发出的字节计算(广播共享的帧在每个接收方各计一次，偏保守)
+// 这里只做记账和判断，超限时的处理(拒绝大帧、断开、收缩缓冲区)由 CServerSocket 执行
+// 只在epoll线程中使用
+class CMemoryBudget
+{
+public:
+    enum Kind : uint8_t {
+        RECEIVE = 0,       // 接收缓冲区
+        OUTBOUND = 1,      // 发送队列
+        INBOX = 2,         // 处理函数挂起期间积压的帧
+        KIND_COUNT = 3
+    };
+
+    enum Counter : uint8_t {
+        FRAMES_REFUSED = 0,        // 超过上限被拒绝的入站帧
+        CAP_DISCONNECTS = 1,       // 超过单连接上限被断开
+        BUFFERS_SHRUNK = 2,        // 收缩的缓冲区
+        BYTES_RELEASED = 3,        // 收缩释放的字节
+        COUNTER_COUNT = 4
+    };
+
+    static const size_t DEFAULT_TOTAL_LIMIT = 1024ULL * 1024 * 1024;
+    static const size_t DEFAULT_CONNECTION_LIMIT = 160 * 1024 * 1024;  // 容得下一个最大包加满发送队列
+    static const size_t RECEIVE_KEEP = 64 * 1024;      // 接收缓冲区空闲时保留的容量
+    static const uint64_t IDLE_MS = 10000;             // 超过该时间没有收发的连接释放缓冲区
+    static const uint64_t CHECK_MS = 1000;
+
+    CMemoryBudget();
+
+    // 0表示不限制
+    void setLimits(size_t total, size_t perConnection);
+    size_t totalLimit() const { return m_totalLimit; }
+    size_t connectionLimit() const { return m_connectionLimit; }
+
+    // 更新某个连接某一类的当前字节数
+    void set(int clientId, Kind kind, size_t bytes);
+    void touch(int clientId, uint64_t nowMs) { m_accounts[clientId].lastActiveMs = nowMs; }
+    void removeClient(int clientId);
+
+    size_t total() const { return m_total; }
+    size_t total(Kind kind) const { return m_kindTotals[kind]; }
+    size_t connectionBytes(int clientId) const;
+
+    // 该连接再增加 bytes 是否仍在单连接上限和全局预算之内(全局预算不含发送队列，见实现)
+    bool canGrow(int clientId, size_t bytes) const;
+    bool overConnectionLimit(int clientId) const;
+    bool overBudget() const { return m_totalLimit > 0 && m_total > m_totalLimit; }
+    // 全局用量百分比，未设置预算时为0
+    size_t usagePercent() const { return m_totalLimit > 0 ? m_total * 100 / m_totalLimit : 0; }
+
+    // 超过 idleMs 没有活动的连接
+    std::vector<int> idleClients(uint64_t nowMs, uint64_t idleMs) const;
+
+    void count(Counter counter, uint64_t n = 1) { m_counters[counter] += n; }
+
+    std::string describe() const;
+
+private:
+    struct Account {
+        size_t bytes[KIND_COUNT] = {};
+        uint64_t lastActiveMs = 0;
+    };
+
+    size_t m_totalLimit;
+    size_t m_connectionLimit;
+    size_t m_total;
+    size_t m_kindTotals[KIND_COUNT];
+    size_t m_peak;
+    uint64_t m_counters[COUNTER_COUNT];
+    std::map<int, Account> m_accounts;
+};
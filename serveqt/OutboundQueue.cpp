@@ -0,0 +1,254 @@
+#include "OutboundQueue.h"
+#include "Command.h"
+#include "Packet.h"
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// 每轮额度：控制和聊天的帧都很小，给足额度保证一轮内发完
+static const size_t QUANTUM[COutboundQueue::CLASS_COUNT] = {
+    64 * 1024,     // CONTROL
+    32 * 1024,     // CHAT
+    16 * 1024      // BULK
+};
+
+static const int MAX_IOV = 64;
+
+std::atomic<size_t> COutboundQueue::s_batchBytes(COutboundQueue::DEFAULT_BATCH_BYTES);
+
+COutboundQueue::COutboundQueue()
+    : m_current(0), m_freshTurn(true), m_offset(0), m_bytes(0), m_bytesWritten(0), m_framesWritten(0), m_slow(false),
+    m_detached(false)
+{
+    for (size_t i = 0; i < CLASS_COUNT; ++i) {
+        m_classes[i].quantum = QUANTUM[i];
+    }
+}
+
+COutboundQueue::Class COutboundQueue::classify(uint16_t cmd)
+{
+    switch (static_cast<CCommand::Type>(cmd & ~CPacket::CMD_COMPRESSED)) {
+    case CCommand::Type::TEXT_MESSAGE:
+        return CHAT;
+    case CCommand::Type::FILE_START:
+    case CCommand::Type::FILE_DATA:
+    case CCommand::Type::FILE_COMPLETE:
+    case CCommand::Type::FILE_MANIFEST:
+    case CCommand::Type::CHUNK_DATA:
+        return BULK;
+    default:
+        return CONTROL;
+    }
+}
+
+COutboundQueue::Class COutboundQueue::classifyFrame(const std::string& frame)
+{
+    // 帧头：包头(2) + 长度(4) + 命令(2)
+    if (frame.size() < 8) {
+        return CONTROL;
+    }
+    uint16_t cmd = static_cast<uint16_t>((static_cast<uint8_t>(frame[6]) << 8) | static_cast<uint8_t>(frame[7]));
+    return classify(cmd);
+}
+
+bool COutboundQueue::push(const Frame& frame, Class cls)
+{
+    if (!frame || frame->empty()) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_detached) {
+        // 会话已被新连接恢复时丢弃，新连接的队列会自己记录
+        if (m_session && !m_session->recordDetached(frame)) {
+            m_session.reset();
+        }
+        return true;
+    }
+    if (m_bytes + frame->size() > MAX_QUEUED_BYTES) {
+        return false;
+    }
+    m_classes[cls].frames.push_back(frame);
+    m_bytes += frame->size();
+    return true;
+}
+
+void COutboundQueue::restorePending(const std::string& data)
+{
+    if (data.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // 前面可能是上一个进程写了一半的帧，放在所有已调度帧之前
+    m_inflight.push_front(std::make_shared<const std::string>(data));
+    m_offset = 0;
+    m_bytes += data.size();
+}
+
+void COutboundQueue::attachSession(const std::shared_ptr<CSession>& session, const std::vector<Frame>& preamble)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& frame : preamble) {
+        m_inflight.push_back(frame);
+        m_bytes += frame->size();
+    }
+    m_session = session;
+}
+
+void COutboundQueue::detachSession()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_session) {
+        return;
+    }
+    // 已调度的帧已经在窗口中，写出一半的也会在重连后整帧重发
+    Frame frame;
+    while ((frame = next()) != nullptr) {
+        m_session->record(frame);
+        m_bytes -= frame->size();
+    }
+    m_detached = true;
+}
+
+COutboundQueue::Frame COutboundQueue::next()
+{
+    size_t queued = 0;
+    for (const auto& queue : m_classes) {
+        queued += queue.frames.size();
+    }
+    if (queued == 0) {
+        return nullptr;
+    }
+
+    // 慢速接收方的文件数据只在没有其他帧时发出
+    bool holdBulk = slow() && queued > m_classes[BULK].frames.size();
+
+    // 每个类别轮到时加一次额度，队首帧不超过额度就发出，否则轮到下一个类别
+    while (true) {
+        ClassQueue& queue = m_classes[m_current];
+        if (queue.frames.empty()) {
+            queue.deficit = 0;
+        }
+        else if (holdBulk && m_current == BULK) {
+            // 保留已有额度，恢复正常后继续
+        }
+        else {
+            if (m_freshTurn) {
+                queue.deficit += queue.quantum;
+                m_freshTurn = false;
+            }
+            size_t size = queue.frames.front()->size();
+            if (size <= queue.deficit) {
+                Frame frame = queue.frames.front();
+                queue.frames.pop_front();
+                queue.deficit -= size;
+                return frame;
+            }
+        }
+        m_current = (m_current + 1) % CLASS_COUNT;
+        m_freshTurn = true;
+    }
+}
+
+bool COutboundQueue::flush(int fd)
+{
+    return flush([fd](const struct iovec* iov, int count) {
+        struct msghdr msg = {};
+        msg.msg_iov = const_cast<struct iovec*>(iov);
+        msg.msg_iovlen = count;
+        return sendmsg(fd, &msg, MSG_NOSIGNAL);
+    });
+}
+
+bool COutboundQueue::flush(const Writer& writer)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while (m_bytes > 0) {
+        // 补充调度好的帧，限制批量大小，新到的聊天消息不会排在太多文件数据之后
+        size_t batch = 0;
+        for (const auto& frame : m_inflight) {
+            batch += frame->size();
+        }
+        batch -= m_offset;
+        size_t batchLimit = batchBytes();
+        while (batch < batchLimit && m_inflight.size() < static_cast<size_t>(MAX_IOV)) {
+            Frame frame = next();
+            if (!frame) {
+                break;
+            }
+            batch += frame->size();
+            m_inflight.push_back(frame);
+            if (m_session) {
+                m_session->record(frame);
+            }
+        }
+
+        struct iovec iov[MAX_IOV];
+        int count = 0;
+        for (const auto& frame : m_inflight) {
+            if (count == MAX_IOV) {
+                break;
+            }
+            size_t skip = count == 0 ? m_offset : 0;
+            iov[count].iov_base = const_cast<char*>(frame->data() + skip);
+            iov[count].iov_len = frame->size() - skip;
+            count++;
+        }
+
+        ssize_t sent = writer(iov, count);
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // 缓冲区已满，等待EPOLLOUT
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        m_bytes -= sent;
+        m_bytesWritten += sent;
+        size_t remaining = static_cast<size_t>(sent);
+        while (remaining > 0) {
+            size_t left = m_inflight.front()->size() - m_offset;
+            if (remaining < left) {
+                m_offset += remaining;
+                break;
+            }
+            remaining -= left;
+            m_inflight.pop_front();
+            m_offset = 0;
+            m_framesWritten++;
+        }
+    }
+    return true;
+}
+
+void COutboundQueue::shrink()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_bytes != 0) {
+        return;
+    }
+    for (auto& queue : m_classes) {
+        std::deque<Frame>().swap(queue.frames);
+    }
+    std::deque<Frame>().swap(m_inflight);
+    m_offset = 0;
+}
+
+std::string COutboundQueue::takePending()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::string pending;
+    pending.reserve(m_bytes);
+    for (size_t i = 0; i < m_inflight.size(); ++i) {
+        pending.append(*m_inflight[i], i == 0 ? m_offset : 0, std::string::npos);
+    }
+    m_inflight.clear();
+    m_offset = 0;
+
+    Frame frame;
+    while ((frame = next()) != nullptr) {
+        pending.append(*frame);
+    }
+    m_bytes = 0;
+    return pending;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+#include "Session.h"
+
+// 每个连接的发送队列 - 按流量类别分队列，用差额轮询(DRR)调度
+// 类别：控制/测试连接、聊天、文件；每轮每个类别获得 quantum 字节的发送额度，
+// 只在帧边界切换类别，大文件块在入队前已拆成不超过 MAX_BULK_FRAME 的帧，
+// 因此聊天消息最多等待一个文件额度就能发出
+// 帧以shared_ptr保存，广播时同一编码的所有接收方共享同一份数据
+// 并行扇出时工作线程也会入队和写出(见 CFanOut)，队列操作加锁，计数可以无锁读取
+// 绑定可靠会话后，帧从类别队列调度出来时按顺序记入会话的重传窗口(见 CSession)
+class COutboundQueue
+{
+public:
+    enum Class : uint8_t {
+        CONTROL = 0,       // 控制、在线状态、测试连接
+        CHAT = 1,          // 聊天消息
+        BULK = 2,          // 文件传输
+        CLASS_COUNT = 3
+    };
+
+    using Frame = std::shared_ptr<const std::string>;
+    // 写出一批数据，返回值和errno的含义与sendmsg相同
+    using Writer = std::function<ssize_t(const struct iovec* iov, int count)>;
+
+    static constexpr size_t MAX_BULK_FRAME = 16 * 1024;            // 文件数据帧拆分上限
+    static const size_t MAX_QUEUED_BYTES = 64 * 1024 * 1024;   // 单个连接未发出数据上限
+    static const size_t DEFAULT_BATCH_BYTES = 64 * 1024;       // 单次writev最多取出的字节数
+
+    // 批量上限对所有连接生效，可以在运行中修改(工作线程写出时读取)
+    static void setBatchBytes(size_t bytes) { s_batchBytes.store(bytes, std::memory_order_relaxed); }
+    static size_t batchBytes() { return s_batchBytes.load(std::memory_order_relaxed); }
+
+    COutboundQueue();
+
+    // 按命令字/帧头决定类别
+    static Class classify(uint16_t cmd);
+    static Class classifyFrame(const std::string& frame);
+
+    // 入队，超过上限时返回false
+    bool push(const Frame& frame, Class cls);
+
+    // 热重启恢复的未发送数据，必须最先发出
+    void restorePending(const std::string& data);
+
+    // 绑定会话：preamble(会话回复和需要重发的帧)排在已调度的帧之后、不记入窗口，之后调度的帧依次编号
+    void attachSession(const std::shared_ptr<CSession>& session, const std::vector<Frame>& preamble);
+    // 连接断开：尚未调度的帧记入会话，之后入队的帧(进行中的并行扇出)也直接记入
+    void detachSession();
+
+    // 尽量写出，直到队列为空或socket缓冲区已满；连接出错返回false
+    bool flush(int fd);
+    bool flush(const Writer& writer);      // 非socket连接(共享内存)
+
+    // 取出全部未发送数据(热重启交接)，从部分发送的帧剩余部分开始
+    std::string takePending();
+
+    // 队列为空时释放各deque保留的块(空闲连接)
+    void shrink();
+
+    bool empty() const { return bytes() == 0; }
+    size_t bytes() const { return m_bytes.load(std::memory_order_relaxed); }
+
+    // 累计写出的字节数和完整写出的帧数(连接统计)
+    uint64_t bytesWritten() const { return m_bytesWritten.load(std::memory_order_relaxed); }
+    uint64_t framesWritten() const { return m_framesWritten.load(std::memory_order_relaxed); }
+
+    // 慢速接收方：控制和聊天有帧时不调度文件数据，交互消息不必在文件额度之后等待
+    void setSlow(bool slow) { m_slow.store(slow, std::memory_order_relaxed); }
+    bool slow() const { return m_slow.load(std::memory_order_relaxed); }
+
+private:
+    struct ClassQueue {
+        std::deque<Frame> frames;
+        size_t quantum = 0;
+        size_t deficit = 0;
+    };
+
+    static std::atomic<size_t> s_batchBytes;
+
+    mutable std::mutex m_mutex;
+    ClassQueue m_classes[CLASS_COUNT];
+    size_t m_current;                      // 当前轮到的类别
+    bool m_freshTurn;                      // 当前类别本轮是否还未加额度
+    std::deque<Frame> m_inflight;          // 已调度、等待写出的帧
+    size_t m_offset;                       // 第一帧已写出的字节数
+    std::atomic<size_t> m_bytes;           // 队列中全部未写出的字节数
+    std::atomic<uint64_t> m_bytesWritten;
+    std::atomic<uint64_t> m_framesWritten;
+    std::atomic<bool> m_slow;
+    std::shared_ptr<CSession> m_session;   // 绑定的可靠会话
+    bool m_detached;                       // 连接已断开，入队的帧只记入仍处于断线状态的会话
+
+    Frame next();                          // DRR选出下一帧(持有锁)
+};
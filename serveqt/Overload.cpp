@@ -0,0 +1,157 @@
+#include "Overload.h"
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <time.h>
+
+namespace {
+
+// 各信号进入 COALESCE..REJECT 的阈值
+const uint64_t LAG_THRESHOLDS_MS[] = { 20, 50, 100, 250 };
+const size_t OUTBOUND_THRESHOLDS[] = { 16u << 20, 64u << 20, 128u << 20, 256u << 20 };
+const size_t BACKLOG_THRESHOLDS[] = { 256, 1024, 4096, 16384 };
+const size_t MEMORY_THRESHOLDS_PERCENT[] = { 60, 75, 85, 95 };
+
+template<typename T>
+int stageOf(T value, const T (&thresholds)[4]) {
+    int stage = 0;
+    while (stage < 4 && value >= thresholds[stage]) {
+        stage++;
+    }
+    return stage;
+}
+
+uint64_t monotonicMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+} // namespace
+
+COverloadController::COverloadController()
+    : m_level(NORMAL), m_calmSamples(0), m_memoryLimit(0), m_levelSinceMs(monotonicMs()),
+    m_timeInLevelMs(), m_levelEntries(), m_counters() {
+}
+
+const char* COverloadController::levelName(Level level) {
+    switch (level) {
+    case NORMAL: return "normal";
+    case COALESCE: return "coalesce";
+    case THROTTLE: return "throttle";
+    case DEFER_BULK: return "defer-bulk";
+    case REJECT: return "reject";
+    default: return "unknown";
+    }
+}
+
+COverloadController::Level COverloadController::levelFor(const OverloadSample& sample) const {
+    int stage = stageOf(sample.loopLagMs, LAG_THRESHOLDS_MS);
+    stage = std::max(stage, stageOf(sample.outboundBytes, OUTBOUND_THRESHOLDS));
+    stage = std::max(stage, stageOf(sample.workerBacklog, BACKLOG_THRESHOLDS));
+    if (m_memoryLimit > 0) {
+        size_t percent = sample.rssBytes * 100 / m_memoryLimit;
+        stage = std::max(stage, stageOf(percent, MEMORY_THRESHOLDS_PERCENT));
+    }
+    stage = std::max(stage, stageOf(sample.budgetPercent, MEMORY_THRESHOLDS_PERCENT));
+    return static_cast<Level>(stage);
+}
+
+bool COverloadController::update(const OverloadSample& sample) {
+    m_lastSample = sample;
+    Level target = levelFor(sample);
+    Level next = m_level;
+    if (target > m_level) {
+        next = target;
+        m_calmSamples = 0;
+    }
+    else if (target < m_level && ++m_calmSamples >= COOLDOWN_SAMPLES) {
+        // 一次只降一级，避免在阈值附近来回切换
+        next = static_cast<Level>(m_level - 1);
+        m_calmSamples = 0;
+    }
+    else if (target == m_level) {
+        m_calmSamples = 0;
+    }
+    if (next == m_level) {
+        return false;
+    }
+
+    uint64_t now = monotonicMs();
+    m_timeInLevelMs[m_level] += now - m_levelSinceMs;
+    m_levelSinceMs = now;
+    m_levelEntries[next]++;
+    m_level = next;
+    return true;
+}
+
+bool COverloadController::isDuplicateChat(int clientId, const std::string& data, uint64_t nowMs) {
+    size_t hash = std::hash<std::string>()(data);
+    auto it = m_lastChat.find(clientId);
+    bool duplicate = it != m_lastChat.end() && it->second.hash == hash &&
+        nowMs - it->second.timeMs < DUPLICATE_WINDOW_MS;
+    m_lastChat[clientId] = { hash, nowMs };
+    return duplicate && m_level >= COALESCE;
+}
+
+std::vector<int> COverloadController::heavySenders() {
+    std::vector<std::pair<size_t, int>> senders;
+    size_t total = 0;
+    for (const auto& pair : m_inbound) {
+        total += pair.second;
+        senders.push_back({ pair.second, pair.first });
+    }
+    m_inbound.clear();
+
+    // 超过平均值两倍的客户端中流量最大的，最多十分之一(至少一个)
+    std::vector<int> heavy;
+    if (senders.empty()) {
+        return heavy;
+    }
+    size_t average = total / senders.size();
+    std::sort(senders.rbegin(), senders.rend());
+    size_t limit = std::max<size_t>(1, senders.size() / 10);
+    for (const auto& sender : senders) {
+        if (heavy.size() >= limit || sender.first < HEAVY_SENDER_MIN_BYTES ||
+            (senders.size() > 1 && sender.first < average * 2)) {
+            break;
+        }
+        heavy.push_back(sender.second);
+    }
+    return heavy;
+}
+
+void COverloadController::removeClient(int clientId) {
+    m_lastChat.erase(clientId);
+    m_inbound.erase(clientId);
+}
+
+std::string COverloadController::describe() const {
+    std::ostringstream out;
+    out << "level " << levelName(m_level)
+        << ", lag " << m_lastSample.loopLagMs << " ms"
+        << ", outbound " << m_lastSample.outboundBytes << " bytes"
+        << ", worker backlog " << m_lastSample.workerBacklog
+        << ", rss " << m_lastSample.rssBytes << " bytes";
+    if (m_memoryLimit > 0) {
+        out << " (limit " << m_memoryLimit << ")";
+    }
+    out << ", memory budget " << m_lastSample.budgetPercent << "%";
+
+    uint64_t now = monotonicMs();
+    out << "; time in level ms:";
+    for (int level = NORMAL; level < LEVEL_COUNT; ++level) {
+        uint64_t time = m_timeInLevelMs[level] + (level == m_level ? now - m_levelSinceMs : 0);
+        out << " " << levelName(static_cast<Level>(level)) << "=" << time;
+    }
+    out << "; entered:";
+    for (int level = COALESCE; level < LEVEL_COUNT; ++level) {
+        out << " " << levelName(static_cast<Level>(level)) << "=" << m_levelEntries[level];
+    }
+    out << "; presence coalesced " << m_counters[PRESENCE_COALESCED]
+        << ", chat dropped " << m_counters[CHAT_DROPPED]
+        << ", reads paused " << m_counters[READS_PAUSED]
+        << ", bulk deferred " << m_counters[BULK_DEFERRED]
+        << ", connections rejected " << m_counters[CONNECTIONS_REJECTED];
+    return out.str();
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// 过载时的一次采样
+struct OverloadSample {
+    uint64_t loopLagMs = 0;        // 采样定时器的延迟，即事件循环处理一轮事件的耗时
+    size_t outboundBytes = 0;      // 所有客户端发送队列中未发出的字节数
+    size_t workerBacklog = 0;      // 线程池中排队的任务数
+    size_t rssBytes = 0;           // 进程常驻内存
+    size_t budgetPercent = 0;      // 连接缓冲区占内存预算的百分比(CMemoryBudget)
+};
+
+// 过载控制 - 按事件循环延迟、发送队列、线程池积压和内存分级降载
+// 每个信号各自换算成级别，取最高的一个；升级立即生效，降级要连续 COOLDOWN_SAMPLES 次采样都低于当前级别
+// 级别越高，生效的措施越多：
+//   COALESCE   合并在线状态增量(每个采样周期发一次)，丢弃短时间内重复的聊天消息
+//   THROTTLE   暂停读取流量最大的客户端
+//   DEFER_BULK 推迟处理文件数据(FILE_DATA/CHUNK_DATA等)，推迟期间不再读取该客户端
+//   REJECT     拒绝新连接
+// 这里只做判断和计数，具体措施由 CServerSocket 执行
+class COverloadController
+{
+public:
+    enum Level : uint8_t {
+        NORMAL = 0,
+        COALESCE = 1,
+        THROTTLE = 2,
+        DEFER_BULK = 3,
+        REJECT = 4,
+        LEVEL_COUNT = 5
+    };
+
+    // 降载措施的计数
+    enum Counter : uint8_t {
+        PRESENCE_COALESCED = 0,    // 被合并的在线状态广播
+        CHAT_DROPPED = 1,          // 丢弃的重复聊天消息
+        READS_PAUSED = 2,          // 暂停读取的次数
+        BULK_DEFERRED = 3,         // 推迟处理的文件数据帧
+        CONNECTIONS_REJECTED = 4,  // 拒绝的新连接
+        COUNTER_COUNT = 5
+    };
+
+    static const uint64_t SAMPLE_MS = 100;
+    static const int COOLDOWN_SAMPLES = 10;
+    static const uint64_t DUPLICATE_WINDOW_MS = 2000;      // 同一客户端相同内容的聊天消息视为重复
+    static const uint64_t THROTTLE_MS = 500;               // 每次暂停读取的时间
+    static const size_t HEAVY_SENDER_MIN_BYTES = 256 * 1024; // 一个采样周期内至少发送这么多才会被暂停
+    static const uint64_t MAX_DEFER_MS = 5000;             // 文件数据最多推迟的时间，之后照常处理
+
+    COverloadController();
+
+    // 内存上限，0表示不按内存降载
+    void setMemoryLimit(size_t bytes) { m_memoryLimit = bytes; }
+
+    // 更新级别，级别变化时返回true
+    bool update(const OverloadSample& sample);
+
+    Level level() const { return m_level; }
+    static const char* levelName(Level level);
+
+    bool coalescePresence() const { return m_level >= COALESCE; }
+    bool throttleSenders() const { return m_level >= THROTTLE; }
+    bool deferBulk() const { return m_level >= DEFER_BULK; }
+    bool rejectConnections() const { return m_level >= REJECT; }
+
+    // 记录客户端最近一条聊天消息；降载时与上一条相同且在时间窗口内返回true(应丢弃)
+    bool isDuplicateChat(int clientId, const std::string& data, uint64_t nowMs);
+
+    // 入站流量统计，heavySenders() 返回本采样周期内流量明显高于平均的客户端并开始新周期
+    void recordInbound(int clientId, size_t bytes) { m_inbound[clientId] += bytes; }
+    std::vector<int> heavySenders();
+
+    void removeClient(int clientId);
+
+    void count(Counter counter, uint64_t n = 1) { m_counters[counter] += n; }
+    uint64_t counter(Counter counter) const { return m_counters[counter]; }
+
+    // 当前状态和累计指标，供日志和管理命令使用
+    std::string describe() const;
+
+private:
+    struct LastChat {
+        size_t hash;
+        uint64_t timeMs;
+    };
+
+    Level m_level;
+    int m_calmSamples;                                 // 连续低于当前级别的采样数
+    size_t m_memoryLimit;
+    OverloadSample m_lastSample;
+    uint64_t m_levelSinceMs;
+    uint64_t m_timeInLevelMs[LEVEL_COUNT];
+    uint64_t m_levelEntries[LEVEL_COUNT];
+    uint64_t m_counters[COUNTER_COUNT];
+    std::map<int, LastChat> m_lastChat;
+    std::map<int, size_t> m_inbound;                   // clientId -> 本周期入站字节
+
+    Level levelFor(const OverloadSample& sample) const;
+};
@@ -1,5 +1,29 @@
 #include "Packet.h"
-#include <arpa/inet.h>
+
+// 网络字节序，按字节读写，数据可以从任意地址开始
+static uint16_t readU16(const uint8_t* p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+static uint32_t readU32(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+        (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static void writeU16(uint8_t* p, uint16_t value)
+{
+    p[0] = static_cast<uint8_t>(value >> 8);
+    p[1] = static_cast<uint8_t>(value);
+}
+
+static void writeU32(uint8_t* p, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) {
+        p[i] = static_cast<uint8_t>(value >> (24 - i * 8));
+    }
+}
 
 CPacket::CPacket() : sHead(0), sLength(0), sCmd(0), sSum(0)
 {
@@ -26,31 +50,36 @@ CPacket::CPacket(uint16_t nCmd, const uint8_t* pData, size_t nSize)
 }
 
 CPacket::CPacket(const uint8_t* pData, size_t& nSize)
+    : sHead(0), sLength(0), sCmd(0), sSum(0)
 {
     // nSize = pack.size
     size_t i = 0;
 
-    // 查找包头
-    for (; i < nSize; i++) {
-        if (*(uint16_t*)(pData + i) == 0xFEFF) {
-            sHead = *(uint16_t*)(pData + i);
+    // 查找包头(按字节比较，不做未对齐的16位读取)
+    for (; i + 1 < nSize; i++) {
+        if (pData[i] == 0xFF && pData[i + 1] == 0xFE) {
+            sHead = 0xFEFF;
             i += 2;
             break;
         }
     }
 
     // 检查剩余数据是否足够（sLength 4字节 + sCmd 2字节 + sSum 2字节）
-    if (i + 4 + 2 + 2 > nSize) {
+    if (sHead == 0 || i + 4 + 2 + 2 > nSize) {
         std::cerr << "Error: Incomplete packet header (need "
             << (i + 8) << " bytes, available " << nSize << ")" << std::endl;
         nSize = 0;
         return;
     }
 
-    // 读取数据长度
-   // sLength = *(uint32_t*)(pData + i);
-    sLength = ntohl(*(uint32_t*)(pData + i));
+    // 读取数据长度，至少包含命令和校验和
+    sLength = readU32(pData + i);
     i += 4;
+    if (sLength < 4) {
+        std::cerr << "Error: Invalid packet length " << sLength << std::endl;
+        nSize = 0;
+        return;
+    }
 
     // 如果未完全接收到数据包，返回失败
     if (sLength + i > nSize) {
@@ -61,25 +90,22 @@ CPacket::CPacket(const uint8_t* pData, size_t& nSize)
     }
 
     // 读取命令
-    //sCmd = *(uint16_t*)(pData + i);
-    sCmd = ntohs(*(uint16_t*)(pData + i));
+    sCmd = readU16(pData + i);
     i += 2;
 
-    // strData数据读取（有错误）
+    // strData数据读取
     if (sLength > 4) {
-        strData.resize(sLength - 2 - 2); // sLength - 2 - 2 = sizeof(strData)
-        memcpy((void*)strData.data(), pData + i, sLength - 2 - 2);
+        strData.assign(reinterpret_cast<const char*>(pData + i), sLength - 2 - 2); // sLength - 2 - 2 = sizeof(strData)
         i += sLength - 2 - 2;
     }
 
     // 校验校验和
-    //sSum = *(uint16_t*)(pData + i);
-    sSum = ntohs(*(uint16_t*)(pData + i));
+    sSum = readU16(pData + i);
+    i += 2;
     uint16_t sum = calculateChecksum();
 
     if (sum == sSum) {
-        nSize -= i; // 移除粘包
-        // 修改为剩余未处理数据
+        nSize = i; // 消耗的字节数(含包头之前跳过的数据)
         return;
     }
     else {
@@ -97,6 +123,11 @@ CPacket::CPacket(const CPacket& pack)
     sSum = pack.sSum;
 }
 
+CPacket::CPacket(CPacket&& pack) noexcept
+    : sHead(pack.sHead), sLength(pack.sLength), sCmd(pack.sCmd), sSum(pack.sSum), strData(std::move(pack.strData))
+{
+}
+
 CPacket::~CPacket()
 {
 }
@@ -113,6 +144,20 @@ CPacket& CPacket::operator=(const CPacket& pack)
     return *this;  // 返回对象引用
 }
 
+CPacket& CPacket::operator=(CPacket&& pack) noexcept
+{
+    if (this != &pack) {
+        sHead = pack.sHead;
+        sLength = pack.sLength;
+        sCmd = pack.sCmd;
+        strData = std::move(pack.strData);
+        sSum = pack.sSum;
+        strOut.clear();
+        strOut.shrink_to_fit();
+    }
+    return *this;
+}
+
 int CPacket::Size() const
 {
     return sLength + 6; // 数据包总大小
@@ -120,27 +165,32 @@ int CPacket::Size() const
 
 const char* CPacket::Data() const
 {
-    //strOut.resize(Size());
     std::string& mutableStrOut = const_cast<std::string&>(strOut);
-    //uint8_t* pData = reinterpret_cast<uint8_t*>(&strOut[0]);
-    mutableStrOut.resize(Size());
-    uint8_t* pData = reinterpret_cast<uint8_t*>(&mutableStrOut[0]);
+    mutableStrOut = Serialize();
+    return  mutableStrOut.c_str();
+}
+
+std::string CPacket::Serialize() const
+{
+    std::string out(Size(), '\0');
+    uint8_t* pData = reinterpret_cast<uint8_t*>(&out[0]);
 
-    *reinterpret_cast<uint16_t*>(pData) = sHead;
+    pData[0] = 0xFF;
+    pData[1] = 0xFE;
     pData += 2;
 
-    *reinterpret_cast<uint32_t*>(pData) = htonl(sLength);
+    writeU32(pData, sLength);
     pData += 4;
 
-    *reinterpret_cast<uint16_t*>(pData) = htons(sCmd);
+    writeU16(pData, sCmd);
     pData += 2;
 
     memcpy(pData, strData.data(), strData.size());
     pData += strData.size();
 
-    *reinterpret_cast<uint16_t*>(pData) = htons(sSum);
+    writeU16(pData, sSum);
 
-    return  mutableStrOut.c_str();
+    return out;
 }
 
 void CPacket::setData(const std::string& data)
@@ -156,31 +206,46 @@ void CPacket::setCmd(uint16_t cmd)
     sSum = calculateChecksum();
 }
 
-uint16_t CPacket::calculateChecksum() const
+void CPacket::setCompressed(bool compressed)
+{
+    if (compressed) {
+        sCmd |= CMD_COMPRESSED;
+    }
+    else {
+        sCmd &= ~CMD_COMPRESSED;
+    }
+}
+
+uint16_t CPacket::checksum(const uint8_t* pData, size_t nSize)
 {
     uint16_t sum = 0;
-    for (uint8_t byte : strData) {
-        sum += byte;
+    for (size_t i = 0; i < nSize; i++) {
+        sum += pData[i];
     }
     return sum;
 }
 
+uint16_t CPacket::calculateChecksum() const
+{
+    return checksum(reinterpret_cast<const uint8_t*>(strData.data()), strData.size());
+}
+
 bool CPacket::validatePacket(const uint8_t* pData, size_t nSize) const
 {
-    if (nSize < 8) { // 最小包大小：2(头) + 4(长度) + 2(命令) + 2(校验和)
+    if (nSize < 10) { // 最小包大小：2(头) + 4(长度) + 2(命令) + 2(校验和)
         return false;
     }
 
     // 检查包头
-    if (*(uint16_t*)pData != 0xFEFF) {
+    if (pData[0] != 0xFF || pData[1] != 0xFE) {
         return false;
     }
 
     // 检查数据长度
-    uint32_t length = *(uint32_t*)(pData + 2);
-    if (length + 6 > nSize) { // 6 = 2(头) + 4(长度)
+    uint32_t length = readU32(pData + 2);
+    if (length < 4 || length + 6 > nSize) { // 6 = 2(头) + 4(长度)
         return false;
     }
 
     return true;
-}
\ No newline at end of file
+}
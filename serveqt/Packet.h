@@ -17,26 +17,42 @@ public:
     // 构造数据包
     CPacket(uint16_t nCmd, const uint8_t* pData, size_t nSize);
 
-    // 解析数据包
+    // 解析数据包：成功时nSize改为消耗的字节数(含包头之前跳过的数据)，失败时为0
     CPacket(const uint8_t* pData, size_t& nSize);
 
     // 拷贝构造函数
     CPacket(const CPacket& pack);
 
+    // 移动构造：收件队列、命令结果列表中转移负载，不复制数据
+    CPacket(CPacket&& pack) noexcept;
+
     // 析构函数
     ~CPacket();
 
     // 赋值运算符
     CPacket& operator=(const CPacket& pack);
+    CPacket& operator=(CPacket&& pack) noexcept;
 
     // 获取数据包大小
     int Size() const;
 
-    // 获取数据包数据
+    // 获取数据包数据(结果保存在包内，包存活期间一直占用)
     const char* Data() const;
 
-    // 获取命令
-    uint16_t getCmd() const { return sCmd; }
+    // 序列化为独立的帧，不在包内保留副本
+    std::string Serialize() const;
+
+    // 命令字最高位表示负载已压缩（编码由连接协商决定）
+    static const uint16_t CMD_COMPRESSED = 0x8000;
+
+    // 获取命令（不含压缩标志位）
+    uint16_t getCmd() const { return sCmd & ~CMD_COMPRESSED; }
+
+    // 负载是否已压缩
+    bool isCompressed() const { return (sCmd & CMD_COMPRESSED) != 0; }
+
+    // 设置压缩标志
+    void setCompressed(bool compressed);
 
     // 获取数据
     const std::string& getData() const { return strData; }
@@ -47,6 +63,9 @@ public:
     // 设置命令
     void setCmd(uint16_t cmd);
 
+    // 数据部分的校验和(逐字节累加，取低16位)
+    static uint16_t checksum(const uint8_t* pData, size_t nSize);
+
 private:
     uint16_t sHead;     // 2字节 - 包头标识 0xFEFF
     uint32_t sLength;   // 4字节 - 数据长度
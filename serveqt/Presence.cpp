@@ -0,0 +1,113 @@
+#include "Presence.h"
+#include "Schema.h"
+
+static void putName(schema::Writer& writer, const std::string& name)
+{
+    size_t length = name.size() > 0xFFFF ? 0xFFFF : name.size();
+    writer.writeInt(static_cast<uint16_t>(length));
+    writer.writeBytes(std::string_view(name).substr(0, length));
+}
+
+CPresence::CPresence()
+    : m_version(0), m_snapshotVersion(UINT64_MAX), m_namesVersion(UINT64_MAX)
+{
+}
+
+const PresenceDelta* CPresence::record(uint8_t op, int clientId, const std::string& name)
+{
+    m_version++;
+    m_deltas.push_back({ m_version, op, clientId, name });
+    if (m_deltas.size() > MAX_DELTAS) {
+        m_deltas.pop_front();
+    }
+    return &m_deltas.back();
+}
+
+const PresenceDelta* CPresence::join(int clientId, const std::string& name)
+{
+    if (!m_users.emplace(clientId, name).second) {
+        return rename(clientId, name);
+    }
+    return record(PresenceDelta::JOIN, clientId, name);
+}
+
+const PresenceDelta* CPresence::leave(int clientId)
+{
+    m_subscribers.erase(clientId);
+    if (m_users.erase(clientId) == 0) {
+        return nullptr;
+    }
+    return record(PresenceDelta::LEAVE, clientId, "");
+}
+
+const PresenceDelta* CPresence::rename(int clientId, const std::string& name)
+{
+    auto it = m_users.find(clientId);
+    if (it == m_users.end() || it->second == name) {
+        return nullptr;
+    }
+    it->second = name;
+    return record(PresenceDelta::RENAME, clientId, name);
+}
+
+bool CPresence::deltasSince(uint64_t version, std::vector<const PresenceDelta*>& deltas) const
+{
+    deltas.clear();
+    if (version == m_version) {
+        return true;
+    }
+    // 客户端版本超前(服务器重启)或早于保留的最旧变更，只能发快照
+    if (version > m_version || m_deltas.empty() || version + 1 < m_deltas.front().version) {
+        return false;
+    }
+
+    size_t first = static_cast<size_t>(version + 1 - m_deltas.front().version);
+    for (size_t i = first; i < m_deltas.size(); ++i) {
+        deltas.push_back(&m_deltas[i]);
+    }
+    return true;
+}
+
+std::string CPresence::encodeDeltas(const std::vector<const PresenceDelta*>& deltas)
+{
+    std::string out;
+    schema::Writer writer(out);
+    writer.writeInt(static_cast<uint16_t>(deltas.size()));
+    for (const PresenceDelta* delta : deltas) {
+        writer.writeInt(delta->version);
+        writer.writeInt(delta->op);
+        writer.writeInt(static_cast<uint32_t>(delta->clientId));
+        putName(writer, delta->name);
+    }
+    return out;
+}
+
+const std::string& CPresence::encodeSnapshot() const
+{
+    if (m_snapshotVersion != m_version) {
+        m_snapshot.clear();
+        schema::Writer writer(m_snapshot);
+        writer.writeInt(m_version);
+        writer.writeInt(static_cast<uint32_t>(m_users.size()));
+        for (const auto& user : m_users) {
+            writer.writeInt(static_cast<uint32_t>(user.first));
+            putName(writer, user.second);
+        }
+        m_snapshotVersion = m_version;
+    }
+    return m_snapshot;
+}
+
+const std::vector<std::string>& CPresence::getUserNames() const
+{
+    if (m_namesVersion != m_version) {
+        m_names.clear();
+        for (const auto& user : m_users) {
+            if (!user.second.empty()) {
+                m_names.push_back(user.second);
+            }
+        }
+        m_namesVersion = m_version;
+    }
+    return m_names;
+}
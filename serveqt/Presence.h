@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// 在线状态变更
+struct PresenceDelta {
+    enum Op : uint8_t {
+        JOIN = 1,      // 上线
+        LEAVE = 2,     // 下线
+        RENAME = 3     // 修改用户名
+    };
+
+    uint64_t version;      // 变更后的版本号
+    uint8_t op;
+    int clientId;
+    std::string name;
+};
+
+// 带版本号的在线用户列表
+// 每次上线/下线/改名版本号加1，并保留最近 MAX_DELTAS 条变更；
+// 客户端带着自己的版本号同步，落后不多时只补发增量，否则发送完整快照
+// 只有订阅过(发送过 PRESENCE_SYNC)的客户端才会收到增量广播
+//
+// 编码(网络字节序)：
+//   增量 : 条数(2) + [版本(8) 操作(1) 客户端ID(4) 名字长度(2) 名字]...
+//   快照 : 版本(8) + 用户数(4) + [客户端ID(4) 名字长度(2) 名字]...
+class CPresence
+{
+public:
+    static const size_t MAX_DELTAS = 4096;
+
+    CPresence();
+
+    // 状态变更，没有实际变化时返回nullptr
+    const PresenceDelta* join(int clientId, const std::string& name);
+    const PresenceDelta* leave(int clientId);
+    const PresenceDelta* rename(int clientId, const std::string& name);
+
+    // 收集某版本之后的增量；版本过旧或无效时返回false，需要发送快照
+    bool deltasSince(uint64_t version, std::vector<const PresenceDelta*>& deltas) const;
+
+    // 编码
+    static std::string encodeDeltas(const std::vector<const PresenceDelta*>& deltas);
+    const std::string& encodeSnapshot() const;     // 按版本缓存，同一版本只编码一次
+
+    // 订阅者管理
+    void subscribe(int clientId) { m_subscribers.insert(clientId); }
+    bool isSubscribed(int clientId) const { return m_subscribers.count(clientId) != 0; }
+    std::vector<int> getSubscribers() const { return std::vector<int>(m_subscribers.begin(), m_subscribers.end()); }
+
+    // 当前用户名列表(有名字的用户)，按版本缓存
+    const std::vector<std::string>& getUserNames() const;
+
+    uint64_t getVersion() const { return m_version; }
+    size_t getUserCount() const { return m_users.size(); }
+
+private:
+    uint64_t m_version;
+    std::map<int, std::string> m_users;            // clientId -> 用户名
+    std::deque<PresenceDelta> m_deltas;            // 最近的变更
+    std::set<int> m_subscribers;
+
+    mutable uint64_t m_snapshotVersion;
+    mutable std::string m_snapshot;
+    mutable uint64_t m_namesVersion;
+    mutable std::vector<std::string> m_names;
+
+    const PresenceDelta* record(uint8_t op, int clientId, const std::string& name);
+};
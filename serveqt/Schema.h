@@ -0,0 +1,335 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// 消息模式 - 在编译期描述负载的字段布局，由模板生成编码和解码
+// 多字节整数一律网络字节序，按字节移位读写，不依赖对齐和主机字节序
+// 解码是在负载上移动游标并逐字段检查边界，变长字段解码为指向负载的视图，不分配内存；
+// 视图与负载(数据包)同生命周期，需要保留时由使用方复制
+//
+// 字段(Member 为消息结构的成员指针)：
+//   Int<Member>            定长无符号整数，宽度取成员类型(uint8_t/uint16_t/uint32_t/uint64_t)
+//   Magic<Byte>            固定字节，解码时必须一致，用于区分新旧格式
+//   Bytes<Member, N>       定长字节串，如摘要
+//   Blob<Member, LenT>     长度前缀(LenT)的字节串
+//   List<Member, CountT>   计数前缀(CountT)的uint32列表，成员类型为 U32List
+//   Rest<Member>           剩余的全部字节
+//   Version<Member, Cur>   版本号(1字节)，后面的 Since 字段据此决定是否出现；
+//                          对方的版本高于本端认识的 Cur 时，末尾多出的(新版本的)字段被忽略
+//   Since<V, Field>        版本号不低于V时才出现的字段，旧版本的负载解码后保持默认值
+//   Trailing<Field>        可省略的末尾字段：解码时还有剩余字节才读，编码时为默认值则省略
+//
+// 用法：
+//   using Schema = schema::Message<schema::Int<&Msg::id>, schema::Blob<&Msg::name, uint16_t>>;
+//   Schema::decode(payload, msg);   // 负载必须恰好用完(新版本的末尾字段除外)
+//   Schema::encode(msg, out);       // 追加到out，变长字段超出长度前缀的范围时返回false
+namespace schema {
+
+class Reader
+{
+public:
+    explicit Reader(std::string_view data) : m_data(data), m_pos(0), m_version(0), m_newer(false) {}
+
+    template<typename T>
+    bool readInt(T& value) {
+        static_assert(std::is_unsigned_v<T>, "wire integers are unsigned");
+        if (remaining() < sizeof(T)) {
+            return false;
+        }
+        uint64_t result = 0;
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            result = (result << 8) | static_cast<uint8_t>(m_data[m_pos + i]);
+        }
+        m_pos += sizeof(T);
+        value = static_cast<T>(result);
+        return true;
+    }
+
+    bool readBytes(size_t size, std::string_view& bytes) {
+        if (remaining() < size) {
+            return false;
+        }
+        bytes = m_data.substr(m_pos, size);
+        m_pos += size;
+        return true;
+    }
+
+    std::string_view readRest() {
+        std::string_view rest = m_data.substr(m_pos);
+        m_pos = m_data.size();
+        return rest;
+    }
+
+    size_t remaining() const { return m_data.size() - m_pos; }
+    bool atEnd() const { return m_pos == m_data.size(); }
+
+    uint8_t version() const { return m_version; }
+    void setVersion(uint8_t version) { m_version = version; }
+    // 负载来自更新的版本，可以有不认识的末尾字段
+    bool newer() const { return m_newer; }
+    void setNewer(bool newer) { m_newer = newer; }
+
+private:
+    std::string_view m_data;
+    size_t m_pos;
+    uint8_t m_version;
+    bool m_newer;
+};
+
+class Writer
+{
+public:
+    explicit Writer(std::string& out) : m_out(out), m_version(0) {}
+
+    template<typename T>
+    void writeInt(T value) {
+        static_assert(std::is_unsigned_v<T>, "wire integers are unsigned");
+        for (size_t i = sizeof(T); i-- > 0;) {
+            m_out.push_back(static_cast<char>(static_cast<uint64_t>(value) >> (i * 8)));
+        }
+    }
+
+    void writeBytes(std::string_view bytes) { m_out.append(bytes.data(), bytes.size()); }
+
+    uint8_t version() const { return m_version; }
+    void setVersion(uint8_t version) { m_version = version; }
+
+private:
+    std::string& m_out;
+    uint8_t m_version;
+};
+
+// uint32列表 - 解码时指向负载中网络字节序的数据，编码时指向主机字节序的数组，两种情况都不复制
+class U32List
+{
+public:
+    U32List() : m_wire(nullptr), m_host(nullptr), m_size(0) {}
+
+    static U32List wire(std::string_view bytes) {
+        U32List list;
+        list.m_wire = reinterpret_cast<const uint8_t*>(bytes.data());
+        list.m_size = bytes.size() / 4;
+        return list;
+    }
+
+    static U32List host(const std::vector<uint32_t>& values) {
+        U32List list;
+        list.m_host = values.data();
+        list.m_size = values.size();
+        return list;
+    }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    uint32_t operator[](size_t i) const {
+        if (m_host) {
+            return m_host[i];
+        }
+        const uint8_t* p = m_wire + i * 4;
+        return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+            (static_cast<uint32_t>(p[2]) << 8) | p[3];
+    }
+
+    std::vector<uint32_t> toVector() const {
+        std::vector<uint32_t> values(m_size);
+        for (size_t i = 0; i < m_size; ++i) {
+            values[i] = (*this)[i];
+        }
+        return values;
+    }
+
+private:
+    const uint8_t* m_wire;
+    const uint32_t* m_host;
+    size_t m_size;
+};
+
+template<typename T>
+struct MemberTraits;
+
+template<typename C, typename M>
+struct MemberTraits<M C::*> {
+    using Type = M;
+};
+
+template<auto Member>
+using MemberType = typename MemberTraits<decltype(Member)>::Type;
+
+template<auto Member>
+struct Int {
+    using Type = MemberType<Member>;
+    static_assert(std::is_unsigned_v<Type>, "Int field needs an unsigned member");
+    static constexpr size_t MIN_SIZE = sizeof(Type);
+
+    template<typename Msg>
+    static bool decode(Reader& reader, Msg& msg) { return reader.readInt(msg.*Member); }
+    template<typename Msg>
+    static bool encode(Writer& writer, const Msg& msg) { writer.writeInt(msg.*Member); return true; }
+    template<typename Msg>
+    static bool isDefault(const Msg& msg) { return msg.*Member == Type(); }
+};
+
+template<uint8_t Byte>
+struct Magic {
+    static constexpr size_t MIN_SIZE = 1;
+
+    template<typename Msg>
+    static bool decode(Reader& reader, Msg&) {
+        uint8_t value = 0;
+        return reader.readInt(value) && value == Byte;
+    }
+    template<typename Msg>
+    static bool encode(Writer& writer, const Msg&) { writer.writeInt(Byte); return true; }
+};
+
+template<auto Member, size_t N>
+struct Bytes {
+    static constexpr size_t MIN_SIZE = N;
+
+    template<typename Msg>
+    static bool decode(Reader& reader, Msg& msg) { return reader.readBytes(N, msg.*Member); }
+    template<typename Msg>
+    static bool encode(Writer& writer, const Msg& msg) {
+        if (std::string_view(msg.*Member).size() != N) {
+            return false;
+        }
+        writer.writeBytes(msg.*Member);
+        return true;
+    }
+};
+
+template<auto Member, typename LenT>
+struct Blob {
+    static constexpr size_t MIN_SIZE = sizeof(LenT);
+
+    template<typename Msg>
+    static bool decode(Reader& reader, Msg& msg) {
+        LenT length = 0;
+        return reader.readInt(length) && reader.readBytes(length, msg.*Member);
+    }
+    template<typename Msg>
+    static bool encode(Writer& writer, const Msg& msg) {
+        std::string_view bytes = msg.*Member;
+        if (bytes.size() > static_cast<LenT>(~LenT())) {
+            return false;
+        }
+        writer.writeInt(static_cast<LenT>(bytes.size()));
+        writer.writeBytes(bytes);
+        return true;
+    }
+    template<typename Msg>
+    static bool isDefault(const Msg& msg) { return std::string_view(msg.*Member).empty(); }
+};
+
+template<auto Member, typename CountT>
+struct List {
+    static_assert(std::is_same_v<MemberType<Member>, U32List>, "List field needs a U32List member");
+    static constexpr size_t MIN_SIZE = sizeof(CountT);
+
+    template<typename Msg>
+    static bool decode(Reader& reader, Msg& msg) {
+        CountT count = 0;
+        std::string_view bytes;
+        if (!reader.readInt(count) || count > reader.remaining() / 4 || !reader.readBytes(count * 4, bytes)) {
+            return false;
+        }
+        msg.*Member = U32List::wire(bytes);
+        return true;
+    }
+    template<typename Msg>
+    static bool encode(Writer& writer, const Msg& msg) {
+        const U32List& list = msg.*Member;
+        if (list.size() > static_cast<CountT>(~CountT())) {
+            return false;
+        }
+        writer.writeInt(static_cast<CountT>(list.size()));
+        for (size_t i = 0; i < list.size(); ++i) {
+            writer.writeInt(list[i]);
+        }
+        return true;
+    }
+    template<typename Msg>
+    static bool isDefault(const Msg& msg) { return (msg.*Member).empty(); }
+};
+
+template<auto Member>
+struct Rest {
+    static constexpr size_t MIN_SIZE = 0;
+
+    template<typename Msg>
+    static bool decode(Reader& reader, Msg& msg) { msg.*Member = reader.readRest(); return true; }
+    template<typename Msg>
+    static bool encode(Writer& writer, const Msg& msg) { writer.writeBytes(msg.*Member); return true; }
+    template<typename Msg>
+    static bool isDefault(const Msg& msg) { return std::string_view(msg.*Member).empty(); }
+};
+
+template<auto Member, uint8_t Current>
+struct Version {
+    static_assert(std::is_same_v<MemberType<Member>, uint8_t>, "Version field needs a uint8_t member");
+    static constexpr size_t MIN_SIZE = 1;
+
+    template<typename Msg>
+    static bool decode(Reader& reader, Msg& msg) {
+        if (!reader.readInt(msg.*Member)) {
+            return false;
+        }
+        reader.setVersion(msg.*Member);
+        reader.setNewer(msg.*Member > Current);
+        return true;
+    }
+    template<typename Msg>
+    static bool encode(Writer& writer, const Msg& msg) {
+        writer.writeInt(msg.*Member);
+        writer.setVersion(msg.*Member);
+        return true;
+    }
+};
+
+template<uint8_t V, typename Field>
+struct Since {
+    static constexpr size_t MIN_SIZE = 0;
+
+    template<typename Msg>
+    static bool decode(Reader& reader, Msg& msg) { return reader.version() < V || Field::decode(reader, msg); }
+    template<typename Msg>
+    static bool encode(Writer& writer, const Msg& msg) { return writer.version() < V || Field::encode(writer, msg); }
+};
+
+template<typename Field>
+struct Trailing {
+    static constexpr size_t MIN_SIZE = 0;
+
+    template<typename Msg>
+    static bool decode(Reader& reader, Msg& msg) { return reader.atEnd() || Field::decode(reader, msg); }
+    template<typename Msg>
+    static bool encode(Writer& writer, const Msg& msg) { return Field::isDefault(msg) || Field::encode(writer, msg); }
+};
+
+template<typename... Fields>
+struct Message {
+    // 最短负载，长度不足时不必逐字段解码
+    static constexpr size_t MIN_SIZE = (Fields::MIN_SIZE + ... + 0);
+
+    template<typename Msg>
+    static bool decode(std::string_view payload, Msg& msg) {
+        if (payload.size() < MIN_SIZE) {
+            return false;
+        }
+        Reader reader(payload);
+        return (Fields::decode(reader, msg) && ...) && (reader.atEnd() || reader.newer());
+    }
+
+    template<typename Msg>
+    static bool encode(const Msg& msg, std::string& out) {
+        Writer writer(out);
+        return (Fields::encode(writer, msg) && ...);
+    }
+};
+
+} // namespace schema
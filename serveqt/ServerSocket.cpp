@@ -1,14 +1,27 @@
 #include "ServerSocket.h"
 #include "Packet.h"
 #include "Command.h"
+#include "CommandMessages.h"
 #include <vector>
+#include <algorithm>
+#include <climits>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <netinet/tcp.h>
 
 CServerSocket::CServerSocket(const std::string& ip, int port)
-    :m_ip(ip), m_port(port), m_epollFd(-1), m_listenFd(-1), m_running(false), m_nextClientId(1)
+    :m_ip(ip), m_port(port), m_epollFd(-1), m_running(false), m_nextClientId(1), m_joinReplay(0),
+    m_signalFd(-1), m_handoffFd(-1), m_replacementPid(-1), m_handedOff(false), m_chunkMemoryLimit(CChunkStore::DEFAULT_MEMORY_LIMIT),
+    m_shmListenFd(-1), m_overloadTickDue(0), m_spinWakeups(0), m_blockingWakeups(0), m_busyPollFailed(false),
+    m_ktls(true), m_tlsSerial(0)
 {
     m_command = std::unique_ptr<CCommand>(new CCommand()); //创建command
     // 设置Command类的ServerSocket指针
     m_command->setServerSocket(this);
+    m_federation.setServerSocket(this);
+    m_readBuffer.resize(m_config.values().readSize);
 }
 
 CServerSocket::~CServerSocket() {
@@ -20,27 +33,82 @@ bool CServerSocket::start() {
         return false;
     }
     m_running = true;
-    log("Server started successfully, listening on port: " + std::to_string(m_port));
+    std::string endpoints;
+    for (const auto& listener : m_listeners) {
+        endpoints += (endpoints.empty() ? "" : ", ") + listener.endpoint().toString();
+    }
+    log("Server started successfully, listening on: " + endpoints);
     return true;
 }
 
 void CServerSocket::stop() {
-    if (!m_running) {
+    // 信号或交接只结束主循环，资源在这里统一释放
+    if (m_epollFd == -1) {
         return;
     }
     m_running = false;
 
-    // 关闭所有客户端连接
+    // 先停止工作线程，之后不会再有完成回调投递
+    m_workerPool.stop();
+    m_federation.stop();
+    m_completions.close();
+    m_pendingOffload.clear();
+    m_history.close();
+    m_capture.close();
+
+    // 结束所有连接的协程；等待发送额度的处理函数得到false后退出
+    for (auto& pair : m_connections) {
+        pair.second->close();
+    }
+    m_scheduler.runReady();
+    m_connections.clear();
+    m_scheduler.close();
+
+    // 关闭所有客户端连接；已交接时只关闭本进程的副本，连接由新进程继续服务
     auto& clientManager = m_command->getClientManager();
     for (const auto& pair : clientManager.getAllClients()) {
-        close(pair.second.socket);
+        if (m_shmClients.count(pair.second.socket) == 0) {
+            close(pair.second.socket);
+        }
+    }
+    // 并行扇出期间断开、等待任务结束才关闭的连接
+    for (int fd : m_deferredCloses) {
+        close(fd);
+    }
+    m_deferredCloses.clear();
+    for (const auto& pair : m_tlsHandshakes) {
+        close(pair.first);
+    }
+    m_tlsHandshakes.clear();
+    m_tlsClients.clear();
+    m_shmClients.clear();
+    m_shmBells.clear();
+    if (m_shmListenFd != -1) {
+        close(m_shmListenFd);
+        m_shmListenFd = -1;
+        if (!m_handedOff) {
+            unlink(m_shmPath.c_str());
+        }
+    }
+
+    // 交接路径已属于新进程，只有正常退出时才删除
+    if (m_handoffFd != -1) {
+        close(m_handoffFd);
+        m_handoffFd = -1;
+        if (!m_handedOff) {
+            unlink(m_handoffPath.c_str());
+        }
+    }
+    if (m_signalFd != -1) {
+        close(m_signalFd);
+        m_signalFd = -1;
     }
 
-    // 关闭监听socket
-    if (m_listenFd != -1) {
-        close(m_listenFd);
-        m_listenFd = -1;
+    // 关闭监听socket；已交接时Unix域socket路径属于新进程
+    for (auto& listener : m_listeners) {
+        listener.close(!m_handedOff);
     }
+    m_listeners.clear();
     // 关闭epoll
     if (m_epollFd != -1) {
         close(m_epollFd);
@@ -62,9 +130,15 @@ void CServerSocket::run() {
         log("Server not started");
         return;
     }
-    struct epoll_event events[MAX_EVENTS];
+    // 事件数组的大小在启动时确定，重新加载不改变
+    const int maxEvents = m_config.values().maxEvents;
+    std::vector<struct epoll_event> events(maxEvents);
+    CTrace::setThreadName("epoll");
+    if (!m_latency.cpus.empty() && LatencyOptions::pinCurrentThread(m_latency.cpus[0])) {
+        log("Event loop pinned to CPU " + std::to_string(m_latency.cpus[0]));
+    }
     while (m_running) {
-        int nfds = epoll_wait(m_epollFd, events, MAX_EVENTS, 100); // 100ms timeout
+        int nfds = waitEvents(events.data(), maxEvents);
         if (nfds == -1) {
             // If interrupted by a signal
             if (errno == EINTR) {
@@ -74,72 +148,370 @@ void CServerSocket::run() {
             break;
         }
         for (int i = 0; i < nfds; i++) {
-            if (events[i].data.fd == m_listenFd) {
+            // 每个事件是一个采样单位
+            CTraceSample sample;
+            if (CListener* listener = findListener(events[i].data.fd)) {
                 // New connection
-                handleNewConnection();
+                handleNewConnection(*listener);
+            }
+            else if (events[i].data.fd == m_completions.fd()) {
+                // 工作线程完成的任务，在epoll线程中发送
+                m_completions.drain();
+            }
+            else if (events[i].data.fd == m_scheduler.timerFd()) {
+                m_scheduler.expireTimers();
+            }
+            else if (events[i].data.fd == m_shmListenFd) {
+                handleShmConnection();
+            }
+            else if (m_shmBells.count(events[i].data.fd) != 0) {
+                // 门铃：对方写入了数据或读走了数据
+                int clientSocket = m_shmBells[events[i].data.fd];
+                m_shmClients[clientSocket]->clearBell();
+                flushClient(clientSocket);
+                handleClientData(clientSocket);
+            }
+            else if (events[i].data.fd == m_signalFd) {
+                handleSignal();
+            }
+            else if (events[i].data.fd == m_handoffFd) {
+                handleHandoffRequest();
+                if (!m_running) {
+                    break;
+                }
+            }
+            else if (m_tlsHandshakes.count(events[i].data.fd) != 0) {
+                continueTlsHandshake(events[i].data.fd);
+            }
+            else if (m_federation.ownsFd(events[i].data.fd)) {
+                m_federation.handleEvent(events[i].data.fd, events[i].events);
             }
             else {
-                // Handle client data
-                handleClientData(events[i].data.fd);
+                // 先写出发送队列，再读取客户端数据
+                if (events[i].events & EPOLLOUT) {
+                    flushClient(events[i].data.fd);
+                }
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    handleClientData(events[i].data.fd);
+                }
+            }
+            // 本次事件中被唤醒的协程(发送额度、定时器、断开)
+            m_scheduler.runReady();
+        }
+    }
+}
+
+int CServerSocket::waitEvents(struct epoll_event* events, int maxEvents) {
+    // 没有固定的超时：定时器经timerfd唤醒，超时只是按最早的定时器设置的兜底
+    if (m_latency.spinUs > 0) {
+        // 先非阻塞轮询，省去睡眠和唤醒的调度延迟；定时器在这里直接检查，不等timerfd
+        uint64_t spinUntil = CScheduler::nowUs() + m_latency.spinUs;
+        do {
+            int nfds = epoll_wait(m_epollFd, events, maxEvents, 0);
+            if (nfds != 0) {
+                m_spinWakeups += nfds > 0 ? 1 : 0;
+                return nfds;
+            }
+            if (m_scheduler.timerDue()) {
+                m_scheduler.expireTimers();
+                m_scheduler.runReady();
+                spinUntil = CScheduler::nowUs() + m_latency.spinUs;
+            }
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        } while (m_running && CScheduler::nowUs() < spinUntil);
+    }
+    int nfds = epoll_wait(m_epollFd, events, maxEvents, m_scheduler.timeoutMs());
+    m_blockingWakeups += nfds > 0 ? 1 : 0;
+    return nfds;
+}
+
+void CServerSocket::telemetryTick() {
+    auto& clientManager = m_command->getClientManager();
+    uint64_t now = CScheduler::nowUs();
+    for (int clientId : m_telemetry.dueForSample(now)) {
+        ClientInfo* client = clientManager.getClient(clientId);
+        if (!client || !client->outbound) {
+            continue;
+        }
+        int fd = m_shmClients.count(client->socket) != 0 ? -1 : client->socket;
+        const COutboundQueue& outbound = *client->outbound;
+        if (m_telemetry.sample(clientId, fd, outbound.bytesWritten(), outbound.framesWritten(), outbound.bytes(), now)) {
+            bool slow = m_telemetry.isSlow(clientId);
+            client->outbound->setSlow(slow);
+            log("Client " + std::to_string(clientId) + (slow ? " is a slow consumer: " : " recovered: ") +
+                m_telemetry.describe(clientId));
+        }
+
+        // 探测只发给声明会回送的客户端
+        if (client->features & CCommand::FEATURE_PING) {
+            std::string ping = m_telemetry.makePing(clientId, now);
+            if (!ping.empty()) {
+                CPacket packet(static_cast<uint16_t>(CCommand::Type::TEST_CONNECT),
+                    reinterpret_cast<const uint8_t*>(ping.data()), ping.size());
+                sendPacketToClient(clientId, packet);
             }
         }
     }
+    m_scheduler.addTimer(CTelemetry::TICK_MS, [this] { telemetryTick(); });
+}
+
+void CServerSocket::federationTick() {
+    m_federation.tick();
+    m_scheduler.addTimer(CFederation::TICK_MS, [this] { federationTick(); });
+}
+
+void CServerSocket::enableLatencyMode(const LatencyOptions& options) {
+    m_latency = options;
+    if (m_latency.cpus.size() > 1) {
+        m_workerPool.setAffinity(std::vector<int>(m_latency.cpus.begin() + 1, m_latency.cpus.end()));
+    }
+}
+
+std::string CServerSocket::describeLatency() {
+    std::string cpus;
+    for (int cpu : m_latency.cpus) {
+        cpus += (cpus.empty() ? "" : ",") + std::to_string(cpu);
+    }
+    return "cpus " + (cpus.empty() ? std::string("unpinned") : cpus) +
+        ", spin " + std::to_string(m_latency.spinUs) + " us" +
+        ", busy poll " + (m_busyPollFailed ? std::string("unavailable") : std::to_string(m_latency.busyPollUs) + " us") +
+        "; wakeups spinning " + std::to_string(m_spinWakeups) + ", blocking " + std::to_string(m_blockingWakeups) +
+        "; timer wake-up latency " + m_scheduler.timerLateness().describe();
+}
+
+void CServerSocket::resetLatency() {
+    m_spinWakeups = 0;
+    m_blockingWakeups = 0;
+    m_scheduler.timerLateness().reset();
 }
 
 void CServerSocket::handleClientData(int clientSocket) {
-    char buffer[BUFFER_SIZE];
-    ssize_t bytesRead = recv(clientSocket, buffer, sizeof(buffer), 0);
-    if (bytesRead <= 0) {
+    // 边沿触发：必须一直读到EAGAIN，否则剩余数据不会再触发事件
+    auto& clientManager = m_command->getClientManager();
+    int clientId = clientManager.getClientIdBySocket(clientSocket);
+    // 读取缓冲区由所有连接共用，读到的数据立即追加到该客户端的接收缓冲区
+    char* buffer = m_readBuffer.data();
+    size_t totalRead = 0;
+    bool peerClosed = false;
+    while (true) {
+        CTraceSpan recvSpan("recv", clientId);
+        ssize_t bytesRead = readClient(clientSocket, buffer, m_readBuffer.size());
+        if (bytesRead > 0) {
+            if (clientId != -1) {
+                clientManager.appendToBuffer(clientId, buffer, bytesRead);
+            }
+            totalRead += bytesRead;
+            continue;
+        }
+        if (bytesRead == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
         if (bytesRead == 0) {
             log("Client disconnected actively");
+            // 先处理同一次事件中已收到的数据，再断开
+            peerClosed = true;
+            break;
         }
-        else {
-            log("Data reception error: " + std::string(strerror(errno)));
-        }
+        log("Data reception error: " + std::string(strerror(errno)));
         handleClientDisconnect(clientSocket);
         return;
     }
 
-    // 将数据添加到ClientManager的缓冲区
+    if (clientId != -1 && totalRead > 0) {
+        log("Received " + std::to_string(totalRead) + " bytes from client " + std::to_string(clientId));
+        m_overload.recordInbound(clientId, totalRead);
+        m_memory.touch(clientId, CScheduler::nowMs());
+        processReceived(clientSocket, clientId, totalRead);
+    }
+
+    if (peerClosed) {
+        handleClientDisconnect(clientSocket);
+    }
+}
+
+void CServerSocket::processReceived(int clientSocket, int clientId, size_t bytesRead) {
     auto& clientManager = m_command->getClientManager();
-    int clientId = clientManager.getClientIdBySocket(clientSocket);
-    if (clientId != -1) {
-        clientManager.appendToBuffer(clientId, std::string(buffer, bytesRead));
-        log("Received " + std::to_string(bytesRead) + " bytes from client " + std::to_string(clientId));
-
-        // 处理缓冲区中的数据包
-        std::string receiverBuffer = clientManager.getBuffer(clientId);
-        while (receiverBuffer.size() >= 8) { // Minimum packet size
-            size_t remainingSize = receiverBuffer.size();
-            log("Processing buffer of size: " + std::to_string(remainingSize));
-
-            CPacket packet(reinterpret_cast<const uint8_t*>(receiverBuffer.data()), remainingSize);
-            if (remainingSize == 0) {
-                log("Failed to parse data, continuing to try");
-                receiverBuffer.erase(0, 1);
+    // 处理缓冲区中的数据包：先按帧头判断是否收全，收全后再解析，最后一次性移除已处理数据
+    // 缓冲区换出处理，不再每次复制；处理函数中客户端可能被移除
+    std::string receiverBuffer;
+    clientManager.swapBuffer(clientId, receiverBuffer);
+    m_memory.set(clientId, CMemoryBudget::RECEIVE, receiverBuffer.capacity());
+    bool refused = false;
+    size_t frames = 0;
+    size_t offset = 0;
+    while (receiverBuffer.size() - offset >= 8) { // Minimum packet size
+        size_t head = receiverBuffer.find("\xFF\xFE", offset, 2);
+        if (head == std::string::npos) {
+            // 保留最后一个字节，它可能是下一个包头的一半
+            offset = receiverBuffer.size() - 1;
+            break;
+        }
+        offset = head;
+        if (receiverBuffer.size() - head < 6) {
+            break;
+        }
+        const uint8_t* lengthBytes = reinterpret_cast<const uint8_t*>(receiverBuffer.data() + head + 2);
+        size_t length = (static_cast<size_t>(lengthBytes[0]) << 24) | (lengthBytes[1] << 16) |
+            (lengthBytes[2] << 8) | lengthBytes[3];
+        if (length < 4 || length > MAX_PACKET_SIZE) {
+            log("Invalid packet length " + std::to_string(length) + ", skipping header");
+            offset = head + 1;
+            continue;
+        }
+        size_t frameSize = 6 + length;
+        if (receiverBuffer.size() - head < frameSize) {
+            // 数据包未收全，等待后续数据；声明的长度超出该连接上限或全局预算时不再等待
+            size_t missing = frameSize - (receiverBuffer.size() - head);
+            if (!m_memory.canGrow(clientId, missing)) {
+                log("Frame of " + std::to_string(frameSize) + " bytes from client " + std::to_string(clientId) +
+                    " exceeds memory limit, disconnecting");
+                m_memory.count(CMemoryBudget::FRAMES_REFUSED);
+                refused = true;
+            }
+            break;
+        }
+
+        // 组帧(解析/解压)和其中的命令处理
+        CTraceSpan frameSpan("frame", static_cast<uint32_t>(frameSize));
+        size_t consumed = frameSize;
+        CPacket packet(reinterpret_cast<const uint8_t*>(receiverBuffer.data() + head), consumed);
+        if (consumed == 0) {
+            log("Failed to parse data, continuing to try");
+            offset = head + 1;
+            continue;
+        }
+        offset = head + frameSize;
+        frames++;
+        if (bytesRead > 0) {
+            m_capture.record(CaptureRecord::FRAME, clientId, receiverBuffer.data() + head, frameSize);
+        }
+
+        // 压缩包按该连接协商的编码解压
+        if (packet.isCompressed()) {
+            const ClientInfo* client = clientManager.getClient(clientId);
+            CCompressor::Codec codec = client ? static_cast<CCompressor::Codec>(client->codec) : CCompressor::Codec::NONE;
+            CPacket rawPacket;
+            if (!CCompressor::decompressPacket(packet, codec, rawPacket)) {
+                log("Dropping compressed packet from client " + std::to_string(clientId));
                 continue;
             }
-            log("Successfully parsed packet, cmd: " + std::to_string(packet.getCmd()) +
-                ", data size: " + std::to_string(packet.getData().size()));
+            deliverPacket(clientSocket, clientId, rawPacket);
+            continue;
+        }
+
+        // 处理数据包
+        deliverPacket(clientSocket, clientId, packet);
+    }
+
+    if (bytesRead > 0) {
+        m_telemetry.recordInbound(clientId, bytesRead, frames);
+    }
+
+    // 更新缓冲区；大包处理完后不再保留其容量
+    if (refused) {
+        std::string().swap(receiverBuffer);
+        shutdown(clientSocket, SHUT_RDWR);
+    }
+    else {
+        receiverBuffer.erase(0, offset);
+    }
+    if (receiverBuffer.capacity() > CMemoryBudget::RECEIVE_KEEP &&
+        receiverBuffer.capacity() > receiverBuffer.size() * 2) {
+        size_t before = receiverBuffer.capacity();
+        receiverBuffer.shrink_to_fit();
+        m_memory.count(CMemoryBudget::BUFFERS_SHRUNK);
+        m_memory.count(CMemoryBudget::BYTES_RELEASED, before - receiverBuffer.capacity());
+    }
+    if (clientManager.hasClient(clientId)) {
+        clientManager.swapBuffer(clientId, receiverBuffer);
+        m_memory.set(clientId, CMemoryBudget::RECEIVE, clientManager.bufferCapacity(clientId));
+    }
+}
+
+void CServerSocket::deliverPacket(int clientSocket, int clientId, const CPacket& packet) {
+    auto it = m_connections.find(clientId);
+    if (it == m_connections.end()) {
+        handlePacket(clientSocket, packet);
+        return;
+    }
+    // 处理函数挂起期间积压过多，按发送队列溢出的方式断开
+    if (!it->second->deliver(packet)) {
+        log("Inbox overflow for client " + std::to_string(clientId) + ", disconnecting");
+        shutdown(clientSocket, SHUT_RDWR);
+        return;
+    }
+    if (!it->second->closed()) {
+        m_memory.set(clientId, CMemoryBudget::INBOX, it->second->inboxBytes());
+    }
+}
 
-            // 移除已处理的数据包数据
-            int processedSize = receiverBuffer.size() - remainingSize;
-            if (processedSize > 0) {
-                receiverBuffer.erase(0, processedSize);
-                log("Removed " + std::to_string(processedSize) + " bytes from buffer");
+CTask<> CServerSocket::serveConnection(std::shared_ptr<CConnection> connection) {
+    CPacket packet;
+    int clientId = connection->clientId();
+    while (co_await connection->readFrame(packet)) {
+        m_memory.set(clientId, CMemoryBudget::INBOX, connection->inboxBytes());
+        // 过载：丢弃重复的聊天消息
+        if (packet.getCmd() == static_cast<uint16_t>(CCommand::Type::TEXT_MESSAGE) &&
+            m_overload.isDuplicateChat(clientId, packet.getData(), CScheduler::nowMs())) {
+            m_overload.count(COverloadController::CHAT_DROPPED);
+            continue;
+        }
+        // 过载：推迟文件数据，推迟期间不读取该客户端，收件队列不会继续增长
+        if (m_overload.deferBulk() && COutboundQueue::classify(packet.getCmd()) == COutboundQueue::BULK) {
+            m_overload.count(COverloadController::BULK_DEFERRED);
+            m_deferringBulk.insert(clientId);
+            updateReadInterest(clientId);
+            // 等待期间帧仍挂在连接上，热重启时随收件队列交给新进程
+            connection->holdFrame(packet);
+            uint64_t giveUp = CScheduler::nowMs() + COverloadController::MAX_DEFER_MS;
+            while (m_overload.deferBulk() && !connection->closed() && CScheduler::nowMs() < giveUp) {
+                co_await m_scheduler.sleepFor(COverloadController::SAMPLE_MS);
+            }
+            if (connection->closed()) {
+                break;
+            }
+            m_deferringBulk.erase(clientId);
+            updateReadInterest(clientId);
+            if (!connection->releaseFrame()) {
+                continue;
             }
+        }
 
-            // 处理数据包
-            handlePacket(clientSocket, packet);
+        CTask<int> continuation;
+        handlePacket(connection->socket(), packet, &continuation);
+        if (continuation) {
+            // 协程处理函数挂起期间，该连接后续的帧留在收件队列中
+            if (co_await std::move(continuation) != 0) {
+                log("Command execution failed for cmd: " + std::to_string(packet.getCmd()));
+            }
         }
+    }
+}
 
-        // 更新缓冲区
-        clientManager.clearBuffer(clientId);
-        clientManager.appendToBuffer(clientId, receiverBuffer);
+void CServerSocket::openConnection(int clientSocket, int clientId) {
+    ClientInfo* client = m_command->getClientManager().getClient(clientId);
+    if (!client) {
+        return;
     }
+    auto connection = std::make_shared<CConnection>(*this, m_scheduler, clientSocket, clientId, client->outbound);
+    m_connections[clientId] = connection;
+    m_memory.touch(clientId, CScheduler::nowMs());
+    m_telemetry.addClient(clientId);
+    // 运行到第一次 readFrame() 挂起
+    serveConnection(connection).start();
+}
+
+CConnection::SendAwaiter CServerSocket::send(int clientId, const CPacket& packet) {
+    auto it = m_connections.find(clientId);
+    return CConnection::send(it == m_connections.end() ? nullptr : it->second, packet);
 }
 
-void CServerSocket::handlePacket(int clientSocket, const CPacket& packet) {
+void CServerSocket::handlePacket(int clientSocket, const CPacket& packet, CTask<int>* continuation) {
     auto& clientManager = m_command->getClientManager();
     int clientId = clientManager.getClientIdBySocket(clientSocket);
     if (clientId == -1) {
@@ -156,58 +528,98 @@ void CServerSocket::handlePacket(int clientSocket, const CPacket& packet) {
     PacketQueue packetQueue;            // 异步处理队列
     CPacket packetCopy = packet;        // 创建副本以避免const问题
 
-    int result = m_command->ExecuteCommand(packet.getCmd(), lstPacket, packetQueue, packetCopy, clientId);
+    int result;
+    {
+        CTraceSpan span("dispatch", packet.getCmd());
+        result = m_command->ExecuteCommand(packet.getCmd(), lstPacket, packetQueue, packetCopy, clientId, continuation);
+    }
 
     if (result != 0) {
         log("Command execution failed for cmd: " + std::to_string(packet.getCmd()));
     }
 
-    // 同步处理：立即发送lstPacket中的包（实时响应）
+    // 同步处理结果(lstPacket)先发送，随后是异步队列(packetQueue)中的包
+    std::vector<CPacket> outPackets;
     for (const auto& outPacket : lstPacket) {
-        // 广播给所有客户端
-        for (const auto& clientPair : clientManager.getAllClients()) {
-            if (clientPair.second.isConnected) {
-                sendPacketToClient(clientPair.second.id, outPacket);
-            }
-        }
+        appendSplitPacket(outPackets, outPacket);
     }
-
-    // 2. 异步处理：处理packetQueue中的包（高并发场景）
     PacketQueueItem queueItem;
     while (packetQueue.pop(queueItem)) {
-        // 根据操作类型决定发送策略
-        switch (queueItem.nOperator) {
-        case static_cast<size_t>(CCommand::Type::FILE_START):
-        case static_cast<size_t>(CCommand::Type::FILE_DATA):
-        case static_cast<size_t>(CCommand::Type::FILE_COMPLETE):
-            // 文件传输包：广播给所有客户端
-            for (const auto& clientPair : clientManager.getAllClients()) {
-                if (clientPair.second.isConnected) {
-                    sendPacketToClient(clientPair.second.id, queueItem.Data);
-                }
-            }
-            break;
+        // 文件、文本消息和测试连接都广播给所有客户端
+        appendSplitPacket(outPackets, queueItem.Data);
+    }
 
-        case static_cast<size_t>(CCommand::Type::TEXT_MESSAGE):
-        case static_cast<size_t>(CCommand::Type::TEST_CONNECT):
-            // 文本消息和测试连接：广播给所有客户端
-            for (const auto& clientPair : clientManager.getAllClients()) {
-                if (clientPair.second.isConnected) {
-                    sendPacketToClient(clientPair.second.id, queueItem.Data);
-                }
-            }
-            break;
+    if (!outPackets.empty()) {
+        fanOut(clientId, std::move(outPackets), CCommand::isOffloaded(packet.getCmd()));
+    }
+}
 
-        default:
-            // 默认广播
-            for (const auto& clientPair : clientManager.getAllClients()) {
-                if (clientPair.second.isConnected) {
-                    sendPacketToClient(clientPair.second.id, queueItem.Data);
+void CServerSocket::fanOut(int clientId, std::vector<CPacket> packets, bool offload) {
+    CTraceSpan span("fanout", static_cast<uint32_t>(packets.size()));
+    auto pending = m_pendingOffload.find(clientId);
+    if (!offload && pending == m_pendingOffload.end()) {
+        // 轻量命令直接在epoll线程广播，同时转发给集群中的其他节点
+        for (const auto& outPacket : packets) {
+            broadcastPacket(outPacket);
+            m_federation.forwardBroadcast(outPacket, clientId);
+        }
+        return;
+    }
+
+    // 记录当前在用的编码，工作线程为每种编码预先生成帧
+    std::vector<uint8_t> codecs;
+    for (const auto& clientPair : m_command->getClientManager().getAllClients()) {
+        uint8_t codec = clientPair.second.codec;
+        if (std::find(codecs.begin(), codecs.end(), codec) == codecs.end()) {
+            codecs.push_back(codec);
+        }
+    }
+
+    struct OffloadJob {
+        std::vector<CPacket> packets;
+        std::vector<std::map<uint8_t, COutboundQueue::Frame>> frames;
+    };
+    auto job = std::make_shared<OffloadJob>();
+    job->packets = std::move(packets);
+
+    runOffloaded(clientId,
+        [this, job, codecs] {
+            job->frames.resize(job->packets.size());
+            for (size_t i = 0; i < job->packets.size(); ++i) {
+                for (uint8_t codec : codecs) {
+                    job->frames[i][codec] = encodeFrame(job->packets[i], static_cast<CCompressor::Codec>(codec));
                 }
             }
-            break;
+        },
+        [this, job, clientId] {
+            for (size_t i = 0; i < job->packets.size(); ++i) {
+                broadcastFrames(job->packets[i], job->frames[i]);
+                m_federation.forwardBroadcast(job->packets[i], clientId);
+            }
+        });
+}
+
+void CServerSocket::runOffloaded(int clientId, CThreadPool::Task work, std::function<void()> done) {
+    m_pendingOffload[clientId]++;
+
+    // 同一客户端的任务在线程池中串行执行，完成回调按顺序投递回epoll线程
+    m_workerPool.submit(static_cast<uint64_t>(clientId), [this, work, done, clientId] {
+        {
+            CTraceSample sample;
+            CTraceSpan span("offload", clientId);
+            work();
         }
-    }
+        m_completions.post([this, done, clientId] {
+            {
+                CTraceSpan span("offload-done", clientId);
+                done();
+            }
+            auto it = m_pendingOffload.find(clientId);
+            if (it != m_pendingOffload.end() && --it->second <= 0) {
+                m_pendingOffload.erase(it);
+            }
+        });
+    });
 }
 
 void CServerSocket::handleClientDisconnect(int clientSocket) {
@@ -218,8 +630,22 @@ void CServerSocket::handleClientDisconnect(int clientSocket) {
     if (clientId != -1) {
         log("Client disconnected: ID=" + std::to_string(clientId) + ", Socket=" + std::to_string(clientSocket));
 
+        // 会话保留到超时，需要在移除客户端之前记下用户名和编码
+        detachSession(clientId);
         // 通知Command类移除客户端
         m_command->removeClient(clientId);
+        m_capture.record(CaptureRecord::DISCONNECT, clientId);
+        m_overload.removeClient(clientId);
+        m_memory.removeClient(clientId);
+        m_telemetry.removeClient(clientId);
+        m_throttledUntil.erase(clientId);
+        m_deferringBulk.erase(clientId);
+        m_readsPaused.erase(clientId);
+        auto connection = m_connections.find(clientId);
+        if (connection != m_connections.end()) {
+            connection->second->close();
+            m_connections.erase(connection);
+        }
 
         log("Successfully removed client from ClientManager. New size: " + std::to_string(clientManager.getClientCount()));
     }
@@ -228,7 +654,18 @@ void CServerSocket::handleClientDisconnect(int clientSocket) {
     }
     removeClientFromEpoll(clientSocket);
 
-    if (close(clientSocket) == -1) {
+    // 内核加密的连接可能仍有工作线程在写fd，它们不使用TLS状态
+    m_tlsClients.erase(clientSocket);
+    if (m_shmClients.count(clientSocket) != 0) {
+        releaseShmClient(clientSocket);
+        log("Released shared memory channel " + std::to_string(clientSocket));
+    }
+    else if (m_fanOut.busy()) {
+        // 工作线程可能还在写这个fd，完成前关闭会让fd被新连接复用
+        shutdown(clientSocket, SHUT_RDWR);
+        m_deferredCloses.push_back(clientSocket);
+    }
+    else if (close(clientSocket) == -1) {
         log("Failed to close socket " + std::to_string(clientSocket) + ": " + std::string(strerror(errno)));
     }
     else {
@@ -242,43 +679,207 @@ void CServerSocket::removeClientFromEpoll(int clientSocket) {
     }
 }
 
-void CServerSocket::handleNewConnection() {
-    struct sockaddr_in clientAddr;
-    socklen_t clientLen = sizeof(clientAddr);
-
+void CServerSocket::handleNewConnection(CListener& listener) {
     // Accept client connection
-    int clientSocket = accept(m_listenFd, (struct sockaddr*)&clientAddr, &clientLen);
+    std::string clientIP;
+    int clientPort = 0;
+    int clientSocket = listener.accept(clientIP, clientPort);
     if (clientSocket == -1) {
         log("Failed to accept connection: " + std::string(strerror(errno)));
         return;
     }
+    // 过载最严重时立即关闭新连接，不让它们排在积压队列中等待超时
+    if (m_overload.rejectConnections()) {
+        m_overload.count(COverloadController::CONNECTIONS_REJECTED);
+        log("Overloaded, rejecting connection from " + clientIP);
+        close(clientSocket);
+        return;
+    }
+    // 客户端数上限，握手中的TLS连接也计入
+    int maxClients = m_config.values().maxClients;
+    if (maxClients > 0 && getClientCount() + static_cast<int>(m_tlsHandshakes.size()) >= maxClients) {
+        log("Client limit " + std::to_string(maxClients) + " reached, rejecting connection from " + clientIP);
+        close(clientSocket);
+        return;
+    }
 
-    // 设置非阻塞
-    setNonBlocking(clientSocket);
+    // 设置非阻塞，限制内核中未发出的数据量
+    configureClientSocket(clientSocket);
 
     // 添加到epoll
     addClientToEpoll(clientSocket);
 
-    // 获取客户端IP和端口
-    char clientIP[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &clientAddr.sin_addr, clientIP, INET_ADDRSTRLEN);
-    int clientPort = ntohs(clientAddr.sin_port);
+    if (listener.endpoint().tls) {
+        startTlsHandshake(clientSocket, clientIP, clientPort);
+        return;
+    }
+    registerClient(clientSocket, clientIP, clientPort);
+}
+
+void CServerSocket::startTlsHandshake(int clientSocket, const std::string& ip, int port) {
+    std::unique_ptr<CTlsConnection> tls = m_tls.accept(clientSocket);
+    if (!tls) {
+        removeClientFromEpoll(clientSocket);
+        close(clientSocket);
+        return;
+    }
+    uint64_t serial = ++m_tlsSerial;
+    m_tlsHandshakes[clientSocket] = { ip, port, serial };
+    m_tlsClients[clientSocket] = std::move(tls);
+    // 不发送或不完成握手的连接不能一直占用fd
+    m_scheduler.addTimer(CTlsContext::HANDSHAKE_TIMEOUT_MS, [this, clientSocket, serial] {
+        auto it = m_tlsHandshakes.find(clientSocket);
+        if (it != m_tlsHandshakes.end() && it->second.serial == serial) {
+            log("TLS handshake timed out for " + it->second.ip);
+            m_tls.recordTimeout();
+            closeTlsHandshake(clientSocket);
+        }
+    });
+    // ClientHello可能已经到达，边沿触发下不会再有事件
+    continueTlsHandshake(clientSocket);
+}
+
+void CServerSocket::continueTlsHandshake(int clientSocket) {
+    auto pending = m_tlsHandshakes.find(clientSocket);
+    if (pending == m_tlsHandshakes.end()) {
+        return;
+    }
+    CTlsConnection& tls = *m_tlsClients[clientSocket];
+    CTlsConnection::State state = tls.handshake();
+    if (state == CTlsConnection::HANDSHAKING) {
+        return;
+    }
+    if (state == CTlsConnection::FAILED) {
+        log("TLS handshake failed for " + pending->second.ip);
+        m_tls.recordFailure();
+        closeTlsHandshake(clientSocket);
+        return;
+    }
+
+    std::string ip = pending->second.ip;
+    int port = pending->second.port;
+    m_tlsHandshakes.erase(pending);
+    m_tls.recordHandshake(tls);
+    log("TLS established on socket " + std::to_string(clientSocket) + ": " + tls.describe());
+    // 客户端可能紧接着握手发送了数据
+    if (registerClient(clientSocket, ip, port)) {
+        handleClientData(clientSocket);
+    }
+}
+
+void CServerSocket::closeTlsHandshake(int clientSocket) {
+    removeClientFromEpoll(clientSocket);
+    m_tlsHandshakes.erase(clientSocket);
+    m_tlsClients.erase(clientSocket);
+    close(clientSocket);
+}
+
+void CServerSocket::handleShmConnection() {
+    std::unique_ptr<CShmChannel> channel(new CShmChannel());
+    if (!channel->accept(m_shmListenFd)) {
+        log("Shared memory handshake failed");
+        return;
+    }
+    if (m_overload.rejectConnections()) {
+        m_overload.count(COverloadController::CONNECTIONS_REJECTED);
+        log("Overloaded, rejecting shared memory connection");
+        return;
+    }
+
+    // 握手连接只用于检测断开，数据经门铃通知
+    int clientSocket = channel->socket();
+    int bell = channel->bellFd();
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = bell;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, bell, &event) == -1) {
+        log("Failed to add shared memory doorbell to epoll: " + std::string(strerror(errno)));
+        return;
+    }
+    addClientToEpoll(clientSocket);
+    m_shmBells[bell] = clientSocket;
+    m_shmClients[clientSocket] = std::move(channel);
+
+    registerClient(clientSocket, "local", 0);
+}
+
+int CServerSocket::allocateClientId() {
+    // 集群模式下只在本节点的ID段内循环，ID用完后从头复用，跳过仍在使用(在线或有未完成的后台任务)的ID
+    int first = m_federation.isEnabled() ? m_federation.firstClientId() : 1;
+    int last = m_federation.isEnabled() ? m_federation.lastClientId() : INT_MAX;
+    const ClientManager& clientManager = m_command->getClientManager();
+    for (int64_t tries = 0; tries <= static_cast<int64_t>(last) - first; tries++) {
+        if (m_nextClientId < first || m_nextClientId > last) {
+            m_nextClientId = first;
+        }
+        int clientId = m_nextClientId;
+        m_nextClientId = clientId == last ? first : clientId + 1;
+        if (!clientManager.hasClient(clientId) && m_pendingOffload.count(clientId) == 0) {
+            return clientId;
+        }
+    }
+    return -1;
+}
 
+bool CServerSocket::registerClient(int clientSocket, const std::string& ip, int port) {
     // 分配客户端ID
-    int clientId = m_nextClientId++;
+    int clientId = allocateClientId();
+    if (clientId == -1) {
+        log("No free client ID, rejecting connection from " + ip);
+        removeClientFromEpoll(clientSocket);
+        if (m_shmClients.count(clientSocket) != 0) {
+            releaseShmClient(clientSocket);
+        }
+        else {
+            m_tlsClients.erase(clientSocket);
+            close(clientSocket);
+        }
+        return false;
+    }
 
     // 通过Command类添加客户端到ClientManager
-    m_command->addClient(clientSocket, clientId, std::string(clientIP), clientPort);
+    m_command->addClient(clientSocket, clientId, ip, port);
+    m_capture.record(CaptureRecord::CONNECT, clientId);
+    openConnection(clientSocket, clientId);
 
     log("New client connected: Socket=" + std::to_string(clientSocket) +
         ", ID=" + std::to_string(clientId) +
-        ", IP=" + std::string(clientIP) +
-        ", Port=" + std::to_string(clientPort));
+        ", IP=" + ip +
+        ", Port=" + std::to_string(port));
+
+    // 新连接补发最近的历史消息
+    if (m_joinReplay > 0) {
+        replayHistoryLast(clientId, m_joinReplay);
+    }
+    return true;
+}
+
+void CServerSocket::releaseShmClient(int clientSocket) {
+    auto it = m_shmClients.find(clientSocket);
+    if (it == m_shmClients.end()) {
+        return;
+    }
+    int bell = it->second->bellFd();
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, bell, nullptr);
+    m_shmBells.erase(bell);
+    m_shmClients.erase(it);
+}
+
+ssize_t CServerSocket::readClient(int clientSocket, char* buffer, size_t size) {
+    auto it = m_shmClients.find(clientSocket);
+    if (it != m_shmClients.end()) {
+        return it->second->recv(buffer, size);
+    }
+    auto tls = m_tlsClients.find(clientSocket);
+    if (tls != m_tlsClients.end()) {
+        return tls->second->read(buffer, size);
+    }
+    return recv(clientSocket, buffer, size, 0);
 }
 
 void CServerSocket::addClientToEpoll(int clientSocket) {
     struct epoll_event event;
-    event.events = EPOLLIN | EPOLLET; // Edge-triggered
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET; // Edge-triggered, EPOLLOUT继续写出发送队列
     event.data.fd = clientSocket;
 
     if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, clientSocket, &event) == -1) {
@@ -289,37 +890,36 @@ void CServerSocket::addClientToEpoll(int clientSocket) {
 }
 
 bool CServerSocket::initialize() {
-    // 创建监听socket
-    m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
-    if (m_listenFd == -1) {
-        log("Failed to create socket: " + std::string(strerror(errno)));
+    // 先阻塞信号，之后启动的工作线程继承信号掩码，信号统一经signalfd交给epoll线程
+    if (!setupSignals()) {
         return false;
     }
 
-    // 设置socket选项
-    int opt = 1;
-    if (setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1) {
-        log("Failed to set socket option: " + std::string(strerror(errno)));
-        close(m_listenFd);
-        return false;
+    // TLS监听地址需要证书
+    bool tlsListeners = false;
+    for (const auto& endpoint : m_endpoints) {
+        tlsListeners = tlsListeners || endpoint.tls;
     }
-
-    // 绑定地址
-    struct sockaddr_in serverAddr;
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = inet_addr(m_ip.c_str());
-    serverAddr.sin_port = htons(m_port);
-
-    if (bind(m_listenFd, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == -1) {
-        log("Failed to bind: " + std::string(strerror(errno)));
-        close(m_listenFd);
-        return false;
+    if (tlsListeners) {
+        if (m_tlsCert.empty() || m_tlsKey.empty()) {
+            log("TLS listen addresses require a certificate and a private key");
+            return false;
+        }
+        if (!m_tls.open(m_tlsCert, m_tlsKey, m_ktls)) {
+            return false;
+        }
     }
 
-    // 监听连接
-    if (listen(m_listenFd, SOMAXCONN) == -1) {
-        log("Failed to listen: " + std::string(strerror(errno)));
-        close(m_listenFd);
+    // 热重启：交接路径上有旧进程时接管它的监听socket和客户端，否则正常创建
+    HandoffState inherited;
+    int handoffConn = -1;
+    if (!m_handoffPath.empty()) {
+        handoffConn = CHandoff::takeOver(m_handoffPath, inherited);
+    }
+    if (!openListeners(inherited)) {
+        if (handoffConn != -1) {
+            close(handoffConn);
+        }
         return false;
     }
 
@@ -327,72 +927,1267 @@ bool CServerSocket::initialize() {
     m_epollFd = epoll_create1(0);
     if (m_epollFd == -1) {
         log("Failed to create epoll: " + std::string(strerror(errno)));
-        close(m_listenFd);
         return false;
     }
 
-    // 添加监听socket到epoll
+    // 添加监听socket到epoll，设置非阻塞
     struct epoll_event event;
-    event.events = EPOLLIN;
-    event.data.fd = m_listenFd;
+    for (const auto& listener : m_listeners) {
+        event.events = EPOLLIN;
+        event.data.fd = listener.fd();
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, listener.fd(), &event) == -1) {
+            log("Failed to add listen socket to epoll: " + std::string(strerror(errno)));
+            close(m_epollFd);
+            m_epollFd = -1;
+            return false;
+        }
+        setNonBlocking(listener.fd());
+    }
+
+    // 协程定时器
+    if (m_scheduler.open()) {
+        event.events = EPOLLIN;
+        event.data.fd = m_scheduler.timerFd();
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_scheduler.timerFd(), &event) == -1) {
+            log("Failed to add coroutine timer to epoll: " + std::string(strerror(errno)));
+        }
+        // 过载采样
+        m_overloadTickDue = CScheduler::nowMs() + COverloadController::SAMPLE_MS;
+        m_scheduler.addTimer(COverloadController::SAMPLE_MS, [this] { overloadTick(); });
+        m_scheduler.addTimer(CMemoryBudget::CHECK_MS, [this] { memoryTick(); });
+        m_scheduler.addTimer(CTelemetry::TICK_MS, [this] { telemetryTick(); });
+        if (m_sessions.enabled()) {
+            m_scheduler.addTimer(CSessionTable::CHECK_MS, [this] { sessionTick(); });
+        }
+    }
 
-    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_listenFd, &event) == -1) {
-        log("Failed to add listen socket to epoll: " + std::string(strerror(errno)));
+    // 工作线程完成队列
+    if (!m_completions.open()) {
+        close(m_epollFd);
+        m_epollFd = -1;
+        return false;
+    }
+    event.events = EPOLLIN;
+    event.data.fd = m_completions.fd();
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_completions.fd(), &event) == -1) {
+        log("Failed to add completion queue to epoll: " + std::string(strerror(errno)));
+        m_completions.close();
         close(m_epollFd);
-        close(m_listenFd);
+        m_epollFd = -1;
         return false;
     }
-
-    // 设置非阻塞
-    setNonBlocking(m_listenFd);
-
-    return true;
-}
-
-void CServerSocket::setNonBlocking(int fd) {
-    int flags = fcntl(fd, F_GETFL, 0);
-    if (flags == -1) {
-        log("Failed to get socket flags: " + std::string(strerror(errno)));
-        return;
+    event.events = EPOLLIN;
+    event.data.fd = m_signalFd;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_signalFd, &event) == -1) {
+        log("Failed to add signalfd to epoll: " + std::string(strerror(errno)));
     }
-    if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
-        log("Failed to set socket non-blocking: " + std::string(strerror(errno)));
+    m_workerPool.start();
+    if (m_fanOut.partitionCount() == CFanOut::AUTO_PARTITIONS) {
+        m_fanOut.configure(m_workerPool.threadCount(), m_fanOut.threshold());
     }
-}
 
-void CServerSocket::log(const std::string message) const {
-    std::cout << "[ServerSocket] " << message << std::endl;
-}
+    if (!m_historyDir.empty() && !m_history.open(m_historyDir)) {
+        log("Failed to open history directory, message history disabled: " + m_historyDir);
+    }
+    if (!m_capturePath.empty() && !m_capture.open(m_capturePath, handoffConn != -1)) {
+        log("Failed to open capture file, traffic capture disabled: " + m_capturePath);
+    }
 
-bool CServerSocket::sendPacketToClient(int clientId, const CPacket& packet) {
-    auto& clientManager = m_command->getClientManager();
-    int clientSocket = clientManager.getSocketByClientId(clientId);
-    if (clientSocket == -1) {
-        log("Client not found for sending packet: " + std::to_string(clientId));
-        return false;
+    if (!m_chunkStore.open(m_chunkDir, m_chunkMemoryLimit)) {
+        log("Failed to open chunk cache directory, chunks kept in memory only: " + m_chunkDir);
+        m_chunkStore.open("", m_chunkMemoryLimit);
     }
 
-    // 序列化数据包
-    const char* packetData = packet.Data();
-    int packetSize = packet.Size();
-    ssize_t bytesSent = send(clientSocket, packetData, packetSize, 0);
+    if (!m_shmPath.empty()) {
+        m_shmListenFd = CShmChannel::listen(m_shmPath);
+        struct epoll_event shmEvent;
+        shmEvent.events = EPOLLIN;
+        shmEvent.data.fd = m_shmListenFd;
+        if (m_shmListenFd == -1 || epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_shmListenFd, &shmEvent) == -1) {
+            log("Failed to listen for shared memory clients on " + m_shmPath);
+        }
+    }
 
-    if (bytesSent == -1) {
-        log("Failed to send packet to client " + std::to_string(clientId) +
-            ": " + std::string(strerror(errno)));
-        return false;
+    // 集群模式下客户端ID带节点前缀，在各节点之间唯一
+    if (m_federation.isEnabled()) {
+        m_nextClientId = std::max(m_nextClientId, m_federation.firstClientId());
+        m_federation.start(m_epollFd);
+        m_scheduler.addTimer(CFederation::TICK_MS, [this] { federationTick(); });
     }
 
-    if (bytesSent != static_cast<ssize_t>(packetSize)) {
-        log("Partial send to client " + std::to_string(clientId) +
-            ": " + std::to_string(bytesSent) + "/" + std::to_string(packetSize));
+    // 接管完成后回复旧进程，旧进程收到确认后退出
+    if (handoffConn != -1) {
+        adoptClients(inherited);
+        if (!CHandoff::sendAck(handoffConn)) {
+            log("Failed to acknowledge handoff: " + std::string(strerror(errno)));
+        }
+        close(handoffConn);
+        // 旧进程积压的帧同样要等新数据才会触发读事件，确认后先解析
+        auto& clientManager = m_command->getClientManager();
+        for (const auto& client : inherited.clients) {
+            if (clientManager.hasClient(client.id)) {
+                processReceived(client.fd, client.id, 0);
+            }
+        }
+    }
+
+    // 等待下一次热重启
+    if (!m_handoffPath.empty()) {
+        m_handoffFd = CHandoff::listen(m_handoffPath);
+        if (m_handoffFd != -1) {
+            event.events = EPOLLIN;
+            event.data.fd = m_handoffFd;
+            if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_handoffFd, &event) == -1) {
+                log("Failed to add handoff socket to epoll: " + std::string(strerror(errno)));
+            }
+            else {
+                log("Hot restart enabled, handoff path: " + m_handoffPath);
+            }
+        }
+    }
+
+    return true;
+}
+
+bool CServerSocket::addListener(const std::string& spec) {
+    ListenEndpoint endpoint;
+    if (!ListenEndpoint::parse(spec, endpoint)) {
+        log("Invalid listen address: " + spec);
+        return false;
+    }
+    m_endpoints.push_back(endpoint);
+    return true;
+}
+
+bool CServerSocket::openListeners(HandoffState& inherited) {
+    if (m_endpoints.empty()) {
+        ListenEndpoint endpoint;
+        endpoint.family = ListenEndpoint::IPV4;
+        endpoint.address = m_ip;
+        endpoint.port = m_port;
+        m_endpoints.push_back(endpoint);
+    }
+
+    // 旧进程交来的监听socket按地址匹配，配置中新增的地址重新创建
+    for (const auto& endpoint : m_endpoints) {
+        CListener listener(endpoint);
+        for (auto& handed : inherited.listeners) {
+            if (handed.fd != -1 && handed.endpoint == endpoint.toString()) {
+                listener.adopt(handed.fd);
+                handed.fd = -1;
+                log("Inherited listen socket " + handed.endpoint + " from previous process");
+                break;
+            }
+        }
+        if (listener.fd() == -1 && !listener.open()) {
+            // 交接失败后旧进程继续服务：只删除本进程创建的socket文件，接管的路径仍属于旧进程
+            for (auto& opened : m_listeners) {
+                opened.close(!opened.adopted());
+            }
+            m_listeners.clear();
+            for (auto& handed : inherited.listeners) {
+                if (handed.fd != -1) {
+                    close(handed.fd);
+                    handed.fd = -1;
+                }
+            }
+            return false;
+        }
+        m_listeners.push_back(listener);
+    }
+
+    // 新配置中已经去掉的地址
+    for (const auto& handed : inherited.listeners) {
+        if (handed.fd != -1) {
+            log("Closing inherited listen socket " + handed.endpoint + " (no longer configured)");
+            close(handed.fd);
+        }
+    }
+    return true;
+}
+
+CListener* CServerSocket::findListener(int fd) {
+    for (auto& listener : m_listeners) {
+        if (listener.fd() == fd) {
+            return &listener;
+        }
+    }
+    return nullptr;
+}
+
+bool CServerSocket::setupSignals() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGUSR2);
+    sigaddset(&mask, SIGUSR1);
+    sigaddset(&mask, SIGHUP);
+    if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0) {
+        log("Failed to block signals");
+        return false;
+    }
+
+    m_signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (m_signalFd == -1) {
+        log("Failed to create signalfd: " + std::string(strerror(errno)));
+        return false;
+    }
+    return true;
+}
+
+void CServerSocket::setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1) {
+        log("Failed to get socket flags: " + std::string(strerror(errno)));
+        return;
+    }
+    if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        log("Failed to set socket non-blocking: " + std::string(strerror(errno)));
+    }
+}
+
+void CServerSocket::configureClientSocket(int fd) {
+    setNonBlocking(fd);
+    const ServerConfig& config = m_config.values();
+
+    // socket缓冲区，未配置时由内核自动调整
+    if (config.sendBufferKb > 0) {
+        int size = config.sendBufferKb * 1024;
+        if (setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) == -1) {
+            log("Failed to set SO_SNDBUF: " + std::string(strerror(errno)));
+        }
+    }
+    if (config.receiveBufferKb > 0) {
+        int size = config.receiveBufferKb * 1024;
+        if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) == -1) {
+            log("Failed to set SO_RCVBUF: " + std::string(strerror(errno)));
+        }
+    }
+
+    // Unix域socket没有TCP选项
+    int domain = AF_INET;
+    socklen_t length = sizeof(domain);
+    if (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &domain, &length) == 0 && domain == AF_UNIX) {
+        return;
+    }
+
+    // 未发出数据超过低水位时不再报告可写，排队的数据留在发送队列中由调度器决定顺序，
+    // 否则大量文件数据会先进入内核缓冲区，聊天消息只能排在后面
+    if (config.notSentLowatKb > 0) {
+        int lowat = config.notSentLowatKb * 1024;
+        if (setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat)) == -1) {
+            log("Failed to set TCP_NOTSENT_LOWAT: " + std::string(strerror(errno)));
+        }
+    }
+    if (config.noDelay) {
+        int opt = 1;
+        if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt)) == -1) {
+            log("Failed to set TCP_NODELAY: " + std::string(strerror(errno)));
+        }
+    }
+
+    // 低延迟模式：读取时在网卡队列上忙等一段时间，超出系统上限需要CAP_NET_ADMIN
+    if (m_latency.busyPollUs > 0 && !m_busyPollFailed) {
+        int busyPoll = static_cast<int>(m_latency.busyPollUs);
+        if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &busyPoll, sizeof(busyPoll)) == -1) {
+            log("Failed to set SO_BUSY_POLL, busy polling disabled: " + std::string(strerror(errno)));
+            m_busyPollFailed = true;
+        }
+    }
+}
+
+void CServerSocket::log(const std::string message) const {
+    std::cout << "[ServerSocket] " << message << std::endl;
+}
+
+bool CServerSocket::sendPacketToClient(int clientId, const CPacket& packet) {
+    auto& clientManager = m_command->getClientManager();
+    const ClientInfo* client = clientManager.getClient(clientId);
+    if (!client) {
+        log("Client not found for sending packet: " + std::to_string(clientId));
+        return false;
+    }
+
+    // 按该客户端协商的编码序列化数据包
+    return sendFrame(clientId, client->socket, encodeFrame(packet, static_cast<CCompressor::Codec>(client->codec)));
+}
+
+int CServerSocket::broadcastPacket(const CPacket& packet, int excludeClientId) {
+    std::map<uint8_t, COutboundQueue::Frame> frames;
+    return broadcastFrames(packet, frames, excludeClientId);
+}
+
+int CServerSocket::broadcastFrames(const CPacket& packet, std::map<uint8_t, COutboundQueue::Frame>& frames, int excludeClientId) {
+    auto& clientManager = m_command->getClientManager();
+
+    // 接收方很多(或已有并行扇出进行中)时交给分区，epoll线程只负责生成帧
+    if (m_fanOut.shouldSplit(clientManager.getClientCount())) {
+        refreshFanOut();
+        for (uint8_t codec : m_fanOut.codecs()) {
+            if (frames.find(codec) == frames.end()) {
+                frames.emplace(codec, encodeFrame(packet, static_cast<CCompressor::Codec>(codec)));
+            }
+        }
+        std::vector<CFanOut::Partition> partitions;
+        for (size_t i = 0; i < m_fanOut.partitionCount(); ++i) {
+            partitions.push_back(m_fanOut.partition(i));
+        }
+        recordDetached(packet, frames);
+        return submitFanOut(partitions, frames, excludeClientId) + sendToDirectClients(packet, frames, excludeClientId);
+    }
+
+    // 每种编码的帧只生成一次，所有使用该编码的接收方共享
+    int sent = 0;
+    for (const auto& clientPair : clientManager.getAllClients()) {
+        const ClientInfo& client = clientPair.second;
+        if (!client.isConnected || client.id == excludeClientId) {
+            continue;
+        }
+
+        auto it = frames.find(client.codec);
+        if (it == frames.end()) {
+            it = frames.emplace(client.codec, encodeFrame(packet, static_cast<CCompressor::Codec>(client.codec))).first;
+        }
+        if (sendFrame(client.id, client.socket, it->second)) {
+            sent++;
+        }
+    }
+    recordDetached(packet, frames);
+    return sent;
+}
+
+int CServerSocket::multicastPacket(const CPacket& packet, const std::vector<int>& clientIds) {
+    auto& clientManager = m_command->getClientManager();
+
+    std::map<uint8_t, COutboundQueue::Frame> frames;
+    int sent = 0;
+    if (m_fanOut.shouldSplit(clientIds.size())) {
+        std::vector<std::vector<CFanOut::Member>> members(m_fanOut.partitionCount());
+        for (int clientId : clientIds) {
+            const ClientInfo* client = clientManager.getClient(clientId);
+            if (!client || !client->isConnected || !client->outbound) {
+                continue;
+            }
+            if (frames.find(client->codec) == frames.end()) {
+                frames.emplace(client->codec, encodeFrame(packet, static_cast<CCompressor::Codec>(client->codec)));
+            }
+            if (directWrite(client->socket)) {
+                sent += sendFrame(client->id, client->socket, frames[client->codec]) ? 1 : 0;
+                continue;
+            }
+            members[m_fanOut.partitionOf(clientId)].push_back({ client->id, client->socket, client->codec, client->outbound });
+        }
+        std::vector<CFanOut::Partition> partitions;
+        for (auto& partition : members) {
+            partitions.push_back(std::make_shared<const std::vector<CFanOut::Member>>(std::move(partition)));
+        }
+        return sent + submitFanOut(partitions, frames, -1);
+    }
+
+    for (int clientId : clientIds) {
+        const ClientInfo* client = clientManager.getClient(clientId);
+        if (!client || !client->isConnected) {
+            continue;
+        }
+
+        auto it = frames.find(client->codec);
+        if (it == frames.end()) {
+            it = frames.emplace(client->codec, encodeFrame(packet, static_cast<CCompressor::Codec>(client->codec))).first;
+        }
+        if (sendFrame(client->id, client->socket, it->second)) {
+            sent++;
+        }
+    }
+    return sent;
+}
+
+COutboundQueue::Frame CServerSocket::encodeFrame(const CPacket& packet, CCompressor::Codec codec) const {
+    CTraceSpan span("encode", static_cast<uint32_t>(packet.Size()));
+    CPacket compressed;
+    if (CCompressor::compressPacket(packet, codec, compressed)) {
+        return std::make_shared<const std::string>(compressed.Serialize());
+    }
+    return std::make_shared<const std::string>(packet.Serialize());
+}
+
+bool CServerSocket::sendFrame(int clientId, int clientSocket, const char* data, size_t size) {
+    return sendFrame(clientId, clientSocket, std::make_shared<const std::string>(data, size));
+}
+
+bool CServerSocket::sendFrame(int clientId, int clientSocket, const COutboundQueue::Frame& frame) {
+    ClientInfo* client = m_command->getClientManager().getClient(clientId);
+    if (!client || !client->outbound) {
+        log("Client not found for sending packet: " + std::to_string(clientId));
         return false;
     }
 
-    log("Successfully sent packet to client " + std::to_string(clientId) +
-        ", bytes: " + std::to_string(bytesSent) + "/" + std::to_string(packetSize));
+    // 并行扇出进行中：经该客户端所在分区的串行队列，排在已提交的广播帧之后
+    if (m_fanOut.busy() && !directWrite(clientSocket)) {
+        auto members = std::make_shared<std::vector<CFanOut::Member>>();
+        members->push_back({ clientId, clientSocket, client->codec, client->outbound });
+        auto frames = std::make_shared<FrameSet>();
+        (*frames)[client->codec] = frame;
+        submitPartition(m_fanOut.partitionOf(clientId), members, frames, -1, nullptr);
+        m_fanOut.recordRouted();
+        return true;
+    }
+
+    // 接收方太慢，队列超过上限时断开；shutdown后由读事件走正常的断开流程
+    if (!client->outbound->push(frame, COutboundQueue::classifyFrame(*frame))) {
+        log("Outbound queue overflow for client " + std::to_string(clientId) +
+            " (" + std::to_string(client->outbound->bytes()) + " bytes), disconnecting");
+        shutdown(clientSocket, SHUT_RDWR);
+        return false;
+    }
+    return flushClient(clientSocket);
+}
+
+bool CServerSocket::flushClient(int clientSocket) {
+    auto& clientManager = m_command->getClientManager();
+    ClientInfo* client = clientManager.getClient(clientManager.getClientIdBySocket(clientSocket));
+    if (!client || !client->outbound) {
+        return false;
+    }
+    CTraceSpan span("send", client->id);
+    bool flushed;
+    auto shm = m_shmClients.find(clientSocket);
+    if (shm != m_shmClients.end()) {
+        CShmChannel* channel = shm->second.get();
+        flushed = client->outbound->flush([channel](const struct iovec* iov, int count) {
+            return channel->send(iov, count);
+        });
+    }
+    else if (directWrite(clientSocket)) {
+        // 用户态加密的TLS
+        CTlsConnection* tls = m_tlsClients[clientSocket].get();
+        flushed = client->outbound->flush([tls](const struct iovec* iov, int count) {
+            return tls->write(iov, count);
+        });
+    }
+    else {
+        flushed = client->outbound->flush(clientSocket);
+    }
+    if (!flushed) {
+        log("Failed to send to client " + std::to_string(client->id) + ": " + std::string(strerror(errno)));
+        shutdown(clientSocket, SHUT_RDWR);
+        return false;
+    }
+    chargeOutbound(client->id, clientSocket, *client->outbound);
+    auto connection = m_connections.find(client->id);
+    if (connection != m_connections.end()) {
+        connection->second->onWritable();
+    }
+    return true;
+}
+
+void CServerSocket::enableFanOut(size_t partitions, size_t threshold) {
+    m_fanOut.configure(partitions, threshold);
+}
+
+void CServerSocket::refreshFanOut() {
+    auto& clientManager = m_command->getClientManager();
+    if (!m_fanOut.stale(clientManager.getGeneration())) {
+        return;
+    }
+    std::vector<std::vector<CFanOut::Member>> members(m_fanOut.partitionCount());
+    for (const auto& clientPair : clientManager.getAllClients()) {
+        const ClientInfo& client = clientPair.second;
+        if (!client.isConnected || !client.outbound || directWrite(client.socket)) {
+            continue;
+        }
+        members[m_fanOut.partitionOf(client.id)].push_back({ client.id, client.socket, client.codec, client.outbound });
+    }
+    m_fanOut.rebuild(clientManager.getGeneration(), members);
+}
+
+int CServerSocket::submitFanOut(const std::vector<CFanOut::Partition>& partitions, const FrameSet& frames, int excludeClientId) {
+    CTraceSpan span("fanout-submit", static_cast<uint32_t>(partitions.size()));
+    auto shared = std::make_shared<const FrameSet>(frames);
+    auto remaining = std::make_shared<size_t>(0);
+    uint64_t startUs = CScheduler::nowUs();
+    size_t recipients = 0;
+    for (size_t i = 0; i < partitions.size(); ++i) {
+        if (!partitions[i] || partitions[i]->empty()) {
+            continue;
+        }
+        recipients += partitions[i]->size();
+        (*remaining)++;
+        submitPartition(i, partitions[i], shared, excludeClientId, [this, remaining, startUs] {
+            if (--*remaining == 0) {
+                m_fanOut.recordCompletion(CScheduler::nowUs() - startUs);
+            }
+        });
+    }
+    m_fanOut.recordBroadcast(recipients, *remaining);
+    return static_cast<int>(recipients);
+}
+
+void CServerSocket::submitPartition(size_t index, CFanOut::Partition members, std::shared_ptr<const FrameSet> frames,
+    int excludeClientId, std::function<void()> done) {
+    m_fanOut.begin();
+    m_workerPool.submit(m_fanOut.strandOf(index), [this, members, frames, excludeClientId, done] {
+        // 需要回到epoll线程处理的连接：出错的，以及发送队列在写出前后不为空的(内存记账、等待发送的协程)
+        std::vector<std::pair<int, bool>> followUps;
+        {
+            CTraceSample sample;
+            CTraceSpan span("fanout-partition", static_cast<uint32_t>(members->size()));
+            for (const auto& member : *members) {
+                auto frame = frames->find(member.codec);
+                if (member.clientId == excludeClientId || frame == frames->end()) {
+                    continue;
+                }
+                size_t before = member.outbound->bytes();
+                bool ok = member.outbound->push(frame->second, COutboundQueue::classifyFrame(*frame->second)) &&
+                    member.outbound->flush(member.fd);
+                if (!ok) {
+                    shutdown(member.fd, SHUT_RDWR);
+                }
+                if (!ok || before > 0 || !member.outbound->empty()) {
+                    followUps.emplace_back(member.clientId, ok);
+                }
+            }
+        }
+        m_completions.post([this, followUps, done] {
+            if (done) {
+                done();
+            }
+            finishPartition(followUps);
+        });
+    });
+}
+
+void CServerSocket::finishPartition(const std::vector<std::pair<int, bool>>& followUps) {
+    auto& clientManager = m_command->getClientManager();
+    size_t failures = 0;
+    for (const auto& item : followUps) {
+        ClientInfo* client = clientManager.getClient(item.first);
+        if (!client || !client->outbound) {
+            continue;
+        }
+        if (!item.second) {
+            log("Send to client " + std::to_string(item.first) + " failed during fan-out (" +
+                std::to_string(client->outbound->bytes()) + " bytes queued), disconnecting");
+            failures++;
+            continue;
+        }
+        chargeOutbound(item.first, client->socket, *client->outbound);
+        auto connection = m_connections.find(item.first);
+        if (connection != m_connections.end()) {
+            connection->second->onWritable();
+        }
+    }
+    m_fanOut.recordFailures(failures);
+
+    if (m_fanOut.finish()) {
+        for (int fd : m_deferredCloses) {
+            close(fd);
+        }
+        m_deferredCloses.clear();
+    }
+}
+
+bool CServerSocket::directWrite(int clientSocket) const {
+    if (m_shmClients.count(clientSocket) != 0) {
+        return true;
+    }
+    auto tls = m_tlsClients.find(clientSocket);
+    return tls != m_tlsClients.end() && !tls->second->kernelSend();
+}
+
+int CServerSocket::sendToDirectClients(const CPacket& packet, FrameSet& frames, int excludeClientId) {
+    std::vector<int> sockets;
+    for (const auto& shm : m_shmClients) {
+        sockets.push_back(shm.first);
+    }
+    for (const auto& tls : m_tlsClients) {
+        if (directWrite(tls.first)) {
+            sockets.push_back(tls.first);
+        }
+    }
+    auto& clientManager = m_command->getClientManager();
+    int sent = 0;
+    for (int clientSocket : sockets) {
+        ClientInfo* client = clientManager.getClient(clientManager.getClientIdBySocket(clientSocket));
+        if (!client || !client->isConnected || client->id == excludeClientId) {
+            continue;
+        }
+        auto it = frames.find(client->codec);
+        if (it == frames.end()) {
+            it = frames.emplace(client->codec, encodeFrame(packet, static_cast<CCompressor::Codec>(client->codec))).first;
+        }
+        if (sendFrame(client->id, client->socket, it->second)) {
+            sent++;
+        }
+    }
+    return sent;
+}
+
+void CServerSocket::chargeOutbound(int clientId, int clientSocket, const COutboundQueue& outbound) {
+    m_memory.set(clientId, CMemoryBudget::OUTBOUND, outbound.bytes());
+    if (outbound.empty()) {
+        m_memory.touch(clientId, CScheduler::nowMs());
+    }
+    // 发送队列自身有上限，这里限制的是接收缓冲区、积压帧和发送队列的总和
+    if (m_memory.overConnectionLimit(clientId)) {
+        log("Memory cap exceeded for client " + std::to_string(clientId) +
+            " (" + std::to_string(m_memory.connectionBytes(clientId)) + " bytes), disconnecting");
+        m_memory.count(CMemoryBudget::CAP_DISCONNECTS);
+        shutdown(clientSocket, SHUT_RDWR);
+    }
+}
+
+void CServerSocket::appendSplitPacket(std::vector<CPacket>& packets, const CPacket& packet) {
+    const std::string& data = packet.getData();
+    if (packet.getCmd() != static_cast<uint16_t>(CCommand::Type::FILE_DATA) ||
+        data.size() <= COutboundQueue::MAX_BULK_FRAME) {
+        packets.push_back(packet);
+        return;
+    }
+    // 文件数据块按顺序拼接，拆分后对接收方是等价的
+    for (size_t offset = 0; offset < data.size(); offset += COutboundQueue::MAX_BULK_FRAME) {
+        size_t size = std::min(COutboundQueue::MAX_BULK_FRAME, data.size() - offset);
+        packets.emplace_back(packet.getCmd(), reinterpret_cast<const uint8_t*>(data.data() + offset), size);
+    }
+}
+
+void CServerSocket::enableHistory(const std::string& directory, size_t joinReplay) {
+    m_historyDir = directory;
+    m_joinReplay = joinReplay;
+}
+
+void CServerSocket::appendHistory(const CPacket& packet, int clientId) {
+    // 其他节点可能开启了历史记录，本节点未开启时也要转发
+    uint64_t timestamp = CHistoryLog::nowMs();
+    writeHistory(packet, clientId, timestamp);
+    m_federation.forwardHistory(packet, clientId, timestamp);
+}
+
+void CServerSocket::recordRemoteHistory(const CPacket& packet, int clientId, uint64_t timestampMs) {
+    writeHistory(packet, clientId, timestampMs);
+}
+
+void CServerSocket::writeHistory(const CPacket& packet, int clientId, uint64_t timestampMs) {
+    if (!m_history.isOpen()) {
+        return;
+    }
+
+    // 所有历史写入共用一个串行队列，保证记录顺序与广播顺序一致
+    m_workerPool.submit(HISTORY_STRAND, [this, packet, clientId, timestampMs] {
+        CTraceSample sample;
+        CTraceSpan span("history", static_cast<uint32_t>(packet.Size()));
+        std::string frame = packet.Serialize();
+        m_history.append(timestampMs, clientId, frame.data(), frame.size());
+    });
+}
+
+size_t CServerSocket::replayHistoryLast(int clientId, size_t count) {
+    int clientSocket = m_command->getClientManager().getSocketByClientId(clientId);
+    if (clientSocket == -1 || !m_history.isOpen()) {
+        return 0;
+    }
+
+    size_t replayed = m_history.replayLast(count, [&](const char* frame, size_t size) {
+        return sendFrame(clientId, clientSocket, frame, size);
+    });
+    log("Replayed " + std::to_string(replayed) + " history messages to client " + std::to_string(clientId));
+    return replayed;
+}
+
+size_t CServerSocket::replayHistorySince(int clientId, uint64_t timestampMs, size_t maxCount) {
+    int clientSocket = m_command->getClientManager().getSocketByClientId(clientId);
+    if (clientSocket == -1 || !m_history.isOpen()) {
+        return 0;
+    }
+
+    size_t replayed = m_history.replaySince(timestampMs, maxCount, [&](const char* frame, size_t size) {
+        return sendFrame(clientId, clientSocket, frame, size);
+    });
+    log("Replayed " + std::to_string(replayed) + " history messages since " +
+        std::to_string(timestampMs) + " to client " + std::to_string(clientId));
+    return replayed;
+}
+
+void CServerSocket::enableHotRestart(const std::string& handoffPath, const std::vector<std::string>& restartArgv) {
+    m_handoffPath = handoffPath;
+    m_restartArgv = restartArgv;
+}
+
+void CServerSocket::handleSignal() {
+    struct signalfd_siginfo info;
+    while (read(m_signalFd, &info, sizeof(info)) == sizeof(info)) {
+        switch (info.ssi_signo) {
+        case SIGINT:
+        case SIGTERM:
+            log("Received signal " + std::to_string(info.ssi_signo) + ", shutting down the server...");
+            m_running = false;
+            break;
+        case SIGUSR2:
+            spawnReplacement();
+            break;
+        case SIGUSR1:
+            CTrace::dump();
+            break;
+        case SIGHUP:
+            reloadConfig();
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void CServerSocket::spawnReplacement() {
+    if (m_handoffFd == -1 || m_restartArgv.empty()) {
+        log("Hot restart not enabled, ignoring SIGUSR2");
+        return;
+    }
+
+    // 回收之前启动失败的新进程；仍在运行(正在交接)时不再启动第二个
+    if (m_replacementPid != -1) {
+        if (waitpid(m_replacementPid, nullptr, WNOHANG) == 0) {
+            log("Replacement process " + std::to_string(m_replacementPid) + " still running, ignoring SIGUSR2");
+            return;
+        }
+        m_replacementPid = -1;
+    }
+
+    // fork之后子进程只调用异步信号安全的函数(其他线程可能持有malloc锁)，参数在fork之前准备好
+    std::vector<char*> args;
+    for (const auto& arg : m_restartArgv) {
+        args.push_back(const_cast<char*>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+    long maxFd = std::min<long>(sysconf(_SC_OPEN_MAX), 65536);
+    sigset_t mask;
+    sigemptyset(&mask);
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        log("Failed to fork replacement process: " + std::string(strerror(errno)));
+        return;
+    }
+    if (pid == 0) {
+        // 子进程：恢复信号掩码，关闭继承的描述符(客户端socket由交接流程传递)后执行新程序
+        sigprocmask(SIG_SETMASK, &mask, nullptr);
+        for (int fd = 3; fd < maxFd; ++fd) {
+            close(fd);
+        }
+        execv(args[0], args.data());
+        _exit(127);
+    }
+    m_replacementPid = pid;
+    log("Started replacement process " + std::to_string(pid) + ", waiting for handoff");
+}
+
+void CServerSocket::handleHandoffRequest() {
+    int conn = accept4(m_handoffFd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (conn == -1) {
+        log("Failed to accept handoff connection: " + std::string(strerror(errno)));
+        return;
+    }
+    struct timeval timeout = { HANDOFF_TIMEOUT_MS / 1000, 0 };
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(conn, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (!CHandoff::readRequest(conn)) {
+        log("Invalid handoff request");
+        close(conn);
+        return;
+    }
+
+    // 共享内存映射和TLS状态无法交给新进程，断开后由客户端重新连接
+    std::vector<int> localSockets;
+    for (const auto& pair : m_shmClients) {
+        localSockets.push_back(pair.first);
+    }
+    std::vector<int> handshakes;
+    for (const auto& pair : m_tlsClients) {
+        (m_tlsHandshakes.count(pair.first) != 0 ? handshakes : localSockets).push_back(pair.first);
+    }
+    for (int clientSocket : handshakes) {
+        closeTlsHandshake(clientSocket);
+    }
+    for (int clientSocket : localSockets) {
+        handleClientDisconnect(clientSocket);
+    }
+
+    // 停止接收新数据，等已经提交的后台任务把结果发出
+    log("Handoff requested, pausing I/O");
+    setIoPaused(true);
+    if (!drainForHandoff(HANDOFF_TIMEOUT_MS)) {
+        log("Background tasks did not finish in time, handoff aborted");
+        setIoPaused(false);
+        close(conn);
+        return;
+    }
+
+    auto& clientManager = m_command->getClientManager();
+    const CPresence& presence = clientManager.getPresence();
+    HandoffState state;
+    for (const auto& listener : m_listeners) {
+        HandoffListener handed;
+        handed.fd = listener.fd();
+        handed.endpoint = listener.endpoint().toString();
+        state.listeners.push_back(handed);
+    }
+    state.nextClientId = m_nextClientId;
+    // 协程处理函数挂起期间积压的帧放回接收缓冲区，由新进程(或交接失败后的本进程)重新解析
+    for (auto& pair : m_connections) {
+        std::string inbox = pair.second->takeInbox();
+        if (!inbox.empty()) {
+            std::string buffered = clientManager.getBuffer(pair.first);
+            clientManager.clearBuffer(pair.first);
+            clientManager.appendToBuffer(pair.first, inbox + buffered);
+        }
+    }
+    for (const auto& pair : clientManager.getAllClients()) {
+        const ClientInfo& info = pair.second;
+        HandoffClient client;
+        client.fd = info.socket;
+        client.id = info.id;
+        client.ip = info.ip;
+        client.port = info.port;
+        client.username = info.username;
+        client.codec = info.codec;
+        client.features = info.features;
+        client.presenceSubscribed = presence.isSubscribed(info.id);
+        client.receiverBuffer = info.receiverBuffer;
+        if (info.outbound) {
+            client.pendingOutput = info.outbound->takePending();
+        }
+        state.clients.push_back(client);
+    }
+
+    // 历史目录由新进程重新打开
+    m_history.close();
+    if (!CHandoff::sendState(conn, state) || !CHandoff::waitAck(conn, HANDOFF_TIMEOUT_MS)) {
+        log("Handoff failed, resuming service");
+        close(conn);
+        for (const auto& client : state.clients) {
+            ClientInfo* info = clientManager.getClient(client.id);
+            if (info && info->outbound) {
+                info->outbound->restorePending(client.pendingOutput);
+            }
+        }
+        if (!m_historyDir.empty() && !m_history.open(m_historyDir)) {
+            log("Failed to reopen history directory: " + m_historyDir);
+        }
+        setIoPaused(false);
+        // 放回接收缓冲区的帧在对端发来新数据之前不会再触发读事件，在这里重新解析
+        for (const auto& client : state.clients) {
+            if (clientManager.hasClient(client.id)) {
+                processReceived(client.fd, client.id, 0);
+            }
+        }
+        return;
+    }
+    close(conn);
+
+    log("Handed off " + std::to_string(state.clients.size()) + " clients to the new process");
+    m_handedOff = true;
+    m_running = false;
+}
+
+bool CServerSocket::drainForHandoff(int timeoutMs) {
+    uint64_t deadline = CHistoryLog::nowMs() + timeoutMs;
+    while (!m_pendingOffload.empty() || m_workerPool.pending(HISTORY_STRAND) > 0 || m_fanOut.busy()) {
+        if (CHistoryLog::nowMs() >= deadline) {
+            return false;
+        }
+        struct pollfd pfd = { m_completions.fd(), POLLIN, 0 };
+        poll(&pfd, 1, 10);
+        m_completions.drain();
+    }
     return true;
 }
 
+void CServerSocket::setIoPaused(bool paused) {
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    for (const auto& listener : m_listeners) {
+        event.data.fd = listener.fd();
+        epoll_ctl(m_epollFd, paused ? EPOLL_CTL_DEL : EPOLL_CTL_ADD, listener.fd(), paused ? nullptr : &event);
+    }
+    if (m_shmListenFd != -1) {
+        event.data.fd = m_shmListenFd;
+        epoll_ctl(m_epollFd, paused ? EPOLL_CTL_DEL : EPOLL_CTL_ADD, m_shmListenFd, paused ? nullptr : &event);
+    }
+
+    for (const auto& pair : m_command->getClientManager().getAllClients()) {
+        if (paused) {
+            removeClientFromEpoll(pair.second.socket);
+        }
+        else {
+            // 重新加入时读写都监听，再按过载控制的暂停状态恢复
+            addClientToEpoll(pair.second.socket);
+            m_readsPaused.erase(pair.first);
+            updateReadInterest(pair.first);
+        }
+    }
+}
+
+void CServerSocket::adoptClients(const HandoffState& state) {
+    auto& clientManager = m_command->getClientManager();
+    CPresence& presence = clientManager.getPresence();
+
+    // 直接登记到ClientManager，对其他客户端来说连接从未断开，不广播上线
+    for (const auto& client : state.clients) {
+        configureClientSocket(client.fd);
+        addClientToEpoll(client.fd);
+        clientManager.addClient(client.fd, client.id, client.ip, client.port);
+        m_capture.record(CaptureRecord::CONNECT, client.id);
+        openConnection(client.fd, client.id);
+        if (!client.username.empty()) {
+            clientManager.updateClientUsername(client.id, client.username);
+        }
+        clientManager.updateClientCodec(client.id, client.codec);
+        clientManager.updateClientFeatures(client.id, client.features);
+        clientManager.appendToBuffer(client.id, client.receiverBuffer);
+        if (client.presenceSubscribed) {
+            presence.subscribe(client.id);
+        }
+        ClientInfo* info = clientManager.getClient(client.id);
+        if (info && !client.pendingOutput.empty()) {
+            info->outbound->restorePending(client.pendingOutput);
+            flushClient(client.fd);
+        }
+    }
+    m_nextClientId = std::max(m_nextClientId, state.nextClientId);
+
+    // 新进程的在线状态版本号重新开始，先给订阅者发一份快照，之后继续按增量同步
+    std::vector<int> subscribers = presence.getSubscribers();
+    if (!subscribers.empty()) {
+        const std::string& snapshot = presence.encodeSnapshot();
+        CPacket snapshotPacket(static_cast<int>(CCommand::Type::PRESENCE_SNAPSHOT),
+            reinterpret_cast<const uint8_t*>(snapshot.data()), snapshot.size());
+        multicastPacket(snapshotPacket, subscribers);
+    }
+    log("Adopted " + std::to_string(state.clients.size()) + " clients from previous process");
+}
+
+void CServerSocket::enableFederation(int nodeId, int federationPort, const std::vector<std::string>& peers) {
+    m_federation.configure(nodeId, federationPort, peers);
+}
+
+void CServerSocket::enableShmTransport(const std::string& path) {
+    m_shmPath = path;
+}
+
+void CServerSocket::enableChunkStore(const std::string& spillDirectory, size_t memoryLimit) {
+    m_chunkDir = spillDirectory;
+    m_chunkMemoryLimit = memoryLimit;
+}
+
+void CServerSocket::enableCapture(const std::string& path) {
+    m_capturePath = path;
+}
+
+void CServerSocket::overloadTick() {
+    uint64_t now = CScheduler::nowMs();
+    OverloadSample sample;
+    sample.loopLagMs = now > m_overloadTickDue ? now - m_overloadTickDue : 0;
+    for (const auto& pair : m_command->getClientManager().getAllClients()) {
+        if (pair.second.outbound) {
+            sample.outboundBytes += pair.second.outbound->bytes();
+        }
+    }
+    sample.workerBacklog = m_workerPool.queued();
+    sample.rssBytes = residentBytes();
+    sample.budgetPercent = m_memory.usagePercent();
+    if (m_overload.update(sample)) {
+        log("Overload " + m_overload.describe());
+    }
+
+    // 合并的在线状态每个周期发送一次
+    m_command->flushPresence();
+
+    // 暂停读取流量最大的客户端，到期或级别下降后恢复
+    std::vector<int> heavy = m_overload.heavySenders();
+    if (m_overload.throttleSenders()) {
+        for (int clientId : heavy) {
+            if (m_throttledUntil.count(clientId) == 0) {
+                m_overload.count(COverloadController::READS_PAUSED);
+                log("Overloaded, pausing reads from client " + std::to_string(clientId));
+            }
+            m_throttledUntil[clientId] = now + COverloadController::THROTTLE_MS;
+            updateReadInterest(clientId);
+        }
+    }
+    for (auto it = m_throttledUntil.begin(); it != m_throttledUntil.end();) {
+        if (it->second <= now || !m_overload.throttleSenders()) {
+            int clientId = it->first;
+            it = m_throttledUntil.erase(it);
+            updateReadInterest(clientId);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    m_overloadTickDue = now + COverloadController::SAMPLE_MS;
+    m_scheduler.addTimer(COverloadController::SAMPLE_MS, [this] { overloadTick(); });
+}
+
+void CServerSocket::updateReadInterest(int clientId) {
+    const ClientInfo* client = m_command->getClientManager().getClient(clientId);
+    if (!client || m_shmClients.count(client->socket) != 0) {
+        return;
+    }
+    bool pause = m_throttledUntil.count(clientId) != 0 || m_deferringBulk.count(clientId) != 0;
+    if (pause == (m_readsPaused.count(clientId) != 0)) {
+        return;
+    }
+
+    // 边沿触发下重新加上EPOLLIN时，内核会检查一次就绪状态，暂停期间到达的数据不会丢失事件
+    struct epoll_event event;
+    event.events = pause ? (EPOLLOUT | EPOLLET) : (EPOLLIN | EPOLLOUT | EPOLLET);
+    event.data.fd = client->socket;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_MOD, client->socket, &event) == -1) {
+        log("Failed to update read interest for client " + std::to_string(clientId) + ": " + std::string(strerror(errno)));
+        return;
+    }
+    if (pause) {
+        m_readsPaused.insert(clientId);
+    }
+    else {
+        m_readsPaused.erase(clientId);
+    }
+}
+
+void CServerSocket::enableTls(const std::string& certFile, const std::string& keyFile, bool ktls) {
+    m_tlsCert = certFile;
+    m_tlsKey = keyFile;
+    m_ktls = ktls;
+}
+
+std::string CServerSocket::describeTls() const {
+    return m_tls.describe(m_tlsClients.size() - m_tlsHandshakes.size(), m_tlsHandshakes.size());
+}
+
+void CServerSocket::enableSessions(size_t window, uint64_t timeoutMs) {
+    m_sessions.configure(window, timeoutMs);
+}
+
+bool CServerSocket::openSession(int clientId, const std::string& token, uint64_t ack) {
+    if (!m_sessions.enabled()) {
+        log("Session request from client " + std::to_string(clientId) + " ignored: sessions disabled");
+        return false;
+    }
+    auto& clientManager = m_command->getClientManager();
+    ClientInfo* client = clientManager.getClient(clientId);
+    if (!client || !client->outbound) {
+        return false;
+    }
+    if (m_sessions.find(clientId)) {
+        log("Client " + std::to_string(clientId) + " already has a session");
+        return false;
+    }
+
+    std::shared_ptr<CSession> session;
+    std::vector<COutboundQueue::Frame> retransmit;
+    if (!token.empty()) {
+        // 旧连接还没有检测到断开(半开连接)：先按断开处理，再从断线会话中恢复
+        int owner = m_sessions.ownerOf(token);
+        if (owner != -1) {
+            const ClientInfo* previous = clientManager.getClient(owner);
+            log("Session of client " + std::to_string(owner) + " taken over by client " + std::to_string(clientId));
+            detachSession(owner);
+            if (previous) {
+                shutdown(previous->socket, SHUT_RDWR);
+            }
+        }
+        session = m_sessions.take(token);
+        if (session && session->canResume(ack)) {
+            retransmit = session->resumeFrom(ack);
+        }
+        else {
+            log("Session resume failed for client " + std::to_string(clientId) + " (ack " + std::to_string(ack) +
+                (session ? ", frames no longer in window)" : ", unknown or expired token)"));
+            session.reset();
+        }
+        m_sessions.recordResume(session != nullptr);
+    }
+
+    SessionReplyMsg reply;
+    if (session) {
+        // 重发的帧按会话建立时的编码生成，新连接沿用该编码和用户名
+        clientManager.updateClientCodec(clientId, session->codec);
+        clientManager.updateClientFeatures(clientId, session->features);
+        if (!session->username.empty()) {
+            m_command->updateClientUsername(clientId, session->username);
+        }
+        m_sessions.bind(clientId, session);
+        m_sessions.recordRetransmit(retransmit.size());
+        session->resumes++;
+        reply.firstSeq = ack + 1;
+        reply.resumed = 1;
+        log("Client " + std::to_string(clientId) + " resumed the session of client " + std::to_string(session->originalId) +
+            " from seq " + std::to_string(reply.firstSeq) + ", retransmitting " + std::to_string(retransmit.size()) + " frames");
+
+        // 恢复的连接沿用新ID，通知其他客户端(和集群节点)上一个ID属于同一会话
+        SessionMovedMsg moved;
+        moved.previousId = static_cast<uint32_t>(session->previousId);
+        moved.clientId = static_cast<uint32_t>(clientId);
+        moved.originalId = static_cast<uint32_t>(session->originalId);
+        CPacket movedPacket;
+        encodePacket(moved, movedPacket);
+        broadcastPacket(movedPacket, clientId);
+        m_federation.forwardBroadcast(movedPacket, clientId);
+    }
+    else {
+        session = m_sessions.create(clientId);
+        session->codec = client->codec;
+        session->features = client->features;
+        reply.firstSeq = session->nextSeq();
+        log("Client " + std::to_string(clientId) + " opened a session");
+    }
+    reply.token = session->token();
+    reply.codec = client->codec;
+    reply.clientId = static_cast<uint32_t>(clientId);
+
+    CPacket replyPacket;
+    encodePacket(reply, replyPacket);
+    retransmit.insert(retransmit.begin(), encodeFrame(replyPacket, static_cast<CCompressor::Codec>(client->codec)));
+    client->outbound->attachSession(session, retransmit);
+    return flushClient(client->socket);
+}
+
+void CServerSocket::detachSession(int clientId) {
+    const ClientInfo* client = m_command->getClientManager().getClient(clientId);
+    std::shared_ptr<CSession> session = m_sessions.find(clientId);
+    if (!client || !session) {
+        return;
+    }
+    session->codec = client->codec;
+    session->features = client->features;
+    session->username = client->username;
+    // 会话先进入断线状态，队列断开后工作线程入队的帧才能记入
+    m_sessions.detach(clientId, CScheduler::nowMs());
+    if (client->outbound) {
+        client->outbound->detachSession();
+    }
+    log("Session of client " + std::to_string(clientId) + " detached, " +
+        std::to_string(session->windowFrames()) + " frames kept for resume");
+}
+
+void CServerSocket::recordDetached(const CPacket& packet, std::map<uint8_t, COutboundQueue::Frame>& frames) {
+    for (const auto& pair : m_sessions.detached()) {
+        CSession& session = *pair.second;
+        auto it = frames.find(session.codec);
+        if (it == frames.end()) {
+            it = frames.emplace(session.codec, encodeFrame(packet, static_cast<CCompressor::Codec>(session.codec))).first;
+        }
+        session.record(it->second);
+    }
+}
+
+void CServerSocket::sessionTick() {
+    size_t expired = m_sessions.expire(CScheduler::nowMs());
+    if (expired > 0) {
+        log("Expired " + std::to_string(expired) + " detached sessions");
+    }
+    m_scheduler.addTimer(CSessionTable::CHECK_MS, [this] { sessionTick(); });
+}
 
+void CServerSocket::memoryTick() {
+    // 超出预算时收缩所有连接，否则只收缩空闲连接
+    std::vector<int> clients;
+    if (m_memory.overBudget()) {
+        for (const auto& pair : m_command->getClientManager().getAllClients()) {
+            clients.push_back(pair.first);
+        }
+    }
+    else {
+        clients = m_memory.idleClients(CScheduler::nowMs(), CMemoryBudget::IDLE_MS);
+    }
+    for (int clientId : clients) {
+        releaseBuffers(clientId);
+    }
+    m_scheduler.addTimer(CMemoryBudget::CHECK_MS, [this] { memoryTick(); });
+}
 
+void CServerSocket::releaseBuffers(int clientId) {
+    auto& clientManager = m_command->getClientManager();
+    ClientInfo* client = clientManager.getClient(clientId);
+    if (!client) {
+        return;
+    }
+    size_t released = clientManager.shrinkBuffer(clientId);
+    if (released > 0) {
+        m_memory.count(CMemoryBudget::BUFFERS_SHRUNK);
+        m_memory.count(CMemoryBudget::BYTES_RELEASED, released);
+        m_memory.set(clientId, CMemoryBudget::RECEIVE, clientManager.bufferCapacity(clientId));
+    }
+    if (client->outbound) {
+        client->outbound->shrink();
+    }
+}
+
+size_t CServerSocket::residentBytes() {
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm) {
+        return 0;
+    }
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    if (fscanf(statm, "%lu %lu", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(statm);
+    return static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+void CServerSocket::deliverRemoteBroadcast(const CPacket& packet) {
+    std::map<uint8_t, COutboundQueue::Frame> frames;
+    broadcastFrames(packet, frames);
+}
+
+void CServerSocket::enableConfig(const CConfig& config) {
+    m_config = config;
+    m_workerPool.setThreadCount(static_cast<size_t>(m_config.values().workerThreads));
+    applyTunables();
+}
+
+void CServerSocket::applyTunables() {
+    // 这些参数在epoll线程中读取(批量上限除外，它是原子变量)，重新加载时直接替换
+    // 运行中用管理命令临时修改的同名参数(如 trace-rate)会被配置中的值覆盖
+    const ServerConfig& config = m_config.values();
+    m_readBuffer.resize(static_cast<size_t>(config.readSize));
+    COutboundQueue::setBatchBytes(static_cast<size_t>(config.writeBatchKb) * 1024);
+    m_joinReplay = static_cast<size_t>(config.joinReplay);
+    CTrace::configure(static_cast<uint32_t>(config.traceSample), "");
+    m_overload.setMemoryLimit(static_cast<size_t>(config.overloadRssMb) * 1024 * 1024);
+    m_memory.setLimits(static_cast<size_t>(config.memBudgetMb) * 1024 * 1024,
+        static_cast<size_t>(config.connMemMb) * 1024 * 1024);
+    m_latency.spinUs = config.latency.spinUs;
+    m_fanOut.setThreshold(static_cast<size_t>(config.fanOutThreshold));
+    m_sessions.setTimeout(static_cast<uint64_t>(config.sessionTimeoutS) * 1000);
+}
+
+std::string CServerSocket::describeConfig() const {
+    return m_config.describe();
+}
+
+std::string CServerSocket::reloadConfig() {
+    std::vector<std::string> applied;
+    std::vector<std::string> restartOnly;
+    if (!m_config.reload(applied, restartOnly)) {
+        return "error: reload failed, configuration unchanged (see server log)";
+    }
+    applyTunables();
+    for (const auto& change : applied) {
+        log("Config reloaded: " + change);
+    }
+    for (const auto& change : restartOnly) {
+        log("Config changed, takes effect after restart: " + change);
+    }
+    std::string summary = "reloaded: " + std::to_string(applied.size()) + " applied";
+    for (const auto& change : applied) {
+        summary += "\n  " + change;
+    }
+    summary += "\n" + std::to_string(restartOnly.size()) + " need a restart";
+    for (const auto& change : restartOnly) {
+        summary += "\n  " + change;
+    }
+    return summary;
+}
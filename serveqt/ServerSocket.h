@@ -2,6 +2,26 @@
 #include "Packet.h"
 #include "ClientManager.h"
 #include "CQueue.h"
+#include "Compressor.h"
+#include "ThreadPool.h"
+#include "HistoryLog.h"
+#include "Handoff.h"
+#include "Federation.h"
+#include "ChunkStore.h"
+#include "ShmTransport.h"
+#include "Listener.h"
+#include "Trace.h"
+#include "Capture.h"
+#include "Coroutine.h"
+#include "Connection.h"
+#include "Overload.h"
+#include "Latency.h"
+#include "Telemetry.h"
+#include "MemoryBudget.h"
+#include "FanOut.h"
+#include "Session.h"
+#include "Tls.h"
+#include "Config.h"
 
 // 前向声明
 class CCommand;
@@ -14,19 +34,18 @@ class CCommand;
 #include <arpa/inet.h>
 #include <sys/epoll.h>
 #include <memory>
+#include <set>
 #include <vector>
+#include <functional>
 
-#define MAX_EVENTS 1024 
-#define MAX_CLIENTS 100
-#define BUFFER_SIZE 2048
-#define DEFAULT_PORT 8080
+#define MAX_PACKET_SIZE (64 * 1024 * 1024)
 
 // 服务器Socket类 - 负责网络通信和客户端连接管理
 // 使用epoll进行高效的事件驱动I/O处理
 class CServerSocket
 {
 public:
-    CServerSocket(const std::string& ip = "127.0.0.1", int port = DEFAULT_PORT);
+    CServerSocket(const std::string& ip = "127.0.0.1", int port = 8080);
     ~CServerSocket();
 
     // 服务器生命周期管理
@@ -44,6 +63,101 @@ public:
 
     // 网络通信接口
     bool sendPacketToClient(int clientId, const CPacket& packet);
+    // 广播给所有已连接客户端，每种压缩编码只序列化/压缩一次
+    int broadcastPacket(const CPacket& packet, int excludeClientId = -1);
+    // 发送给指定的一组客户端，同样按编码共享帧
+    int multicastPacket(const CPacket& packet, const std::vector<int>& clientIds);
+
+    // 监听地址：start()之前调用，可以添加多个(IPv4、IPv6、Unix域socket)
+    // 一个都没有添加时监听构造函数指定的ip:port
+    bool addListener(const std::string& spec);
+
+    // 消息历史：start()之前调用，joinReplay为新连接自动回放的条数
+    void enableHistory(const std::string& directory, size_t joinReplay = 0);
+    // 记录一条广播消息，写入在线程池的历史串行队列中完成
+    void appendHistory(const CPacket& packet, int clientId);
+    // 向指定客户端回放历史，帧直接从映射内存发送
+    size_t replayHistoryLast(int clientId, size_t count);
+    size_t replayHistorySince(int clientId, uint64_t timestampMs, size_t maxCount);
+
+    // 热重启：start()之前调用
+    // 启动时若交接路径上有旧进程，接管其监听socket和全部客户端；之后在该路径上等待下一次交接
+    // 收到SIGUSR2时用restartArgv启动新进程，由新进程发起交接
+    void enableHotRestart(const std::string& handoffPath, const std::vector<std::string>& restartArgv);
+
+    // 集群：start()之前调用，nodeId从1开始，peers为其他节点的 host:port
+    void enableFederation(int nodeId, int federationPort, const std::vector<std::string>& peers);
+    CFederation& getFederation() { return m_federation; }
+    // 其他节点转发来的广播和历史，只在本地投递/记录
+    void deliverRemoteBroadcast(const CPacket& packet);
+    void recordRemoteHistory(const CPacket& packet, int clientId, uint64_t timestampMs);
+
+    // 共享内存传输：start()之前调用，同一台机器上的客户端连接该Unix域socket路径后改用共享内存收发
+    void enableShmTransport(const std::string& path);
+
+    // 分块存储：start()之前调用，spillDirectory为空时只使用内存
+    void enableChunkStore(const std::string& spillDirectory, size_t memoryLimit);
+    CChunkStore& getChunkStore() { return m_chunkStore; }
+
+    // 流量捕获：start()之前调用，记录所有入站帧供回放工具离线重放
+    void enableCapture(const std::string& path);
+
+    // 协程处理函数发送给单个客户端：co_await send(clientId, packet)，发送队列超过高水位时挂起
+    CConnection::SendAwaiter send(int clientId, const CPacket& packet);
+    CScheduler& getScheduler() { return m_scheduler; }
+
+    // 低延迟模式：start()之前调用
+    void enableLatencyMode(const LatencyOptions& options);
+    std::string describeLatency();                     // 管理命令 "latency"
+    void resetLatency();
+
+    // 过载控制：start()之前可以设置内存上限
+    COverloadController& getOverload() { return m_overload; }
+    // 连接缓冲区的内存记账和上限
+    CMemoryBudget& getMemoryBudget() { return m_memory; }
+    // 连接统计(管理命令 "stats")
+    CTelemetry& getTelemetry() { return m_telemetry; }
+
+    // 并行扇出：start()之前调用，partitions为0时不启用，为 CFanOut::AUTO_PARTITIONS 时每个工作线程一个分区
+    void enableFanOut(size_t partitions, size_t threshold);
+    CFanOut& getFanOut() { return m_fanOut; }
+
+    // TLS：start()之前调用，"tls:"前缀的监听地址使用该证书；ktls为false时不尝试让内核加解密
+    void enableTls(const std::string& certFile, const std::string& keyFile, bool ktls);
+    std::string describeTls() const;                   // 管理命令 "tls"
+
+    // 可靠会话：start()之前调用，window为每个会话重传窗口的字节上限，为0时不启用
+    void enableSessions(size_t window, uint64_t timeoutMs);
+    CSessionTable& getSessions() { return m_sessions; }
+    // 新建会话或按令牌恢复(SESSION命令)，回复和需要重发的帧直接放入发送队列
+    bool openSession(int clientId, const std::string& token, uint64_t ack);
+
+    // 运行参数：start()之前调用，保存配置并应用其中可重载的参数；未调用时使用 ServerConfig 的默认值
+    void enableConfig(const CConfig& config);
+    std::string describeConfig() const;                // 管理命令 "config"
+    // 重新读取配置文件(SIGHUP、管理命令 "config-reload")，返回结果摘要
+    std::string reloadConfig();
+
+    // 在该客户端的串行队列中执行后台任务，done回到epoll线程执行，与该客户端的广播保持顺序
+    void runOffloaded(int clientId, CThreadPool::Task work, std::function<void()> done);
+    // 协程处理函数中的阻塞操作(读盘等)：co_await offload(clientId, work)，work完成后在epoll线程恢复
+    auto offload(int clientId, CThreadPool::Task work) {
+        struct Awaiter {
+            CServerSocket& server;
+            int clientId;
+            CThreadPool::Task work;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) {
+                CScheduler* scheduler = &server.m_scheduler;
+                server.runOffloaded(clientId, std::move(work), [scheduler, handle] { scheduler->post(handle); });
+            }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{ *this, clientId, std::move(work) };
+    }
+
+    // 超过 MAX_BULK_FRAME 的文件数据拆成多个帧，调度器只在帧边界切换类别
+    static void appendSplitPacket(std::vector<CPacket>& packets, const CPacket& packet);
 
     // 获取Command实例的引用，用于设置ServerSocket指针
     CCommand* getCommand();
@@ -51,29 +165,157 @@ public:
 private:
     bool m_running;                                    // 服务器运行状态
     std::unique_ptr<CCommand> m_command;               // 命令处理器
-    int m_listenFd;                                    // 监听socket文件描述符
+    std::vector<ListenEndpoint> m_endpoints;           // 配置的监听地址
+    std::vector<CListener> m_listeners;                // 监听socket
     int m_epollFd;                                     // epoll实例文件描述符
     int m_port;                                        // 服务器端口
     int m_nextClientId;                                // 下一个客户端ID
     std::string m_ip;                                  // 服务器IP地址
+    CThreadPool m_workerPool;                          // 重负载命令的工作线程池
+    CCompletionQueue m_completions;                    // 工作线程结果投递回epoll线程
+    std::map<int, int> m_pendingOffload;               // clientId -> 尚未完成的后台任务数
+    CHistoryLog m_history;                             // 消息历史日志
+    std::string m_historyDir;                          // 历史目录，为空时不记录
+    size_t m_joinReplay;                               // 新连接自动回放的历史条数
+    int m_signalFd;                                    // signalfd，在epoll线程中处理信号
+    std::string m_handoffPath;                         // 热重启交接路径，为空时不启用
+    std::vector<std::string> m_restartArgv;            // SIGUSR2时启动新进程的命令行
+    int m_handoffFd;                                   // 交接监听socket
+    pid_t m_replacementPid;                            // SIGUSR2启动的新进程，-1为没有
+    bool m_handedOff;                                  // 已把连接交给新进程
+    CFederation m_federation;                          // 集群链路
+    CChunkStore m_chunkStore;                          // 文件分块存储
+    std::string m_chunkDir;                            // 分块淘汰目录
+    size_t m_chunkMemoryLimit;                         // 分块内存上限
+    std::string m_shmPath;                             // 共享内存握手路径，为空时不启用
+    int m_shmListenFd;                                 // 共享内存握手监听socket
+    std::map<int, std::unique_ptr<CShmChannel>> m_shmClients; // 握手连接 -> 共享内存通道
+    std::map<int, int> m_shmBells;                     // 门铃eventfd -> 握手连接
+    std::string m_capturePath;                         // 流量捕获文件，为空时不捕获
+    CCaptureWriter m_capture;                          // 流量捕获
+    CScheduler m_scheduler;                            // 协程就绪队列和定时器
+    std::map<int, std::shared_ptr<CConnection>> m_connections; // clientId -> 连接协程
+    COverloadController m_overload;                    // 过载控制
+    uint64_t m_overloadTickDue;                        // 下一次采样的预定时间，实际时间与之的差即循环延迟
+    std::map<int, uint64_t> m_throttledUntil;          // clientId -> 暂停读取到期时间(流量最大的客户端)
+    std::set<int> m_deferringBulk;                     // 正在推迟文件数据的客户端，期间不读取
+    std::set<int> m_readsPaused;                       // 当前已从epoll去掉EPOLLIN的客户端
+    CMemoryBudget m_memory;                            // 连接缓冲区内存记账
+    CTelemetry m_telemetry;                            // 连接统计和慢速接收方判定
+    LatencyOptions m_latency;                          // 低延迟模式
+    uint64_t m_spinWakeups;                            // 自旋期间取到事件的次数
+    uint64_t m_blockingWakeups;                        // 阻塞等待后取到事件的次数
+    bool m_busyPollFailed;                             // SO_BUSY_POLL设置失败后不再尝试
+    CFanOut m_fanOut;                                  // 大规模广播的分区并行扇出
+    std::vector<int> m_deferredCloses;                 // 并行扇出进行期间断开的socket，完成后关闭
+    CSessionTable m_sessions;                          // 可靠会话
+    CTlsContext m_tls;                                 // TLS证书和配置
+    std::string m_tlsCert;                             // 证书链文件，为空时不启用TLS
+    std::string m_tlsKey;                              // 私钥文件
+    bool m_ktls;                                       // 握手后尝试把密钥交给内核
+    struct TlsHandshake {
+        std::string ip;
+        int port;
+        uint64_t serial;                               // 区分复用同一fd的连接(握手超时检查)
+    };
+    std::map<int, TlsHandshake> m_tlsHandshakes;       // 握手中的socket -> 对端地址
+    std::map<int, std::unique_ptr<CTlsConnection>> m_tlsClients; // socket -> TLS状态(握手中和已建立)
+    uint64_t m_tlsSerial;
+    CConfig m_config;                                  // 运行参数
+    std::vector<char> m_readBuffer;                    // 每次recv的缓冲区(read-size)
+
+    static const uint64_t HISTORY_STRAND = UINT64_MAX; // 历史写入的串行队列
+    static const int HANDOFF_TIMEOUT_MS = 10000;       // 交接时等待后台任务/确认的时间
 
     // 服务器初始化
     bool initialize();
+    bool openListeners(HandoffState& inherited);       // 接管或新建全部监听socket
+    CListener* findListener(int fd);
+    bool setupSignals();                               // 阻塞信号并创建signalfd
+    void applyTunables();                              // 应用配置中可重载的参数
+
+    // 信号与热重启
+    void handleSignal();
+    void spawnReplacement();                           // SIGUSR2：启动新进程
+    void handleHandoffRequest();                       // 新进程请求接管
+    bool drainForHandoff(int timeoutMs);               // 等待后台任务和历史写入完成
+    void adoptClients(const HandoffState& state);      // 接管旧进程的客户端
+    void setIoPaused(bool paused);                     // 交接期间停止读取监听socket和客户端
+
+    // 过载控制
+    void overloadTick();                               // 每个采样周期：更新级别、执行降载措施
+    void updateReadInterest(int clientId);             // 按暂停状态设置该客户端是否读取
+    static size_t residentBytes();                     // 进程常驻内存
+
+    int waitEvents(struct epoll_event* events, int maxEvents); // 按低延迟模式自旋或阻塞等待事件
+    void federationTick();
+    void telemetryTick();                              // 分批采样连接统计，向支持的客户端发送探测
+
+    // 内存预算
+    void memoryTick();                                 // 定期释放空闲连接的缓冲区
+    void releaseBuffers(int clientId);
+    void chargeOutbound(int clientId, int clientSocket, const COutboundQueue& outbound);
+
+    // 可靠会话
+    void sessionTick();                                // 删除超时的断线会话
+    void detachSession(int clientId);                  // 连接断开：未发出的帧记入窗口，会话等待重连
+    void recordDetached(const CPacket& packet, std::map<uint8_t, COutboundQueue::Frame>& frames); // 广播记入断线会话
 
     // 日志记录
     void log(const std::string message) const;
 
+    // 写入历史日志(在历史串行队列中执行)
+    void writeHistory(const CPacket& packet, int clientId, uint64_t timestampMs);
+
     // Socket配置
     void setNonBlocking(int fd);
+    void configureClientSocket(int fd);                // 非阻塞 + 配置中的socket选项
 
     // 客户端连接管理
-    void handleNewConnection();                        // 处理新连接
+    void handleNewConnection(CListener& listener);     // 处理新连接
+    void handleShmConnection();                        // 处理共享内存握手
+    void startTlsHandshake(int clientSocket, const std::string& ip, int port);
+    void continueTlsHandshake(int clientSocket);       // 握手完成后登记为客户端
+    void closeTlsHandshake(int clientSocket);          // 握手失败或超时
+    bool registerClient(int clientSocket, const std::string& ip, int port); // 分配ID并登记，没有可用ID时关闭连接
+    int allocateClientId();                            // 没有可用ID时返回-1
+    void releaseShmClient(int clientSocket);           // 释放共享内存通道(同时关闭握手连接)
     void addClientToEpoll(int clientSocket);          // 添加客户端到epoll
     void removeClientFromEpoll(int clientSocket);     // 从epoll移除客户端
 
     // 客户端数据处理
     void handleClientData(int clientSocket);          // 处理客户端数据
+    // 解析接收缓冲区中收全的帧；bytesRead为0表示重新解析交接时放回的帧(已经记录过，不再计入抓包和统计)
+    void processReceived(int clientSocket, int clientId, size_t bytesRead);
+    ssize_t readClient(int clientSocket, char* buffer, size_t size); // socket或共享内存，语义同recv
     void handleClientDisconnect(int clientSocket);    // 处理客户端断开
-    void handlePacket(int clientSocket, const CPacket& packet); // 处理数据包
+    // 处理数据包；协程处理函数的任务放入continuation，由连接的协程等待
+    void handlePacket(int clientSocket, const CPacket& packet, CTask<int>* continuation = nullptr);
+    void openConnection(int clientSocket, int clientId);   // 创建连接对象并启动其协程
+    CTask<> serveConnection(std::shared_ptr<CConnection> connection); // 按顺序处理该连接的帧
+    void deliverPacket(int clientSocket, int clientId, const CPacket& packet); // 交给连接的协程
+
+    // 数据发送
+    // 广播一组数据包：重负载命令或该客户端仍有后台任务时交给线程池编码，保证同一客户端的顺序
+    void fanOut(int clientId, std::vector<CPacket> packets, bool offload);
+    int broadcastFrames(const CPacket& packet, std::map<uint8_t, COutboundQueue::Frame>& frames, int excludeClientId = -1);
+    COutboundQueue::Frame encodeFrame(const CPacket& packet, CCompressor::Codec codec) const; // 按编码序列化
+    // 已序列化的帧放入该客户端的发送队列并尽量写出
+    bool sendFrame(int clientId, int clientSocket, const COutboundQueue::Frame& frame);
+    bool sendFrame(int clientId, int clientSocket, const char* data, size_t size);
+    bool flushClient(int clientSocket);                // 写出发送队列(EPOLLOUT)
+
+    // 并行扇出
+    using FrameSet = std::map<uint8_t, COutboundQueue::Frame>;
+    void refreshFanOut();                              // 客户端变化后重建分区快照
+    // 每个非空分区提交一个任务，返回接收方数
+    int submitFanOut(const std::vector<CFanOut::Partition>& partitions, const FrameSet& frames, int excludeClientId);
+    void submitPartition(size_t index, CFanOut::Partition members, std::shared_ptr<const FrameSet> frames,
+        int excludeClientId, std::function<void()> done);
+    // 回到epoll线程：更新内存记账、唤醒等待发送的协程，全部完成后关闭延迟的socket
+    void finishPartition(const std::vector<std::pair<int, bool>>& followUps);
+    // 只能在epoll线程写出的连接(共享内存、用户态加密的TLS)不进入分区，直接发送
+    bool directWrite(int clientSocket) const;
+    int sendToDirectClients(const CPacket& packet, FrameSet& frames, int excludeClientId);
 };
 
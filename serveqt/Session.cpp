@@ -0,0 +1,243 @@
+#include "Session.h"
+#include <random>
+#include <sstream>
+#include <sys/random.h>
+
+CSession::CSession(const std::string& token, size_t windowLimit)
+    : m_token(token), m_limit(windowLimit), m_bytes(0), m_nextSeq(1), m_firstSeq(1), m_dropped(0),
+    m_detached(false)
+{
+}
+
+uint64_t CSession::record(const Frame& frame)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return recordLocked(frame);
+}
+
+bool CSession::recordDetached(const Frame& frame)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_detached) {
+        return false;
+    }
+    recordLocked(frame);
+    return true;
+}
+
+void CSession::setDetached(bool detached)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_detached = detached;
+}
+
+uint64_t CSession::recordLocked(const Frame& frame)
+{
+    uint64_t seq = m_nextSeq++;
+    m_window.emplace_back(seq, frame);
+    m_bytes += frame->size();
+    // 超过上限时丢弃最旧的帧，至少保留刚记录的一帧
+    while (m_bytes > m_limit && m_window.size() > 1) {
+        m_bytes -= m_window.front().second->size();
+        m_window.pop_front();
+        m_dropped++;
+    }
+    m_firstSeq = m_window.front().first;
+    return seq;
+}
+
+bool CSession::ack(uint64_t seq)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (seq >= m_nextSeq) {
+        return false;
+    }
+    trimTo(seq);
+    return true;
+}
+
+bool CSession::canResume(uint64_t ack) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return ack < m_nextSeq && ack + 1 >= m_firstSeq;
+}
+
+std::vector<CSession::Frame> CSession::resumeFrom(uint64_t ack)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    trimTo(ack);
+    std::vector<Frame> frames;
+    frames.reserve(m_window.size());
+    for (const auto& item : m_window) {
+        frames.push_back(item.second);
+    }
+    return frames;
+}
+
+void CSession::trimTo(uint64_t seq)
+{
+    while (!m_window.empty() && m_window.front().first <= seq) {
+        m_bytes -= m_window.front().second->size();
+        m_window.pop_front();
+    }
+    m_firstSeq = m_window.empty() ? m_nextSeq : m_window.front().first;
+}
+
+uint64_t CSession::nextSeq() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_nextSeq;
+}
+
+size_t CSession::windowBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+size_t CSession::windowFrames() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_window.size();
+}
+
+uint64_t CSession::dropped() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+CSessionTable::CSessionTable()
+    : m_window(0), m_timeoutMs(DEFAULT_TIMEOUT_MS),
+    m_created(0), m_resumed(0), m_resumeFailures(0), m_expired(0), m_retransmitted(0)
+{
+}
+
+void CSessionTable::configure(size_t window, uint64_t timeoutMs)
+{
+    m_window = window;
+    m_timeoutMs = timeoutMs;
+}
+
+std::string CSessionTable::randomToken()
+{
+    std::string token(CSession::TOKEN_SIZE, '\0');
+    if (getrandom(&token[0], token.size(), 0) != static_cast<ssize_t>(token.size())) {
+        std::random_device device;
+        for (auto& byte : token) {
+            byte = static_cast<char>(device() & 0xFF);
+        }
+    }
+    return token;
+}
+
+std::shared_ptr<CSession> CSessionTable::create(int clientId)
+{
+    std::string token;
+    do {
+        token = randomToken();
+    } while (m_detached.count(token) != 0 || ownerOf(token) != -1);
+
+    auto session = std::make_shared<CSession>(token, m_window);
+    session->clientId = clientId;
+    session->originalId = clientId;
+    m_attached[clientId] = session;
+    m_created++;
+    return session;
+}
+
+std::shared_ptr<CSession> CSessionTable::find(int clientId) const
+{
+    auto it = m_attached.find(clientId);
+    return it != m_attached.end() ? it->second : nullptr;
+}
+
+int CSessionTable::ownerOf(const std::string& token) const
+{
+    for (const auto& pair : m_attached) {
+        if (pair.second->token() == token) {
+            return pair.first;
+        }
+    }
+    return -1;
+}
+
+std::shared_ptr<CSession> CSessionTable::detach(int clientId, uint64_t nowMs)
+{
+    auto it = m_attached.find(clientId);
+    if (it == m_attached.end()) {
+        return nullptr;
+    }
+    std::shared_ptr<CSession> session = it->second;
+    m_attached.erase(it);
+    session->previousId = session->clientId;
+    session->clientId = -1;
+    session->detachedAtMs = nowMs;
+    session->setDetached(true);
+    m_detached[session->token()] = session;
+    return session;
+}
+
+std::shared_ptr<CSession> CSessionTable::take(const std::string& token)
+{
+    auto it = m_detached.find(token);
+    if (it == m_detached.end()) {
+        return nullptr;
+    }
+    std::shared_ptr<CSession> session = it->second;
+    m_detached.erase(it);
+    return session;
+}
+
+void CSessionTable::bind(int clientId, const std::shared_ptr<CSession>& session)
+{
+    session->clientId = clientId;
+    session->detachedAtMs = 0;
+    session->setDetached(false);
+    m_attached[clientId] = session;
+}
+
+size_t CSessionTable::expire(uint64_t nowMs)
+{
+    size_t expired = 0;
+    for (auto it = m_detached.begin(); it != m_detached.end();) {
+        if (nowMs - it->second->detachedAtMs >= m_timeoutMs) {
+            it = m_detached.erase(it);
+            expired++;
+        }
+        else {
+            ++it;
+        }
+    }
+    m_expired += expired;
+    return expired;
+}
+
+std::string CSessionTable::describe() const
+{
+    std::ostringstream out;
+    if (!enabled()) {
+        out << "sessions: disabled";
+        return out.str();
+    }
+    size_t frames = 0;
+    size_t bytes = 0;
+    uint64_t dropped = 0;
+    auto add = [&](const CSession& session) {
+        frames += session.windowFrames();
+        bytes += session.windowBytes();
+        dropped += session.dropped();
+    };
+    for (const auto& pair : m_attached) {
+        add(*pair.second);
+    }
+    for (const auto& pair : m_detached) {
+        add(*pair.second);
+    }
+    out << "sessions: " << m_attached.size() << " attached, " << m_detached.size() << " detached (window "
+        << m_window << " bytes, timeout " << m_timeoutMs / 1000 << " s)\n"
+        << "retransmit windows " << frames << " frames / " << bytes << " bytes, " << dropped << " frames dropped unacked\n"
+        << "created " << m_created << ", resumed " << m_resumed << ", resume failures " << m_resumeFailures
+        << ", expired " << m_expired << ", retransmitted " << m_retransmitted << " frames";
+    return out.str();
+}
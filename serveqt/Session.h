@@ -0,0 +1,126 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 可靠会话 - 客户端断线重连后从最后确认的位置继续接收，不需要全量重新同步
+// 帧头没有序号字段，广播帧又由多个接收方共享，因此序号是隐式的：
+// 会话回复之后写给该连接的帧按写出顺序依次编号(回复中给出第一个序号)，
+// 帧被发送队列调度时记入重传窗口，窗口中保存的是共享的帧，不另外复制
+// 客户端累计确认，窗口丢弃已确认的帧；窗口超过上限时丢弃最旧的帧，此后确认号落在被丢弃范围内的重连无法恢复
+// 记录和确认可能来自工作线程(并行扇出中的写出)，窗口操作加锁；身份信息只在epoll线程使用
+class CSession
+{
+public:
+    using Frame = std::shared_ptr<const std::string>;
+
+    static const size_t TOKEN_SIZE = 16;
+
+    CSession(const std::string& token, size_t windowLimit);
+
+    const std::string& token() const { return m_token; }
+
+    // 记录一帧，返回分配的序号
+    uint64_t record(const Frame& frame);
+    // 断开的连接(进行中的并行扇出)入队的帧：只在会话仍处于断线状态时记录，已被新连接恢复时返回false
+    bool recordDetached(const Frame& frame);
+    // 断线/恢复(CSessionTable::detach/bind)
+    void setDetached(bool detached);
+    // 累计确认，seq超过已记录的最大序号时返回false
+    bool ack(uint64_t seq);
+    // 确认号之后的帧是否都还在窗口中
+    bool canResume(uint64_t ack) const;
+    // 重连：丢弃确认号及之前的帧，返回需要重发的帧(按序号)
+    std::vector<Frame> resumeFrom(uint64_t ack);
+
+    uint64_t nextSeq() const;
+    size_t windowBytes() const;
+    size_t windowFrames() const;
+    uint64_t dropped() const;                  // 未确认就被挤出窗口的帧数
+
+    // 身份信息(epoll线程)
+    int clientId = -1;                         // 当前连接的客户端ID
+    int originalId = -1;                       // 创建会话的客户端ID
+    int previousId = -1;                       // 断线前连接的客户端ID
+    uint8_t codec = 0;
+    uint8_t features = 0;
+    std::string username;
+    uint64_t detachedAtMs = 0;                 // 断线时间，0表示在线
+    uint32_t resumes = 0;
+
+private:
+    const std::string m_token;
+    const size_t m_limit;
+    mutable std::mutex m_mutex;
+    std::deque<std::pair<uint64_t, Frame>> m_window;
+    size_t m_bytes;
+    uint64_t m_nextSeq;                        // 下一帧的序号，从1开始
+    uint64_t m_firstSeq;                       // 窗口中第一帧的序号(窗口为空时等于m_nextSeq)
+    uint64_t m_dropped;
+    bool m_detached;                           // 与 detachedAtMs 对应，工作线程在锁内读取
+
+    uint64_t recordLocked(const Frame& frame); // 持有锁
+    void trimTo(uint64_t seq);                 // 丢弃序号不超过seq的帧(持有锁)
+};
+
+// 全部会话：在线的按客户端ID索引，断线的按令牌索引并在超时后删除
+// 只在epoll线程中使用
+class CSessionTable
+{
+public:
+    static const size_t DEFAULT_WINDOW = 4 * 1024 * 1024;   // 每个会话重传窗口的字节上限
+    static const uint64_t DEFAULT_TIMEOUT_MS = 60 * 1000;   // 断线会话保留时间
+    static const uint64_t CHECK_MS = 1000;                  // 超时检查周期
+
+    CSessionTable();
+
+    // window为0时不启用
+    void configure(size_t window, uint64_t timeoutMs);
+    bool enabled() const { return m_window > 0; }
+    // 断线会话的保留时间可以在运行中修改，下一次超时检查生效
+    void setTimeout(uint64_t timeoutMs) { m_timeoutMs = timeoutMs; }
+
+    // 新建会话并绑定到客户端
+    std::shared_ptr<CSession> create(int clientId);
+    std::shared_ptr<CSession> find(int clientId) const;
+    // 令牌对应的在线会话所在的客户端ID(旧连接还未检测到断开)，没有时返回-1
+    int ownerOf(const std::string& token) const;
+
+    // 连接断开：会话转为断线状态，等待重连
+    std::shared_ptr<CSession> detach(int clientId, uint64_t nowMs);
+    // 按令牌取出断线的会话，没有或已失效时返回nullptr
+    std::shared_ptr<CSession> take(const std::string& token);
+    // 恢复成功后绑定到新连接
+    void bind(int clientId, const std::shared_ptr<CSession>& session);
+
+    // 断线的会话，广播期间不在线的会话也要记录帧
+    const std::map<std::string, std::shared_ptr<CSession>>& detached() const { return m_detached; }
+    // 删除超时的断线会话，返回删除数
+    size_t expire(uint64_t nowMs);
+
+    // 统计
+    void recordResume(bool resumed) { resumed ? m_resumed++ : m_resumeFailures++; }
+    void recordRetransmit(size_t frames) { m_retransmitted += frames; }
+
+    // 管理命令 "sessions"
+    std::string describe() const;
+
+private:
+    size_t m_window;
+    uint64_t m_timeoutMs;
+    std::map<int, std::shared_ptr<CSession>> m_attached;
+    std::map<std::string, std::shared_ptr<CSession>> m_detached;
+
+    uint64_t m_created;
+    uint64_t m_resumed;
+    uint64_t m_resumeFailures;
+    uint64_t m_expired;
+    uint64_t m_retransmitted;
+
+    static std::string randomToken();
+};
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// SHA-256 (FIPS 180-4)，分块内容寻址用
+class CSha256
+{
+public:
+    static const size_t DIGEST_SIZE = 32;
+
+    CSha256();
+
+    void update(const void* data, size_t size);
+    void final(uint8_t digest[DIGEST_SIZE]);
+
+    // 一次性计算，返回32字节二进制摘要
+    static std::string digest(const void* data, size_t size);
+    static std::string toHex(const std::string& digest);
+
+private:
+    uint32_t m_state[8];
+    uint64_t m_length;         // 已处理的字节数
+    uint8_t m_block[64];
+    size_t m_blockSize;
+
+    void transform(const uint8_t* block);
+};
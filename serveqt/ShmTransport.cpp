@@ -0,0 +1,387 @@
+#include "ShmTransport.h"
+#include <algorithm>
+#include <iostream>
+#include <new>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+static const size_t CONTROL_SIZE = 64;                 // 控制块，之后依次是两个环
+static const size_t MAX_RING_SIZE = 256 * 1024 * 1024;
+
+void CShmRing::attach(void* base, size_t capacity, bool initialize)
+{
+    m_header = static_cast<Header*>(base);
+    m_data = static_cast<char*>(base) + sizeof(Header);
+    m_capacity = capacity;
+    m_position = 0;
+    m_broken = false;
+    if (initialize) {
+        new (m_header) Header();
+        m_header->head.store(0);
+        m_header->tail.store(0);
+        // 消费者一开始就在等待，第一次写入要敲门铃
+        m_header->consumerWaiting.store(1);
+        m_header->producerWaiting.store(0);
+    }
+}
+
+// 消费者调用：对方写入的head只读取一次
+size_t CShmRing::readable()
+{
+    uint64_t used = m_header->head.load(std::memory_order_acquire) - m_position;
+    if (m_broken || used > m_capacity) {
+        m_broken = true;
+        return 0;
+    }
+    return static_cast<size_t>(used);
+}
+
+// 生产者调用：对方写入的tail只读取一次
+size_t CShmRing::writable()
+{
+    uint64_t used = m_position - m_header->tail.load(std::memory_order_acquire);
+    if (m_broken || used > m_capacity) {
+        m_broken = true;
+        return 0;
+    }
+    return m_capacity - static_cast<size_t>(used);
+}
+
+size_t CShmRing::write(const struct iovec* iov, int count)
+{
+    uint64_t head = m_position;
+    size_t space = writable();
+    size_t written = 0;
+    for (int i = 0; i < count && space > 0; ++i) {
+        const char* src = static_cast<const char*>(iov[i].iov_base);
+        size_t len = std::min(iov[i].iov_len, space);
+        // 回绕时分两段拷贝
+        size_t pos = static_cast<size_t>(head + written) & (m_capacity - 1);
+        size_t first = std::min(len, m_capacity - pos);
+        memcpy(m_data + pos, src, first);
+        memcpy(m_data, src + first, len - first);
+        written += len;
+        space -= len;
+    }
+    if (written > 0) {
+        m_position = head + written;
+        m_header->head.store(m_position, std::memory_order_release);
+    }
+    return written;
+}
+
+size_t CShmRing::read(void* buffer, size_t size)
+{
+    uint64_t tail = m_position;
+    size_t len = std::min(size, readable());
+    if (len == 0) {
+        return 0;
+    }
+    size_t pos = static_cast<size_t>(tail) & (m_capacity - 1);
+    size_t first = std::min(len, m_capacity - pos);
+    memcpy(buffer, m_data + pos, first);
+    memcpy(static_cast<char*>(buffer) + first, m_data, len - first);
+    m_position = tail + len;
+    m_header->tail.store(m_position, std::memory_order_release);
+    return len;
+}
+
+CShmChannel::CShmChannel()
+    : m_socket(-1), m_localBell(-1), m_remoteBell(-1), m_base(nullptr), m_mapSize(0)
+{
+}
+
+CShmChannel::~CShmChannel()
+{
+    close();
+}
+
+int CShmChannel::listen(const std::string& path)
+{
+    struct sockaddr_un addr;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "[Shm] Socket path too long: " << path << std::endl;
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size());
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        std::cerr << "[Shm] socket failed: " << strerror(errno) << std::endl;
+        return -1;
+    }
+    // 上一个进程留下的socket文件(热重启时由新进程接替)
+    // listen之前无法连接，在此之间把权限收紧到只有本用户可以连接
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1 || chmod(path.c_str(), 0600) == -1 ||
+        ::listen(fd, SOMAXCONN) == -1) {
+        std::cerr << "[Shm] Failed to listen on " << path << ": " << strerror(errno) << std::endl;
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool CShmChannel::map(int memfd, size_t ringSize, bool server, bool initialize)
+{
+    m_mapSize = CONTROL_SIZE + 2 * CShmRing::footprint(ringSize);
+    m_base = mmap(nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (m_base == MAP_FAILED) {
+        std::cerr << "[Shm] mmap failed: " << strerror(errno) << std::endl;
+        m_base = nullptr;
+        return false;
+    }
+
+    char* toServer = static_cast<char*>(m_base) + CONTROL_SIZE;
+    char* toClient = toServer + CShmRing::footprint(ringSize);
+    m_rx.attach(server ? toServer : toClient, ringSize, initialize);
+    m_tx.attach(server ? toClient : toServer, ringSize, initialize);
+    return true;
+}
+
+bool CShmChannel::accept(int listenFd, size_t ringSize)
+{
+    m_socket = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (m_socket == -1) {
+        std::cerr << "[Shm] accept failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    // 只与本用户(或root)的进程共享内存
+    struct ucred peer = {};
+    socklen_t peerLength = sizeof(peer);
+    if (getsockopt(m_socket, SOL_SOCKET, SO_PEERCRED, &peer, &peerLength) == -1 ||
+        (peer.uid != geteuid() && peer.uid != 0)) {
+        std::cerr << "[Shm] Rejected connection from uid " << peer.uid << std::endl;
+        return false;
+    }
+
+    // 交给客户端之前封住大小：客户端把文件截短会让服务器访问映射时收到SIGBUS
+    int memfd = memfd_create("serveqt-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memfd == -1 || ftruncate(memfd, CONTROL_SIZE + 2 * CShmRing::footprint(ringSize)) == -1 ||
+        fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1 ||
+        !map(memfd, ringSize, true, true)) {
+        std::cerr << "[Shm] Failed to create shared memory: " << strerror(errno) << std::endl;
+        if (memfd != -1) {
+            ::close(memfd);
+        }
+        return false;
+    }
+    Control* control = static_cast<Control*>(m_base);
+    control->magic = MAGIC;
+    control->ringSize = static_cast<uint32_t>(ringSize);
+
+    m_localBell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_remoteBell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_localBell == -1 || m_remoteBell == -1) {
+        std::cerr << "[Shm] eventfd failed: " << strerror(errno) << std::endl;
+        ::close(memfd);
+        return false;
+    }
+
+    // 控制块 + 描述符：共享内存、客户端门铃、服务器门铃
+    int fds[3] = { memfd, m_remoteBell, m_localBell };
+    char cmsgBuffer[CMSG_SPACE(sizeof(fds))];
+    memset(cmsgBuffer, 0, sizeof(cmsgBuffer));
+    struct iovec iov = { control, sizeof(Control) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsgBuffer;
+    msg.msg_controllen = sizeof(cmsgBuffer);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    bool sent = sendmsg(m_socket, &msg, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(Control));
+    if (!sent) {
+        std::cerr << "[Shm] Failed to send shared memory to client: " << strerror(errno) << std::endl;
+    }
+    // 映射建立后不再需要memfd
+    ::close(memfd);
+    return sent;
+}
+
+bool CShmChannel::connect(const std::string& path)
+{
+    struct sockaddr_un addr;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size());
+
+    m_socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_socket == -1 || ::connect(m_socket, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1) {
+        std::cerr << "[Shm] Failed to connect to " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    Control control;
+    int fds[3];
+    char cmsgBuffer[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = { &control, sizeof(control) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsgBuffer;
+    msg.msg_controllen = sizeof(cmsgBuffer);
+    if (recvmsg(m_socket, &msg, MSG_CMSG_CLOEXEC) != static_cast<ssize_t>(sizeof(control)) || (msg.msg_flags & MSG_CTRUNC)) {
+        std::cerr << "[Shm] Handshake failed" << std::endl;
+        return false;
+    }
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        std::cerr << "[Shm] Handshake carried no descriptors" << std::endl;
+        return false;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    m_localBell = fds[1];
+    m_remoteBell = fds[2];
+
+    size_t ringSize = control.ringSize;
+    bool valid = control.magic == MAGIC && ringSize > 0 && ringSize <= MAX_RING_SIZE && (ringSize & (ringSize - 1)) == 0;
+    bool mapped = valid && map(fds[0], ringSize, false, false);
+    ::close(fds[0]);
+    if (!mapped) {
+        std::cerr << "[Shm] Invalid shared memory from server" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void CShmChannel::ring()
+{
+    uint64_t one = 1;
+    ssize_t ignored = write(m_remoteBell, &one, sizeof(one));
+    (void)ignored;
+}
+
+void CShmChannel::clearBell()
+{
+    uint64_t value;
+    ssize_t ignored = read(m_localBell, &value, sizeof(value));
+    (void)ignored;
+}
+
+bool CShmChannel::waitBell(int timeoutMs)
+{
+    struct pollfd fds[2] = { { m_localBell, POLLIN, 0 }, { m_socket, POLLIN, 0 } };
+    if (poll(fds, 2, timeoutMs) <= 0) {
+        return false;
+    }
+    clearBell();
+    return true;
+}
+
+ssize_t CShmChannel::send(const void* data, size_t size)
+{
+    struct iovec iov = { const_cast<void*>(data), size };
+    return send(&iov, 1);
+}
+
+ssize_t CShmChannel::send(const struct iovec* iov, int count)
+{
+    if (!m_base) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    CShmRing::Header* header = m_tx.header();
+    size_t written = m_tx.write(iov, count);
+    if (m_tx.broken()) {
+        errno = EPROTO;
+        return -1;
+    }
+    if (written == 0) {
+        // 环已满：先登记等待再检查一次，消费者在两者之间读走数据时不会漏掉门铃
+        header->producerWaiting.store(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        written = m_tx.write(iov, count);
+        if (written == 0) {
+            errno = m_tx.broken() ? EPROTO : EAGAIN;
+            return -1;
+        }
+        header->producerWaiting.store(0);
+    }
+
+    // 对方读空后在等待时才需要敲门铃
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (header->consumerWaiting.exchange(0) != 0) {
+        ring();
+    }
+    return static_cast<ssize_t>(written);
+}
+
+ssize_t CShmChannel::recv(void* buffer, size_t size)
+{
+    if (!m_base) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    CShmRing::Header* header = m_rx.header();
+    size_t received = m_rx.read(buffer, size);
+    if (m_rx.broken()) {
+        errno = EPROTO;
+        return -1;
+    }
+    if (received == 0) {
+        header->consumerWaiting.store(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        received = m_rx.read(buffer, size);
+        if (m_rx.broken()) {
+            errno = EPROTO;
+            return -1;
+        }
+        if (received == 0) {
+            // 环为空时检查握手连接，对方已关闭返回0；关闭前写入的数据先读完
+            char byte;
+            if (::recv(m_socket, &byte, 1, MSG_DONTWAIT | MSG_PEEK) == 0) {
+                received = m_rx.read(buffer, size);
+                return static_cast<ssize_t>(received);
+            }
+            errno = EAGAIN;
+            return -1;
+        }
+        header->consumerWaiting.store(0);
+    }
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (header->producerWaiting.exchange(0) != 0) {
+        ring();
+    }
+    return static_cast<ssize_t>(received);
+}
+
+void CShmChannel::close()
+{
+    if (m_base) {
+        munmap(m_base, m_mapSize);
+        m_base = nullptr;
+    }
+    if (m_localBell != -1) {
+        ::close(m_localBell);
+        m_localBell = -1;
+    }
+    if (m_remoteBell != -1) {
+        ::close(m_remoteBell);
+        m_remoteBell = -1;
+    }
+    if (m_socket != -1) {
+        ::close(m_socket);
+        m_socket = -1;
+    }
+}
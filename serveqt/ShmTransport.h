@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// 共享内存环形缓冲区 - 单生产者单消费者的字节流，帧格式与TCP相同
+// 生产者只写head，消费者只写tail；等待标志用于决定是否需要敲门铃(eventfd)，
+// 对方没有在等待时读写都不经过内核
+// 共享内存对方可以任意改写：本端的位置只以私有副本为准，对方的位置每次读取一次并检查，
+// 与本端位置之差超过容量时环标记为损坏，之后读写都返回0，由通道断开连接
+class CShmRing
+{
+public:
+    struct Header {
+        std::atomic<uint64_t> head;            // 已写入的总字节数
+        char pad1[56];
+        std::atomic<uint64_t> tail;            // 已读取的总字节数
+        char pad2[56];
+        std::atomic<uint32_t> consumerWaiting; // 消费者读空后等待门铃
+        std::atomic<uint32_t> producerWaiting; // 生产者写满后等待门铃
+        char pad3[56];
+    };
+
+    CShmRing() : m_header(nullptr), m_data(nullptr), m_capacity(0), m_position(0), m_broken(false) {}
+
+    // 一个环占用的共享内存大小，capacity必须是2的幂
+    static size_t footprint(size_t capacity) { return sizeof(Header) + capacity; }
+
+    void attach(void* base, size_t capacity, bool initialize);
+
+    // 写入尽量多的数据，返回写入的字节数
+    size_t write(const struct iovec* iov, int count);
+    // 读出最多size字节，返回读取的字节数
+    size_t read(void* buffer, size_t size);
+
+    size_t readable();
+    size_t writable();
+    bool broken() const { return m_broken; }
+    Header* header() const { return m_header; }
+
+private:
+    Header* m_header;
+    char* m_data;
+    size_t m_capacity;
+    uint64_t m_position;                       // 本端的位置：生产者为head，消费者为tail
+    bool m_broken;
+};
+
+// 共享内存连接 - 同一台机器上的客户端通过Unix域socket握手，
+// 服务器创建memfd(两个环：客户端→服务器、服务器→客户端)和两个eventfd门铃，用SCM_RIGHTS交给客户端
+// 握手连接在整个会话期间保持打开，任何一方关闭即断开
+// 接口与socket相同：send/recv 在环满/环空时返回-1并设置EAGAIN，之后对方会敲响本端门铃；环被对方破坏时返回-1并设置EPROTO
+// 监听socket只允许本用户连接(文件权限0600)，握手时再检查对方的uid
+class CShmChannel
+{
+public:
+    static const uint32_t MAGIC = 0x53514d31;                  // "SQM1"
+    static const size_t DEFAULT_RING_SIZE = 4 * 1024 * 1024;
+
+    CShmChannel();
+    ~CShmChannel();
+
+    // 服务器：在路径上监听(已存在的socket文件会被替换)
+    static int listen(const std::string& path);
+    // 服务器：接受一个连接，创建共享内存并发送给客户端
+    bool accept(int listenFd, size_t ringSize = DEFAULT_RING_SIZE);
+    // 客户端：连接服务器并映射共享内存
+    bool connect(const std::string& path);
+
+    ssize_t send(const struct iovec* iov, int count);
+    ssize_t send(const void* data, size_t size);
+    ssize_t recv(void* buffer, size_t size);
+
+    // 清除门铃计数，在门铃可读时调用
+    void clearBell();
+    // 阻塞等待本端门铃(客户端使用)，超时返回false
+    bool waitBell(int timeoutMs);
+
+    int socket() const { return m_socket; }       // 握手连接，关闭即断开
+    int bellFd() const { return m_localBell; }    // 本端门铃，可读表示有数据或有空间
+    void close();
+
+private:
+    struct Control {
+        uint32_t magic;
+        uint32_t ringSize;
+    };
+
+    int m_socket;
+    int m_localBell;
+    int m_remoteBell;
+    void* m_base;
+    size_t m_mapSize;
+    CShmRing m_rx;
+    CShmRing m_tx;
+
+    bool map(int memfd, size_t ringSize, bool server, bool initialize);
+    void ring();
+};
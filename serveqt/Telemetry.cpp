@@ -0,0 +1,193 @@
+#include "Telemetry.h"
+#include "Schema.h"
+#include <algorithm>
+#include <sstream>
+#include <string.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>           // glibc的tcp_info没有tcpi_delivery_rate
+#include <sys/socket.h>
+
+const char CTelemetry::PING_PREFIX[] = "PING";
+
+void CTelemetry::addClient(int clientId) {
+    m_stats[clientId] = ConnectionStats();
+}
+
+void CTelemetry::removeClient(int clientId) {
+    m_stats.erase(clientId);
+}
+
+void CTelemetry::recordInbound(int clientId, size_t bytes, size_t frames) {
+    auto it = m_stats.find(clientId);
+    if (it != m_stats.end()) {
+        it->second.bytesIn += bytes;
+        it->second.framesIn += frames;
+    }
+}
+
+std::vector<int> CTelemetry::dueForSample(uint64_t nowUs) {
+    std::vector<std::pair<uint64_t, int>> due;
+    for (const auto& pair : m_stats) {
+        if (nowUs - pair.second.sampledUs >= SAMPLE_INTERVAL_MS * 1000) {
+            due.push_back({ pair.second.sampledUs, pair.first });
+        }
+    }
+    // 最久未采样的优先
+    size_t count = std::min(due.size(), MAX_SAMPLES_PER_TICK);
+    std::partial_sort(due.begin(), due.begin() + count, due.end());
+    std::vector<int> clients;
+    for (size_t i = 0; i < count; ++i) {
+        clients.push_back(due[i].second);
+    }
+    return clients;
+}
+
+bool CTelemetry::sample(int clientId, int fd, uint64_t bytesWritten, uint64_t framesWritten, size_t outboundBytes,
+    uint64_t nowUs) {
+    auto it = m_stats.find(clientId);
+    if (it == m_stats.end()) {
+        return false;
+    }
+    ConnectionStats& stats = it->second;
+    if (stats.sampledUs != 0 && nowUs > stats.sampledUs) {
+        stats.drainRate = (bytesWritten - stats.sampledBytesOut) * 1000000 / (nowUs - stats.sampledUs);
+    }
+    stats.sampledUs = nowUs;
+    stats.sampledBytesOut = bytesWritten;
+    stats.bytesOut = bytesWritten;
+    stats.framesOut = framesWritten;
+    stats.outboundBytes = outboundBytes;
+
+    // Unix域socket和共享内存连接没有TCP_INFO，第一次失败后不再尝试
+    if (stats.tcp && fd != -1) {
+        struct tcp_info info;
+        socklen_t length = sizeof(info);
+        memset(&info, 0, sizeof(info));
+        if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length) == 0) {
+            stats.rttUs = info.tcpi_rtt;
+            stats.rttVarUs = info.tcpi_rttvar;
+            stats.cwnd = info.tcpi_snd_cwnd;
+            stats.unacked = info.tcpi_unacked;
+            stats.retransmits = info.tcpi_total_retrans;
+            stats.deliveryRate = info.tcpi_delivery_rate;
+        }
+        else {
+            stats.tcp = false;
+        }
+    }
+
+    // 探测长时间没有回应：按丢失处理，下次重新探测
+    if (stats.pingSentUs != 0 && nowUs - stats.pingSentUs > PING_TIMEOUT_MS * 1000) {
+        stats.pingSentUs = 0;
+    }
+
+    bool wasSlow = stats.slow;
+    classify(stats);
+    return stats.slow != wasSlow;
+}
+
+void CTelemetry::classify(ConnectionStats& stats) const {
+    uint32_t rtt = std::max(stats.tcp ? stats.rttUs : 0, stats.pingRttUs);
+    if (!stats.slow) {
+        stats.slow = (stats.outboundBytes > SLOW_QUEUE_BYTES && stats.drainRate < SLOW_DRAIN_RATE) ||
+            rtt > SLOW_RTT_US;
+    }
+    else {
+        stats.slow = !(stats.outboundBytes < FAST_QUEUE_BYTES && rtt < SLOW_RTT_US / 2);
+    }
+}
+
+std::string CTelemetry::makePing(int clientId, uint64_t nowUs) {
+    auto it = m_stats.find(clientId);
+    if (it == m_stats.end() || it->second.pingSentUs != 0 ||
+        (it->second.pingsSent > 0 && nowUs - it->second.lastPingUs < PING_INTERVAL_MS * 1000)) {
+        return "";
+    }
+    ConnectionStats& stats = it->second;
+    std::string payload(PING_PREFIX, 4);
+    schema::Writer(payload).writeInt(nowUs);
+    stats.pingSentUs = nowUs;
+    stats.lastPingUs = nowUs;
+    stats.pingsSent++;
+    return payload;
+}
+
+bool CTelemetry::isPing(const std::string& payload) {
+    return payload.size() == PING_SIZE && payload.compare(0, 4, PING_PREFIX) == 0;
+}
+
+void CTelemetry::recordPong(int clientId, const std::string& payload, uint64_t nowUs) {
+    auto it = m_stats.find(clientId);
+    if (it == m_stats.end() || !isPing(payload)) {
+        return;
+    }
+    uint64_t sentUs = 0;
+    schema::Reader(std::string_view(payload).substr(4)).readInt(sentUs);
+    ConnectionStats& stats = it->second;
+    // 只接受最近一次探测的回应，旧的或伪造的时间戳忽略
+    if (sentUs != stats.pingSentUs || nowUs < sentUs) {
+        return;
+    }
+    uint32_t rtt = static_cast<uint32_t>(std::min<uint64_t>(nowUs - sentUs, UINT32_MAX));
+    // 与内核的srtt相同，按1/8平滑
+    stats.pingRttUs = stats.pingsAnswered == 0 ? rtt : stats.pingRttUs - stats.pingRttUs / 8 + rtt / 8;
+    stats.pingsAnswered++;
+    stats.pingSentUs = 0;
+}
+
+bool CTelemetry::isSlow(int clientId) const {
+    auto it = m_stats.find(clientId);
+    return it != m_stats.end() && it->second.slow;
+}
+
+const ConnectionStats* CTelemetry::get(int clientId) const {
+    auto it = m_stats.find(clientId);
+    return it != m_stats.end() ? &it->second : nullptr;
+}
+
+std::string CTelemetry::describe() const {
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    size_t queued = 0;
+    size_t slow = 0;
+    std::vector<std::pair<size_t, int>> deepest;
+    for (const auto& pair : m_stats) {
+        bytesIn += pair.second.bytesIn;
+        bytesOut += pair.second.bytesOut;
+        queued += pair.second.outboundBytes;
+        slow += pair.second.slow ? 1 : 0;
+        deepest.push_back({ pair.second.outboundBytes, pair.first });
+    }
+    size_t top = std::min<size_t>(deepest.size(), 10);
+    std::partial_sort(deepest.begin(), deepest.begin() + top, deepest.end(),
+        [](const std::pair<size_t, int>& a, const std::pair<size_t, int>& b) { return a.first > b.first; });
+
+    std::ostringstream out;
+    out << m_stats.size() << " connections, " << slow << " slow; in " << bytesIn << " bytes, out " << bytesOut
+        << " bytes, queued " << queued << " bytes";
+    for (size_t i = 0; i < top; ++i) {
+        out << "\n" << describe(deepest[i].second);
+    }
+    return out.str();
+}
+
+std::string CTelemetry::describe(int clientId) const {
+    const ConnectionStats* stats = get(clientId);
+    if (!stats) {
+        return "error: unknown client " + std::to_string(clientId);
+    }
+    std::ostringstream out;
+    out << "client " << clientId << (stats->slow ? " SLOW" : "")
+        << ": in " << stats->bytesIn << " bytes/" << stats->framesIn << " frames"
+        << ", out " << stats->bytesOut << " bytes/" << stats->framesOut << " frames"
+        << ", queued " << stats->outboundBytes << " bytes, drain " << stats->drainRate << " B/s";
+    if (stats->tcp) {
+        out << "; tcp rtt " << stats->rttUs << "+-" << stats->rttVarUs << " us, cwnd " << stats->cwnd
+            << ", unacked " << stats->unacked << ", retrans " << stats->retransmits
+            << ", rate " << stats->deliveryRate << " B/s";
+    }
+    if (stats->pingsSent > 0) {
+        out << "; ping " << stats->pingRttUs << " us (" << stats->pingsAnswered << "/" << stats->pingsSent << ")";
+    }
+    return out.str();
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// 单个连接的统计
+struct ConnectionStats {
+    // 计数(累计)
+    uint64_t bytesIn = 0;
+    uint64_t framesIn = 0;
+    uint64_t bytesOut = 0;         // 已写入socket的字节
+    uint64_t framesOut = 0;        // 完整写出的帧
+    size_t outboundBytes = 0;      // 最近一次采样时发送队列中未发出的字节
+
+    // 内核TCP_INFO(最近一次采样)，非TCP连接(Unix域、共享内存)为空
+    bool tcp = true;
+    uint32_t rttUs = 0;
+    uint32_t rttVarUs = 0;
+    uint32_t cwnd = 0;             // 拥塞窗口(段)
+    uint32_t unacked = 0;          // 已发出未确认的段
+    uint32_t retransmits = 0;      // 累计重传段数
+    uint64_t deliveryRate = 0;     // 内核估计的发送速率(字节/秒)
+
+    // 服务器探测：向声明 FEATURE_PING 的客户端发送带时间戳的TEST_CONNECT，客户端原样回送
+    uint32_t pingRttUs = 0;        // 平滑后的往返时间
+    uint64_t pingsSent = 0;
+    uint64_t pingsAnswered = 0;
+    uint64_t pingSentUs = 0;       // 未回应的探测发出时间，0表示没有
+    uint64_t lastPingUs = 0;
+
+    // 上一次采样，用于计算发送速率
+    uint64_t sampledUs = 0;
+    uint64_t sampledBytesOut = 0;
+    uint64_t drainRate = 0;        // 两次采样之间的写出速率(字节/秒)
+
+    bool slow = false;             // 慢速接收方
+};
+
+// 连接统计 - 收发计数、发送队列深度、TCP_INFO采样和服务器探测，据此判断慢速接收方
+// 采样分散在多个周期中进行(每次最多 MAX_SAMPLES_PER_TICK 个连接)，连接很多时也不会让事件循环停顿
+// 慢速判定(满足任一)：
+//   发送队列超过 SLOW_QUEUE_BYTES 且写出速率低于 SLOW_DRAIN_RATE
+//   TCP或探测的往返时间超过 SLOW_RTT_US
+// 恢复需要队列低于 FAST_QUEUE_BYTES 且往返时间低于 SLOW_RTT_US 的一半，避免在阈值附近反复切换
+// 只在epoll线程中使用
+class CTelemetry
+{
+public:
+    static const uint64_t TICK_MS = 100;
+    static const uint64_t SAMPLE_INTERVAL_MS = 1000;   // 每个连接的采样周期
+    static constexpr size_t MAX_SAMPLES_PER_TICK = 256;
+    static const uint64_t PING_INTERVAL_MS = 5000;
+    static const uint64_t PING_TIMEOUT_MS = 15000;     // 超过该时间未回应视为丢失，重新探测
+    static const size_t SLOW_QUEUE_BYTES = 1024 * 1024;
+    static const size_t FAST_QUEUE_BYTES = 64 * 1024;
+    static const uint64_t SLOW_DRAIN_RATE = 256 * 1024;
+    static const uint32_t SLOW_RTT_US = 200000;
+
+    // 探测负载：前缀 + 8字节发出时间(微秒，网络字节序)
+    static const char PING_PREFIX[];
+    static const size_t PING_SIZE = 12;
+
+    void addClient(int clientId);
+    void removeClient(int clientId);
+
+    void recordInbound(int clientId, size_t bytes, size_t frames);
+    // 本周期需要采样的连接，按上次采样时间轮转
+    std::vector<int> dueForSample(uint64_t nowUs);
+    // 更新一个连接：发送队列的累计写出量和当前深度，fd为TCP socket时读取TCP_INFO；返回慢速状态是否变化
+    bool sample(int clientId, int fd, uint64_t bytesWritten, uint64_t framesWritten, size_t outboundBytes, uint64_t nowUs);
+
+    // 服务器探测：需要发送时返回负载，否则返回空串
+    std::string makePing(int clientId, uint64_t nowUs);
+    static bool isPing(const std::string& payload);
+    void recordPong(int clientId, const std::string& payload, uint64_t nowUs);
+
+    bool isSlow(int clientId) const;
+    const ConnectionStats* get(int clientId) const;
+
+    // 管理命令：汇总和发送队列最深的连接 / 单个连接
+    std::string describe() const;
+    std::string describe(int clientId) const;
+
+private:
+    std::map<int, ConnectionStats> m_stats;
+
+    void classify(ConnectionStats& stats) const;
+};
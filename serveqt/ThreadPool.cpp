@@ -0,0 +1,249 @@
+#include "ThreadPool.h"
+#include "Trace.h"
+#include "Latency.h"
+#include <iostream>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// 当前线程所属的工作线程编号，非工作线程为-1
+static thread_local int t_workerIndex = -1;
+
+CThreadPool::CThreadPool(size_t nThreads)
+    : m_running(false), m_queued(0), m_nextWorker(0)
+{
+    setThreadCount(nThreads);
+}
+
+void CThreadPool::setThreadCount(size_t nThreads)
+{
+    if (m_running) {
+        return;
+    }
+    m_workers.clear();
+    if (nThreads == 0) {
+        nThreads = std::thread::hardware_concurrency();
+        nThreads = nThreads > 1 ? nThreads - 1 : 1; // 给事件循环留一个核
+    }
+    for (size_t i = 0; i < nThreads; ++i) {
+        m_workers.emplace_back(new Worker());
+    }
+}
+
+CThreadPool::~CThreadPool()
+{
+    stop();
+}
+
+bool CThreadPool::start()
+{
+    if (m_running) {
+        return true;
+    }
+    m_running = true;
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        m_workers[i]->thread = std::thread(&CThreadPool::workerLoop, this, i);
+    }
+    std::cout << "[ThreadPool] Started " << m_workers.size() << " worker threads" << std::endl;
+    return true;
+}
+
+void CThreadPool::stop()
+{
+    if (!m_running) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_running = false;
+    }
+    m_sleepCondition.notify_all();
+
+    for (auto& worker : m_workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+        worker->tasks.clear();
+    }
+    m_queued = 0;
+
+    std::lock_guard<std::mutex> lock(m_strandMutex);
+    m_strands.clear();
+}
+
+void CThreadPool::submit(Task task)
+{
+    // 工作线程内提交的任务放入自己的队列，其他线程空闲时会来窃取
+    size_t index = t_workerIndex >= 0 ? static_cast<size_t>(t_workerIndex)
+        : m_nextWorker.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_queued++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_workers[index]->mutex);
+        m_workers[index]->tasks.push_back(std::move(task));
+    }
+    m_sleepCondition.notify_one();
+}
+
+void CThreadPool::submit(uint64_t key, Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_strandMutex);
+        Strand& strand = m_strands[key];
+        strand.tasks.push_back(std::move(task));
+        if (strand.running) {
+            return; // 当前任务完成后会继续调度
+        }
+        strand.running = true;
+    }
+    submit([this, key] { runStrand(key); });
+}
+
+size_t CThreadPool::pending(uint64_t key) const
+{
+    std::lock_guard<std::mutex> lock(m_strandMutex);
+    auto it = m_strands.find(key);
+    if (it == m_strands.end()) {
+        return 0;
+    }
+    return it->second.tasks.size() + (it->second.running ? 1 : 0);
+}
+
+void CThreadPool::runStrand(uint64_t key)
+{
+    Task task;
+    {
+        std::lock_guard<std::mutex> lock(m_strandMutex);
+        auto it = m_strands.find(key);
+        if (it == m_strands.end() || it->second.tasks.empty()) {
+            return;
+        }
+        task = std::move(it->second.tasks.front());
+        it->second.tasks.pop_front();
+    }
+
+    task();
+
+    // 每次只执行一个任务再重新调度，避免一个客户端长期占用工作线程
+    {
+        std::lock_guard<std::mutex> lock(m_strandMutex);
+        auto it = m_strands.find(key);
+        if (it == m_strands.end()) {
+            return;
+        }
+        if (it->second.tasks.empty()) {
+            m_strands.erase(it);
+            return;
+        }
+    }
+    submit([this, key] { runStrand(key); });
+}
+
+bool CThreadPool::popTask(size_t index, Task& task)
+{
+    // 本地队列：从尾部取(LIFO)，缓存更友好
+    {
+        Worker& self = *m_workers[index];
+        std::lock_guard<std::mutex> lock(self.mutex);
+        if (!self.tasks.empty()) {
+            task = std::move(self.tasks.back());
+            self.tasks.pop_back();
+            m_queued--;
+            return true;
+        }
+    }
+
+    // 窃取：从其他队列的头部取
+    for (size_t i = 1; i < m_workers.size(); ++i) {
+        Worker& victim = *m_workers[(index + i) % m_workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            m_queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void CThreadPool::workerLoop(size_t index)
+{
+    t_workerIndex = static_cast<int>(index);
+    CTrace::setThreadName("worker");
+    if (!m_cpus.empty()) {
+        LatencyOptions::pinCurrentThread(m_cpus[index % m_cpus.size()]);
+    }
+    while (m_running) {
+        Task task;
+        if (popTask(index, task)) {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_sleepCondition.wait(lock, [this] { return !m_running || m_queued > 0; });
+    }
+    t_workerIndex = -1;
+}
+
+CCompletionQueue::CCompletionQueue() : m_eventFd(-1)
+{
+}
+
+CCompletionQueue::~CCompletionQueue()
+{
+    close();
+}
+
+bool CCompletionQueue::open()
+{
+    m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_eventFd == -1) {
+        std::cerr << "[ThreadPool] Failed to create eventfd: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void CCompletionQueue::close()
+{
+    if (m_eventFd != -1) {
+        ::close(m_eventFd);
+        m_eventFd = -1;
+    }
+    m_queue.clear();
+}
+
+void CCompletionQueue::post(Task task)
+{
+    m_queue.push(0, task);
+    uint64_t one = 1;
+    if (write(m_eventFd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        std::cerr << "[ThreadPool] Failed to signal eventfd: " << strerror(errno) << std::endl;
+    }
+}
+
+size_t CCompletionQueue::drain()
+{
+    uint64_t count = 0;
+    if (read(m_eventFd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+        std::cerr << "[ThreadPool] Failed to read eventfd: " << strerror(errno) << std::endl;
+    }
+
+    size_t executed = 0;
+    for (;;) {
+        std::vector<QueueItem<Task>> items = m_queue.popBatch(64);
+        if (items.empty()) {
+            break;
+        }
+        for (auto& item : items) {
+            item.Data();
+            executed++;
+        }
+    }
+    return executed;
+}
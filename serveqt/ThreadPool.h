@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "CQueue.h"
+
+// 工作窃取线程池 - 把耗时的命令处理移出epoll线程
+// 每个工作线程有自己的任务队列，空闲时从其他线程的队列头部窃取任务
+// 带key提交的任务按key串行执行(同一客户端的任务保持顺序)
+class CThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    // nThreads为0时按CPU核数决定
+    explicit CThreadPool(size_t nThreads = 0);
+    ~CThreadPool();
+
+    // 修改线程数(start()之前调用)，0时按CPU核数决定
+    void setThreadCount(size_t nThreads);
+    // 工作线程依次绑定到这些核(start()之前调用)
+    void setAffinity(const std::vector<int>& cpus) { m_cpus = cpus; }
+
+    bool start();
+    void stop();
+
+    // 无序提交
+    void submit(Task task);
+
+    // 有序提交：同一key的任务按提交顺序逐个执行
+    void submit(uint64_t key, Task task);
+
+    // 指定key尚未完成的任务数(包括正在执行的)
+    size_t pending(uint64_t key) const;
+    // 所有队列中等待执行的任务数
+    size_t queued() const { return m_queued.load(std::memory_order_relaxed); }
+
+    size_t threadCount() const { return m_workers.size(); }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    // 同一key的串行队列
+    struct Strand {
+        std::deque<Task> tasks;
+        bool running = false;
+    };
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<int> m_cpus;
+    std::atomic<bool> m_running;
+    std::atomic<size_t> m_queued;                      // 所有工作队列中的任务总数
+    std::atomic<size_t> m_nextWorker;                  // 外部提交时轮询选择队列
+    std::mutex m_sleepMutex;
+    std::condition_variable m_sleepCondition;
+
+    mutable std::mutex m_strandMutex;
+    std::unordered_map<uint64_t, Strand> m_strands;
+
+    void workerLoop(size_t index);
+    bool popTask(size_t index, Task& task);            // 先取本地队列，再窃取
+    void runStrand(uint64_t key);
+};
+
+// 事件循环完成队列 - 工作线程把结果投递回epoll线程
+// 通过eventfd唤醒，由事件循环在自己的线程中执行回调
+class CCompletionQueue
+{
+public:
+    using Task = std::function<void()>;
+
+    CCompletionQueue();
+    ~CCompletionQueue();
+
+    bool open();
+    void close();
+
+    // 任意线程调用
+    void post(Task task);
+
+    // 事件循环在eventfd可读时调用，执行所有已投递的回调
+    size_t drain();
+
+    int fd() const { return m_eventFd; }
+
+private:
+    int m_eventFd;
+    CQueue<Task> m_queue;
+};
@@ -0,0 +1,277 @@
+#include "Tls.h"
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <iostream>
+#include <sstream>
+
+#ifdef SERVEQT_WITH_OPENSSL
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
+
+// 用户态加密时一次SSL_write的上限，正好一个TLS记录
+static const size_t MAX_RECORD = 16 * 1024;
+
+#ifdef SERVEQT_WITH_OPENSSL
+
+static std::string lastError()
+{
+    unsigned long code = ERR_get_error();
+    if (code == 0) {
+        return "unknown error";
+    }
+    char text[256];
+    ERR_error_string_n(code, text, sizeof(text));
+    ERR_clear_error();
+    return text;
+}
+
+CTlsConnection::CTlsConnection(struct ssl_st* ssl, int fd)
+    : m_ssl(ssl), m_fd(fd), m_state(HANDSHAKING), m_kernelSend(false), m_kernelRecv(false)
+{
+}
+
+CTlsConnection::~CTlsConnection()
+{
+    // 不发送close_notify：socket由调用方关闭，对方按连接断开处理
+    SSL_free(m_ssl);
+}
+
+CTlsConnection::State CTlsConnection::handshake()
+{
+    if (m_state != HANDSHAKING) {
+        return m_state;
+    }
+    int result = SSL_accept(m_ssl);
+    if (result == 1) {
+        m_state = ESTABLISHED;
+        m_kernelSend = BIO_get_ktls_send(SSL_get_wbio(m_ssl)) != 0;
+        m_kernelRecv = BIO_get_ktls_recv(SSL_get_rbio(m_ssl)) != 0;
+        return m_state;
+    }
+    int error = SSL_get_error(m_ssl, result);
+    if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+        return m_state;
+    }
+    std::cerr << "TLS handshake failed on socket " << m_fd << ": " << lastError() << std::endl;
+    m_state = FAILED;
+    return m_state;
+}
+
+std::string CTlsConnection::describe() const
+{
+    std::ostringstream out;
+    out << SSL_get_version(m_ssl) << " " << SSL_get_cipher_name(m_ssl)
+        << ", send " << (m_kernelSend ? "kernel" : "userspace")
+        << ", receive " << (m_kernelRecv ? "kernel" : "userspace");
+    return out.str();
+}
+
+ssize_t CTlsConnection::read(char* buffer, size_t size)
+{
+    errno = 0;
+    int count = SSL_read(m_ssl, buffer, static_cast<int>(std::min<size_t>(size, INT32_MAX)));
+    if (count > 0) {
+        return count;
+    }
+    switch (SSL_get_error(m_ssl, count)) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        errno = EAGAIN;
+        return -1;
+    case SSL_ERROR_ZERO_RETURN:
+        return 0;
+    case SSL_ERROR_SYSCALL:
+        // 底层读到EOF时errno为0，按对端关闭处理
+        if (errno == 0) {
+            return 0;
+        }
+        return -1;
+    default:
+        ERR_clear_error();
+        errno = EIO;
+        return -1;
+    }
+}
+
+ssize_t CTlsConnection::write(const struct iovec* iov, int count)
+{
+    // 把小帧凑成整个记录再交给SSL_write；上次返回EAGAIN的记录重试时，发送队列会从同一位置给出同样的数据
+    char record[MAX_RECORD];
+    ssize_t total = 0;
+    int index = 0;
+    size_t offset = 0;
+    while (index < count) {
+        size_t length = 0;
+        while (index < count && length < sizeof(record)) {
+            size_t take = std::min(iov[index].iov_len - offset, sizeof(record) - length);
+            memcpy(record + length, static_cast<const char*>(iov[index].iov_base) + offset, take);
+            length += take;
+            offset += take;
+            if (offset == iov[index].iov_len) {
+                index++;
+                offset = 0;
+            }
+        }
+        if (length == 0) {
+            break;
+        }
+        errno = 0;
+        int written = SSL_write(m_ssl, record, static_cast<int>(length));
+        if (written > 0) {
+            total += written;
+            if (static_cast<size_t>(written) < length) {
+                break;
+            }
+            continue;
+        }
+        int error = SSL_get_error(m_ssl, written);
+        if (total > 0) {
+            break;
+        }
+        if (error == SSL_ERROR_WANT_WRITE || error == SSL_ERROR_WANT_READ) {
+            errno = EAGAIN;
+        }
+        else if (error != SSL_ERROR_SYSCALL || errno == 0) {
+            ERR_clear_error();
+            errno = EIO;
+        }
+        return -1;
+    }
+    return total;
+}
+
+CTlsContext::CTlsContext()
+    : m_ctx(nullptr), m_ktls(false), m_handshakes(0), m_failures(0), m_timeouts(0), m_kernelSend(0), m_kernelRecv(0)
+{
+}
+
+CTlsContext::~CTlsContext()
+{
+    if (m_ctx) {
+        SSL_CTX_free(m_ctx);
+    }
+}
+
+bool CTlsContext::open(const std::string& certFile, const std::string& keyFile, bool ktls)
+{
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        std::cerr << "Failed to create TLS context: " << lastError() << std::endl;
+        return false;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    if (SSL_CTX_use_certificate_chain_file(ctx, certFile.c_str()) != 1 ||
+        SSL_CTX_use_PrivateKey_file(ctx, keyFile.c_str(), SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx) != 1) {
+        std::cerr << "Failed to load TLS certificate " << certFile << " / key " << keyFile << ": " << lastError() << std::endl;
+        SSL_CTX_free(ctx);
+        return false;
+    }
+    // 部分写出：用户态发送时和socket一样按写出的字节数推进发送队列
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+    // 不做会话恢复，握手后不再发送会话票据，连接建立后发送方向只有应用数据
+    SSL_CTX_set_num_tickets(ctx, 0);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    // 客户端不发送close_notify直接断开时按普通的连接关闭处理
+    SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+    if (ktls) {
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    }
+    m_ctx = ctx;
+    m_ktls = ktls;
+    return true;
+}
+
+std::unique_ptr<CTlsConnection> CTlsContext::accept(int fd)
+{
+    SSL* ssl = SSL_new(m_ctx);
+    if (!ssl) {
+        std::cerr << "Failed to create TLS connection: " << lastError() << std::endl;
+        return nullptr;
+    }
+    if (SSL_set_fd(ssl, fd) != 1) {
+        std::cerr << "Failed to attach TLS to socket " << fd << ": " << lastError() << std::endl;
+        SSL_free(ssl);
+        return nullptr;
+    }
+    SSL_set_accept_state(ssl);
+    return std::unique_ptr<CTlsConnection>(new CTlsConnection(ssl, fd));
+}
+
+#else
+
+CTlsConnection::CTlsConnection(struct ssl_st* ssl, int fd)
+    : m_ssl(ssl), m_fd(fd), m_state(FAILED), m_kernelSend(false), m_kernelRecv(false)
+{
+}
+
+CTlsConnection::~CTlsConnection()
+{
+}
+
+CTlsConnection::State CTlsConnection::handshake()
+{
+    return FAILED;
+}
+
+std::string CTlsConnection::describe() const
+{
+    return "unavailable";
+}
+
+ssize_t CTlsConnection::read(char*, size_t)
+{
+    errno = EIO;
+    return -1;
+}
+
+ssize_t CTlsConnection::write(const struct iovec*, int)
+{
+    errno = EIO;
+    return -1;
+}
+
+CTlsContext::CTlsContext()
+    : m_ctx(nullptr), m_ktls(false), m_handshakes(0), m_failures(0), m_timeouts(0), m_kernelSend(0), m_kernelRecv(0)
+{
+}
+
+CTlsContext::~CTlsContext()
+{
+}
+
+bool CTlsContext::open(const std::string&, const std::string&, bool)
+{
+    std::cerr << "TLS is not available: built without SERVEQT_WITH_OPENSSL" << std::endl;
+    return false;
+}
+
+std::unique_ptr<CTlsConnection> CTlsContext::accept(int)
+{
+    return nullptr;
+}
+
+#endif
+
+void CTlsContext::recordHandshake(const CTlsConnection& connection)
+{
+    m_handshakes++;
+    m_kernelSend += connection.kernelSend() ? 1 : 0;
+    m_kernelRecv += connection.kernelRecv() ? 1 : 0;
+}
+
+std::string CTlsContext::describe(size_t established, size_t handshaking) const
+{
+    std::ostringstream out;
+    if (!isOpen()) {
+        out << "tls: disabled";
+        return out.str();
+    }
+    out << "tls: " << established << " connections, " << handshaking << " handshaking (kTLS "
+        << (m_ktls ? "enabled" : "disabled") << ")\n"
+        << "handshakes " << m_handshakes << ", failures " << m_failures << ", timeouts " << m_timeouts
+        << ", kernel send " << m_kernelSend << ", kernel receive " << m_kernelRecv;
+    return out.str();
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+struct ssl_st;
+struct ssl_ctx_st;
+
+// TLS连接 - 握手在用户态由OpenSSL完成，之后尽量把密钥交给内核(kTLS)
+// 内核接管发送方向后，socket上的sendmsg由内核加密：共享的广播帧、并行扇出的工作线程、
+// 发送队列的writev都和明文连接一样直接写fd，不需要逐连接在用户态复制和加密
+// 内核不支持时(没有tls模块、套件不支持)发送退回SSL_write，这样的连接只在epoll线程写出(同共享内存客户端)
+// 读取始终经SSL_read：内核接管接收方向时OpenSSL直接收到明文，否则在用户态解密
+// 接口与socket相同：read/write 在需要等待时返回-1并设置EAGAIN
+class CTlsConnection
+{
+public:
+    enum State {
+        HANDSHAKING,
+        ESTABLISHED,
+        FAILED
+    };
+
+    CTlsConnection(struct ssl_st* ssl, int fd);
+    ~CTlsConnection();
+
+    // 继续握手，仍在进行时返回 HANDSHAKING，等待下一次读写事件
+    State handshake();
+    State state() const { return m_state; }
+
+    bool kernelSend() const { return m_kernelSend; }
+    bool kernelRecv() const { return m_kernelRecv; }
+    std::string describe() const;              // 协议版本、套件、kTLS
+
+    ssize_t read(char* buffer, size_t size);   // 语义同recv
+    ssize_t write(const struct iovec* iov, int count); // 语义同sendmsg，kernelSend时不使用
+
+private:
+    struct ssl_st* m_ssl;
+    int m_fd;
+    State m_state;
+    bool m_kernelSend;
+    bool m_kernelRecv;
+};
+
+// 服务器证书和TLS配置；编译时未定义 SERVEQT_WITH_OPENSSL 时 open 总是失败
+// 只在epoll线程中使用
+class CTlsContext
+{
+public:
+    static const int HANDSHAKE_TIMEOUT_MS = 10000;     // 握手未完成的连接在此之后关闭
+
+    CTlsContext();
+    ~CTlsContext();
+
+    // 加载证书链和私钥；ktls为false时始终在用户态加解密
+    bool open(const std::string& certFile, const std::string& keyFile, bool ktls);
+    bool isOpen() const { return m_ctx != nullptr; }
+
+    // 为新连接创建TLS状态，握手由调用方推进
+    std::unique_ptr<CTlsConnection> accept(int fd);
+
+    // 统计
+    void recordHandshake(const CTlsConnection& connection);
+    void recordFailure() { m_failures++; }
+    void recordTimeout() { m_timeouts++; }
+
+    // 管理命令 "tls"
+    std::string describe(size_t established, size_t handshaking) const;
+
+private:
+    struct ssl_ctx_st* m_ctx;
+    bool m_ktls;
+    uint64_t m_handshakes;
+    uint64_t m_failures;
+    uint64_t m_timeouts;
+    uint64_t m_kernelSend;                     // 发送方向由内核加密的连接
+    uint64_t m_kernelRecv;                     // 接收方向由内核解密的连接
+};
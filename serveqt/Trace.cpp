@@ -0,0 +1,164 @@
+#include "Trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace {
+
+struct Event {
+    const char* name;
+    uint64_t startNs;
+    uint64_t endNs;
+    uint32_t arg;
+};
+
+// 每个线程一个缓冲区，只有本线程写入；锁只在导出时与写入竞争
+struct ThreadBuffer {
+    std::mutex mutex;
+    std::vector<Event> events;
+    size_t next = 0;
+    bool wrapped = false;
+    long tid = 0;
+    std::string name;
+};
+
+std::mutex g_registryMutex;
+std::vector<std::shared_ptr<ThreadBuffer>> g_buffers;   // 线程退出后保留，导出时仍可读取
+std::string g_directory = "/tmp";
+thread_local const char* t_threadName = nullptr;
+
+
+ThreadBuffer& threadBuffer()
+{
+    static thread_local std::shared_ptr<ThreadBuffer> buffer;
+    if (!buffer) {
+        buffer = std::make_shared<ThreadBuffer>();
+        buffer->events.resize(CTrace::RING_SIZE);
+        buffer->tid = syscall(SYS_gettid);
+        buffer->name = t_threadName ? t_threadName : "";
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        g_buffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+} // namespace
+
+std::atomic<uint32_t> CTrace::s_sampleRate(0);
+thread_local bool CTrace::s_sampling = false;
+thread_local uint32_t CTrace::s_counter = 0;
+
+void CTrace::configure(uint32_t sampleRate, const std::string& directory)
+{
+    {
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        if (!directory.empty()) {
+            g_directory = directory;
+        }
+    }
+    s_sampleRate.store(sampleRate, std::memory_order_relaxed);
+}
+
+uint64_t CTrace::nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+void CTrace::record(const char* name, uint64_t startNs, uint64_t endNs, uint32_t arg)
+{
+    ThreadBuffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.events[buffer.next] = { name, startNs, endNs, arg };
+    if (++buffer.next == buffer.events.size()) {
+        buffer.next = 0;
+        buffer.wrapped = true;
+    }
+}
+
+void CTrace::setThreadName(const char* name)
+{
+    // 缓冲区在第一次记录时才分配，未启用追踪的线程不占内存
+    t_threadName = name;
+}
+
+std::string CTrace::dump()
+{
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    std::string directory;
+    {
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        buffers = g_buffers;
+        directory = g_directory;
+    }
+
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    std::string path = directory + "/serveqt-trace-" + std::to_string(getpid()) + "-" +
+        std::to_string(wall.tv_sec * 1000 + wall.tv_nsec / 1000000) + ".json";
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "[Trace] Failed to open " << path << std::endl;
+        return "";
+    }
+
+    // 时间单位为微秒，保留纳秒精度
+    int pid = getpid();
+    size_t count = 0;
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    for (const auto& buffer : buffers) {
+        std::vector<Event> events;
+        std::string name;
+        {
+            std::lock_guard<std::mutex> lock(buffer->mutex);
+            if (buffer->wrapped) {
+                events.assign(buffer->events.begin() + buffer->next, buffer->events.end());
+            }
+            events.insert(events.end(), buffer->events.begin(), buffer->events.begin() + buffer->next);
+            name = buffer->name;
+        }
+        if (!name.empty()) {
+            out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+                << ",\"tid\":" << buffer->tid << ",\"args\":{\"name\":\"" << name << "\"}}";
+            first = false;
+        }
+        for (const auto& event : events) {
+            char timing[64];
+            snprintf(timing, sizeof(timing), "\"ts\":%.3f,\"dur\":%.3f",
+                event.startNs / 1000.0, (event.endNs - event.startNs) / 1000.0);
+            out << (first ? "" : ",") << "\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":" << pid
+                << ",\"tid\":" << buffer->tid << "," << timing << ",\"args\":{\"arg\":" << event.arg << "}}";
+            first = false;
+        }
+        count += events.size();
+    }
+    out << "\n]}\n";
+    out.close();
+    if (!out) {
+        std::cerr << "[Trace] Failed to write " << path << std::endl;
+        return "";
+    }
+
+    std::cout << "[Trace] Wrote " << count << " spans to " << path << std::endl;
+    return path;
+}
+
+CTraceSample::CTraceSample()
+    : m_previous(CTrace::s_sampling)
+{
+    if (!m_previous) {
+        uint32_t rate = CTrace::s_sampleRate.load(std::memory_order_relaxed);
+        if (rate != 0) {
+            CTrace::s_sampling = ++CTrace::s_counter % rate == 0;
+        }
+    }
+}
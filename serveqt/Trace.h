@@ -0,0 +1,69 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// 轻量级追踪 - 作用域span记录到每个线程自己的环形缓冲区，导出为Chrome trace-event JSON(Perfetto可直接打开)
+// 采样以 CTraceSample 为单位(一次epoll事件处理、一个后台任务)，其中的所有span要么都记录，要么都不记录
+// 未启用时 CTraceSample 只读一次原子变量，CTraceSpan 只读一个线程局部变量
+class CTrace
+{
+public:
+    static const size_t RING_SIZE = 16384;             // 每个线程保留的最近span数
+
+    // sampleRate为N时每N次采样范围记录一次，0为关闭
+    static void configure(uint32_t sampleRate, const std::string& directory);
+    static uint32_t sampleRate() { return s_sampleRate.load(std::memory_order_relaxed); }
+    static bool sampling() { return s_sampling; }
+
+    static uint64_t nowNs();
+    static void record(const char* name, uint64_t startNs, uint64_t endNs, uint32_t arg);
+    static void setThreadName(const char* name);        // 线程启动时调用，name必须是字符串常量
+
+    // 把所有线程缓冲区中的span写入追踪目录，返回文件路径，失败返回空串
+    static std::string dump();
+
+private:
+    friend class CTraceSample;
+
+    static std::atomic<uint32_t> s_sampleRate;
+    static thread_local bool s_sampling;               // 当前线程是否处在被采样的范围内
+    static thread_local uint32_t s_counter;
+};
+
+// 采样范围：构造时决定其中的span是否记录，嵌套时沿用外层的决定
+class CTraceSample
+{
+public:
+    CTraceSample();
+    ~CTraceSample() { CTrace::s_sampling = m_previous; }
+
+    CTraceSample(const CTraceSample&) = delete;
+    CTraceSample& operator=(const CTraceSample&) = delete;
+
+private:
+    bool m_previous;
+};
+
+// 作用域span，name必须是字符串常量；arg在导出时作为参数显示(命令字、字节数等)
+class CTraceSpan
+{
+public:
+    explicit CTraceSpan(const char* name, uint32_t arg = 0)
+        : m_name(CTrace::sampling() ? name : nullptr), m_arg(arg), m_start(m_name ? CTrace::nowNs() : 0) {}
+    ~CTraceSpan() {
+        if (m_name) {
+            CTrace::record(m_name, m_start, CTrace::nowNs(), m_arg);
+        }
+    }
+
+    void setArg(uint32_t arg) { m_arg = arg; }
+
+    CTraceSpan(const CTraceSpan&) = delete;
+    CTraceSpan& operator=(const CTraceSpan&) = delete;
+
+private:
+    const char* m_name;
+    uint32_t m_arg;
+    uint64_t m_start;
+};
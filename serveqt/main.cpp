@@ -1,73 +1,140 @@
 #include <iostream>
 #include <signal.h>
 #include <unistd.h>
+#include <limits.h>
+#include <stdlib.h>
 #include <string>
+#include <vector>
 #include "ServerSocket.h"
 
-// Global server pointer for signal handling
-CServerSocket* g_server = nullptr;
-
-// Signal handler function
-void signalHandler(int signum) {
-    std::cout << "\nReceived signal " << signum << ", shutting down the server..." << std::endl;
-
-    if (g_server) {
-        g_server->stop();
-    }
-
-    exit(0);
-}
-
 int main(int argc, char* argv[]) {
-    std::string ip = "127.0.0.1";  // Default IP
-    int port = 8080;  // Default port
-
-    // Parse command line arguments
-    if (argc > 1) {
-        ip = argv[1];
-    }
-    if (argc > 2) {
-        port = std::atoi(argv[2]);
-        if (port <= 0 || port > 65535) {
-            std::cerr << "Error: Port number must be between 1 and 65535." << std::endl;
-            return 1;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--help" || std::string(argv[i]) == "-h") {
+            CConfig::usage(std::cout);
+            return 0;
         }
     }
-    else {
-        // If no command line arguments, prompt user to input port
-        std::cout << "Enter port number (default: 8080): ";
-        std::string portInput;
-        std::getline(std::cin, portInput);
 
-        if (!portInput.empty()) {
-            port = std::atoi(portInput.c_str());
-            if (port <= 0 || port > 65535) {
-                std::cerr << "Error: Port number must be between 1 and 65535, using default port 8080" << std::endl;
-                port = 8080;
-            }
-        }
+    // Defaults, then the --config file, then the command line; nothing is asked interactively
+    CConfig config;
+    if (!config.load(argc, argv)) {
+        return 1;
     }
+    const ServerConfig& options = config.values();
 
     // Print welcome information
     std::cout << "=== Linux Server - Qt Client Test ===" << std::endl;
-    std::cout << "IP: " << ip << std::endl;
-    std::cout << "Port: " << port << std::endl;
+    if (options.listeners.empty()) {
+        std::cout << "IP: " << options.ip << std::endl;
+        std::cout << "Port: " << options.port << std::endl;
+    }
+    for (const auto& listener : options.listeners) {
+        std::cout << "Listen: " << listener << std::endl;
+    }
     std::cout << "Supported commands:" << std::endl;
     std::cout << "  1 - Text Message" << std::endl;
     std::cout << "  2 - File Start" << std::endl;
     std::cout << "  3 - File Data" << std::endl;
     std::cout << "  4 - File Complete" << std::endl;
+    std::cout << "  5 - Capability (compression)" << std::endl;
+    std::cout << "  6 - History Request" << std::endl;
+    std::cout << "  9 - Presence Sync" << std::endl;
+    std::cout << "  10 - Set Username" << std::endl;
+    std::cout << "  11 - File Manifest" << std::endl;
+    std::cout << "  12 - Chunk Request" << std::endl;
+    std::cout << "  13 - Chunk Data" << std::endl;
+    std::cout << "  14 - Admin (local clients only)" << std::endl;
+    std::cout << "  15 - Session (open or resume)" << std::endl;
+    std::cout << "  16 - Session Ack" << std::endl;
     std::cout << "  1981 - Test Connect" << std::endl;
+    if (!options.historyDir.empty()) {
+        std::cout << "History: " << options.historyDir << " (replay on join: " << options.joinReplay << ")" << std::endl;
+    }
+    if (options.nodeId > 0) {
+        std::cout << "Federation: node " << options.nodeId << ", peer port " << options.federationPort
+            << ", " << options.peers.size() << " peers" << std::endl;
+    }
+    if (!options.shmPath.empty()) {
+        std::cout << "Shared memory transport: " << options.shmPath << std::endl;
+    }
+    if (options.traceSample > 0) {
+        std::cout << "Tracing: 1 in " << options.traceSample << " events, dumps to " << options.traceDir
+            << " (send SIGUSR1 or admin \"trace-dump\")" << std::endl;
+    }
+    std::cout << "Chunk cache: " << (options.chunkDir.empty() ? "memory only" : options.chunkDir)
+        << " (" << options.chunkCacheMb << " MB in memory)" << std::endl;
+    if (!options.capturePath.empty()) {
+        std::cout << "Capture: " << options.capturePath << " (replay with the replay tool)" << std::endl;
+    }
+    if (options.overloadRssMb > 0) {
+        std::cout << "Overload memory limit: " << options.overloadRssMb << " MB" << std::endl;
+    }
+    std::cout << "Connection memory: " << (options.memBudgetMb > 0 ? std::to_string(options.memBudgetMb) + " MB" : std::string("unlimited"))
+        << " total, " << (options.connMemMb > 0 ? std::to_string(options.connMemMb) + " MB" : std::string("unlimited"))
+        << " per connection (admin \"memory\")" << std::endl;
+    if (options.latency.enabled()) {
+        std::cout << "Latency mode: " << options.latency.cpus.size() << " pinned CPUs, spin " << options.latency.spinUs
+            << " us, busy poll " << options.latency.busyPollUs << " us (admin \"latency\")" << std::endl;
+    }
+    if (!config.path().empty()) {
+        std::cout << "Config: " << config.path() << " (send SIGHUP or admin \"config-reload\" to reload)" << std::endl;
+    }
+    if (!options.handoffPath.empty()) {
+        std::cout << "Hot restart: " << options.handoffPath << " (send SIGUSR2 to restart)" << std::endl;
+    }
     std::cout << "Press Ctrl+C to exit" << std::endl;  // More intuitive description
     std::cout << "=====================================" << std::endl;
 
-    // Register signal handlers
-    signal(SIGINT, signalHandler);
-    signal(SIGTERM, signalHandler);
+    // SIGINT/SIGTERM/SIGUSR2/SIGHUP are handled by the server loop through signalfd;
+    // writes to a closed client must not kill the process
+    signal(SIGPIPE, SIG_IGN);
+
+    // Tracing can also be switched on later with admin "trace-rate N"
+    CTrace::configure(static_cast<uint32_t>(options.traceSample), options.traceDir);
 
     // Create and start server
-    CServerSocket server(ip, port);
-    g_server = &server;
+    CServerSocket server(options.ip, options.port);
+    if (!options.historyDir.empty()) {
+        server.enableHistory(options.historyDir, options.joinReplay);
+    }
+    for (const auto& listener : options.listeners) {
+        if (!server.addListener(listener)) {
+            std::cerr << "Error: Invalid listen address " << listener << std::endl;
+            return 1;
+        }
+    }
+    if (!options.shmPath.empty()) {
+        server.enableShmTransport(options.shmPath);
+    }
+    if (!options.capturePath.empty()) {
+        server.enableCapture(options.capturePath);
+    }
+    server.enableLatencyMode(options.latency);
+    // Without an explicit partition count the server uses one partition per worker thread
+    server.enableFanOut(options.fanOutPartitions >= 0 ? static_cast<size_t>(options.fanOutPartitions) : CFanOut::AUTO_PARTITIONS,
+        static_cast<size_t>(options.fanOutThreshold));
+    if (!options.tlsCert.empty() || !options.tlsKey.empty()) {
+        server.enableTls(options.tlsCert, options.tlsKey, options.ktls);
+    }
+    server.enableSessions(static_cast<size_t>(options.sessionWindowKb) * 1024, static_cast<uint64_t>(options.sessionTimeoutS) * 1000);
+    server.enableChunkStore(options.chunkDir, static_cast<size_t>(options.chunkCacheMb) * 1024 * 1024);
+    if (options.nodeId > 0) {
+        server.enableFederation(options.nodeId, options.federationPort, options.peers);
+    }
+    if (!options.handoffPath.empty()) {
+        // The replacement process is started with the same arguments
+        std::vector<std::string> restartArgv(argv, argv + argc);
+        char exePath[PATH_MAX];
+        ssize_t length = readlink("/proc/self/exe", exePath, sizeof(exePath) - 1);
+        if (length > 0) {
+            restartArgv[0].assign(exePath, length);
+        }
+        server.enableHotRestart(options.handoffPath, restartArgv);
+    }
+
+    // Socket options, limits and the reloadable tunables (memory budget, overload limit, ...);
+    // SIGHUP re-reads the config file
+    server.enableConfig(config);
 
     if (!server.start()) {
         std::cerr << "Server failed to start!" << std::endl;
@@ -78,6 +145,7 @@ int main(int argc, char* argv[]) {
 
     // Run server main loop
     server.run();
+    server.stop();
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,547 @@
+#include "FaultProxy.h"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t monotonicUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool FaultProfile::preset(const std::string& name, FaultProfile& profile) {
+    FaultProfile result;
+    result.name = name;
+    if (name == "none") {
+    }
+    else if (name == "fragment") {
+        // Frames split at arbitrary byte boundaries, each piece a separate read on the server
+        result.fragment = 7;
+        result.fragmentGapUs = 300;
+    }
+    else if (name == "slow-reader") {
+        // A fifth of the clients read slowly and stall now and then
+        result.share = 0.2;
+        result.delayMs = 50;
+        result.jitterMs = 50;
+        result.throttle = 32 * 1024;
+        result.stallRate = 0.05;
+        result.stallMs = 3000;
+    }
+    else if (name == "garbage") {
+        // Corrupted, duplicated and junk-prefixed data forcing the server to resync on FF FE
+        result.fragment = 64;
+        result.corruptRate = 0.01;
+        result.duplicateRate = 0.01;
+        result.garbageRate = 0.01;
+    }
+    else if (name == "mixed") {
+        result.share = 0.5;
+        result.fragment = 16;
+        result.delayMs = 20;
+        result.jitterMs = 20;
+        result.throttle = 256 * 1024;
+        result.stallRate = 0.01;
+        result.stallMs = 2000;
+        result.duplicateRate = 0.002;
+        result.corruptRate = 0.002;
+        result.garbageRate = 0.002;
+    }
+    else {
+        return false;
+    }
+    profile = result;
+    return true;
+}
+
+bool FaultProfile::parse(const std::string& spec, FaultProfile& profile) {
+    FaultProfile result;
+    bool custom = false;
+    std::istringstream stream(spec);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (item.empty()) {
+            continue;
+        }
+        size_t equals = item.find('=');
+        if (equals == std::string::npos) {
+            std::string name = result.name;
+            if (!preset(item, result)) {
+                std::cerr << "Error: Unknown fault preset " << item << std::endl;
+                return false;
+            }
+            if (custom) {
+                result.name = name + "+" + item;
+            }
+            continue;
+        }
+        std::string key = item.substr(0, equals);
+        std::string value = item.substr(equals + 1);
+        double number = std::atof(value.c_str());
+        if (number < 0) {
+            std::cerr << "Error: Fault " << key << " must not be negative" << std::endl;
+            return false;
+        }
+        if (key == "share") {
+            result.share = std::min(number, 1.0);
+        }
+        else if (key == "fragment") {
+            result.fragment = static_cast<size_t>(number);
+        }
+        else if (key == "gap") {
+            result.fragmentGapUs = static_cast<uint32_t>(number);
+        }
+        else if (key == "delay") {
+            result.delayMs = static_cast<uint32_t>(number);
+        }
+        else if (key == "jitter") {
+            result.jitterMs = static_cast<uint32_t>(number);
+        }
+        else if (key == "throttle") {
+            result.throttle = static_cast<uint64_t>(number);
+        }
+        else if (key == "stall") {
+            // rate:ms
+            size_t colon = value.find(':');
+            result.stallRate = number;
+            result.stallMs = colon == std::string::npos ? 1000 : static_cast<uint32_t>(std::atoi(value.c_str() + colon + 1));
+        }
+        else if (key == "dup") {
+            result.duplicateRate = number;
+        }
+        else if (key == "corrupt") {
+            result.corruptRate = number;
+        }
+        else if (key == "garbage") {
+            result.garbageRate = number;
+        }
+        else {
+            std::cerr << "Error: Unknown fault " << key << std::endl;
+            return false;
+        }
+        if (!custom) {
+            result.name = result.name == "none" ? "custom" : result.name + "+custom";
+            custom = true;
+        }
+    }
+    profile = result;
+    return true;
+}
+
+std::string FaultProfile::toString() const {
+    std::ostringstream out;
+    out << name << " (share " << share;
+    if (fragment > 0) {
+        out << ", fragment 1.." << fragment << " gap " << fragmentGapUs << "us";
+    }
+    if (delayMs > 0 || jitterMs > 0) {
+        out << ", delay " << delayMs << "+" << jitterMs << "ms";
+    }
+    if (throttle > 0) {
+        out << ", throttle " << throttle << " B/s";
+    }
+    if (stallRate > 0) {
+        out << ", stall " << stallRate << "/s for " << stallMs << "ms";
+    }
+    if (duplicateRate > 0) {
+        out << ", dup " << duplicateRate;
+    }
+    if (corruptRate > 0) {
+        out << ", corrupt " << corruptRate;
+    }
+    if (garbageRate > 0) {
+        out << ", garbage " << garbageRate;
+    }
+    out << ")";
+    return out.str();
+}
+
+std::string FaultStats::describe() const {
+    std::ostringstream out;
+    out << "proxy " << active.load() << " active/" << accepted.load() << " accepted";
+    if (failed.load() > 0) {
+        out << " (" << failed.load() << " upstream failures)";
+    }
+    out << ", up " << bytesUp.load() << " B, down " << bytesDown.load() << " B, pieces " << pieces.load()
+        << ", stalls " << stalls.load() << ", dup " << duplicated.load() << ", corrupt " << corrupted.load()
+        << ", garbage " << garbage.load();
+    return out.str();
+}
+
+int connectEndpoint(const ListenEndpoint& target) {
+    int fd = -1;
+    int result = -1;
+    if (target.family == ListenEndpoint::UNIX) {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, target.address.c_str(), sizeof(address.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd != -1) {
+            result = connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+        }
+    }
+    else if (target.family == ListenEndpoint::IPV6) {
+        struct sockaddr_in6 address;
+        memset(&address, 0, sizeof(address));
+        address.sin6_family = AF_INET6;
+        address.sin6_port = htons(target.port);
+        inet_pton(AF_INET6, target.address.c_str(), &address.sin6_addr);
+        fd = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd != -1) {
+            result = connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+        }
+    }
+    else {
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(target.port);
+        inet_pton(AF_INET, target.address.c_str(), &address.sin_addr);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd != -1) {
+            result = connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+        }
+    }
+    if (result == -1) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+    if (target.family != ListenEndpoint::UNIX) {
+        int flag = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+CFaultProxy::CFaultProxy(const ListenEndpoint& listen, const ListenEndpoint& target, uint64_t seed)
+    : m_listener(listen), m_target(target), m_epollFd(-1), m_random(seed)
+{
+}
+
+CFaultProxy::~CFaultProxy() {
+    for (auto& pair : m_pairs) {
+        closePair(*pair.second);
+    }
+    m_pairs.clear();
+    m_listener.close(true);
+    if (m_epollFd != -1) {
+        close(m_epollFd);
+    }
+}
+
+bool CFaultProxy::open() {
+    if (!m_listener.open()) {
+        return false;
+    }
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epollFd == -1) {
+        std::cerr << "Failed to create epoll: " << strerror(errno) << std::endl;
+        return false;
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = m_listener.fd();
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_listener.fd(), &event);
+    return true;
+}
+
+void CFaultProxy::setProfile(const FaultProfile& profile) {
+    std::lock_guard<std::mutex> lock(m_profileMutex);
+    m_profile = profile;
+}
+
+void CFaultProxy::acceptAll() {
+    while (true) {
+        std::string ip;
+        int port = 0;
+        int clientFd = m_listener.accept(ip, port);
+        if (clientFd == -1) {
+            return;
+        }
+        fcntl(clientFd, F_SETFL, fcntl(clientFd, F_GETFL, 0) | O_NONBLOCK);
+        int flag = 1;
+        setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+        m_stats.accepted++;
+
+        int serverFd = connectEndpoint(m_target);
+        if (serverFd == -1) {
+            m_stats.failed++;
+            close(clientFd);
+            continue;
+        }
+
+        std::shared_ptr<Pair> pair = std::make_shared<Pair>();
+        {
+            std::lock_guard<std::mutex> lock(m_profileMutex);
+            pair->profile = m_profile;
+        }
+        pair->faulty = uniform() < pair->profile.share;
+        pair->clientFd = clientFd;
+        pair->serverFd = serverFd;
+        pair->up.from = clientFd;
+        pair->up.to = serverFd;
+        pair->up.upstream = true;
+        pair->down.from = serverFd;
+        pair->down.to = clientFd;
+        pair->clientEvents = EPOLLIN;
+        pair->serverEvents = EPOLLIN;
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = clientFd;
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, clientFd, &event);
+        event.data.fd = serverFd;
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, serverFd, &event);
+        m_pairs[clientFd] = pair;
+        m_pairs[serverFd] = pair;
+        m_stats.active++;
+    }
+}
+
+// Read one chunk and queue it with its faults applied; false if the side closed
+bool CFaultProxy::readPipe(Pair& pair, Pipe& pipe, uint64_t now) {
+    char buffer[READ_SIZE];
+    ssize_t count = recv(pipe.from, buffer, sizeof(buffer), 0);
+    if (count == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return true;
+    }
+    if (count <= 0) {
+        return false;
+    }
+    (pipe.upstream ? m_stats.bytesUp : m_stats.bytesDown) += static_cast<uint64_t>(count);
+
+    const FaultProfile& profile = pair.profile;
+    bool faulty = pair.faulty;
+    uint64_t releaseUs = now;
+    if (faulty) {
+        releaseUs += static_cast<uint64_t>(profile.delayMs) * 1000 + below(static_cast<uint64_t>(profile.jitterMs) * 1000 + 1);
+    }
+    // Jitter never reorders the stream
+    releaseUs = std::max(releaseUs, pipe.lastReleaseUs);
+    pipe.lastReleaseUs = releaseUs;
+
+    std::string data(buffer, static_cast<size_t>(count));
+    auto enqueue = [&](std::string bytes) {
+        pipe.queued += bytes.size();
+        Chunk chunk;
+        chunk.releaseUs = releaseUs;
+        chunk.data = std::move(bytes);
+        pipe.queue.push_back(std::move(chunk));
+    };
+
+    if (faulty && pipe.upstream) {
+        if (profile.garbageRate > 0 && uniform() < profile.garbageRate) {
+            // Half of the junk starts with a frame marker and an implausible or truncated header
+            std::string junk;
+            if (uniform() < 0.5) {
+                junk.append("\xFF\xFE", 2);
+            }
+            size_t size = 1 + below(32);
+            for (size_t i = 0; i < size; ++i) {
+                junk.push_back(static_cast<char>(m_random()));
+            }
+            enqueue(std::move(junk));
+            m_stats.garbage++;
+        }
+        if (profile.corruptRate > 0 && uniform() < profile.corruptRate) {
+            size_t index = below(data.size());
+            data[index] = static_cast<char>(data[index] ^ (1 + below(255)));
+            m_stats.corrupted++;
+        }
+        if (profile.duplicateRate > 0 && uniform() < profile.duplicateRate) {
+            enqueue(data);
+            m_stats.duplicated++;
+        }
+    }
+    enqueue(std::move(data));
+    return true;
+}
+
+// Send whatever is due; false if the destination failed
+bool CFaultProxy::flushPipe(Pair& pair, Pipe& pipe, uint64_t now) {
+    const FaultProfile& profile = pair.profile;
+    bool faulty = pair.faulty;
+    size_t fragment = faulty && pipe.upstream ? profile.fragment : 0;
+    uint64_t throttle = faulty && !pipe.upstream ? profile.throttle : 0;
+
+    while (!pipe.queue.empty() && pipe.queue.front().releaseUs <= now && pipe.nextSendUs <= now) {
+        Chunk& chunk = pipe.queue.front();
+        size_t size = chunk.data.size() - chunk.sent;
+        if (fragment > 0) {
+            size = std::min<size_t>(size, 1 + below(fragment));
+        }
+        if (throttle > 0) {
+            // Pace in slices of about 10 ms worth of data
+            size = std::min<size_t>(size, std::max<uint64_t>(throttle / 100, 512));
+        }
+        ssize_t written = send(pipe.to, chunk.data.data() + chunk.sent, size, MSG_NOSIGNAL);
+        if (written == -1 && errno == EINTR) {
+            continue;
+        }
+        if (written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            pipe.blocked = true;
+            return true;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        pipe.blocked = false;
+        chunk.sent += static_cast<size_t>(written);
+        pipe.queued -= static_cast<size_t>(written);
+        if (chunk.sent == chunk.data.size()) {
+            pipe.queue.pop_front();
+        }
+        if (fragment > 0) {
+            m_stats.pieces++;
+            pipe.nextSendUs = now + below(profile.fragmentGapUs + 1);
+        }
+        if (throttle > 0) {
+            pipe.nextSendUs = std::max(pipe.nextSendUs, now + static_cast<uint64_t>(written) * 1000000 / throttle);
+        }
+    }
+    return true;
+}
+
+uint64_t CFaultProxy::nextWakeUs(const Pipe& pipe, uint64_t now) const {
+    uint64_t wake = UINT64_MAX;
+    if (!pipe.queue.empty() && !pipe.blocked) {
+        wake = std::max(pipe.queue.front().releaseUs, pipe.nextSendUs);
+    }
+    if (pipe.stalledUntilUs > now) {
+        wake = std::min(wake, pipe.stalledUntilUs);
+    }
+    return wake;
+}
+
+void CFaultProxy::updateInterest(Pair& pair, uint64_t now) {
+    // A side is read while its data can be queued, and polled for writing while a send is blocked
+    auto readable = [&](const Pipe& pipe) { return pipe.queued < MAX_QUEUED && pipe.stalledUntilUs <= now; };
+    uint32_t clientEvents = (readable(pair.up) ? static_cast<uint32_t>(EPOLLIN) : 0u) |
+        (pair.down.blocked ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    uint32_t serverEvents = (readable(pair.down) ? static_cast<uint32_t>(EPOLLIN) : 0u) |
+        (pair.up.blocked ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    struct epoll_event event;
+    if (clientEvents != pair.clientEvents) {
+        event.events = clientEvents;
+        event.data.fd = pair.clientFd;
+        epoll_ctl(m_epollFd, EPOLL_CTL_MOD, pair.clientFd, &event);
+        pair.clientEvents = clientEvents;
+    }
+    if (serverEvents != pair.serverEvents) {
+        event.events = serverEvents;
+        event.data.fd = pair.serverFd;
+        epoll_ctl(m_epollFd, EPOLL_CTL_MOD, pair.serverFd, &event);
+        pair.serverEvents = serverEvents;
+    }
+}
+
+void CFaultProxy::closePair(Pair& pair) {
+    if (pair.closed) {
+        return;
+    }
+    pair.closed = true;
+    close(pair.clientFd);
+    close(pair.serverFd);
+    m_stats.active--;
+}
+
+void CFaultProxy::run(const std::atomic<bool>& running) {
+    uint64_t nextStallTickUs = monotonicUs() + 1000000;
+    std::vector<std::shared_ptr<Pair>> pairs;
+    while (running.load()) {
+        uint64_t now = monotonicUs();
+
+        // Collect each pair once; both of its fds are in the map
+        pairs.clear();
+        for (const auto& entry : m_pairs) {
+            if (entry.first == entry.second->clientFd) {
+                pairs.push_back(entry.second);
+            }
+        }
+
+        // Stalls start once a second, per faulty connection
+        if (now >= nextStallTickUs) {
+            nextStallTickUs = now + 1000000;
+            for (auto& pair : pairs) {
+                if (pair->faulty && pair->profile.stallRate > 0 && pair->down.stalledUntilUs <= now &&
+                    uniform() < pair->profile.stallRate) {
+                    pair->down.stalledUntilUs = now + static_cast<uint64_t>(pair->profile.stallMs) * 1000;
+                    m_stats.stalls++;
+                }
+            }
+        }
+
+        // Send what is due, then sleep until the next release, pacing slot or stall end
+        uint64_t wakeUs = std::min(nextStallTickUs, now + 100000);
+        for (auto& pair : pairs) {
+            if (!flushPipe(*pair, pair->up, now) || !flushPipe(*pair, pair->down, now)) {
+                closePair(*pair);
+                continue;
+            }
+            updateInterest(*pair, now);
+            wakeUs = std::min({ wakeUs, nextWakeUs(pair->up, now), nextWakeUs(pair->down, now) });
+        }
+        for (auto& pair : pairs) {
+            if (pair->closed) {
+                m_pairs.erase(pair->clientFd);
+                m_pairs.erase(pair->serverFd);
+            }
+        }
+
+        int timeoutMs = wakeUs > now ? static_cast<int>((wakeUs - now + 999) / 1000) : 0;
+        struct epoll_event events[256];
+        int count = epoll_wait(m_epollFd, events, 256, timeoutMs);
+        if (count == -1 && errno != EINTR) {
+            std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
+            return;
+        }
+        now = monotonicUs();
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == m_listener.fd()) {
+                acceptAll();
+                continue;
+            }
+            auto it = m_pairs.find(fd);
+            if (it == m_pairs.end()) {
+                continue;
+            }
+            std::shared_ptr<Pair> pair = it->second;
+            if (pair->closed) {
+                continue;
+            }
+            bool client = fd == pair->clientFd;
+            Pipe& inbound = client ? pair->up : pair->down;
+            Pipe& outbound = client ? pair->down : pair->up;
+            bool alive = true;
+            if (events[i].events & EPOLLOUT) {
+                outbound.blocked = false;
+                alive = flushPipe(*pair, outbound, now);
+            }
+            if (alive && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                alive = readPipe(*pair, inbound, now);
+            }
+            if (!alive) {
+                closePair(*pair);
+                m_pairs.erase(pair->clientFd);
+                m_pairs.erase(pair->serverFd);
+            }
+        }
+    }
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include "Listener.h"
+
+// Faults injected into one proxied connection.
+// Where they apply:
+//   delay, jitter                both directions
+//   fragment                     client -> server (partial frames at the server)
+//   corrupt, duplicate, garbage  client -> server (exercises the server's header resync)
+//   throttle, stall              server -> client (a slow or stalled reader; the server's queue grows)
+// Spec: a preset name and/or comma separated key=value pairs, applied left to right, e.g.
+//   "mixed", "fragment=7,gap=200", "slow-reader,share=0.5", "corrupt=0.01,dup=0.001"
+// Presets: none, fragment, slow-reader, garbage, mixed
+struct FaultProfile {
+    std::string name = "none";
+    double share = 1.0;            // Fraction of connections the faults apply to (chosen at accept)
+    size_t fragment = 0;           // Forward data in pieces of 1..N bytes (0 = as read)
+    uint32_t fragmentGapUs = 500;  // Pause up to this long between pieces so they arrive as separate reads
+    uint32_t delayMs = 0;          // Added one-way latency
+    uint32_t jitterMs = 0;         // Random extra latency 0..N; order is preserved
+    uint64_t throttle = 0;         // Server -> client bytes/s (0 = unlimited)
+    double stallRate = 0;          // Chance per second that a connection stops reading from the server
+    uint32_t stallMs = 0;          // How long a stall lasts
+    double duplicateRate = 0;      // Chance per chunk that it is forwarded twice
+    double corruptRate = 0;        // Chance per chunk that one byte is flipped
+    double garbageRate = 0;        // Chance per chunk that junk (sometimes a bogus FF FE header) precedes it
+
+    static bool parse(const std::string& spec, FaultProfile& profile);
+    static bool preset(const std::string& name, FaultProfile& profile);
+    std::string toString() const;
+};
+
+// Counters shared with the thread that reports them
+struct FaultStats {
+    std::atomic<uint64_t> accepted{ 0 };
+    std::atomic<uint64_t> failed{ 0 };        // Upstream connect failures
+    std::atomic<uint64_t> active{ 0 };
+    std::atomic<uint64_t> bytesUp{ 0 };
+    std::atomic<uint64_t> bytesDown{ 0 };
+    std::atomic<uint64_t> pieces{ 0 };        // send() calls made while fragmenting
+    std::atomic<uint64_t> duplicated{ 0 };
+    std::atomic<uint64_t> corrupted{ 0 };
+    std::atomic<uint64_t> garbage{ 0 };
+    std::atomic<uint64_t> stalls{ 0 };
+
+    std::string describe() const;
+};
+
+// Connect to a server endpoint (TCP, IPv6 or Unix socket); returns a non-blocking fd or -1
+int connectEndpoint(const ListenEndpoint& target);
+
+// Fault-injection proxy: accepts connections on one endpoint, opens one to the target for each
+// and forwards both directions through the current FaultProfile.
+// Single-threaded epoll loop; setProfile() and the stats may be used from other threads.
+class CFaultProxy
+{
+public:
+    CFaultProxy(const ListenEndpoint& listen, const ListenEndpoint& target, uint64_t seed);
+    ~CFaultProxy();
+
+    bool open();
+    // Applies to connections accepted afterwards
+    void setProfile(const FaultProfile& profile);
+    // Event loop; returns once running becomes false
+    void run(const std::atomic<bool>& running);
+
+    const FaultStats& stats() const { return m_stats; }
+
+private:
+    static const size_t READ_SIZE = 65536;
+    static const size_t MAX_QUEUED = 1024 * 1024;  // Stop reading a side whose data is not leaving
+
+    struct Chunk {
+        uint64_t releaseUs;
+        std::string data;
+        size_t sent = 0;
+    };
+
+    struct Pipe {
+        int from = -1;
+        int to = -1;
+        bool upstream = false;
+        std::deque<Chunk> queue;
+        size_t queued = 0;
+        uint64_t lastReleaseUs = 0;
+        uint64_t nextSendUs = 0;       // Fragment gap / throttle pacing
+        uint64_t stalledUntilUs = 0;
+        bool blocked = false;          // Last send hit EAGAIN
+    };
+
+    struct Pair {
+        int clientFd = -1;
+        int serverFd = -1;
+        bool faulty = false;
+        FaultProfile profile;
+        Pipe up;
+        Pipe down;
+        uint32_t clientEvents = 0;
+        uint32_t serverEvents = 0;
+        bool closed = false;
+    };
+
+    void acceptAll();
+    bool readPipe(Pair& pair, Pipe& pipe, uint64_t now);
+    bool flushPipe(Pair& pair, Pipe& pipe, uint64_t now);
+    void updateInterest(Pair& pair, uint64_t now);
+    uint64_t nextWakeUs(const Pipe& pipe, uint64_t now) const;
+    void closePair(Pair& pair);
+
+    double uniform() { return std::uniform_real_distribution<double>(0.0, 1.0)(m_random); }
+    uint64_t below(uint64_t bound) { return bound == 0 ? 0 : m_random() % bound; }
+
+    CListener m_listener;
+    ListenEndpoint m_target;
+    int m_epollFd;
+    std::mt19937_64 m_random;
+
+    std::mutex m_profileMutex;
+    FaultProfile m_profile;
+
+    std::map<int, std::shared_ptr<Pair>> m_pairs;  // Both fds of a pair map to it
+    FaultStats m_stats;
+};
@@ -0,0 +1,824 @@
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "FaultProxy.h"
+#include "Listener.h"
+#include "Packet.h"
+
+// Fault-injection proxy and soak test for serveqt.
+//
+//   soak proxy --listen host:port --target host:port [--faults SPEC]
+//       Only the proxy: point any client (or replay) at --listen.
+//
+//   soak run --target host:port [--pid PID] [--scenarios a,b,...] [--duration 4h] ...
+//       Runs a chat load through an in-process proxy for hours, cycling through the fault
+//       scenarios, and watches the server: RSS and open fds (/proc/PID), event loop lag
+//       (TEST_CONNECT round trips on a direct connection that bypasses the proxy) and
+//       delivered chat throughput. Exits 1 if any check fails:
+//         - throughput below --min-throughput of the scenario's baseline for 3 reports in a row
+//         - probe p99 above --max-lag-ms for 3 reports in a row, or the probe unanswered
+//         - RSS more than --max-rss-growth MB above its level after the first scenario cycle
+//         - open fds not back within --max-fd-growth of the idle count once the load stops
+//         - the server process exits
+// The throughput baseline of each scenario is learned during its first --warmup-s seconds,
+// skipping the first report after the switch (all clients reconnect when the scenario changes).
+
+static const uint16_t TEXT_MESSAGE = 1;
+static const uint16_t ADMIN = 14;
+static const uint16_t TEST_CONNECT = 1981;
+static const int ADMIN_TIMEOUT_MS = 2000;
+static const size_t MAX_CLIENT_PENDING = 256 * 1024;  // Skip sends while the proxy is not taking data
+static const uint64_t PROBE_TIMEOUT_US = 5000000;     // An unanswered probe counts as this much lag
+static const int STRIKES = 3;                         // Consecutive bad reports before failing
+static const int SETTLE_TIMEOUT_MS = 10000;           // Wait for the server to close fds after the load
+
+struct Options {
+    std::string mode;
+    ListenEndpoint target;
+    ListenEndpoint listen;
+    std::string faults = "none";
+    int pid = 0;
+    int clients = 32;
+    double rate = 5;                 // Chat messages per client per second
+    size_t size = 128;               // Message bytes
+    double churn = 0.01;             // Chance per second per client to reconnect
+    std::vector<std::string> scenarios = { "fragment", "slow-reader", "garbage", "mixed" };
+    uint64_t scenarioS = 300;
+    uint64_t durationS = 3600;
+    uint64_t reportS = 10;
+    uint64_t warmupS = 30;
+    int probeMs = 100;
+    double minThroughput = 0.3;
+    uint64_t maxLagMs = 250;
+    uint64_t maxRssGrowthMb = 64;
+    uint64_t maxFdGrowth = 8;
+    uint64_t seed = 0;
+};
+
+struct LoadClient {
+    int fd = -1;
+    std::string pending;
+    size_t sent = 0;
+    std::string inbound;
+    uint64_t nextSendUs = 0;
+};
+
+static std::atomic<bool> g_running(true);
+
+static void onSignal(int) {
+    g_running = false;
+}
+
+static uint64_t nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// "90", "90s", "30m", "4h"
+static bool parseDuration(const std::string& text, uint64_t& seconds) {
+    char* end = nullptr;
+    double value = strtod(text.c_str(), &end);
+    if (end == text.c_str() || value <= 0) {
+        return false;
+    }
+    std::string unit = end;
+    double scale = unit.empty() || unit == "s" ? 1 : unit == "m" ? 60 : unit == "h" ? 3600 : 0;
+    if (scale == 0) {
+        return false;
+    }
+    seconds = static_cast<uint64_t>(value * scale);
+    return seconds > 0;
+}
+
+static std::string frameOf(uint16_t cmd, const std::string& data) {
+    CPacket packet(cmd, reinterpret_cast<const uint8_t*>(data.data()), data.size());
+    return std::string(packet.Data(), packet.Size());
+}
+
+// Count complete frames with the given command and drop everything parsed
+static uint64_t takeFrames(std::string& buffer, uint16_t wanted) {
+    uint64_t frames = 0;
+    size_t offset = 0;
+    while (buffer.size() - offset >= 10) {
+        size_t head = buffer.find("\xFF\xFE", offset, 2);
+        if (head == std::string::npos) {
+            offset = buffer.size() - 1;
+            break;
+        }
+        if (buffer.size() - head < 8) {
+            offset = head;
+            break;
+        }
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(buffer.data() + head);
+        size_t length = (static_cast<size_t>(bytes[2]) << 24) | (bytes[3] << 16) | (bytes[4] << 8) | bytes[5];
+        if (length < 4) {
+            offset = head + 1;
+            continue;
+        }
+        if (buffer.size() - head < 6 + length) {
+            offset = head;
+            break;
+        }
+        uint16_t cmd = static_cast<uint16_t>((bytes[6] << 8) | bytes[7]) & ~CPacket::CMD_COMPRESSED;
+        if (cmd == wanted) {
+            frames++;
+        }
+        offset = head + 6 + length;
+    }
+    buffer.erase(0, offset);
+    return frames;
+}
+
+// Read everything available; false once the peer closed the connection
+static bool drainSocket(int fd, uint64_t& bytesRead, std::string& keep) {
+    char buffer[65536];
+    while (true) {
+        ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+        if (count > 0) {
+            bytesRead += count;
+            keep.append(buffer, count);
+            continue;
+        }
+        if (count == -1 && errno == EINTR) {
+            continue;
+        }
+        return count == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+}
+
+static bool flushClient(LoadClient& client) {
+    while (client.sent < client.pending.size()) {
+        ssize_t written = send(client.fd, client.pending.data() + client.sent, client.pending.size() - client.sent,
+            MSG_NOSIGNAL);
+        if (written > 0) {
+            client.sent += written;
+            continue;
+        }
+        if (written == -1 && errno == EINTR) {
+            continue;
+        }
+        return written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+    client.pending.clear();
+    client.sent = 0;
+    return true;
+}
+
+// Send one admin command on a short-lived connection and wait for its reply.
+// Returns an empty string if the server does not answer (remote target, old server).
+static std::string adminQuery(const ListenEndpoint& target, const std::string& request) {
+    int fd = connectEndpoint(target);
+    if (fd == -1) {
+        return "";
+    }
+    std::string frame = frameOf(ADMIN, request);
+    std::string buffer;
+    std::string reply;
+    size_t sent = 0;
+    uint64_t deadline = nowUs() + static_cast<uint64_t>(ADMIN_TIMEOUT_MS) * 1000;
+    while (reply.empty() && nowUs() < deadline) {
+        struct pollfd pfd = { fd, static_cast<short>(POLLIN | (sent < frame.size() ? POLLOUT : 0)), 0 };
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        if (sent < frame.size() && (pfd.revents & POLLOUT)) {
+            ssize_t count = send(fd, frame.data() + sent, frame.size() - sent, MSG_NOSIGNAL);
+            if (count > 0) {
+                sent += static_cast<size_t>(count);
+            }
+        }
+        uint64_t ignored = 0;
+        if (!drainSocket(fd, ignored, buffer)) {
+            break;
+        }
+        // Skip broadcasts and presence updates until the admin reply
+        size_t offset = 0;
+        while (reply.empty() && buffer.size() - offset >= 10) {
+            size_t head = buffer.find("\xFF\xFE", offset, 2);
+            if (head == std::string::npos || buffer.size() - head < 8) {
+                break;
+            }
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(buffer.data() + head);
+            size_t length = (static_cast<size_t>(bytes[2]) << 24) | (bytes[3] << 16) | (bytes[4] << 8) | bytes[5];
+            if (length < 4) {
+                offset = head + 1;
+                continue;
+            }
+            if (buffer.size() - head < 6 + length) {
+                break;
+            }
+            uint16_t cmd = static_cast<uint16_t>((bytes[6] << 8) | bytes[7]);
+            if (cmd == ADMIN) {
+                reply.assign(buffer, head + 8, length - 4);
+            }
+            offset = head + 6 + length;
+        }
+        buffer.erase(0, offset);
+    }
+    close(fd);
+    return reply;
+}
+
+// Resident set size in kB from /proc/PID/status; 0 if the process is gone
+static uint64_t readRssKb(int pid) {
+    FILE* file = fopen(("/proc/" + std::to_string(pid) + "/status").c_str(), "r");
+    if (!file) {
+        return 0;
+    }
+    char line[256];
+    uint64_t rss = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "VmRSS:", 6) == 0) {
+            rss = strtoull(line + 6, nullptr, 10);
+            break;
+        }
+    }
+    fclose(file);
+    return rss;
+}
+
+// Open file descriptors of the process; -1 if the process is gone
+static int countFds(int pid) {
+    DIR* dir = opendir(("/proc/" + std::to_string(pid) + "/fd").c_str());
+    if (!dir) {
+        return -1;
+    }
+    int count = 0;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            count++;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+static uint64_t percentile(const std::vector<uint64_t>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static void usage(const char* program) {
+    std::cerr << "Usage: " << program << " proxy --listen host:port --target host:port [--faults SPEC]"
+        << " [--report-s N] [--seed N]" << std::endl
+        << "       " << program << " run --target host:port [--pid PID] [--proxy host:port]"
+        << " [--scenarios a,b,...] [--scenario-s N] [--duration 90s|30m|4h] [--clients N] [--rate N]"
+        << " [--size N] [--churn P] [--report-s N] [--warmup-s N] [--probe-ms N] [--min-throughput F]"
+        << " [--max-lag-ms N] [--max-rss-growth MB] [--max-fd-growth N] [--seed N]" << std::endl
+        << "Fault presets: none, fragment, slow-reader, garbage, mixed; add key=value to adjust"
+        << " (share, fragment, gap, delay, jitter, throttle, stall=rate:ms, dup, corrupt, garbage)" << std::endl;
+}
+
+static bool parseOptions(int argc, char* argv[], Options& options) {
+    if (argc < 2) {
+        return false;
+    }
+    options.mode = argv[1];
+    if (options.mode != "proxy" && options.mode != "run") {
+        return false;
+    }
+    ListenEndpoint::parse("127.0.0.1:8080", options.target);
+    ListenEndpoint::parse("127.0.0.1:18080", options.listen);
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        std::string value = hasValue ? argv[i + 1] : "";
+        if (!hasValue) {
+            return false;
+        }
+        i++;
+        if (arg == "--target" || arg == "--listen" || arg == "--proxy") {
+            if (!ListenEndpoint::parse(value, arg == "--target" ? options.target : options.listen)) {
+                std::cerr << "Error: Invalid address " << value << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--faults") {
+            options.faults = value;
+        }
+        else if (arg == "--scenarios") {
+            options.scenarios.clear();
+            std::istringstream stream(value);
+            std::string item;
+            // Separated by '/' instead of ',' when the scenarios carry key=value adjustments
+            while (std::getline(stream, item, value.find('/') != std::string::npos ? '/' : ',')) {
+                if (!item.empty()) {
+                    options.scenarios.push_back(item);
+                }
+            }
+            if (options.scenarios.empty()) {
+                return false;
+            }
+        }
+        else if (arg == "--duration" || arg == "--scenario-s") {
+            if (!parseDuration(value, arg == "--duration" ? options.durationS : options.scenarioS)) {
+                std::cerr << "Error: Invalid duration " << value << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--pid") {
+            options.pid = std::atoi(value.c_str());
+        }
+        else if (arg == "--clients") {
+            options.clients = std::atoi(value.c_str());
+        }
+        else if (arg == "--rate") {
+            options.rate = std::atof(value.c_str());
+        }
+        else if (arg == "--size") {
+            options.size = static_cast<size_t>(std::atoll(value.c_str()));
+        }
+        else if (arg == "--churn") {
+            options.churn = std::atof(value.c_str());
+        }
+        else if (arg == "--report-s") {
+            options.reportS = static_cast<uint64_t>(std::atoll(value.c_str()));
+        }
+        else if (arg == "--warmup-s") {
+            options.warmupS = static_cast<uint64_t>(std::atoll(value.c_str()));
+        }
+        else if (arg == "--probe-ms") {
+            options.probeMs = std::atoi(value.c_str());
+        }
+        else if (arg == "--min-throughput") {
+            options.minThroughput = std::atof(value.c_str());
+        }
+        else if (arg == "--max-lag-ms") {
+            options.maxLagMs = static_cast<uint64_t>(std::atoll(value.c_str()));
+        }
+        else if (arg == "--max-rss-growth") {
+            options.maxRssGrowthMb = static_cast<uint64_t>(std::atoll(value.c_str()));
+        }
+        else if (arg == "--max-fd-growth") {
+            options.maxFdGrowth = static_cast<uint64_t>(std::atoll(value.c_str()));
+        }
+        else if (arg == "--seed") {
+            options.seed = static_cast<uint64_t>(std::atoll(value.c_str()));
+        }
+        else {
+            return false;
+        }
+    }
+    if (options.clients <= 0 || options.rate <= 0 || options.size == 0 || options.reportS == 0 || options.probeMs <= 0) {
+        std::cerr << "Error: --clients, --rate, --size, --report-s and --probe-ms must be positive." << std::endl;
+        return false;
+    }
+    if (options.seed == 0) {
+        options.seed = static_cast<uint64_t>(time(nullptr));
+    }
+    return true;
+}
+
+static int runProxy(const Options& options) {
+    FaultProfile profile;
+    if (!FaultProfile::parse(options.faults, profile)) {
+        return 1;
+    }
+    CFaultProxy proxy(options.listen, options.target, options.seed);
+    if (!proxy.open()) {
+        return 1;
+    }
+    proxy.setProfile(profile);
+    std::cout << "Proxy " << options.listen.toString() << " -> " << options.target.toString() << ", faults "
+        << profile.toString() << ", seed " << options.seed << std::endl;
+
+    std::atomic<bool> proxyRunning(true);
+    std::thread thread([&]() { proxy.run(proxyRunning); });
+    uint64_t nextReportUs = nowUs() + options.reportS * 1000000;
+    while (g_running) {
+        usleep(100000);
+        if (nowUs() >= nextReportUs) {
+            nextReportUs += options.reportS * 1000000;
+            std::cout << proxy.stats().describe() << std::endl;
+        }
+    }
+    proxyRunning = false;
+    thread.join();
+    std::cout << proxy.stats().describe() << std::endl;
+    return 0;
+}
+
+static int runSoak(const Options& options) {
+    std::vector<FaultProfile> profiles;
+    for (const auto& spec : options.scenarios) {
+        FaultProfile profile;
+        if (!FaultProfile::parse(spec, profile)) {
+            return 1;
+        }
+        profiles.push_back(profile);
+    }
+    if (options.pid == 0) {
+        std::cerr << "Warning: no --pid, RSS and fd checks are skipped" << std::endl;
+    }
+
+    CFaultProxy proxy(options.listen, options.target, options.seed);
+    if (!proxy.open()) {
+        return 1;
+    }
+    proxy.setProfile(profiles[0]);
+    std::atomic<bool> proxyRunning(true);
+    std::thread proxyThread([&]() { proxy.run(proxyRunning); });
+
+    std::mt19937_64 random(options.seed + 1);
+    auto uniform = [&]() { return std::uniform_real_distribution<double>(0.0, 1.0)(random); };
+
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    int idleFds = options.pid ? countFds(options.pid) : -1;
+    std::vector<LoadClient> clients(options.clients);
+    uint64_t reconnects = 0;
+    uint64_t dropped = 0;            // Connections closed by the server or the proxy
+    uint64_t skipped = 0;            // Sends skipped because the client's data was not leaving
+
+    auto disconnect = [&](LoadClient& client) {
+        if (client.fd != -1) {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, client.fd, nullptr);
+            close(client.fd);
+        }
+        client = LoadClient();
+    };
+    auto connectClient = [&](size_t index, uint64_t now) {
+        LoadClient& client = clients[index];
+        disconnect(client);
+        client.fd = connectEndpoint(options.listen);
+        if (client.fd == -1) {
+            return;
+        }
+        // Spread the first sends over one interval
+        client.nextSendUs = now + static_cast<uint64_t>(uniform() * 1000000 / options.rate);
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        event.data.u64 = index;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, client.fd, &event);
+    };
+
+    // Direct probe connection: event loop lag without the proxy's faults
+    int probeFd = connectEndpoint(options.target);
+    if (probeFd == -1) {
+        std::cerr << "Failed to connect to " << options.target.toString() << std::endl;
+        proxyRunning = false;
+        proxyThread.join();
+        return 1;
+    }
+    const uint64_t PROBE_KEY = UINT64_MAX;
+    {
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLET;
+        event.data.u64 = PROBE_KEY;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, probeFd, &event);
+    }
+    std::string probeFrame = frameOf(TEST_CONNECT, "soak");
+    std::string probeBuffer;
+    uint64_t probeSentAt = 0;
+    uint64_t nextProbeAt = 0;
+    std::vector<uint64_t> lags;      // This report's probe round trips
+
+    std::string message(options.size, 'x');
+    std::string chatFrame = frameOf(TEXT_MESSAGE, message);
+    uint64_t intervalUs = static_cast<uint64_t>(1000000 / options.rate);
+
+    adminQuery(options.target, "latency-reset");
+    std::cout << "Soak " << options.listen.toString() << " -> " << options.target.toString() << ", "
+        << options.clients << " clients x " << options.rate << " msg/s x " << options.size << " B, "
+        << options.durationS << " s, seed " << options.seed << std::endl;
+    if (idleFds >= 0) {
+        std::cout << "Server pid " << options.pid << ": idle " << idleFds << " fds, " << readRssKb(options.pid)
+            << " kB RSS" << std::endl;
+    }
+
+    std::vector<std::string> failures;
+    auto fail = [&](const std::string& reason) {
+        std::cout << "FAIL: " << reason << std::endl;
+        failures.push_back(reason);
+    };
+
+    uint64_t startUs = nowUs();
+    uint64_t endUs = startUs + options.durationS * 1000000;
+    uint64_t nextReportUs = startUs + options.reportS * 1000000;
+    uint64_t nextChurnUs = startUs + 1000000;
+    size_t scenario = 0;
+    size_t cycle = 0;
+    uint64_t scenarioStartUs = startUs;
+    bool firstReportOfScenario = true;
+    std::vector<double> baseline(profiles.size(), 0);
+    std::vector<std::vector<double>> baselineSamples(profiles.size());
+    int throughputStrikes = 0;
+    int lagStrikes = 0;
+    uint64_t rssWarmupKb = 0;        // At the end of the first warmup
+    uint64_t rssReferenceKb = 0;     // Starts at rssWarmupKb, raised to the peak of the first cycle
+    uint64_t rssPeakKb = 0;
+    uint64_t windowSent = 0;
+    uint64_t windowReceived = 0;
+    uint64_t windowBytes = 0;
+    uint64_t totalSent = 0;
+    uint64_t totalReceived = 0;
+
+    std::cout << "Scenario " << profiles[0].toString() << std::endl;
+    for (size_t i = 0; i < clients.size(); ++i) {
+        connectClient(i, startUs);
+    }
+
+    while (g_running && failures.empty()) {
+        uint64_t now = nowUs();
+        if (now >= endUs) {
+            break;
+        }
+
+        // Next scenario: every client reconnects so the new faults apply to all of them
+        if (now - scenarioStartUs >= options.scenarioS * 1000000) {
+            scenario = (scenario + 1) % profiles.size();
+            if (scenario == 0) {
+                cycle++;
+            }
+            proxy.setProfile(profiles[scenario]);
+            for (size_t i = 0; i < clients.size(); ++i) {
+                connectClient(i, now);
+            }
+            scenarioStartUs = now;
+            firstReportOfScenario = true;
+            throughputStrikes = 0;
+            std::cout << "Scenario " << profiles[scenario].toString() << std::endl;
+        }
+
+        // Chat load
+        for (size_t i = 0; i < clients.size(); ++i) {
+            LoadClient& client = clients[i];
+            if (client.fd == -1) {
+                reconnects++;
+                connectClient(i, now);
+                continue;
+            }
+            while (client.nextSendUs <= now) {
+                client.nextSendUs += intervalUs;
+                if (client.pending.size() > MAX_CLIENT_PENDING) {
+                    skipped++;
+                    continue;
+                }
+                client.pending += chatFrame;
+                windowSent++;
+            }
+            if (!client.pending.empty() && !flushClient(client)) {
+                dropped++;
+                disconnect(client);
+            }
+        }
+        if (now >= nextChurnUs) {
+            nextChurnUs += 1000000;
+            for (size_t i = 0; i < clients.size(); ++i) {
+                if (uniform() < options.churn) {
+                    reconnects++;
+                    connectClient(i, now);
+                }
+            }
+        }
+
+        // Probe
+        if (probeSentAt == 0 && now >= nextProbeAt) {
+            if (send(probeFd, probeFrame.data(), probeFrame.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(probeFrame.size())) {
+                probeSentAt = now;
+            }
+            nextProbeAt = now + static_cast<uint64_t>(options.probeMs) * 1000;
+        }
+        else if (probeSentAt != 0 && now - probeSentAt > PROBE_TIMEOUT_US) {
+            lags.push_back(PROBE_TIMEOUT_US);
+            probeSentAt = 0;
+        }
+
+        // Report and checks
+        if (now >= nextReportUs) {
+            double seconds = (now - nextReportUs + options.reportS * 1000000) / 1000000.0;
+            nextReportUs = now + options.reportS * 1000000;
+            double received = windowReceived / seconds;
+            std::sort(lags.begin(), lags.end());
+            uint64_t lagP99 = percentile(lags, 0.99);
+            uint64_t rssKb = options.pid ? readRssKb(options.pid) : 0;
+            int fds = options.pid ? countFds(options.pid) : -1;
+            size_t connected = 0;
+            for (const auto& client : clients) {
+                connected += client.fd != -1 ? 1 : 0;
+            }
+            uint64_t elapsedS = (now - startUs) / 1000000;
+            uint64_t inScenarioS = (now - scenarioStartUs) / 1000000;
+
+            std::cout << "[" << std::setw(6) << elapsedS << "s] " << std::left << std::setw(12)
+                << profiles[scenario].name << std::right << " clients " << connected << "/" << clients.size()
+                << "  sent " << static_cast<uint64_t>(windowSent / seconds) << "/s  recv "
+                << static_cast<uint64_t>(received) << "/s " << std::fixed << std::setprecision(2)
+                << windowBytes / seconds / (1024 * 1024) << " MB/s  lag p50 " << percentile(lags, 0.5) / 1000.0
+                << " p99 " << lagP99 / 1000.0 << " max " << (lags.empty() ? 0 : lags.back()) / 1000.0 << " ms";
+            if (options.pid) {
+                std::cout << "  rss " << rssKb / 1024.0 << " MB  fds " << fds;
+            }
+            std::cout << std::defaultfloat << "  reconnects " << reconnects << " dropped " << dropped
+                << " skipped " << skipped << std::endl;
+            std::cout << "          " << proxy.stats().describe() << std::endl;
+
+            // Server process
+            if (options.pid && (rssKb == 0 || fds < 0)) {
+                fail("server process " + std::to_string(options.pid) + " is gone");
+            }
+
+            // Throughput against the scenario's baseline
+            if (inScenarioS <= options.warmupS && cycle == 0) {
+                if (!firstReportOfScenario) {
+                    baselineSamples[scenario].push_back(received);
+                }
+            }
+            else {
+                if (baseline[scenario] == 0) {
+                    auto& samples = baselineSamples[scenario];
+                    if (samples.empty()) {
+                        samples.push_back(received);
+                    }
+                    double sum = 0;
+                    for (double sample : samples) {
+                        sum += sample;
+                    }
+                    baseline[scenario] = std::max(sum / samples.size(), 1.0);
+                    std::cout << "          baseline " << static_cast<uint64_t>(baseline[scenario]) << " msg/s" << std::endl;
+                }
+                if (!firstReportOfScenario && received < baseline[scenario] * options.minThroughput) {
+                    if (++throughputStrikes >= STRIKES) {
+                        fail("throughput collapsed in " + profiles[scenario].name + ": " +
+                            std::to_string(static_cast<uint64_t>(received)) + " msg/s vs baseline " +
+                            std::to_string(static_cast<uint64_t>(baseline[scenario])));
+                    }
+                }
+                else {
+                    throughputStrikes = 0;
+                }
+            }
+
+            // Event loop lag
+            if (lags.empty() || lagP99 > options.maxLagMs * 1000) {
+                if (++lagStrikes >= STRIKES) {
+                    fail("event loop lag p99 " + std::to_string(lagP99 / 1000) + " ms above " +
+                        std::to_string(options.maxLagMs) + " ms");
+                }
+            }
+            else {
+                lagStrikes = 0;
+            }
+
+            // Memory: reference from the end of the first warmup, raised to the first cycle's peak
+            if (options.pid && rssKb > 0) {
+                rssPeakKb = std::max(rssPeakKb, rssKb);
+                if (rssReferenceKb == 0 && elapsedS >= options.warmupS) {
+                    rssWarmupKb = rssKb;
+                    rssReferenceKb = rssKb;
+                }
+                else if (rssReferenceKb != 0 && cycle == 0) {
+                    rssReferenceKb = std::max(rssReferenceKb, rssKb);
+                }
+                else if (rssReferenceKb != 0 && rssKb > rssReferenceKb + options.maxRssGrowthMb * 1024) {
+                    fail("RSS grew from " + std::to_string(rssReferenceKb / 1024) + " MB to " +
+                        std::to_string(rssKb / 1024) + " MB");
+                }
+                // Every soak connection holds one server fd; more than that is a leak in progress
+                if (idleFds >= 0 && fds > idleFds + static_cast<int>(clients.size() + 2 + options.maxFdGrowth)) {
+                    fail("server holds " + std::to_string(fds) + " fds for " + std::to_string(connected) +
+                        " clients (idle " + std::to_string(idleFds) + ")");
+                }
+            }
+
+            totalSent += windowSent;
+            totalReceived += windowReceived;
+            windowSent = 0;
+            windowReceived = 0;
+            windowBytes = 0;
+            lags.clear();
+            firstReportOfScenario = false;
+        }
+
+        // Sleep until the next send, probe or report
+        uint64_t wakeUs = std::min(nextReportUs, nextChurnUs);
+        for (const auto& client : clients) {
+            if (client.fd != -1) {
+                wakeUs = std::min(wakeUs, client.nextSendUs);
+            }
+        }
+        if (probeSentAt == 0) {
+            wakeUs = std::min(wakeUs, nextProbeAt);
+        }
+        int timeoutMs = wakeUs > now ? static_cast<int>(std::min<uint64_t>((wakeUs - now + 999) / 1000, 100)) : 0;
+        struct epoll_event events[256];
+        int count = epoll_wait(epollFd, events, 256, timeoutMs);
+        if (count == -1 && errno != EINTR) {
+            std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            uint64_t key = events[i].data.u64;
+            if (key == PROBE_KEY) {
+                uint64_t ignored = 0;
+                if (!drainSocket(probeFd, ignored, probeBuffer)) {
+                    fail("probe connection closed by the server");
+                    break;
+                }
+                if (takeFrames(probeBuffer, TEST_CONNECT) > 0 && probeSentAt != 0) {
+                    lags.push_back(nowUs() - probeSentAt);
+                    probeSentAt = 0;
+                }
+                continue;
+            }
+            LoadClient& client = clients[key];
+            if (client.fd == -1) {
+                continue;
+            }
+            bool alive = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                alive = drainSocket(client.fd, windowBytes, client.inbound);
+                windowReceived += takeFrames(client.inbound, TEXT_MESSAGE);
+            }
+            if (alive && (events[i].events & EPOLLOUT)) {
+                alive = flushClient(client);
+            }
+            if (!alive) {
+                dropped++;
+                disconnect(client);
+            }
+        }
+    }
+    totalSent += windowSent;
+    totalReceived += windowReceived;
+
+    // Stop the load and check that the server gives every fd back
+    for (auto& client : clients) {
+        disconnect(client);
+    }
+    proxyRunning = false;
+    proxyThread.join();
+    close(probeFd);
+    close(epollFd);
+    int finalFds = -1;
+    if (idleFds >= 0) {
+        uint64_t deadline = nowUs() + static_cast<uint64_t>(SETTLE_TIMEOUT_MS) * 1000;
+        do {
+            usleep(200000);
+            finalFds = countFds(options.pid);
+        } while (finalFds > idleFds + static_cast<int>(options.maxFdGrowth) && nowUs() < deadline);
+        if (finalFds < 0) {
+            if (failures.empty()) {
+                fail("server process " + std::to_string(options.pid) + " is gone");
+            }
+        }
+        else if (finalFds > idleFds + static_cast<int>(options.maxFdGrowth)) {
+            fail("fd leak: " + std::to_string(finalFds) + " fds after the load, idle " + std::to_string(idleFds));
+        }
+    }
+    // A run shorter than one cycle still compares the peak with the warmup level
+    if (cycle == 0 && rssWarmupKb != 0 && rssPeakKb > rssWarmupKb + options.maxRssGrowthMb * 1024 && failures.empty()) {
+        fail("RSS grew from " + std::to_string(rssWarmupKb / 1024) + " MB to " + std::to_string(rssPeakKb / 1024) + " MB");
+    }
+
+    double seconds = std::max<uint64_t>(nowUs() - startUs, 1) / 1000000.0;
+    std::cout << "=== Soak: " << seconds << " s, " << cycle << " full scenario cycles ===" << std::endl;
+    std::cout << "Messages: " << totalSent << " sent, " << totalReceived << " delivered ("
+        << static_cast<uint64_t>(totalReceived / seconds) << "/s)" << std::endl;
+    std::cout << "Connections: " << reconnects << " reconnects, " << dropped << " dropped, " << skipped
+        << " sends skipped" << std::endl;
+    std::cout << proxy.stats().describe() << std::endl;
+    if (idleFds >= 0) {
+        std::cout << "Server: fds " << idleFds << " idle -> " << finalFds << " after, RSS peak " << rssPeakKb / 1024
+            << " MB" << std::endl;
+    }
+    for (const char* request : { "memory", "latency" }) {
+        std::string reply = adminQuery(options.target, request);
+        if (!reply.empty() && reply.compare(0, 6, "error:") != 0) {
+            std::cout << "Server " << request << ": " << reply << std::endl;
+        }
+    }
+    std::cout << (failures.empty() ? "PASS" : "FAIL") << std::endl;
+    return failures.empty() ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    return options.mode == "proxy" ? runProxy(options) : runSoak(options);
+}